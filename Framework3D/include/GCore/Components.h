@@ -14,6 +14,11 @@ struct GOperandComponent {
 
     virtual GOperandComponentHandle copy(GOperandBase* operand) const = 0;
     virtual std::string to_string() const = 0;
+    // Memory held by the component's data, for profiling.
+    virtual size_t byte_size() const
+    {
+        return 0;
+    }
 
     virtual std::string name() const
     {
@@ -21,6 +26,8 @@ struct GOperandComponent {
     }
 
 
+    // The operand the component was created for. Copies of that operand share the component
+    // until they write to it, so this is not necessarily the operand it is read from.
     [[nodiscard]] GOperandBase* get_attached_operand() const
     {
         return attached_operand;
@@ -12,6 +12,7 @@ struct USTC_CG_API PointsComponent : public GOperandComponent {
     }
 
     std::string to_string() const override;
+    size_t byte_size() const override;
 
     pxr::VtArray<pxr::GfVec3f> vertices;
     pxr::VtArray<float> width;
@@ -45,10 +45,18 @@ public:
     virtual void copy_to(GOperandBaseHandle handle);
 
     virtual std::string to_string() const;
+    // Memory held by the components. Shared components are counted in full by every operand.
+    size_t byte_size() const;
 
 
+    // Copies of an operand share their components. Reading through a const operand never copies
+    // anything; asking a non-const operand for a component it shares first gives it a copy of
+    // its own. That copy is shallow, the VtArrays inside are copied on write by USD, so only the
+    // arrays that are actually written get duplicated.
     template<typename OperandType>
-    std::shared_ptr<OperandType> get_component(size_t idx = 0) const;
+    std::shared_ptr<const OperandType> get_component(size_t idx = 0) const;
+    template<typename OperandType>
+    std::shared_ptr<OperandType> get_component(size_t idx = 0);
     void attach_component(const GOperandComponentHandle& component);
     void detach_component(const GOperandComponentHandle& component);
 
@@ -59,17 +67,23 @@ public:
     }
 
 protected:
+    template<typename OperandType>
+    int find_component(size_t idx) const;
+    // Replaces the component with a copy of its own if it may be shared.
+    void own_component(int i);
+
     std::vector<GOperandComponentHandle> components_;
+    // Whether each component may be shared with another operand. Marked on both sides of a copy.
+    mutable std::vector<bool> shared_;
 };
 
 template<typename OperandType>
-std::shared_ptr<OperandType> GOperandBase::get_component(size_t idx) const
+int GOperandBase::find_component(size_t idx) const
 {
     size_t counter = 0;
     for (int i = 0; i < components_.size(); ++i)
     {
-        auto ptr = std::dynamic_pointer_cast<OperandType>(components_[i]);
-        if (ptr)
+        if (std::dynamic_pointer_cast<OperandType>(components_[i]))
         {
             if (counter < idx)
             {
@@ -77,11 +91,34 @@ std::shared_ptr<OperandType> GOperandBase::get_component(size_t idx) const
             }
             else
             {
-                return ptr;
+                return i;
             }
         }
     }
-    return nullptr;
+    return -1;
+}
+
+template<typename OperandType>
+std::shared_ptr<const OperandType> GOperandBase::get_component(size_t idx) const
+{
+    int i = find_component<OperandType>(idx);
+    if (i < 0)
+    {
+        return nullptr;
+    }
+    return std::static_pointer_cast<const OperandType>(components_[i]);
+}
+
+template<typename OperandType>
+std::shared_ptr<OperandType> GOperandBase::get_component(size_t idx)
+{
+    int i = find_component<OperandType>(idx);
+    if (i < 0)
+    {
+        return nullptr;
+    }
+    own_component(i);
+    return std::static_pointer_cast<OperandType>(components_[i]);
 }
 
 
@@ -25,6 +25,7 @@ class NodeSystem {
     NodeTree* get_tree();
     NodeTreeExecutor* get_executor() const;
 
+    float cached_first_time_code();
     float cached_last_time_code();
     void set_required_time_code(float time_code_to_render);
 
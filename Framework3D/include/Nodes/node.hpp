@@ -23,12 +23,11 @@ struct NodeLink {
           EndPinID(endPinId)
     {
     }
-
-    void Serialize(nlohmann::json& value);
 };
 
 
 using ExecFunction = void (*)(ExeParams params);
+using DemandFunction = void (*)(DemandParams& params);
 using NodeDeclareFunction = void (*)(NodeDeclarationBuilder& builder);
 
 enum class NodeTypeOfGrpah { Geometry, Function, Render, Composition };
@@ -46,6 +45,15 @@ struct NodeTypeInfo {
     NodeDeclareFunction declare;
     ExecFunction node_execute;
     bool ALWAYS_REQUIRED = false;
+    // The node can't run concurrently with other nodes (GL calls, writes to the global stage).
+    // ParallelNodeTreeExecutor keeps such nodes on the thread that executes the tree.
+    bool THREAD_UNSAFE = false;
+    // The outputs can't be reused between executions even when the inputs are unchanged, e.g. a
+    // solver object that the downstream nodes keep stepping.
+    bool NO_CACHE = false;
+    // Optional. Tells the executors which inputs the execution will actually read, e.g. only the
+    // selected branch of a switch. Without it, every input is evaluated.
+    DemandFunction demand_inputs = nullptr;
 
     std::unique_ptr<NodeDeclaration> static_declaration;
 };
@@ -66,6 +74,9 @@ struct Node {
 
     bool REQUIRED = false;
     bool MISSING_INPUT = false;
+    // Set when the node or something upstream was edited. A dirty node always runs again instead
+    // of reusing the outputs the executor cached for it.
+    bool dirty = true;
     std::string execution_failed = {};
 
     std::function<void()> override_left_pane_info = nullptr;
@@ -81,8 +92,6 @@ struct Node {
         Size[0] = 0;
         Size[1] = 0;
     }
-
-    void Serialize(nlohmann::json& value);
 };
 
 void nodeRegisterType(NodeTypeInfo* type_info);
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <cassert>
+#include <functional>
+#include <memory>
 #include <vector>
 
 #include "USTC_CG.h"
@@ -11,6 +13,7 @@ USTC_CG_NAMESPACE_OPEN_SCOPE
 struct NodeSocket;
 struct Node;
 struct NodeTree;
+class NodeProfiler;
 
 struct ExeParams {
     const Node& node_;
@@ -53,6 +56,41 @@ struct ExeParams {
     std::vector<GMutablePointer> outputs_;
 };
 
+// What a node type's demand_inputs sees before the node executes. Reading an input evaluates
+// whatever it is linked to first; need_input only asks for the input to be evaluated before the
+// node executes. Inputs that are neither are never evaluated. It may be asked more than once, so
+// it should only look at its inputs.
+struct DemandParams {
+    const Node& node_;
+
+    template<typename T>
+    T get_input(const char* identifier)
+    {
+        const int index = this->get_input_index(identifier);
+        needed_[index] = true;
+        GMutablePointer value = pull_(index);
+        if (!value.get()) {
+            return T();
+        }
+        return *static_cast<T*>(value.get());
+    }
+
+    void need_input(const char* identifier)
+    {
+        needed_[this->get_input_index(identifier)] = true;
+    }
+
+   private:
+    DemandParams(const Node& node, std::function<GMutablePointer(int)> pull);
+    int get_input_index(const char* identifier) const;
+
+    friend class EagerNodeTreeExecutor;
+
+    std::vector<bool> needed_;
+    // Evaluates the input at this index, and returns its value (null when there is none).
+    std::function<GMutablePointer(int)> pull_;
+};
+
 // This executes a tree. The execution strategy is left to its children.
 struct NodeTreeExecutor {
     virtual ~NodeTreeExecutor() = default;
@@ -68,11 +106,24 @@ struct NodeTreeExecutor {
     virtual void sync_node_to_external_storage(NodeSocket* socket, void* data)
     {
     }
+    // False if the tree prepared last doesn't run the socket. Executors that can't tell say true.
+    virtual bool is_socket_executed(NodeSocket* socket)
+    {
+        return true;
+    }
+    // Exchanges what one execution leaves to the next, such as a simulation's storage, with
+    // `state`. A null state is a fresh one. Executors that keep nothing leave it as it is.
+    virtual void swap_persistent_state(std::shared_ptr<void>& state)
+    {
+    }
     void execute(NodeTree* tree)
     {
         prepare_tree(tree);
         execute_tree(tree);
     }
+
+    // When set, every node execution is timed and reported to it. Not owned.
+    NodeProfiler* profiler = nullptr;
 };
 
 USTC_CG_NAMESPACE_CLOSE_SCOPE
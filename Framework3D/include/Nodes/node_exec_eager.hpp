@@ -1,5 +1,8 @@
 #pragma once
+#include <cstddef>
 #include <map>
+#include <set>
+#include <unordered_map>
 #include <vector>
 
 #include "USTC_CG.h"
@@ -22,11 +25,44 @@ struct RuntimeOutputState {
     bool is_last_used = false;
 };
 
+// One block of memory for all the runtime values of an execution. The values are laid out with
+// add() after compiling, then placed with commit(). The block is kept across executions and only
+// reallocated when a tree needs more room than any before it.
+class RuntimeArena {
+   public:
+    RuntimeArena() = default;
+    RuntimeArena(const RuntimeArena&) = delete;
+    RuntimeArena& operator=(const RuntimeArena&) = delete;
+    ~RuntimeArena();
+
+    // Reserves a slot for a value of this type, and returns its offset.
+    size_t add(const CPPType& type);
+    void commit();
+    void* at(size_t offset) const
+    {
+        return data_ + offset;
+    }
+    // Forgets the layout. Whatever lived in the slots must have been destructed.
+    void reset();
+
+   private:
+    std::byte* data_ = nullptr;
+    size_t capacity_ = 0;
+    size_t capacity_alignment_ = alignof(std::max_align_t);
+    size_t size_ = 0;
+    size_t alignment_ = alignof(std::max_align_t);
+};
+
 // Provide single threaded execution. The aim of this executor is simplicity and
 // robustness.
+//
+// Outputs are kept between executions, keyed by a hash of the node's inputs. A linked input
+// contributes the hash of the output it comes from, so a node is only run again when something
+// upstream actually changed (or it was marked dirty).
 
 class EagerNodeTreeExecutor : public NodeTreeExecutor {
    public:
+    ~EagerNodeTreeExecutor() override;
     void compile(NodeTree* tree);
     void prepare_memory();
     void prepare_tree(NodeTree* tree) override;
@@ -34,20 +70,89 @@ class EagerNodeTreeExecutor : public NodeTreeExecutor {
     GMutablePointer FindPtr(NodeSocket* socket);
     void sync_node_from_external_storage(NodeSocket* socket, void* data) override;
     void sync_node_to_external_storage(NodeSocket* socket, void* data) override;
+    bool is_socket_executed(NodeSocket* socket) override
+    {
+        return runtime_index(socket) >= 0;
+    }
 
    protected:
     virtual ExeParams prepare_params(NodeTree* tree, Node* node);
+    // An input that isn't required may stay unfilled without the node missing an input. Those
+    // are the inputs a demand_inputs left out.
+    virtual bool is_input_required(NodeSocket* input)
+    {
+        return input_demanded.empty() || input_demanded[runtime_index(input)];
+    }
     virtual bool execute_node(NodeTree* tree, Node* node);
     void forward_output_to_input(Node* node);
     void clear();
 
+    // Slot of the socket in input_states or output_states, -1 when it isn't executed. For the
+    // sockets of the tree prepared last.
+    int runtime_index(const NodeSocket* socket) const
+    {
+        size_t id = socket->ID.Get();
+        return id < socket_slots.size() ? socket_slots[id] : -1;
+    }
+
+    // Runs the node, or restores its outputs from the cache, then forwards them.
+    void run_node(NodeTree* tree, Node* node);
+
+    // Finds the nodes the sinks need when the tree has nodes with demand_inputs. What a
+    // demand_inputs reads is run right away; the rest is left for execute_tree to run.
+    void resolve_demands(NodeTree* tree);
+    // Whether execute_tree still has to run the node.
+    bool is_pending(Node* node) const;
+    // Walks up from the sink, through the inputs each node needs. With run, the nodes are run
+    // on the way; without, only what a demand_inputs reads is.
+    void pull(NodeTree* tree, Node* sink, bool run);
+    // What the input holds now: the forwarded value, its default, or null.
+    GMutablePointer current_input_value(NodeSocket* input);
+    virtual bool is_cacheable(Node* node);
+
+    struct CachedOutputs {
+        uint64_t input_hash = 0;
+        std::vector<GMutablePointer> values;
+    };
+
+    bool compute_input_hash(Node* node, uint64_t& hash);
+    bool reuse_cached_outputs(Node* node, uint64_t input_hash);
+    void update_output_hashes(Node* node, const uint64_t* input_hash);
+    void store_cached_outputs(Node* node, uint64_t input_hash);
+    void clear_cached_outputs(CachedOutputs& cached);
+
     std::vector<RuntimeInputState> input_states;
     std::vector<RuntimeOutputState> output_states;
-    std::map<NodeSocket*, size_t> index_cache;
     std::vector<Node*> nodes_to_execute;
     std::vector<NodeSocket*> input_of_nodes_to_execute;
     std::vector<NodeSocket*> output_of_nodes_to_execute;
+    // Slots by socket ID, resolved once in compile. The IDs are small, unique in their tree. The
+    // executor's own, so that several executors can prepare the same tree.
+    std::vector<int> socket_slots;
     ptrdiff_t nodes_to_execute_count = 0;
+    // Some node to execute has demand_inputs.
+    bool has_demand_inputs = false;
+
+    enum class PullState : uint8_t { None, Demanded, Ran };
+    struct PullFrame {
+        Node* node;
+        bool run;
+    };
+    std::unordered_map<Node*, PullState> pull_states;
+    std::vector<PullFrame> pull_stack;
+    // By input slot. Empty when every input is read.
+    std::vector<bool> input_demanded;
+
+    // Holds all the input and output states, and what their 'Any' inputs point to.
+    RuntimeArena arena;
+    std::vector<GMutablePointer> any_input_targets;
+
+    // Hash of each output state's value, 0 when it can't be known.
+    std::vector<uint64_t> output_hashes;
+    // Written from outside the tree after prepare_tree, so not a function of their inputs.
+    std::set<Node*> externally_synced;
+    // Kept across prepare_tree.
+    std::map<Node*, CachedOutputs> output_cache;
 };
 
 std::unique_ptr<EagerNodeTreeExecutor> CreateEagerNodeTreeExecutorRender();
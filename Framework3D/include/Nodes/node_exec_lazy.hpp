@@ -0,0 +1,22 @@
+#pragma once
+
+#include "USTC_CG.h"
+#include "node_exec_eager.hpp"
+
+USTC_CG_NAMESPACE_OPEN_SCOPE
+
+// Pulls the tree from its sinks instead of running it front to back. A node only runs once a
+// node downstream asks for it, and a node type with demand_inputs only asks for the inputs it is
+// going to read: a switch evaluates the selected branch, and the other one never runs.
+//
+// Compiling and the memory layout are those of EagerNodeTreeExecutor, so the pruning of the
+// nodes no sink depends on, and the output cache, work the same way. The eager executors honor
+// demand_inputs too; this one differs in running every node in the order it is pulled.
+class LazyNodeTreeExecutor : public EagerNodeTreeExecutor {
+   public:
+    void execute_tree(NodeTree* tree) override;
+};
+
+std::unique_ptr<EagerNodeTreeExecutor> CreateLazyNodeTreeExecutor();
+
+USTC_CG_NAMESPACE_CLOSE_SCOPE
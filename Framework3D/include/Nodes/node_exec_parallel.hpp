@@ -0,0 +1,35 @@
+#pragma once
+#include <utility>
+#include <vector>
+
+#include "USTC_CG.h"
+#include "node_exec_eager.hpp"
+
+USTC_CG_NAMESPACE_OPEN_SCOPE
+struct Node;
+
+// Executes the independent branches of a tree concurrently. It compiles and prepares the tree
+// exactly like EagerNodeTreeExecutor; only execute_tree differs. Every node keeps a counter of
+// the upstream nodes it still waits for, and is handed to the work-stealing scheduler as soon as
+// it drops to zero.
+//
+// Nodes whose type is flagged THREAD_UNSAFE are never run on a worker. They are queued for the
+// thread that called execute_tree, which runs them one at a time while waiting for the rest of
+// the tree.
+class ParallelNodeTreeExecutor : public EagerNodeTreeExecutor {
+   public:
+    void prepare_tree(NodeTree* tree) override;
+    void execute_tree(NodeTree* tree) override;
+
+   protected:
+    // Run a and b in the same relative order as the serial executor would, on top of the
+    // dependencies given by the links. For data shared outside of the links, e.g. the simulation
+    // storage. Following the topological order means these can never introduce a cycle.
+    void keep_serial_order(Node* a, Node* b);
+
+    std::vector<std::pair<Node*, Node*>> serial_order_pairs;
+};
+
+std::unique_ptr<EagerNodeTreeExecutor> CreateParallelNodeTreeExecutor();
+
+USTC_CG_NAMESPACE_CLOSE_SCOPE
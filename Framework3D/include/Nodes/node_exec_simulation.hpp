@@ -0,0 +1,147 @@
+#pragma once
+#include <cstddef>
+#include <functional>
+#include <istream>
+#include <map>
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "USTC_CG.h"
+#include "node_exec_parallel.hpp"
+
+USTC_CG_NAMESPACE_OPEN_SCOPE
+
+// How a stored value is checkpointed. By default a checkpoint holds a copy of the value, which
+// is all a value type needs; copies of geometry share their components until written, so they
+// are cheap. A solver object stored by pointer is stepped in place, and a copy of the pointer
+// would follow it, so its type registers how to save the state a step changes and to put it back.
+struct CheckpointFunctions {
+    std::function<std::shared_ptr<void>(const void* value)> save;
+    // Optional. False when the value can't take the snapshot back, e.g. no solver has been
+    // created yet. A checkpoint is only restored once every one of its values can take it.
+    std::function<bool(const void* snapshot, const void* value)> can_restore;
+    std::function<void(const void* snapshot, void* value)> restore;
+    std::function<size_t(const void* snapshot)> byte_size;
+    // Optional. A checkpoint is only spilled to disk if all its snapshots can be written; values
+    // of trivial types are written as they are.
+    std::function<void(const void* snapshot, std::ostream& out)> write;
+    std::function<std::shared_ptr<void>(std::istream& in)> read;
+};
+
+void register_checkpoint_type(const CPPType& type, CheckpointFunctions functions);
+
+// For CheckpointFunctions::write and read: a trivial value, and a dense Eigen matrix or anything
+// else with rows(), cols(), data() and resize().
+template<typename T>
+void write_checkpoint_value(std::ostream& out, const T& value)
+{
+    out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template<typename T>
+void read_checkpoint_value(std::istream& in, T& value)
+{
+    in.read(reinterpret_cast<char*>(&value), sizeof(T));
+}
+
+template<typename Matrix>
+void write_checkpoint_matrix(std::ostream& out, const Matrix& matrix)
+{
+    write_checkpoint_value(out, int64_t(matrix.rows()));
+    write_checkpoint_value(out, int64_t(matrix.cols()));
+    out.write(
+        reinterpret_cast<const char*>(matrix.data()),
+        matrix.size() * sizeof(typename Matrix::Scalar));
+}
+
+template<typename Matrix>
+void read_checkpoint_matrix(std::istream& in, Matrix& matrix)
+{
+    int64_t rows = 0, cols = 0;
+    read_checkpoint_value(in, rows);
+    read_checkpoint_value(in, cols);
+    if (!in || rows < 0 || cols < 0) {
+        in.setstate(std::ios::failbit);
+        return;
+    }
+    matrix.resize(rows, cols);
+    in.read(
+        reinterpret_cast<char*>(matrix.data()), matrix.size() * sizeof(typename Matrix::Scalar));
+}
+
+// How a geometry tree's time code goes from one execution to the next, the same in the editor and
+// in graph_runner. The first execution is at 0 and the next just past it; from there on, each
+// execution moves the time code on by what the tree gave its geom_time_gain, in seconds.
+//
+// Gives the tree's geom_time_code node the time code. Between prepare_tree and execute_tree.
+void sync_time_code(NodeTreeExecutor* executor, NodeTree* tree, float time_code);
+// What the tree gave its geom_time_gain node, after execute_tree. None when the tree has none
+// running, i.e. it isn't a simulation.
+std::optional<float> fetch_time_gain(NodeTreeExecutor* executor, NodeTree* tree);
+float next_simulation_time_code(float time_code, float time_gain);
+
+// Runs in parallel; the storage nodes are the only ones sharing data outside of the links, and are
+// kept in their serial order.
+//
+// The storage can be checkpointed by time code, and set back to a checkpoint. The checkpoints
+// stay under checkpoint_budget bytes of memory: past it, the ones closest to their neighbors are
+// spilled to checkpoint_directory, or dropped when there is none, so that what is left stays
+// spread over the timeline. The newest checkpoint always stays in memory.
+class EagerNodeTreeExecutorSimulation : public ParallelNodeTreeExecutor {
+   public:
+    void prepare_tree(NodeTree* node_tree) override;
+    void execute_tree(NodeTree* tree) override;
+    // The state is the storage. The checkpoints stay with the executor.
+    void swap_persistent_state(std::shared_ptr<void>& state) override;
+    ~EagerNodeTreeExecutorSimulation();
+
+    // A checkpoint of the storage as it is, for the execution at this time code.
+    void save_checkpoint(float time_code);
+    // Sets the storage back to the latest checkpoint at or before the time code, and returns its
+    // time code. Nothing is changed if there is none, or if the storage no longer matches it.
+    std::optional<float> restore_checkpoint(float time_code);
+    void clear_checkpoints();
+
+    size_t checkpoint_count() const
+    {
+        return checkpoints.size();
+    }
+    size_t checkpoint_bytes() const
+    {
+        return checkpoint_memory;
+    }
+
+    size_t checkpoint_budget = size_t(1) << 30;
+    // Empty for no spilling. Spilled files are removed with their checkpoints.
+    std::string checkpoint_directory;
+
+   protected:
+    bool execute_node(NodeTree* tree, Node* node) override;
+
+    struct Snapshot {
+        std::string name;
+        const CPPType* type;
+        std::shared_ptr<void> value;
+    };
+    struct Checkpoint {
+        std::vector<Snapshot> snapshots;
+        size_t bytes = 0;
+        // Set once spilled, and the snapshots are released.
+        std::string file;
+    };
+
+    void drop(std::map<float, Checkpoint>::iterator checkpoint);
+    void enforce_checkpoint_budget();
+    bool spill(Checkpoint& checkpoint);
+    std::optional<std::vector<Snapshot>> load(const Checkpoint& checkpoint);
+
+    std::map<std::string, GMutablePointer> storage;
+    std::map<float, Checkpoint> checkpoints;
+    size_t checkpoint_memory = 0;
+    unsigned spilled_files = 0;
+};
+
+USTC_CG_NAMESPACE_CLOSE_SCOPE
@@ -0,0 +1,68 @@
+#pragma once
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include <variant>
+#include <vector>
+
+#include "USTC_CG.h"
+#include "node_exec.hpp"
+
+USTC_CG_NAMESPACE_OPEN_SCOPE
+struct NodeSocket;
+struct NodeTree;
+
+// A value for the default of an unlinked Int, Float or String input. Numbers convert between
+// int and float.
+struct SocketOverride {
+    NodeSocket* socket;
+    std::variant<int, float, std::string> value;
+};
+
+struct WedgeVariant {
+    std::string name;
+    std::vector<SocketOverride> overrides;
+};
+
+struct WedgeResult {
+    // Index of the variant whose execution produced this result. Its own index, unless an
+    // earlier variant had the same effective inputs.
+    size_t same_as;
+    double ms = 0;
+    bool failed = false;
+};
+
+// What each variant's executions leave to its next one, e.g. the storage of a simulation, kept
+// from one call of execute_wedge to the next to run the variants over several frames.
+struct WedgeState {
+    std::vector<std::shared_ptr<void>> variants;
+};
+
+// Runs the tree once for each variant, with its overrides applied over the tree's own values.
+//
+// Variants run one after the other, as the nodes write to the shared stage; each execution is as
+// parallel as the executor makes it. Nothing is recomputed that the overrides don't reach: with
+// an executor derived from EagerNodeTreeExecutor, the nodes no overridden socket feeds into keep
+// the input hash they had for the first variant, so they run for it and are restored from the
+// output cache afterwards. Variants that end up with the same effective values (the same
+// numbers, or overrides on inputs that are linked or don't reach a sink) aren't executed again,
+// unless the executor keeps state between executions: a variant skipped once would fall behind.
+//
+// Each variant executes on its own persistent state (see swap_persistent_state), taken from and
+// left in `state`; the executor's own is put back after each. Without a state, every variant
+// starts fresh.
+//
+// before_execute is called between prepare_tree and execute_tree, to sync external storage as
+// for a single execution. after_execute is called once the variant has executed, e.g. to export
+// what the tree wrote; a deduplicated variant has no execution of its own. The tree's own values
+// are restored at the end.
+std::vector<WedgeResult> execute_wedge(
+    NodeTreeExecutor* executor,
+    NodeTree* tree,
+    const std::vector<WedgeVariant>& variants,
+    const std::function<void(size_t variant)>& before_execute = {},
+    const std::function<void(size_t variant)>& after_execute = {},
+    WedgeState* state = nullptr);
+
+USTC_CG_NAMESPACE_CLOSE_SCOPE
@@ -0,0 +1,83 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "USTC_CG.h"
+
+USTC_CG_NAMESPACE_OPEN_SCOPE
+struct Node;
+
+struct NodeProfile {
+    static constexpr size_t kHistorySize = 64;
+
+    uintptr_t node_id = 0;
+    std::string ui_name;
+    std::string type_name;
+    size_t call_count = 0;
+    double last_ms = 0;
+    double total_ms = 0;
+    double max_ms = 0;
+    size_t output_bytes = 0;
+    // The last kHistorySize timings, oldest first from history_head.
+    std::array<float, kHistorySize> history{};
+    size_t history_head = 0;
+
+    double average_ms() const
+    {
+        return call_count ? total_ms / call_count : 0;
+    }
+};
+
+// Records how long each node_execute takes, how often it runs and how much its outputs hold.
+// Executors report to it from any thread; the UI reads copies of the profiles.
+class NodeProfiler {
+   public:
+    using Clock = std::chrono::steady_clock;
+
+    NodeProfiler();
+
+    void record(
+        const Node* node,
+        Clock::time_point start,
+        Clock::time_point end,
+        size_t output_bytes);
+
+    // Copies, so that the caller doesn't race with the executor.
+    bool get_profile(const Node* node, NodeProfile& profile) const;
+    std::vector<NodeProfile> get_profiles() const;
+    // Largest last_ms over the recorded nodes, to scale the heat colors with.
+    double max_last_ms() const;
+
+    void clear();
+
+    // Writes the recorded executions in the Chrome trace event format, for chrome://tracing or
+    // Perfetto.
+    bool export_chrome_trace(const std::string& path) const;
+
+    // Set by the UI while executors record from their own threads.
+    std::atomic<bool> enabled = true;
+
+   private:
+    struct TraceEvent {
+        std::string name;
+        std::string type_name;
+        int64_t start_us;
+        int64_t duration_us;
+        size_t thread;
+    };
+    static constexpr size_t kMaxTraceEvents = 100000;
+
+    mutable std::mutex mutex_;
+    std::unordered_map<uintptr_t, NodeProfile> profiles_;
+    std::deque<TraceEvent> trace_;
+    Clock::time_point origin_;
+};
+
+USTC_CG_NAMESPACE_CLOSE_SCOPE
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <memory>
+#include <string_view>
 #include <vector>
 
 #include "USTC_CG.h"
@@ -12,6 +13,7 @@ struct NodeTypeInfo;
 class SocketDeclaration;
 struct Node;
 struct NodeSocket;
+struct SerializedTree;
 
 class NodeTree {
    public:
@@ -87,6 +89,12 @@ class NodeTree {
         std::vector<NodeSocket*>& new_sockets);
     void refresh_node(Node* node);
 
+    // nodeAddLink without the topology update, for adding many links at once.
+    NodeLink* add_link(Node* fromnode, NodeSocket* fromsock, Node* tonode, NodeSocket* tosock);
+
+    void describe(SerializedTree& tree) const;
+    void build_from(const SerializedTree& tree);
+
     // There is definitely better solution. However this is the most
     std::unordered_set<unsigned> used_ids;
 
@@ -96,6 +104,12 @@ class NodeTree {
     std::string Serialize();
     void Deserialize(const std::string& str);
 
+    // Compact form of the same content, for large trees and caches. The data is only read, so it
+    // can come straight from a memory-mapped file; a truncated one throws std::runtime_error.
+    std::string SerializeBinary();
+    void DeserializeBinary(std::string_view data);
+    static bool IsBinary(std::string_view data);
+
     void SetDirty(bool dirty = true)
     {
         this->dirty = dirty;
@@ -105,6 +119,9 @@ class NodeTree {
         return dirty;
     }
 
+    // Marks the node and everything downstream of it dirty, and the tree as a whole.
+    void MarkNodeDirty(Node* node);
+
    private:
     bool dirty = true;
 };
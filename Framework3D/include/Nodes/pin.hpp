@@ -54,10 +54,6 @@ struct NodeSocket {
     {
     }
 
-    void Serialize(nlohmann::json& value);
-    void DeserializeInfo(nlohmann::json& value);
-    void DeserializeValue(const nlohmann::json& value);
-
     /** Utility to access the value of the socket. */
     template<typename T>
     T* default_value_typed();
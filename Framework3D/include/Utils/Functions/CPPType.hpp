@@ -6,6 +6,7 @@
 
 #include "USTC_CG.h"
 #include "memory_utils.hh"
+#include "pxr/base/tf/hash.h"
 #include "mixins.hpp"
 #include "utildefines.h"
 
@@ -21,10 +22,11 @@ enum class CPPTypeFlags {
     None = 0,
     Printable = 1 << 0,
     EqualityComparable = 1 << 1,
+    Hashable = 1 << 2,
 
-    BasicType = Printable | EqualityComparable,
+    BasicType = Printable | EqualityComparable | Hashable,
 };
-ENUM_OPERATORS(CPPTypeFlags, CPPTypeFlags::EqualityComparable)
+ENUM_OPERATORS(CPPTypeFlags, CPPTypeFlags::Hashable)
 
 /**
  * A struct that allows passing in a type as a function parameter.
@@ -71,6 +73,8 @@ class CPPType : NonCopyable, NonMovable {
 
     void (*print_)(const void *value, std::stringstream &ss) = nullptr;
     bool (*is_equal_)(const void *a, const void *b) = nullptr;
+    uint64_t (*hash_)(const void *value) = nullptr;
+    int64_t (*byte_size_)(const void *value) = nullptr;
 
     const void *default_value_ = nullptr;
     std::string debug_name_;
@@ -199,6 +203,11 @@ class CPPType : NonCopyable, NonMovable {
         return is_equal_ != nullptr;
     }
 
+    bool is_hashable() const
+    {
+        return hash_ != nullptr;
+    }
+
     /**
      * Returns true, when the type has the following functions:
      * - Default constructor.
@@ -400,6 +409,23 @@ class CPPType : NonCopyable, NonMovable {
         return false;
     }
 
+    uint64_t hash(const void *value) const
+    {
+        assert(this->pointer_can_point_to_instance(value));
+        return hash_(value);
+    }
+
+    /**
+     * Approximate memory held by the value: its byte_size() when it has one,
+     * otherwise its own size plus the elements when it is a contiguous
+     * container (arrays, vectors, strings).
+     */
+    int64_t byte_size(const void *value) const
+    {
+        assert(this->pointer_can_point_to_instance(value));
+        return byte_size_(value);
+    }
+
     /**
      * Get a pointer to a constant value of this type. The specific value
      * depends on the type. It is usually a zero-initialized or default
@@ -528,6 +554,31 @@ bool is_equal_cb(const void *a, const void *b)
     return a_ == b_;
 }
 
+template<typename T>
+uint64_t hash_cb(const void *value)
+{
+    const T &value_ = *static_cast<const T *>(value);
+    return pxr::TfHash()(value_);
+}
+
+template<typename T>
+int64_t byte_size_cb(const void *value)
+{
+    const T &value_ = *static_cast<const T *>(value);
+    if constexpr (requires { value_.byte_size(); }) {
+        return int64_t(value_.byte_size());
+    }
+    else if constexpr (requires {
+                           typename T::value_type;
+                           value_.size();
+                           value_.data();
+                       }) {
+        return int64_t(sizeof(T) + value_.size() * sizeof(typename T::value_type));
+    }
+    else {
+        return int64_t(sizeof(T));
+    }
+}
 
 }  // namespace cpp_type_util
 
@@ -579,6 +630,10 @@ CPPType::CPPType(
     if constexpr ((bool)(Flags & CPPTypeFlags::EqualityComparable)) {
         is_equal_ = is_equal_cb<T>;
     }
+    if constexpr ((bool)(Flags & CPPTypeFlags::Hashable)) {
+        hash_ = hash_cb<T>;
+    }
+    byte_size_ = byte_size_cb<T>;
 
     alignment_mask_ = uintptr_t(alignment_) - uintptr_t(1);
     has_special_member_functions_ =
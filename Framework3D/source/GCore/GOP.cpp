@@ -16,9 +16,13 @@ GOperandBase::GOperandBase(GOperandBase&& operand) noexcept
 
 GOperandBase& GOperandBase::operator=(const GOperandBase& operand)
 {
-    for (auto&& operand_component : operand.components_) {
-        this->components_.push_back(operand_component->copy(this));
+    if (this == &operand) {
+        return *this;
     }
+    // Share the components; whichever side writes to one first gets its own copy.
+    components_ = operand.components_;
+    operand.shared_.assign(operand.components_.size(), true);
+    shared_ = operand.shared_;
 
     return *this;
 }
@@ -26,6 +30,9 @@ GOperandBase& GOperandBase::operator=(const GOperandBase& operand)
 GOperandBase& GOperandBase::operator=(GOperandBase&& operand) noexcept
 {
     this->components_ = std::move(operand.components_);
+    this->shared_ = std::move(operand.shared_);
+    operand.components_.clear();
+    operand.shared_.clear();
     //this->stage = operand.stage;
     //operand.stage.Reset();
 
@@ -54,6 +61,17 @@ std::string GOperandBase::to_string() const
     return out.str();
 }
 
+size_t GOperandBase::byte_size() const
+{
+    size_t size = sizeof(GOperandBase);
+    for (auto&& component : components_) {
+        if (component) {
+            size += component->byte_size();
+        }
+    }
+    return size;
+}
+
 void GOperandBase::attach_component(const GOperandComponentHandle& component)
 {
     if (component->get_attached_operand() != this) {
@@ -63,11 +81,21 @@ void GOperandBase::attach_component(const GOperandComponentHandle& component)
             Warning);
     }
     components_.push_back(component);
+    shared_.push_back(false);
+}
+
+void GOperandBase::own_component(int i)
+{
+    if (shared_[i]) {
+        components_[i] = components_[i]->copy(this);
+        shared_[i] = false;
+    }
 }
 
 void GOperandBase::detach_component(const GOperandComponentHandle& component)
 {
     auto iter = std::find(components_.begin(), components_.end(), component);
+    shared_.erase(shared_.begin() + (iter - components_.begin()));
     components_.erase(iter);
 }
 
@@ -15,6 +15,14 @@ std::string MeshComponent::to_string() const
     return out.str();
 }
 
+size_t MeshComponent::byte_size() const
+{
+    return vertices.size() * sizeof(pxr::GfVec3f) + faceVertexCounts.size() * sizeof(int) +
+           faceVertexIndices.size() * sizeof(int) + controlPoints.size() * sizeof(float) +
+           normals.size() * sizeof(pxr::GfVec3f) + texcoordsArray.size() * sizeof(pxr::GfVec2f) +
+           displayColor.size() * sizeof(pxr::GfVec3f);
+}
+
 GOperandComponentHandle MeshComponent::copy(GOperandBase* operand) const
 {
     auto ret = std::make_shared<MeshComponent>(operand);
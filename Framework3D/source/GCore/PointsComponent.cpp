@@ -15,6 +15,12 @@ std::string PointsComponent::to_string() const
     return out.str();
 }
 
+size_t PointsComponent::byte_size() const
+{
+    return vertices.size() * sizeof(pxr::GfVec3f) + width.size() * sizeof(float) +
+           displayColor.size() * sizeof(pxr::GfVec3f);
+}
+
 GOperandComponentHandle PointsComponent::copy(GOperandBase* operand) const
 {
     auto ret = std::make_shared<PointsComponent>(operand);
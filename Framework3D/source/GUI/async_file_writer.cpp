@@ -0,0 +1,75 @@
+#include "async_file_writer.h"
+
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+USTC_CG_NAMESPACE_OPEN_SCOPE
+
+AsyncFileWriter::~AsyncFileWriter()
+{
+    {
+        std::lock_guard lock(mutex_);
+        stopping_ = true;
+    }
+    cv_.notify_all();
+    if (worker_.joinable()) {
+        worker_.join();
+    }
+}
+
+void AsyncFileWriter::write(const std::string& path, std::string content)
+{
+    {
+        std::lock_guard lock(mutex_);
+        pending_[path] = std::move(content);
+        if (!worker_.joinable()) {
+            worker_ = std::thread(&AsyncFileWriter::run, this);
+        }
+    }
+    cv_.notify_all();
+}
+
+void AsyncFileWriter::flush()
+{
+    std::unique_lock lock(mutex_);
+    cv_.wait(lock, [this] { return pending_.empty() && !writing_; });
+}
+
+void AsyncFileWriter::run()
+{
+    std::unique_lock lock(mutex_);
+    while (true) {
+        cv_.wait(lock, [this] { return stopping_ || !pending_.empty(); });
+        // Pending files are still written when stopping.
+        if (pending_.empty()) {
+            return;
+        }
+
+        auto node = pending_.extract(pending_.begin());
+        writing_ = true;
+        lock.unlock();
+
+        // Through a temporary file, so that a crash mid-write leaves the previous save intact.
+        auto temp_path = node.key() + ".tmp";
+        bool written;
+        {
+            std::ofstream file(temp_path, std::ios::binary);
+            file << node.mapped();
+            written = bool(file);
+        }
+        std::error_code error;
+        if (written) {
+            std::filesystem::rename(temp_path, node.key(), error);
+        }
+        if (!written || error) {
+            std::cerr << "Failed to save " << node.key() << std::endl;
+        }
+
+        lock.lock();
+        writing_ = false;
+        cv_.notify_all();
+    }
+}
+
+USTC_CG_NAMESPACE_CLOSE_SCOPE
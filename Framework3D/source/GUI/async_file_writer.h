@@ -0,0 +1,37 @@
+#pragma once
+
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "USTC_CG.h"
+
+USTC_CG_NAMESPACE_OPEN_SCOPE
+
+// Writes files on a worker thread, so that saving doesn't stall the frame. Only the latest
+// content of each path is kept: saves that arrive while the disk is busy replace each other.
+class AsyncFileWriter {
+   public:
+    AsyncFileWriter() = default;
+    AsyncFileWriter(const AsyncFileWriter&) = delete;
+    AsyncFileWriter& operator=(const AsyncFileWriter&) = delete;
+    ~AsyncFileWriter();
+
+    void write(const std::string& path, std::string content);
+    // Blocks until everything written so far is on disk.
+    void flush();
+
+   private:
+    void run();
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::map<std::string, std::string> pending_;
+    bool writing_ = false;
+    bool stopping_ = false;
+    std::thread worker_;
+};
+
+USTC_CG_NAMESPACE_CLOSE_SCOPE
@@ -2,8 +2,12 @@
 
 #include <imgui_internal.h>
 
+#include <algorithm>
+
 #include "Nodes/GlobalUsdStage.h"
 #include "Nodes/node_exec_eager.hpp"
+#include "Nodes/node_exec_lazy.hpp"
+#include "Nodes/node_exec_simulation.hpp"
 #include "Nodes/node_register.h"
 #include "Nodes/node_tree.hpp"
 #include "imgui/imgui-node-editor/imgui_node_editor.h"
@@ -17,6 +21,11 @@ float NodeSystemExecution::cached_last_frame() const
     return std::numeric_limits<float>::max();
 }
 
+float NodeSystemExecution::cached_first_frame() const
+{
+    return std::numeric_limits<float>::lowest();
+}
+
 NodeSystemExecution::NodeSystemExecution()
 {
     static std::once_flag register_flag;
@@ -162,13 +171,41 @@ float GeoNodeSystemExecution::cached_last_frame() const
     return cached_last_frame_;
 }
 
+float GeoNodeSystemExecution::cached_first_frame() const
+{
+    return cached_first_frame_;
+}
+
 void GeoNodeSystemExecution::MarkDirty()
 {
-    // It is marked dirty from outside, which means the cache is all outdated.
+    // It is marked dirty from outside, which means the simulated frames are all outdated. Nodes
+    // untouched by the change still come from the executor's cache.
+    mark_outdated(true);
+}
+
+void GeoNodeSystemExecution::MarkNodeDirty(Node* node)
+{
+    node_tree->MarkNodeDirty(node);
+    // Everything that goes into the stored state is upstream of a Storage In.
+    bool reaches_storage = std::any_of(
+        node_tree->nodes.begin(), node_tree->nodes.end(), [](auto&& other) {
+            return other->dirty && std::string(other->typeinfo->id_name) == "geom_storage_in";
+        });
+    bool simulating = cached_last_frame_ < std::numeric_limits<float>::max();
+    mark_outdated(reaches_storage || !simulating);
+}
+
+void GeoNodeSystemExecution::mark_outdated(bool simulation)
+{
     NodeSystemExecution::MarkDirty();
-    cached_last_frame_ = 0;
-    time_code_to_render_ = 0;
-    just_renewed = true;
+    if (simulation) {
+        simulation_outdated_ = true;
+        cached_last_frame_ = 0;
+        cached_first_frame_ = 0;
+        time_code_to_render_ = 0;
+        resume_frame_ = 0;
+        just_renewed = true;
+    }
 }
 
 void GeoNodeSystemExecution::set_required_time_code(float time_code_to_render)
@@ -183,56 +220,69 @@ void GeoNodeSystemExecution::set_required_time_code(float time_code_to_render)
 // This is NOT best practice.
 void GeoNodeSystemExecution::try_execution()
 {
+    auto simulation = static_cast<EagerNodeTreeExecutorSimulation*>(executor.get());
+    bool simulating =
+        cached_last_frame_ > 0 && cached_last_frame_ < std::numeric_limits<float>::max();
+
     if (required_execution) {
         auto& stage = GlobalUsdStage::global_usd_stage;
         stage->RemovePrim(pxr::SdfPath("/geom"));
         stage->RemovePrim(pxr::SdfPath("/TexModel"));
+        if (simulation_outdated_) {
+            simulation->clear_checkpoints();
+            next_checkpoint_ = 0;
+        }
     }
 
-    if (cached_last_frame_ < time_code_to_render_ || required_execution) {
-        executor->prepare_tree(node_tree.get());
-
-        for (auto&& node : node_tree->nodes) {
-            auto try_fill_info = [&node, this](const char* id_name, void* data) {
-                if (std::string(node->typeinfo->id_name) == id_name) {
-                    assert(node->outputs.size() == 1);
-                    auto output_socket = node->outputs[0];
-                    executor->sync_node_from_external_storage(output_socket, data);
-                }
-            };
-            try_fill_info("geom_time_code", &cached_last_frame_);
+    // Where the simulation is set back to before this execution.
+    std::optional<float> rewind_to;
+    if (required_execution && !simulation_outdated_ && simulating) {
+        // Only what is made from the simulation changed. The stage is made again from the
+        // checkpoint before the newest frame, the earlier frames when they are asked for.
+        if (resume_frame_ > 0) {
+            cached_last_frame_ = resume_last_frame_;
+            resume_frame_ = 0;
         }
+        time_code_to_render_ = cached_last_frame_;
+        rewind_to = cached_last_frame_;
+    }
+    else if (!required_execution && simulating && time_code_to_render_ < cached_first_frame_) {
+        // Scrubbed back before the frames on the stage: they are filled in from the checkpoint
+        // before, up to the ones on the stage, and the simulation goes back to the newest frame.
+        if (resume_frame_ == 0) {
+            simulation->save_checkpoint(cached_last_frame_);
+            resume_frame_ = cached_first_frame_;
+            resume_last_frame_ = cached_last_frame_;
+        }
+        rewind_to = time_code_to_render_;
+    }
 
-        executor->execute_tree(node_tree.get());
+    if (cached_last_frame_ < time_code_to_render_ || resume_frame_ > 0 || required_execution ||
+        rewind_to) {
+        executor->prepare_tree(node_tree.get());
 
-        float time_advected = 0;
+        if (rewind_to) {
+            // Without a checkpoint, the simulation starts over.
+            cached_last_frame_ = simulation->restore_checkpoint(*rewind_to).value_or(0);
+            cached_first_frame_ = cached_last_frame_;
+            next_checkpoint_ = cached_last_frame_ + checkpoint_interval;
+        }
 
-        bool has_time_advection = false;
+        sync_time_code(executor.get(), node_tree.get(), cached_last_frame_);
 
-        for (auto&& node : node_tree->nodes) {
-            auto try_fetch_info = [&node, this](const char* id_name, void* data) {
-                if (std::string(node->typeinfo->id_name) == id_name) {
-                    assert(node->inputs.size() == 1);
-                    auto output_socket = node->inputs[0];
-                    executor->sync_node_to_external_storage(output_socket, data);
-                    return true;
-                }
-                return false;
-            };
+        executor->execute_tree(node_tree.get());
 
-            if (try_fetch_info("geom_time_gain", &time_advected)) {
-                has_time_advection = true;
-                break;
+        if (auto time_gain = fetch_time_gain(executor.get(), node_tree.get())) {
+            bool first_frame = cached_last_frame_ == 0;
+            cached_last_frame_ = next_simulation_time_code(cached_last_frame_, *time_gain);
+            if (first_frame) {
+                time_code_to_render_ = cached_last_frame_;  // Avoid repeated running
             }
-        }
 
-        if (has_time_advection) {
-            if (cached_last_frame_ == 0) {  // Means this is the first frame.
-                cached_last_frame_ = std::numeric_limits<float>::epsilon();
-                time_code_to_render_ = cached_last_frame_;  // Avoid repeated running
+            if (cached_last_frame_ >= next_checkpoint_) {
+                simulation->save_checkpoint(cached_last_frame_);
+                next_checkpoint_ = cached_last_frame_ + checkpoint_interval;
             }
-            else
-                cached_last_frame_ += time_advected * GlobalUsdStage::timeCodesPerSecond;
         }
         else {
             cached_last_frame_ = std::numeric_limits<float>::max();
@@ -240,7 +290,17 @@ void GeoNodeSystemExecution::try_execution()
 
         executor->finalize(node_tree.get());
 
+        if (resume_frame_ > 0 && cached_last_frame_ >= resume_frame_) {
+            // The frames from here on are on the stage already.
+            if (auto restored = simulation->restore_checkpoint(resume_last_frame_)) {
+                cached_last_frame_ = *restored;
+                next_checkpoint_ = cached_last_frame_ + checkpoint_interval;
+            }
+            resume_frame_ = 0;
+        }
+
         required_execution = false;
+        simulation_outdated_ = false;
     }
 }
 
@@ -302,7 +362,7 @@ Node* RenderNodeSystemExecution::create_node_menu()
 CompositionNodeSystemExecution::CompositionNodeSystemExecution()
 {
     NodeSystemExecution();
-    executor = std::make_unique<EagerNodeTreeExecutor>();
+    executor = CreateLazyNodeTreeExecutor();
 }
 
 void CompositionNodeSystemExecution::try_execution()
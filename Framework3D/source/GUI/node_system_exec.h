@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Nodes/node.hpp"
+#include "Nodes/node_profiler.hpp"
 #include "Nodes/node_tree.hpp"
 #include "USTC_CG.h"
 
@@ -9,6 +10,8 @@ class NodeSystemExecution {
    public:
     virtual ~NodeSystemExecution() = default;
     virtual float cached_last_frame() const;
+    // The frames from cached_first_frame() to cached_last_frame() are ready to show.
+    virtual float cached_first_frame() const;
     virtual void set_required_time_code(float time_code_to_render)
     {
     }
@@ -38,6 +41,14 @@ class NodeSystemExecution {
         required_execution = true;
     }
 
+    // Only the node and what is downstream of it have to run again; the executor serves the rest
+    // from its cache.
+    virtual void MarkNodeDirty(Node* node)
+    {
+        node_tree->MarkNodeDirty(node);
+        MarkDirty();
+    }
+
     void RemoveLink(LinkId linkId);
 
     bool IsPinLinked(SocketID id)
@@ -62,6 +73,7 @@ class NodeSystemExecution {
 
     std::unique_ptr<NodeTree> node_tree;
     std::unique_ptr<NodeTreeExecutor> executor;
+    NodeProfiler profiler;
 
     bool CanCreateLink(NodeSocket* a, NodeSocket* b);
 
@@ -76,18 +88,35 @@ struct GeoNodeSystemExecution : public NodeSystemExecution {
     GeoNodeSystemExecution();
 
     float cached_last_frame() const override;
+    float cached_first_frame() const override;
 
     void MarkDirty() override;
+    // A change that doesn't reach any Storage In leaves the simulation as it was; the frames are
+    // made again from its checkpoints instead of from the start.
+    void MarkNodeDirty(Node* node) override;
 
     void set_required_time_code(float time_code_to_render) override;
 
     void try_execution() override;
     Node* create_node_menu() override;
 
+    // Frames between two checkpoints of the simulation.
+    float checkpoint_interval = 10;
+
    private:
+    void mark_outdated(bool simulation);
+
     float cached_last_frame_ = 0;
+    float cached_first_frame_ = 0;
     float time_code_to_render_ = 0;
     bool just_renewed = true;
+    // Whether the pending execution has to start the simulation over.
+    bool simulation_outdated_ = true;
+    float next_checkpoint_ = 0;
+    // While the frames before cached_first_frame_ are filled in: the first frame that was on the
+    // stage, and the newest frame, where the simulation goes on from once they are.
+    float resume_frame_ = 0;
+    float resume_last_frame_ = 0;
 };
 
 struct RenderNodeSystemExecution : public NodeSystemExecution {
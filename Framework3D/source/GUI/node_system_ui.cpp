@@ -6,6 +6,7 @@
 #include <string>
 
 #include "GUI/node_system.h"
+#include "async_file_writer.h"
 #include "imgui.h"
 #include "imgui/blueprint-utilities/builders.h"
 #include "imgui/blueprint-utilities/images.inl"
@@ -16,6 +17,8 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include <Utils/Math/string_hash.h>
 
+#include <algorithm>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
 
@@ -107,9 +110,11 @@ struct NodeSystemImpl {
     void OnFrame(float deltaTime);
 
     void ShowLeftPane(float paneWidth);
+    void ShowProfiler();
 
    protected:
     static void DrawPinIcon(const NodeSocket& pin, bool connected, int alpha);
+    static void DrawProfileBadge(const NodeProfile& profile, double max_ms);
 
    protected:
     size_t frame = 0;
@@ -128,6 +133,10 @@ struct NodeSystemImpl {
     std::string filename;
 
     bool link_changed = true;
+    bool show_profiler = false;
+
+    // The editor saves on every change; the file is written off the UI thread.
+    AsyncFileWriter autosave;
 
    private:
     ed::EditorContext* m_Editor = nullptr;
@@ -182,6 +191,8 @@ void NodeSystemImpl::OnStart()
     else if (node_system_type == NodeSystemType::Composition) {
         node_system_execution_ = std::make_unique<CompositionNodeSystemExecution>();
     }
+    node_system_execution_->profiler.enabled = show_profiler;
+    node_system_execution_->executor->profiler = &node_system_execution_->profiler;
 
     ed::Config config;
 
@@ -193,7 +204,6 @@ void NodeSystemImpl::OnStart()
                              void* userPointer) -> bool {
         auto ptr = static_cast<NodeSystemImpl*>(userPointer);
 
-        std::ofstream file(ptr->filename);
         auto node_serialize = ptr->node_system_execution_->Serialize();
 
         node_serialize.erase(node_serialize.end() - 1);
@@ -203,7 +213,7 @@ void NodeSystemImpl::OnStart()
 
         node_serialize += "," + ui_json + '}';
 
-        file << node_serialize;
+        ptr->autosave.write(ptr->filename, std::move(node_serialize));
         return true;
     };
 
@@ -255,6 +265,7 @@ void NodeSystemImpl::OnStop()
         ed::DestroyEditor(m_Editor);
         m_Editor = nullptr;
     }
+    autosave.flush();
 }
 
 bool NodeSystemImpl::draw_socket_controllers(NodeSocket* input)
@@ -311,6 +322,13 @@ void NodeSystemImpl::OnFrame(float deltaTime)
 
     if (ImGui::Button("Zoom to Content"))
         ed::NavigateToContent();
+    ImGui::SameLine();
+    if (ImGui::Checkbox("Profiler", &show_profiler)) {
+        node_system_execution_->profiler.enabled = show_profiler;
+    }
+    // Scales the badge colors, hottest node in red.
+    double max_profiled_ms = show_profiler ? node_system_execution_->profiler.max_last_ms() : 0;
+
     ed::Begin(("Node editor" + filename).c_str());
     {
         auto cursorTopLeft = ImGui::GetCursorScreenPos();
@@ -346,6 +364,12 @@ void NodeSystemImpl::OnFrame(float deltaTime)
                 if (!node->execution_failed.empty()) {
                     ImGui::TextUnformatted((": " + node->execution_failed).c_str());
                 }
+                NodeProfile profile;
+                if (show_profiler &&
+                    node_system_execution_->profiler.get_profile(node.get(), profile)) {
+                    ImGui::Spring(0);
+                    DrawProfileBadge(profile, max_profiled_ms);
+                }
                 ImGui::Spring(1);
                 ImGui::Dummy(ImVec2(0, 28));
                 ImGui::Spring(0);
@@ -371,7 +395,7 @@ void NodeSystemImpl::OnFrame(float deltaTime)
                 else {
                     ImGui::PushItemWidth(120.0f);
                     if (draw_socket_controllers(input))
-                        node_system_execution_->MarkDirty();
+                        node_system_execution_->MarkNodeDirty(node.get());
                     ImGui::PopItemWidth();
                     ImGui::Spring(0);
                 }
@@ -675,6 +699,138 @@ void NodeSystemImpl::OnFrame(float deltaTime)
     if (node_system_type != NodeSystemType::Render) {
         node_system_execution_->try_execution();
     }
+
+    if (show_profiler) {
+        ShowProfiler();
+    }
+}
+
+// Green for the fastest nodes, through yellow, to red for the slowest one.
+static ImColor HeatColor(double t)
+{
+    t = std::clamp(t, 0.0, 1.0);
+    float r = float(std::min(1.0, 2.0 * t));
+    float g = float(std::min(1.0, 2.0 * (1.0 - t)));
+    return ImColor(r, g, 0.1f, 0.85f);
+}
+
+void NodeSystemImpl::DrawProfileBadge(const NodeProfile& profile, double max_ms)
+{
+    char label[32];
+    snprintf(label, sizeof(label), "%.2f ms", profile.last_ms);
+
+    auto size = ImGui::CalcTextSize(label);
+    auto padding = ImVec2(4, 1);
+    auto position = ImGui::GetCursorScreenPos();
+    ImGui::GetWindowDrawList()->AddRectFilled(
+        position - padding,
+        position + size + padding,
+        HeatColor(max_ms > 0 ? profile.last_ms / max_ms : 0),
+        size.y * 0.25f);
+    ImGui::TextColored(ImVec4(0, 0, 0, 1), "%s", label);
+}
+
+void NodeSystemImpl::ShowProfiler()
+{
+    auto& profiler = node_system_execution_->profiler;
+
+    bool visible = ImGui::Begin(("Node Profiler##" + filename).c_str(), &show_profiler);
+    // Closing the window stops the recording as well.
+    profiler.enabled = show_profiler;
+    if (!visible) {
+        ImGui::End();
+        return;
+    }
+
+    if (ImGui::Button("Clear")) {
+        profiler.clear();
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Export Chrome Trace")) {
+        auto path = std::filesystem::path(filename).replace_extension(".trace.json").string();
+        if (profiler.export_chrome_trace(path)) {
+            logging("Node trace written to " + path, Info);
+        }
+        else {
+            logging("Failed to write the node trace to " + path, Error);
+        }
+    }
+
+    auto profiles = profiler.get_profiles();
+
+    ImGuiTableFlags flags = ImGuiTableFlags_Sortable | ImGuiTableFlags_SizingFixedFit |
+                            ImGuiTableFlags_RowBg | ImGuiTableFlags_Borders |
+                            ImGuiTableFlags_Resizable | ImGuiTableFlags_ScrollY;
+    if (ImGui::BeginTable("profile_table", 8, flags)) {
+        ImGui::TableSetupScrollFreeze(0, 1);
+        ImGui::TableSetupColumn("Node");
+        ImGui::TableSetupColumn("Type");
+        ImGui::TableSetupColumn("Calls");
+        ImGui::TableSetupColumn("Last (ms)", ImGuiTableColumnFlags_DefaultSort);
+        ImGui::TableSetupColumn("Average (ms)");
+        ImGui::TableSetupColumn("Max (ms)");
+        ImGui::TableSetupColumn("Output (KB)");
+        ImGui::TableSetupColumn("History", ImGuiTableColumnFlags_NoSort);
+        ImGui::TableHeadersRow();
+
+        if (auto specs = ImGui::TableGetSortSpecs(); specs && specs->SpecsCount > 0) {
+            auto column = specs->Specs[0].ColumnIndex;
+            bool ascending = specs->Specs[0].SortDirection == ImGuiSortDirection_Ascending;
+            auto key = [column](const NodeProfile& p) -> double {
+                switch (column) {
+                    case 2: return double(p.call_count);
+                    case 3: return p.last_ms;
+                    case 4: return p.average_ms();
+                    case 5: return p.max_ms;
+                    case 6: return double(p.output_bytes);
+                    default: return 0;
+                }
+            };
+            std::stable_sort(
+                profiles.begin(),
+                profiles.end(),
+                [&](const NodeProfile& a, const NodeProfile& b) {
+                    if (column == 0 || column == 1) {
+                        auto& a_name = column == 0 ? a.ui_name : a.type_name;
+                        auto& b_name = column == 0 ? b.ui_name : b.type_name;
+                        return ascending ? a_name < b_name : b_name < a_name;
+                    }
+                    return ascending ? key(a) < key(b) : key(b) < key(a);
+                });
+        }
+
+        for (auto&& profile : profiles) {
+            ImGui::TableNextRow();
+            ImGui::TableSetColumnIndex(0);
+            ImGui::TextUnformatted(profile.ui_name.c_str());
+            ImGui::TableSetColumnIndex(1);
+            ImGui::TextUnformatted(profile.type_name.c_str());
+            ImGui::TableSetColumnIndex(2);
+            ImGui::Text("%zu", profile.call_count);
+            ImGui::TableSetColumnIndex(3);
+            ImGui::Text("%.3f", profile.last_ms);
+            ImGui::TableSetColumnIndex(4);
+            ImGui::Text("%.3f", profile.average_ms());
+            ImGui::TableSetColumnIndex(5);
+            ImGui::Text("%.3f", profile.max_ms);
+            ImGui::TableSetColumnIndex(6);
+            ImGui::Text("%.1f", profile.output_bytes / 1024.0);
+            ImGui::TableSetColumnIndex(7);
+            ImGui::PushID(&profile);
+            ImGui::PlotLines(
+                "##history",
+                profile.history.data(),
+                int(NodeProfile::kHistorySize),
+                int(profile.history_head),
+                nullptr,
+                0.0f,
+                FLT_MAX,
+                ImVec2(120, ImGui::GetTextLineHeight()));
+            ImGui::PopID();
+        }
+        ImGui::EndTable();
+    }
+    ImGui::End();
 }
 
 ImTextureID NodeSystemImpl::LoadTexture(const unsigned char* data, size_t buffer_size)
@@ -826,6 +982,11 @@ NodeTreeExecutor* NodeSystem::get_executor() const
     return impl_->node_system_execution_->executor.get();
 }
 
+float NodeSystem::cached_first_time_code()
+{
+    return impl_->node_system_execution_->cached_first_frame();
+}
+
 float NodeSystem::cached_last_time_code()
 {
     return impl_->node_system_execution_->cached_last_frame();
@@ -127,6 +127,7 @@ void UsdviewEngineImpl::OnFrame(float delta_time, NodeTree* node_tree, NodeTreeE
     renderer_->SetRendererAov(HdAovTokens->color);
     renderer_->SetRendererSetting(TfToken("RenderNodeTree"), VtValue((void*)node_tree));
     renderer_->SetRendererSetting(TfToken("RenderNodeTreeExecutor"), VtValue((void*)executor));
+    renderer_->SetRendererSetting(TfToken("timeCode"), VtValue(timecode));
 
     _renderParams.enableLighting = true;
     _renderParams.enableSceneMaterials = true;
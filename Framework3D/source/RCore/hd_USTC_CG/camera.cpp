@@ -1,6 +1,7 @@
 #include "camera.h"
 
 #include "config.h"
+#include "renderParam.h"
 USTC_CG_NAMESPACE_OPEN_SCOPE
 using namespace pxr;
 void Hd_USTC_CG_Camera::Sync(
@@ -15,9 +16,14 @@ void Hd_USTC_CG_Camera::Sync(
 
     _inverseViewMatrix = GetTransform();
     _viewMatrix = _inverseViewMatrix.GetInverse();
+
+    auto param = static_cast<Hd_USTC_CG_RenderParam*>(renderParam);
+    if (!param->cameraPositionFromRender) {
+        param->cameraPosition = GfVec3f(_inverseViewMatrix.ExtractTranslation());
+    }
 }
 
-GfRay Hd_USTC_CG_Camera::generateRay(
+Ray Hd_USTC_CG_Camera::generateRay(
     GfVec2f pixel_center,
     const std::function<float()>& uniform_float) const
 {
@@ -63,7 +69,7 @@ GfRay Hd_USTC_CG_Camera::generateRay(
     // Transform camera rays to world space.
     origin = _inverseViewMatrix.Transform(origin);
     dir = _inverseViewMatrix.TransformDir(dir).GetNormalized();
-    return { origin, dir };
+    return Ray(origin, dir);
 }
 
 static GfRect2i _GetDataWindow(const HdRenderPassStateSharedPtr& renderPassState)
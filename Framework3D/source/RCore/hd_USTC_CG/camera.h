@@ -3,7 +3,7 @@
 
 #include "renderBuffer.h"
 #include "pxr/pxr.h"
-#include "pxr/base/gf/ray.h"
+#include "ray.h"
 #include "pxr/base/gf/rect2i.h"
 #include "pxr/imaging/hd/camera.h"
 #include "pxr/imaging/hdx/renderSetupTask.h"
@@ -21,7 +21,7 @@ public:
         HdSceneDelegate* sceneDelegate,
         HdRenderParam* renderParam,
         HdDirtyBits* dirtyBits) override;
-    virtual GfRay generateRay(
+    virtual Ray generateRay(
         GfVec2f pixel_center,
         const std::function<float()>& function) const;
 
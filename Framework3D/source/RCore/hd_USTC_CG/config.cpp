@@ -68,6 +68,36 @@ TF_DEFINE_ENV_SETTING(
     300,
     "Intensity of the camera light, specified as a percentage of <1,1,1>.");
 
+TF_DEFINE_ENV_SETTING(
+    HDEMBREE_PRETESSELLATE_SUBDIV,
+    0,
+    "Should Hd_USTC_CG_ tessellate subdivision surfaces with OpenSubdiv? (values > 0 are true)");
+
+TF_DEFINE_ENV_SETTING(
+    HDEMBREE_SUBDIV_EDGE_LENGTH,
+    4,
+    "Target tessellated edge length, in thousandths of the camera distance (must be >= 1)");
+
+TF_DEFINE_ENV_SETTING(
+    HDEMBREE_SUBDIV_MAX_LEVEL,
+    5,
+    "Maximum refine level of pre-tessellated subdivision surfaces (must be >= 1)");
+
+TF_DEFINE_ENV_SETTING(
+    HDEMBREE_MESH_CACHE_DIR,
+    "",
+    "Directory of the persistent mesh cache (empty disables the cache)");
+
+TF_DEFINE_ENV_SETTING(
+    HDEMBREE_DETERMINISTIC,
+    0,
+    "Should Hd_USTC_CG_ render reproducibly, independent of threading? (values > 0 are true)");
+
+TF_DEFINE_ENV_SETTING(
+    HDEMBREE_RANDOM_SEED,
+    0,
+    "Base seed of the deterministic mode (must be >= 0)");
+
 TF_DEFINE_ENV_SETTING(
     HDEMBREE_PRINT_CONFIGURATION,
     0,
@@ -91,6 +121,18 @@ Hd_USTC_CG_Config::Hd_USTC_CG_Config()
                                 100,
                                 TfGetEnvSetting(
                                     HDEMBREE_CAMERA_LIGHT_INTENSITY)) / 100.0f);
+    pretessellateSubdiv = (TfGetEnvSetting(HDEMBREE_PRETESSELLATE_SUBDIV) > 0);
+    subdivEdgeLengthRatio = std::max(
+        1,
+        TfGetEnvSetting(HDEMBREE_SUBDIV_EDGE_LENGTH)) / 1000.0f;
+    subdivMaxLevel = std::max(
+        1,
+        TfGetEnvSetting(HDEMBREE_SUBDIV_MAX_LEVEL));
+    meshCacheDirectory = TfGetEnvSetting(HDEMBREE_MESH_CACHE_DIR);
+    deterministic = (TfGetEnvSetting(HDEMBREE_DETERMINISTIC) > 0);
+    randomSeed = std::max(
+        0,
+        TfGetEnvSetting(HDEMBREE_RANDOM_SEED));
 
     if (TfGetEnvSetting(HDEMBREE_PRINT_CONFIGURATION) > 0)
     {
@@ -107,7 +149,19 @@ Hd_USTC_CG_Config::Hd_USTC_CG_Config()
             << "  useFaceColors              = "
             << useFaceColors << "\n"
             << "  cameraLightIntensity      = "
-            << cameraLightIntensity << "\n";
+            << cameraLightIntensity << "\n"
+            << "  pretessellateSubdiv        = "
+            << pretessellateSubdiv << "\n"
+            << "  subdivEdgeLengthRatio      = "
+            << subdivEdgeLengthRatio << "\n"
+            << "  subdivMaxLevel             = "
+            << subdivMaxLevel << "\n"
+            << "  meshCacheDirectory         = "
+            << meshCacheDirectory << "\n"
+            << "  deterministic              = "
+            << deterministic << "\n"
+            << "  randomSeed                 = "
+            << randomSeed << "\n";
     }
 }
 
@@ -28,6 +28,8 @@
 #include "pxr/pxr.h"
 #include "pxr/base/tf/singleton.h"
 
+#include <string>
+
 USTC_CG_NAMESPACE_OPEN_SCOPE
 using namespace pxr;
 /// \class Hd_USTC_CG_Config
@@ -86,6 +88,50 @@ public:
     /// Override with *HDEMBREE_CAMERA_LIGHT_INTENSITY*.
     float cameraLightIntensity;
 
+    /// Should subdivision surfaces be tessellated into triangles through
+    /// OpenSubdiv, instead of being handed to embree as subdivision geometry?
+    /// The refine level is then chosen per prim from its distance to the
+    /// camera (of the last rendered frame) whenever the mesh syncs.
+    ///
+    /// Override with *HDEMBREE_PRETESSELLATE_SUBDIV*. Integer values greater
+    /// than zero are considered "true".
+    bool pretessellateSubdiv;
+
+    /// Target length of a tessellated edge, as a fraction of the distance
+    /// between the prim and the camera.
+    ///
+    /// Override with *HDEMBREE_SUBDIV_EDGE_LENGTH*, specified in thousandths
+    /// of the camera distance.
+    float subdivEdgeLengthRatio;
+
+    /// Upper bound on the refine level picked for pre-tessellated meshes.
+    ///
+    /// Override with *HDEMBREE_SUBDIV_MAX_LEVEL*.
+    int subdivMaxLevel;
+
+    /// Directory of the persistent mesh cache. Triangulations and smooth
+    /// normals of meshes are stored there on their first sync and loaded
+    /// back on later sessions if the prim's points, topology and transform
+    /// are unchanged. Empty disables the cache.
+    ///
+    /// Override with *HDEMBREE_MESH_CACHE_DIR*.
+    std::string meshCacheDirectory;
+
+    /// Should every camera sample seed its own random engine from
+    /// (seed, frame, pixel, sample index)? The image then no longer depends
+    /// on the thread count, tile size or scheduling, and two renders of the
+    /// same scene with the same build match bit for bit. The frame is the
+    /// time code the application passes in the "timeCode" render setting.
+    ///
+    /// Override with *HDEMBREE_DETERMINISTIC*. Integer values greater than
+    /// zero are considered "true".
+    bool deterministic;
+
+    /// Base seed of the deterministic mode.
+    ///
+    /// Override with *HDEMBREE_RANDOM_SEED*.
+    unsigned int randomSeed;
+
 private:
     // The constructor initializes the config variables with their
     // default or environment-provided override, and optionally prints
@@ -24,9 +24,11 @@
 
 #include "mesh.h"
 
+#include <algorithm>
 #include <iostream>
 
 #include "USTC_CG.h"
+#include "config.h"
 #include "context.h"
 #include "instancer.h"
 #include "meshSamplers.h"
@@ -127,7 +129,7 @@ void Hd_USTC_CG_Mesh::_CreatePrimvarSampler(
                     " on refined meshes.");
             }
             else {
-                HdMeshUtil meshUtil(&_topology, GetId());
+                HdMeshUtil meshUtil(&_GetRtTopology(), GetId());
                 sampler = new Hd_USTC_CG_TriangleFaceVaryingSampler(name, data, meshUtil);
             }
             break;
@@ -386,11 +388,20 @@ RTCGeometry Hd_USTC_CG_Mesh::_CreateEmbreeSubdivMesh(RTCScene scene, RTCDevice d
     return geom;
 }
 
-RTCGeometry Hd_USTC_CG_Mesh::_CreateEmbreeTriangleMesh(RTCScene scene, RTCDevice device)
+RTCGeometry Hd_USTC_CG_Mesh::_CreateEmbreeTriangleMesh(
+    RTCScene scene,
+    RTCDevice device,
+    const Hd_USTC_CG_MeshDiskCache::Entry* cached)
 {
-    // Triangulate the input faces.
-    HdMeshUtil meshUtil(&_topology, GetId());
-    meshUtil.ComputeTriangleIndices(&_triangulatedIndices, &_trianglePrimitiveParams);
+    if (cached) {
+        _triangulatedIndices = cached->triangulatedIndices;
+        _trianglePrimitiveParams = cached->primitiveParams;
+    }
+    else {
+        // Triangulate the input faces.
+        HdMeshUtil meshUtil(&_GetRtTopology(), GetId());
+        meshUtil.ComputeTriangleIndices(&_triangulatedIndices, &_trianglePrimitiveParams);
+    }
 
     // Create the new mesh.
     // geometry will be committed in the calling function
@@ -421,8 +432,44 @@ RTCGeometry Hd_USTC_CG_Mesh::_CreateEmbreeTriangleMesh(RTCScene scene, RTCDevice
     return geom;
 }
 
+const HdMeshTopology& Hd_USTC_CG_Mesh::_GetRtTopology() const
+{
+    return _tessellation ? _tessellation->GetTopology() : _topology;
+}
+
+const VtVec3fArray& Hd_USTC_CG_Mesh::_GetRtPoints() const
+{
+    return _tessellation ? _tessellatedPoints : _points;
+}
+
+VtValue Hd_USTC_CG_Mesh::_TessellatePrimvar(
+    const TfToken& name,
+    const VtValue& data,
+    HdInterpolation interpolation) const
+{
+    VtValue refined;
+    switch (interpolation) {
+        case HdInterpolationConstant: return data;
+        case HdInterpolationUniform: refined = _tessellation->RefineUniformData(data); break;
+        case HdInterpolationVertex:
+        case HdInterpolationVarying: refined = _tessellation->RefineVertexData(data); break;
+        case HdInterpolationFaceVarying:
+            refined = _tessellation->RefineFaceVaryingData(data);
+            break;
+        default: break;
+    }
+    if (refined.IsEmpty()) {
+        TF_WARN(
+            "Hd_USTC_CG_Mesh can't tessellate primvar %s of %s",
+            name.GetText(),
+            GetId().GetText());
+    }
+    return refined;
+}
+
 void Hd_USTC_CG_Mesh::_PopulateRtMesh(
     HdSceneDelegate* sceneDelegate,
+    Hd_USTC_CG_RenderParam* renderParam,
     RTCScene scene,
     RTCDevice device,
     HdDirtyBits* dirtyBits,
@@ -517,6 +564,52 @@ void Hd_USTC_CG_Mesh::_PopulateRtMesh(
     }
     _smoothNormals = _smoothNormals && !authoredNormals;
 
+    // Optionally tessellate the subdivision surface ourselves at a level
+    // picked from the distance to the camera, and send the result down the
+    // triangle mesh path. Tessellations are shared through the cache, so
+    // animated frames and identical meshes only refine the topology once.
+    // The cache keeps the distance the level was picked for, so that the
+    // render pass can mark the mesh dirty once the camera moves away.
+    Hd_USTC_CG_TessellationSharedPtr tessellation;
+    if (doRefine && Hd_USTC_CG_Config::GetInstance().pretessellateSubdiv) {
+        const Hd_USTC_CG_Config& config = Hd_USTC_CG_Config::GetInstance();
+        GfVec3f center;
+        int level = Hd_USTC_CG_TessellationCache::ComputeAdaptiveLevel(
+            _topology,
+            _points,
+            _transform,
+            renderParam->cameraPosition,
+            config.subdivEdgeLengthRatio,
+            config.subdivMaxLevel,
+            &center);
+        tessellation = renderParam->tessellationCache->GetOrCreate(_topology, level);
+        // If OpenSubdiv can't refine this topology, embree's subdivision
+        // geometry still can.
+        doRefine = (tessellation == nullptr);
+        if (tessellation) {
+            renderParam->tessellationCache->SetLeveledDistance(
+                id, center, std::max((center - renderParam->cameraPosition).GetLength(), 1e-4f));
+        }
+    }
+    if (_tessellation && !tessellation) {
+        renderParam->tessellationCache->ForgetLevel(id);
+    }
+    bool tessellationChanged = (tessellation != _tessellation);
+
+    // On the first population of a plain triangle mesh, try the persistent
+    // cache: reopening an unchanged set then skips the triangulation and
+    // the smooth normals. Animated meshes only ever store their first frame.
+    Hd_USTC_CG_MeshDiskCache* diskCache = renderParam->meshDiskCache;
+    const bool useDiskCache =
+        diskCache != nullptr && _rtcMeshScene == nullptr && !doRefine && !tessellation;
+    uint64_t diskCacheKey = 0;
+    Hd_USTC_CG_MeshDiskCache::Entry cachedMesh;
+    bool diskCacheHit = false;
+    if (useDiskCache) {
+        diskCacheKey = Hd_USTC_CG_MeshDiskCache::ComputeKey(id, _topology, _points, _transform);
+        diskCacheHit = diskCache->Load(id, diskCacheKey, &cachedMesh);
+    }
+
     ////////////////////////////////////////////////////////////////////////
     // 3. Populate embree prototype object.
 
@@ -526,7 +619,8 @@ void Hd_USTC_CG_Mesh::_PopulateRtMesh(
     // time this function is called, so that the embree mesh is always
     // created.
     bool newMesh = false;
-    if (HdChangeTracker::IsTopologyDirty(*dirtyBits, id) || doRefine != _refined) {
+    if (HdChangeTracker::IsTopologyDirty(*dirtyBits, id) || doRefine != _refined ||
+        tessellationChanged) {
         newMesh = true;
 
         // Destroy the old mesh, if it exists.
@@ -558,13 +652,19 @@ void Hd_USTC_CG_Mesh::_PopulateRtMesh(
             rtcSetSceneBuildQuality(_rtcMeshScene, RTC_BUILD_QUALITY_LOW);
         }
 
+        _tessellation = tessellation;
+        if (tessellationChanged) {
+            _adjacencyValid = false;
+        }
+
         // Populate either a subdiv or a triangle mesh object. The helper
         // functions will take care of populating topology buffers.
         if (doRefine) {
             _geometry = _CreateEmbreeSubdivMesh(_rtcMeshScene, device);
         }
         else {
-            _geometry = _CreateEmbreeTriangleMesh(_rtcMeshScene, device);
+            _geometry = _CreateEmbreeTriangleMesh(
+                _rtcMeshScene, device, diskCacheHit ? &cachedMesh : nullptr);
         }
         if (_rtcMeshId == RTC_INVALID_GEOMETRY_ID) {
             TF_CODING_ERROR("Unable to create a mesh for the requested geometry");
@@ -637,15 +737,30 @@ void Hd_USTC_CG_Mesh::_PopulateRtMesh(
     // 1. If the topology is dirty, update the adjacency table, a processed
     //    form of the topology that helps calculate smooth normals quickly.
     // 2. If the points are dirty, update the smooth normal buffer itself.
-    if (_smoothNormals && !_adjacencyValid) {
-        _adjacency.BuildAdjacencyTable(&_topology);
+    // Normals loaded from the disk cache need neither.
+    if (diskCacheHit && _smoothNormals && cachedMesh.normals.size() == _points.size()) {
+        computedNormals = cachedMesh.normals;
+        _normalsValid = true;
+        _CreatePrimvarSampler(
+            HdTokens->normals, VtValue(computedNormals), HdInterpolationVertex, _refined);
+    }
+    if (_smoothNormals && !_adjacencyValid && !_normalsValid) {
+        _adjacency.BuildAdjacencyTable(&_GetRtTopology());
         _adjacencyValid = true;
         // If we rebuilt the adjacency table, force a rebuild of normals.
         _normalsValid = false;
     }
+    // Refine the points onto the tessellation before anything samples them.
+    if (_tessellation &&
+        (newMesh || HdChangeTracker::IsPrimvarDirty(*dirtyBits, id, HdTokens->points))) {
+        _tessellatedPoints = _tessellation->RefineVertexData(_points);
+        _normalsValid = false;
+    }
+
     if (_smoothNormals && !_normalsValid) {
+        const VtVec3fArray& points = _GetRtPoints();
         computedNormals =
-            Hd_SmoothNormals::ComputeSmoothNormals(&_adjacency, _points.size(), _points.cdata());
+            Hd_SmoothNormals::ComputeSmoothNormals(&_adjacency, points.size(), points.cdata());
         _normalsValid = true;
 
         // Create a sampler for the "normals" primvar. If there are authored
@@ -655,6 +770,16 @@ void Hd_USTC_CG_Mesh::_PopulateRtMesh(
             HdTokens->normals, VtValue(computedNormals), HdInterpolationVertex, _refined);
     }
 
+    if (useDiskCache && !diskCacheHit) {
+        Hd_USTC_CG_MeshDiskCache::Entry entry;
+        entry.triangulatedIndices = _triangulatedIndices;
+        entry.primitiveParams = _trianglePrimitiveParams;
+        if (_smoothNormals) {
+            entry.normals = computedNormals;
+        }
+        diskCache->Store(id, diskCacheKey, entry);
+    }
+
     // If smooth normals are off and there are no authored normals, make
     // sure there's no "normals" sampler so the renderpass can use its
     // fallback behavior.
@@ -674,23 +799,34 @@ void Hd_USTC_CG_Mesh::_PopulateRtMesh(
     TF_FOR_ALL(it, _primvarSourceMap)
     {
         if (newMesh || HdChangeTracker::IsPrimvarDirty(*dirtyBits, id, it->first)) {
-            _CreatePrimvarSampler(it->first, it->second.data, it->second.interpolation, _refined);
+            if (_tessellation) {
+                VtValue data =
+                    _TessellatePrimvar(it->first, it->second.data, it->second.interpolation);
+                if (!data.IsEmpty()) {
+                    _CreatePrimvarSampler(it->first, data, it->second.interpolation, false);
+                }
+            }
+            else {
+                _CreatePrimvarSampler(
+                    it->first, it->second.data, it->second.interpolation, _refined);
+            }
         }
     }
 
     // Populate points in the RTC mesh.
     if (newMesh || HdChangeTracker::IsPrimvarDirty(*dirtyBits, id, HdTokens->points)) {
+        const VtVec3fArray& points = _GetRtPoints();
         rtcSetSharedGeometryBuffer(
             _geometry,
             RTC_BUFFER_TYPE_VERTEX,
             0,
             /* unsigned int slot */
             RTC_FORMAT_FLOAT3,
-            _points.cdata(),
+            points.cdata(),
             0,
             /* size_t byteOffset */
             sizeof(GfVec3f),
-            _points.size());
+            points.size());
 
         rtcCommitGeometry(_geometry);
     }
@@ -774,7 +910,7 @@ void Hd_USTC_CG_Mesh::_PopulateRtMesh(
         }
     }
 
-    *dirtyBits &= ~HdChangeTracker::AllSceneDirtyBits;
+    *dirtyBits &= ~(HdChangeTracker::AllSceneDirtyBits | DirtyTessellation);
 }
 
 /* static */
@@ -876,7 +1012,7 @@ void Hd_USTC_CG_Mesh::Sync(
     RTCDevice device = embreeRenderParam->GetEmbreeDevice();
 
     // Create embree geometry objects.
-    _PopulateRtMesh(sceneDelegate, scene, device, dirtyBits, desc);
+    _PopulateRtMesh(sceneDelegate, embreeRenderParam, scene, device, dirtyBits, desc);
 }
 
 void Hd_USTC_CG_Mesh::Finalize(HdRenderParam* renderParam)
@@ -914,6 +1050,12 @@ void Hd_USTC_CG_Mesh::Finalize(HdRenderParam* renderParam)
         rtcReleaseScene(_rtcMeshScene);
         _rtcMeshScene = nullptr;
     }
+
+    if (_tessellation) {
+        static_cast<Hd_USTC_CG_RenderParam*>(renderParam)->tessellationCache->ForgetLevel(GetId());
+    }
+    _tessellation = nullptr;
+    _tessellatedPoints = VtVec3fArray();
 }
 
 USTC_CG_NAMESPACE_CLOSE_SCOPE
@@ -26,13 +26,16 @@
 
 #include "context.h"
 #include "embree4/rtcore.h"
+#include "meshDiskCache.h"
 #include "meshSamplers.h"
 #include "pxr/base/gf/matrix4f.h"
 #include "pxr/imaging/hd/mesh.h"
 #include "pxr/imaging/hd/vertexAdjacency.h"
 #include "pxr/pxr.h"
+#include "tessellationCache.h"
 
 USTC_CG_NAMESPACE_OPEN_SCOPE
+class Hd_USTC_CG_RenderParam;
 using namespace pxr;
 /// \class Hd_USTC_CG_Mesh
 ///
@@ -57,6 +60,10 @@ class Hd_USTC_CG_Mesh final : public HdMesh {
    public:
     HF_MALLOC_TAG_NEW("new Hd_USTC_CG_Mesh");
 
+    /// Set by the render pass when the camera moved far enough from a
+    /// pre-tessellated mesh that its refine level should be picked again.
+    static constexpr HdDirtyBits DirtyTessellation = HdChangeTracker::CustomBitsBegin;
+
     /// Hd_USTC_CG_Mesh constructor.
     ///   \param id The scene-graph path to this mesh.
     Hd_USTC_CG_Mesh(const SdfPath& id);
@@ -116,7 +123,11 @@ class Hd_USTC_CG_Mesh final : public HdMesh {
         HdDirtyBits dirtyBits);
     void _UpdatePrimvarSources(HdSceneDelegate* sceneDelegate, HdDirtyBits dirtyBits);
     RTCGeometry _CreateEmbreeSubdivMesh(RTCScene scene, RTCDevice device);
-    RTCGeometry _CreateEmbreeTriangleMesh(RTCScene scene, RTCDevice device);
+    // If cached is given, its triangulation is used instead of recomputing it.
+    RTCGeometry _CreateEmbreeTriangleMesh(
+        RTCScene scene,
+        RTCDevice device,
+        const Hd_USTC_CG_MeshDiskCache::Entry* cached = nullptr);
 
     // This class does not support copying.
     Hd_USTC_CG_Mesh(const Hd_USTC_CG_Mesh&) = delete;
@@ -125,10 +136,21 @@ class Hd_USTC_CG_Mesh final : public HdMesh {
    private:
     void _PopulateRtMesh(
         HdSceneDelegate* sceneDelegate,
+        Hd_USTC_CG_RenderParam* renderParam,
         RTCScene scene,
         RTCDevice device,
         HdDirtyBits* dirtyBits,
         const HdMeshReprDesc& desc);
+    // The topology and points actually handed to embree: the OpenSubdiv
+    // tessellation if there is one, the authored ones otherwise.
+    const HdMeshTopology& _GetRtTopology() const;
+    const VtVec3fArray& _GetRtPoints() const;
+    // Bring a primvar onto the tessellated topology. Returns an empty value
+    // for data that can't be refined (e.g. unsupported types).
+    VtValue _TessellatePrimvar(
+        const TfToken& name,
+        const VtValue& data,
+        HdInterpolation interpolation) const;
     Hd_USTC_CG_PrototypeContext* _GetPrototypeContext();
     Hd_USTC_CG_InstanceContext* _GetInstanceContext(RTCScene scene, size_t i);
 
@@ -162,6 +184,12 @@ class Hd_USTC_CG_Mesh final : public HdMesh {
     VtVec3iArray _triangulatedIndices;
     VtIntArray _trianglePrimitiveParams;
 
+    // When subdivision surfaces are pre-tessellated, _tessellation is the
+    // shared refined topology and _tessellatedPoints holds _points pushed
+    // through its stencils. Both are empty otherwise.
+    Hd_USTC_CG_TessellationSharedPtr _tessellation;
+    VtVec3fArray _tessellatedPoints;
+
     // Embree recommends after creating one should hold onto the geometry
     //
     //      "However, it is generally recommended to store the geometry handle
@@ -0,0 +1,215 @@
+#include "meshDiskCache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+#include "Utils/Logging/Logging.h"
+#include "pxr/base/arch/fileSystem.h"
+#include "pxr/base/arch/hash.h"
+#include "pxr/base/tf/stringUtils.h"
+
+USTC_CG_NAMESPACE_OPEN_SCOPE
+using namespace pxr;
+
+namespace {
+
+constexpr char kMagic[8] = { 'U', 'C', 'G', 'M', 'E', 'S', 'H', '\0' };
+constexpr uint32_t kVersion = 1;
+constexpr size_t kAlignment = 16;
+
+struct FileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t key;
+    uint64_t numTriangles;
+    uint64_t numPrimitiveParams;
+    uint64_t numNormals;
+};
+
+size_t AlignUp(size_t offset)
+{
+    return (offset + kAlignment - 1) / kAlignment * kAlignment;
+}
+
+template<typename T>
+uint64_t HashArray(const VtArray<T>& array, uint64_t seed)
+{
+    return ArchHash64(reinterpret_cast<const char*>(array.cdata()), array.size() * sizeof(T), seed);
+}
+
+uint64_t HashString(const std::string& str, uint64_t seed)
+{
+    return ArchHash64(str.data(), str.size(), seed);
+}
+
+// Keeps the file mapped for as long as any VtArray still points into it.
+struct MappedFileSource : public Vt_ArrayForeignDataSource {
+    explicit MappedFileSource(ArchConstFileMapping mapping)
+        : Vt_ArrayForeignDataSource(Detached),
+          mapping(std::move(mapping))
+    {
+    }
+
+    static void Detached(Vt_ArrayForeignDataSource* self)
+    {
+        delete static_cast<MappedFileSource*>(self);
+    }
+
+    ArchConstFileMapping mapping;
+};
+
+template<typename T>
+VtArray<T> ArrayFromMapping(MappedFileSource* source, size_t offset, size_t count)
+{
+    // VtArray copies foreign data before handing out mutable access, so the const_cast never
+    // leads to a write into the read-only mapping.
+    auto data = reinterpret_cast<T*>(const_cast<char*>(source->mapping.get() + offset));
+    return VtArray<T>(source, data, count);
+}
+
+}  // namespace
+
+Hd_USTC_CG_MeshDiskCache::Hd_USTC_CG_MeshDiskCache(const std::string& directory)
+    : _directory(directory)
+{
+    std::error_code error;
+    std::filesystem::create_directories(_directory, error);
+    if (error) {
+        logging(
+            "Unable to create mesh cache directory " + _directory + ": " + error.message(),
+            Warning);
+    }
+}
+
+uint64_t Hd_USTC_CG_MeshDiskCache::ComputeKey(
+    const SdfPath& id,
+    const HdMeshTopology& topology,
+    const VtVec3fArray& points,
+    const GfMatrix4f& transform)
+{
+    uint64_t key = HashString(id.GetString(), 0);
+    key = HashString(topology.GetScheme().GetString(), key);
+    key = HashString(topology.GetOrientation().GetString(), key);
+    key = HashArray(topology.GetFaceVertexCounts(), key);
+    key = HashArray(topology.GetFaceVertexIndices(), key);
+    key = HashArray(topology.GetHoleIndices(), key);
+    key = HashArray(points, key);
+    key = ArchHash64(reinterpret_cast<const char*>(transform.data()), sizeof(GfMatrix4f), key);
+    return key;
+}
+
+std::string Hd_USTC_CG_MeshDiskCache::_GetFilePath(const SdfPath& id) const
+{
+    const uint64_t pathHash = HashString(id.GetString(), 0);
+    return _directory + "/" + TfStringPrintf("%016llx", (unsigned long long)pathHash) +
+           ".ucgmesh";
+}
+
+bool Hd_USTC_CG_MeshDiskCache::Load(const SdfPath& id, uint64_t key, Entry* entry) const
+{
+    const std::string path = _GetFilePath(id);
+    if (!std::filesystem::exists(path)) {
+        return false;
+    }
+
+    ArchConstFileMapping mapping = ArchMapFileReadOnly(path);
+    if (!mapping) {
+        return false;
+    }
+    const size_t length = ArchGetFileMappingLength(mapping);
+    if (length < sizeof(FileHeader)) {
+        return false;
+    }
+
+    FileHeader header;
+    std::memcpy(&header, mapping.get(), sizeof(FileHeader));
+    if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.version != kVersion ||
+        header.key != key) {
+        return false;
+    }
+
+    const size_t trianglesOffset = AlignUp(sizeof(FileHeader));
+    const size_t primitiveParamsOffset =
+        AlignUp(trianglesOffset + header.numTriangles * sizeof(GfVec3i));
+    const size_t normalsOffset =
+        AlignUp(primitiveParamsOffset + header.numPrimitiveParams * sizeof(int));
+    if (normalsOffset + header.numNormals * sizeof(GfVec3f) > length) {
+        logging("Truncated mesh cache file " + path, Warning);
+        return false;
+    }
+
+    auto source = new MappedFileSource(std::move(mapping));
+    *entry = Entry();
+    if (header.numTriangles > 0) {
+        entry->triangulatedIndices =
+            ArrayFromMapping<GfVec3i>(source, trianglesOffset, header.numTriangles);
+    }
+    if (header.numPrimitiveParams > 0) {
+        entry->primitiveParams =
+            ArrayFromMapping<int>(source, primitiveParamsOffset, header.numPrimitiveParams);
+    }
+    if (header.numNormals > 0) {
+        entry->normals = ArrayFromMapping<GfVec3f>(source, normalsOffset, header.numNormals);
+    }
+    // Nothing references the mapping, so nothing will release it either.
+    if (header.numTriangles == 0 && header.numPrimitiveParams == 0 && header.numNormals == 0) {
+        delete source;
+    }
+
+    return true;
+}
+
+void Hd_USTC_CG_MeshDiskCache::Store(const SdfPath& id, uint64_t key, const Entry& entry) const
+{
+    FileHeader header;
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.reserved = 0;
+    header.key = key;
+    header.numTriangles = entry.triangulatedIndices.size();
+    header.numPrimitiveParams = entry.primitiveParams.size();
+    header.numNormals = entry.normals.size();
+
+    const std::string path = _GetFilePath(id);
+    // Write to a temporary first, so a concurrent or interrupted session never maps a partially
+    // written file.
+    const std::string tmpPath = path + ".tmp";
+    {
+        std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+        if (!file) {
+            logging("Unable to write mesh cache file " + tmpPath, Warning);
+            return;
+        }
+
+        size_t offset = 0;
+        auto writeAligned = [&](const void* data, size_t size) {
+            static const char padding[kAlignment] = {};
+            const size_t aligned = AlignUp(offset);
+            file.write(padding, aligned - offset);
+            file.write(static_cast<const char*>(data), size);
+            offset = aligned + size;
+        };
+
+        file.write(reinterpret_cast<const char*>(&header), sizeof(FileHeader));
+        offset = sizeof(FileHeader);
+        writeAligned(entry.triangulatedIndices.cdata(), header.numTriangles * sizeof(GfVec3i));
+        writeAligned(entry.primitiveParams.cdata(), header.numPrimitiveParams * sizeof(int));
+        writeAligned(entry.normals.cdata(), header.numNormals * sizeof(GfVec3f));
+
+        if (!file) {
+            logging("Failed writing mesh cache file " + tmpPath, Warning);
+            return;
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::rename(tmpPath, path, error);
+    if (error) {
+        std::filesystem::remove(tmpPath, error);
+    }
+}
+
+USTC_CG_NAMESPACE_CLOSE_SCOPE
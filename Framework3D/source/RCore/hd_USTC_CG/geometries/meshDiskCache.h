@@ -0,0 +1,54 @@
+#pragma once
+#include <string>
+
+#include "USTC_CG.h"
+#include "pxr/base/gf/matrix4f.h"
+#include "pxr/base/vt/array.h"
+#include "pxr/base/vt/types.h"
+#include "pxr/imaging/hd/meshTopology.h"
+#include "pxr/pxr.h"
+#include "pxr/usd/sdf/path.h"
+
+USTC_CG_NAMESPACE_OPEN_SCOPE
+using namespace pxr;
+
+/// \class Hd_USTC_CG_MeshDiskCache
+///
+/// Persists the derived data of static meshes between sessions: the triangulated index buffer,
+/// the triangle-to-face primitive params and the smooth normals. These are exactly the buffers
+/// _PopulateRtMesh hands to embree, so a hit only leaves the BVH build itself (embree can't
+/// serialize its acceleration structures).
+///
+/// There is one file per prim path in the cache directory. Its header records a content key
+/// computed from the points, topology and transform, so a stale file is just a miss and gets
+/// overwritten. Files are loaded with a read-only mapping, and the returned arrays reference the
+/// mapped memory directly until they are modified or released.
+///
+class Hd_USTC_CG_MeshDiskCache {
+   public:
+    struct Entry {
+        VtVec3iArray triangulatedIndices;
+        VtIntArray primitiveParams;
+        // Empty when the mesh doesn't use smooth normals.
+        VtVec3fArray normals;
+    };
+
+    explicit Hd_USTC_CG_MeshDiskCache(const std::string& directory);
+
+    /// A content key that is stable across sessions (unlike SdfPath or TfToken hashes).
+    static uint64_t ComputeKey(
+        const SdfPath& id,
+        const HdMeshTopology& topology,
+        const VtVec3fArray& points,
+        const GfMatrix4f& transform);
+
+    bool Load(const SdfPath& id, uint64_t key, Entry* entry) const;
+    void Store(const SdfPath& id, uint64_t key, const Entry& entry) const;
+
+   private:
+    std::string _GetFilePath(const SdfPath& id) const;
+
+    std::string _directory;
+};
+
+USTC_CG_NAMESPACE_CLOSE_SCOPE
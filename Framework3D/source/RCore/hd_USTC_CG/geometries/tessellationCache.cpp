@@ -0,0 +1,368 @@
+#include "tessellationCache.h"
+
+#include <algorithm>
+#include <boost/functional/hash.hpp>
+#include <cmath>
+#include <numeric>
+
+#include "opensubdiv/far/primvarRefiner.h"
+#include "opensubdiv/far/stencilTableFactory.h"
+#include "opensubdiv/far/topologyRefiner.h"
+#include "pxr/base/gf/range3f.h"
+#include "pxr/base/work/loops.h"
+#include "pxr/imaging/hd/perfLog.h"
+#include "pxr/imaging/pxOsd/refinerFactory.h"
+#include "pxr/imaging/pxOsd/tokens.h"
+
+USTC_CG_NAMESPACE_OPEN_SCOPE
+using namespace pxr;
+namespace Far = OpenSubdiv::Far;
+
+Hd_USTC_CG_Tessellation::~Hd_USTC_CG_Tessellation() = default;
+
+std::shared_ptr<const Hd_USTC_CG_Tessellation> Hd_USTC_CG_Tessellation::Create(
+    const HdMeshTopology& topology,
+    int level)
+{
+    HD_TRACE_FUNCTION();
+
+    // One face-varying channel where every face-vertex has its own value.
+    VtIntArray faceVaryingTopology(topology.GetFaceVertexIndices().size());
+    std::iota(faceVaryingTopology.begin(), faceVaryingTopology.end(), 0);
+    PxOsdTopologyRefinerSharedPtr refiner =
+        PxOsdRefinerFactory::Create(topology.GetPxOsdMeshTopology(), { faceVaryingTopology });
+    if (!refiner) {
+        return nullptr;
+    }
+
+    refiner->RefineUniform(Far::TopologyRefiner::UniformOptions(level));
+
+    // Track which coarse face every refined face descends from, so uniform primvars and
+    // primitive ids can still be looked up on the authored faces.
+    std::vector<int> parentFaces(refiner->GetLevel(0).GetNumFaces());
+    std::iota(parentFaces.begin(), parentFaces.end(), 0);
+    Far::PrimvarRefiner primvarRefiner(*refiner);
+    for (int l = 1; l <= level; ++l) {
+        std::vector<int> childFaces(refiner->GetLevel(l).GetNumFaces());
+        primvarRefiner.InterpolateFaceUniform(l, parentFaces, childFaces);
+        parentFaces.swap(childFaces);
+    }
+
+    const Far::TopologyLevel& lastLevel = refiner->GetLevel(level);
+
+    VtIntArray faceVertexCounts;
+    VtIntArray faceVertexIndices;
+    VtIntArray coarseFaceIndices;
+    VtIntArray faceVaryingIndices;
+    faceVertexCounts.reserve(lastLevel.GetNumFaces());
+    coarseFaceIndices.reserve(lastLevel.GetNumFaces());
+    faceVertexIndices.reserve(lastLevel.GetNumFaceVertices());
+    faceVaryingIndices.reserve(lastLevel.GetNumFaceVertices());
+    for (int face = 0; face < lastLevel.GetNumFaces(); ++face) {
+        if (lastLevel.IsFaceHole(face)) {
+            continue;
+        }
+        Far::ConstIndexArray faceVertices = lastLevel.GetFaceVertices(face);
+        Far::ConstIndexArray faceValues = lastLevel.GetFaceFVarValues(face, 0);
+        faceVertexCounts.push_back(faceVertices.size());
+        for (int i = 0; i < faceVertices.size(); ++i) {
+            faceVertexIndices.push_back(faceVertices[i]);
+            faceVaryingIndices.push_back(faceValues[i]);
+        }
+        coarseFaceIndices.push_back(parentFaces[face]);
+    }
+
+    // Only the last level is needed, expressed directly in terms of the control vertices.
+    Far::StencilTableFactory::Options options;
+    options.generateIntermediateLevels = false;
+    options.generateOffsets = true;
+
+    auto tessellation =
+        std::shared_ptr<Hd_USTC_CG_Tessellation>(new Hd_USTC_CG_Tessellation());
+    tessellation->_topology = HdMeshTopology(
+        PxOsdOpenSubdivTokens->none,
+        topology.GetOrientation(),
+        faceVertexCounts,
+        faceVertexIndices);
+    tessellation->_coarseFaceIndices = coarseFaceIndices;
+    tessellation->_faceVaryingIndices = faceVaryingIndices;
+    tessellation->_level = level;
+    tessellation->_stencils.reset(Far::StencilTableFactory::Create(*refiner, options));
+    tessellation->_refiner = refiner;
+
+    return tessellation;
+}
+
+size_t Hd_USTC_CG_Tessellation::GetNumRefinedVertices() const
+{
+    return _stencils->GetNumStencils();
+}
+
+template<typename T>
+VtArray<T> Hd_USTC_CG_Tessellation::_RefineVertexData(const VtArray<T>& coarse) const
+{
+    const Far::StencilTable& stencils = *_stencils;
+    if (coarse.size() < static_cast<size_t>(stencils.GetNumControlVertices())) {
+        TF_WARN("Not enough control vertex data to refine the tessellation");
+        return VtArray<T>();
+    }
+
+    VtArray<T> refined(stencils.GetNumStencils());
+    const T* src = coarse.cdata();
+    T* dst = refined.data();
+
+    WorkParallelForN(stencils.GetNumStencils(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            auto stencil = stencils.GetStencil(static_cast<Far::Index>(i));
+            const Far::Index* indices = stencil.GetVertexIndices();
+            const float* weights = stencil.GetWeights();
+
+            T value = T(0);
+            for (int j = 0; j < stencil.GetSize(); ++j) {
+                value += weights[j] * src[indices[j]];
+            }
+            dst[i] = value;
+        }
+    });
+
+    return refined;
+}
+
+template<typename T>
+VtArray<T> Hd_USTC_CG_Tessellation::_RefineUniformData(const VtArray<T>& coarse) const
+{
+    VtArray<T> refined(_coarseFaceIndices.size());
+    for (size_t i = 0; i < _coarseFaceIndices.size(); ++i) {
+        const size_t coarseFace = _coarseFaceIndices[i];
+        refined[i] = coarseFace < coarse.size() ? coarse[coarseFace] : T(0);
+    }
+    return refined;
+}
+
+namespace {
+// Far::PrimvarRefiner accumulates values through Clear() and AddWithWeight().
+template<typename T>
+struct _FaceVaryingValue {
+    T value;
+
+    void Clear()
+    {
+        value = T(0);
+    }
+    void AddWithWeight(const _FaceVaryingValue& src, float weight)
+    {
+        value += weight * src.value;
+    }
+};
+}  // namespace
+
+template<typename T>
+VtArray<T> Hd_USTC_CG_Tessellation::_RefineFaceVaryingData(const VtArray<T>& coarse) const
+{
+    const size_t numCoarseValues = _refiner->GetLevel(0).GetNumFVarValues(0);
+    if (coarse.size() < numCoarseValues) {
+        TF_WARN("Not enough face-varying data to refine the tessellation");
+        return VtArray<T>();
+    }
+
+    std::vector<_FaceVaryingValue<T>> src(numCoarseValues);
+    for (size_t i = 0; i < numCoarseValues; ++i) {
+        src[i].value = coarse[i];
+    }
+    Far::PrimvarRefiner primvarRefiner(*_refiner);
+    for (int l = 1; l <= _level; ++l) {
+        std::vector<_FaceVaryingValue<T>> dst(_refiner->GetLevel(l).GetNumFVarValues(0));
+        primvarRefiner.InterpolateFaceVarying(l, src, dst, 0);
+        src.swap(dst);
+    }
+
+    VtArray<T> refined(_faceVaryingIndices.size());
+    for (size_t i = 0; i < _faceVaryingIndices.size(); ++i) {
+        refined[i] = src[_faceVaryingIndices[i]].value;
+    }
+    return refined;
+}
+
+VtVec3fArray Hd_USTC_CG_Tessellation::RefineVertexData(const VtVec3fArray& coarse) const
+{
+    return _RefineVertexData(coarse);
+}
+
+VtValue Hd_USTC_CG_Tessellation::RefineVertexData(const VtValue& coarse) const
+{
+    if (coarse.IsHolding<VtFloatArray>()) {
+        return VtValue(_RefineVertexData(coarse.UncheckedGet<VtFloatArray>()));
+    }
+    if (coarse.IsHolding<VtVec2fArray>()) {
+        return VtValue(_RefineVertexData(coarse.UncheckedGet<VtVec2fArray>()));
+    }
+    if (coarse.IsHolding<VtVec3fArray>()) {
+        return VtValue(_RefineVertexData(coarse.UncheckedGet<VtVec3fArray>()));
+    }
+    if (coarse.IsHolding<VtVec4fArray>()) {
+        return VtValue(_RefineVertexData(coarse.UncheckedGet<VtVec4fArray>()));
+    }
+    return VtValue();
+}
+
+VtValue Hd_USTC_CG_Tessellation::RefineUniformData(const VtValue& coarse) const
+{
+    if (coarse.IsHolding<VtFloatArray>()) {
+        return VtValue(_RefineUniformData(coarse.UncheckedGet<VtFloatArray>()));
+    }
+    if (coarse.IsHolding<VtVec2fArray>()) {
+        return VtValue(_RefineUniformData(coarse.UncheckedGet<VtVec2fArray>()));
+    }
+    if (coarse.IsHolding<VtVec3fArray>()) {
+        return VtValue(_RefineUniformData(coarse.UncheckedGet<VtVec3fArray>()));
+    }
+    if (coarse.IsHolding<VtVec4fArray>()) {
+        return VtValue(_RefineUniformData(coarse.UncheckedGet<VtVec4fArray>()));
+    }
+    return VtValue();
+}
+
+VtValue Hd_USTC_CG_Tessellation::RefineFaceVaryingData(const VtValue& coarse) const
+{
+    if (coarse.IsHolding<VtFloatArray>()) {
+        return VtValue(_RefineFaceVaryingData(coarse.UncheckedGet<VtFloatArray>()));
+    }
+    if (coarse.IsHolding<VtVec2fArray>()) {
+        return VtValue(_RefineFaceVaryingData(coarse.UncheckedGet<VtVec2fArray>()));
+    }
+    if (coarse.IsHolding<VtVec3fArray>()) {
+        return VtValue(_RefineFaceVaryingData(coarse.UncheckedGet<VtVec3fArray>()));
+    }
+    if (coarse.IsHolding<VtVec4fArray>()) {
+        return VtValue(_RefineFaceVaryingData(coarse.UncheckedGet<VtVec4fArray>()));
+    }
+    return VtValue();
+}
+
+Hd_USTC_CG_TessellationSharedPtr Hd_USTC_CG_TessellationCache::GetOrCreate(
+    const HdMeshTopology& topology,
+    int level)
+{
+    size_t key = topology.ComputeHash();
+    boost::hash_combine(key, level);
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = _tessellations.find(key);
+        if (it != _tessellations.end()) {
+            return it->second;
+        }
+    }
+
+    // Refining can take a while on big meshes; don't hold up the other meshes syncing in
+    // parallel. If two meshes race on the same topology, the first one to finish wins.
+    auto tessellation = Hd_USTC_CG_Tessellation::Create(topology, level);
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _tessellations.emplace(key, tessellation).first->second;
+}
+
+void Hd_USTC_CG_TessellationCache::GarbageCollect()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (auto it = _tessellations.begin(); it != _tessellations.end();) {
+        if (it->second.use_count() <= 1) {
+            it = _tessellations.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+}
+
+int Hd_USTC_CG_TessellationCache::ComputeAdaptiveLevel(
+    const HdMeshTopology& topology,
+    const VtVec3fArray& points,
+    const GfMatrix4f& transform,
+    const GfVec3f& cameraPosition,
+    float edgeLengthRatio,
+    int maxLevel,
+    GfVec3f* center)
+{
+    const VtIntArray& faceVertexCounts = topology.GetFaceVertexCounts();
+    const VtIntArray& faceVertexIndices = topology.GetFaceVertexIndices();
+
+    // Mean coarse edge length, estimated from the face perimeters in object space.
+    GfRange3f bounds;
+    for (const GfVec3f& p : points) {
+        bounds.UnionWith(p);
+    }
+
+    double perimeter = 0;
+    size_t numEdges = 0;
+    size_t offset = 0;
+    for (int count : faceVertexCounts) {
+        for (int i = 0; i < count; ++i) {
+            const size_t a = faceVertexIndices[offset + i];
+            const size_t b = faceVertexIndices[offset + (i + 1) % count];
+            if (a < points.size() && b < points.size()) {
+                perimeter += (points[a] - points[b]).GetLength();
+                ++numEdges;
+            }
+        }
+        offset += count;
+    }
+    if (numEdges == 0 || bounds.IsEmpty()) {
+        return 1;
+    }
+
+    // Bring the edge length to world space with the average scale of the transform.
+    const float scale = std::cbrt(std::abs(transform.GetDeterminant3()));
+    const float meanEdgeLength = scale * static_cast<float>(perimeter / numEdges);
+    if (meanEdgeLength <= 0) {
+        return 1;
+    }
+
+    const GfVec3f worldCenter = transform.Transform(bounds.GetMidpoint());
+    if (center) {
+        *center = worldCenter;
+    }
+    const float distance = std::max((worldCenter - cameraPosition).GetLength(), 1e-4f);
+    const float targetEdgeLength = edgeLengthRatio * distance;
+
+    // Every uniform refinement halves the edges.
+    int level = static_cast<int>(std::ceil(std::log2(meanEdgeLength / targetEdgeLength)));
+    return std::clamp(level, 1, std::max(maxLevel, 1));
+}
+
+void Hd_USTC_CG_TessellationCache::SetLeveledDistance(
+    const SdfPath& id,
+    const GfVec3f& center,
+    float distance)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _leveled[id] = { center, distance };
+}
+
+void Hd_USTC_CG_TessellationCache::ForgetLevel(const SdfPath& id)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _leveled.erase(id);
+}
+
+SdfPathVector Hd_USTC_CG_TessellationCache::TakeMovedMeshes(const GfVec3f& cameraPosition)
+{
+    // The level follows log2 of the distance, so half a level is a factor of sqrt(2).
+    const float factor = std::sqrt(2.0f);
+
+    SdfPathVector moved;
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (auto it = _leveled.begin(); it != _leveled.end();) {
+        const float distance = std::max((it->second.center - cameraPosition).GetLength(), 1e-4f);
+        if (distance > it->second.distance * factor || distance * factor < it->second.distance) {
+            moved.push_back(it->first);
+            it = _leveled.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+    return moved;
+}
+
+USTC_CG_NAMESPACE_CLOSE_SCOPE
@@ -0,0 +1,144 @@
+#pragma once
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#include "USTC_CG.h"
+#include "opensubdiv/far/stencilTable.h"
+#include "pxr/base/gf/matrix4f.h"
+#include "pxr/base/gf/vec3f.h"
+#include "pxr/base/vt/array.h"
+#include "pxr/base/vt/value.h"
+#include "pxr/usd/sdf/path.h"
+#include "pxr/imaging/hd/meshTopology.h"
+#include "pxr/imaging/pxOsd/refinerFactory.h"
+#include "pxr/pxr.h"
+
+USTC_CG_NAMESPACE_OPEN_SCOPE
+using namespace pxr;
+
+/// \class Hd_USTC_CG_Tessellation
+///
+/// A subdivision surface uniformly refined by OpenSubdiv to a fixed level and flattened into a
+/// polygonal topology (quads for Catmull-Clark, triangles for Loop) that the triangle mesh path
+/// can consume directly.
+///
+/// The tessellation only depends on the coarse topology and the level, so it is shared between
+/// animated frames and between meshes with identical topology. Per-frame vertex data is pushed
+/// through the precomputed stencils with RefineVertexData().
+///
+/// Face-varying data comes from Hydra flattened to one value per face-vertex, so it is refined in
+/// a channel where every face has values of its own, as if every edge were a seam.
+///
+class Hd_USTC_CG_Tessellation {
+   public:
+    ~Hd_USTC_CG_Tessellation();
+
+    /// Refine the given coarse topology. Returns nullptr if OpenSubdiv can't handle it (e.g. a
+    /// Loop mesh with non-triangular faces), in which case the caller should fall back to the
+    /// Embree subdivision geometry.
+    static std::shared_ptr<const Hd_USTC_CG_Tessellation> Create(
+        const HdMeshTopology& topology,
+        int level);
+
+    /// The refined faces, with holes removed.
+    const HdMeshTopology& GetTopology() const
+    {
+        return _topology;
+    }
+
+    /// For each refined face, the index of the coarse face it was generated from.
+    const VtIntArray& GetCoarseFaceIndices() const
+    {
+        return _coarseFaceIndices;
+    }
+
+    int GetLevel() const
+    {
+        return _level;
+    }
+
+    size_t GetNumRefinedVertices() const;
+
+    /// Interpolate per-vertex data from the coarse control vertices onto the refined vertices.
+    /// Supports float, GfVec2f, GfVec3f and GfVec4f arrays; anything else is returned empty.
+    VtValue RefineVertexData(const VtValue& coarse) const;
+    VtVec3fArray RefineVertexData(const VtVec3fArray& coarse) const;
+
+    /// Remap per-face (uniform) data from coarse faces onto the refined faces.
+    VtValue RefineUniformData(const VtValue& coarse) const;
+
+    /// Interpolate face-varying data, one value per coarse face-vertex, onto the refined
+    /// face-vertices. Supports the same types as RefineVertexData().
+    VtValue RefineFaceVaryingData(const VtValue& coarse) const;
+
+   private:
+    Hd_USTC_CG_Tessellation() = default;
+
+    template<typename T>
+    VtArray<T> _RefineVertexData(const VtArray<T>& coarse) const;
+    template<typename T>
+    VtArray<T> _RefineUniformData(const VtArray<T>& coarse) const;
+    template<typename T>
+    VtArray<T> _RefineFaceVaryingData(const VtArray<T>& coarse) const;
+
+    HdMeshTopology _topology;
+    VtIntArray _coarseFaceIndices;
+    // For each refined face-vertex, its value in the last level of the face-varying channel.
+    VtIntArray _faceVaryingIndices;
+    int _level = 0;
+
+    std::unique_ptr<const OpenSubdiv::Far::StencilTable> _stencils;
+    // Kept to refine face-varying data level by level.
+    PxOsdTopologyRefinerSharedPtr _refiner;
+};
+
+using Hd_USTC_CG_TessellationSharedPtr = std::shared_ptr<const Hd_USTC_CG_Tessellation>;
+
+/// \class Hd_USTC_CG_TessellationCache
+///
+/// Tessellations keyed by (topology hash, refine level). Owned by the render delegate and shared
+/// with the meshes through the render param; Sync() runs in parallel, so every access is locked.
+///
+class Hd_USTC_CG_TessellationCache {
+   public:
+    /// Look up or build the tessellation of the topology at the given level. May return nullptr,
+    /// see Hd_USTC_CG_Tessellation::Create.
+    Hd_USTC_CG_TessellationSharedPtr GetOrCreate(const HdMeshTopology& topology, int level);
+
+    /// Drop every tessellation that is no longer referenced by a mesh.
+    void GarbageCollect();
+
+    /// Choose a uniform refine level so that the refined edges of a mesh come out at about
+    /// edgeLengthRatio * (distance to the camera), clamped to [1, maxLevel]. The world space
+    /// center the distance was measured from is written to center, if given.
+    static int ComputeAdaptiveLevel(
+        const HdMeshTopology& topology,
+        const VtVec3fArray& points,
+        const GfMatrix4f& transform,
+        const GfVec3f& cameraPosition,
+        float edgeLengthRatio,
+        int maxLevel,
+        GfVec3f* center = nullptr);
+
+    /// Remember the camera distance a mesh was leveled for, or forget it when the mesh is no
+    /// longer tessellated.
+    void SetLeveledDistance(const SdfPath& id, const GfVec3f& center, float distance);
+    void ForgetLevel(const SdfPath& id);
+
+    /// The meshes the camera got closer to or further from by more than half a level since they
+    /// were leveled. They are expected to be synced again, and are forgotten until then.
+    SdfPathVector TakeMovedMeshes(const GfVec3f& cameraPosition);
+
+   private:
+    struct _Leveled {
+        GfVec3f center;
+        float distance;
+    };
+
+    std::mutex _mutex;
+    std::unordered_map<size_t, Hd_USTC_CG_TessellationSharedPtr> _tessellations;
+    std::unordered_map<SdfPath, _Leveled, SdfPath::Hash> _leveled;
+};
+
+USTC_CG_NAMESPACE_CLOSE_SCOPE
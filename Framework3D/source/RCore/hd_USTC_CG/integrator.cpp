@@ -1,8 +1,10 @@
 #include "integrator.h"
 
 #include <boost/functional/hash.hpp>
+#include <cstring>
 #include <functional>
 #include <random>
+#include <vector>
 
 #include "Utils/Logging/Logging.h"
 #include "config.h"
@@ -16,6 +18,7 @@
 #include "pxr/pxr.h"
 #include "renderParam.h"
 #include "surfaceInteraction.h"
+#include "utils/sampling.hpp"
 USTC_CG_NAMESPACE_OPEN_SCOPE
 using namespace pxr;
 static unsigned channel(VtValue val)
@@ -33,35 +36,29 @@ static unsigned channel(VtValue val)
     TF_CODING_ERROR("val must can cast to those types");
     return 0;
 }
-/// Fill in an RTCRay structure from the given parameters.
-static void _PopulateRay(
-    RTCRay* ray,
-    const GfVec3d& origin,
-    const GfVec3d& dir,
-    float nearest,
-    float tfar = std::numeric_limits<float>::infinity())
+/// Fill in an RTCRay structure from the given ray.
+static void _PopulateRay(RTCRay* rtc_ray, const Ray& ray)
 {
-    ray->org_x = origin[0];
-    ray->org_y = origin[1];
-    ray->org_z = origin[2];
-    ray->tnear = nearest;
-
-    ray->dir_x = dir[0];
-    ray->dir_y = dir[1];
-    ray->dir_z = dir[2];
-    ray->time = 0.0f;
-
-    ray->tfar = tfar;
-    ray->mask = -1;
+    rtc_ray->org_x = ray.origin[0];
+    rtc_ray->org_y = ray.origin[1];
+    rtc_ray->org_z = ray.origin[2];
+    rtc_ray->tnear = ray.tmin;
+
+    rtc_ray->dir_x = ray.direction[0];
+    rtc_ray->dir_y = ray.direction[1];
+    rtc_ray->dir_z = ray.direction[2];
+    rtc_ray->time = ray.time;
+
+    rtc_ray->tfar = ray.tmax;
+    rtc_ray->mask = -1;
 }
 
-/// Fill in an RTCRayHit structure from the given parameters.
+/// Fill in an RTCRayHit structure from the given ray.
 // note this containts a Ray and a RayHit
-static void
-_PopulateRayHit(RTCRayHit* rayHit, const GfVec3d& origin, const GfVec3d& dir, float nearest)
+static void _PopulateRayHit(RTCRayHit* rayHit, const Ray& ray)
 {
     // Fill in defaults for the ray
-    _PopulateRay(&rayHit->ray, origin, dir, nearest);
+    _PopulateRay(&rayHit->ray, ray);
 
     // Fill in defaults for the hit
     rayHit->hit.primID = RTC_INVALID_GEOMETRY_ID;
@@ -94,39 +91,31 @@ Color Integrator::SampleLights(
     return color;
 }
 
-Color Integrator::IntersectLights(const GfRay& ray, GfVec3f& intersectPos)
+Color Integrator::IntersectLights(const Ray& ray, GfVec3f& intersectPos)
 {
-    float currentDepth = std::numeric_limits<float>::infinity();
-    Color color{ 0, 0, 0 };
-    for (auto light : (*render_param->lights)) {
-        float depth = std::numeric_limits<float>::infinity();
-        auto intersected_radiance = light->Intersect(ray, depth);
-        if (depth < currentDepth) {
-            currentDepth = depth;
-            intersectPos = GfVec3f(ray.GetPoint(depth));
-            color = intersected_radiance;
-        }
+    float depth;
+    Color color = light_batch_.Intersect(ray, depth);
+    if (depth < std::numeric_limits<float>::infinity()) {
+        intersectPos = ray.GetPoint(depth);
     }
     return color;
 }
 
-Color Integrator::IntersectDomeLight(const GfRay& ray)
+void Integrator::IntersectLights(const RayBatch& rays, float* depth, Color* radiance)
 {
-    for (auto light : (*render_param->lights)) {
-        if (light->IsDomeLight()) {
-            float depth;
-            return light->Intersect(ray, depth);
-        }
-    }
+    light_batch_.Intersect(rays, depth, radiance);
+}
 
-    return Color{ 0.0 };
+Color Integrator::IntersectDomeLight(const Ray& ray)
+{
+    return light_batch_.EvaluateDome(ray);
 }
 
-bool Integrator::Intersect(const GfRay& ray, SurfaceInteraction& si)
+bool Integrator::Intersect(const Ray& ray, SurfaceInteraction& si)
 {
     RTCRayHit rayHit;
     rayHit.ray.flags = 0;
-    _PopulateRayHit(&rayHit, ray.GetStartPoint(), ray.GetDirection(), 0.0f);
+    _PopulateRayHit(&rayHit, ray);
     {
         rtcIntersect1(rtc_scene, &rayHit);
 
@@ -189,15 +178,15 @@ bool Integrator::Intersect(const GfRay& ray, SurfaceInteraction& si)
     si.barycentric = { rayHit.hit.u, rayHit.hit.v };
     si.texcoord = texcoord;
     si.PrepareTransforms();
-    si.wo = GfVec3f(-ray.GetDirection().GetNormalized());
+    si.wo = -ray.direction;
 
     return true;
 }
 
-bool Integrator::VisibilityTest(const GfRay& ray)
+bool Integrator::VisibilityTest(const Ray& ray)
 {
     RTCRay test_ray;
-    _PopulateRay(&test_ray, ray.GetStartPoint(), ray.GetDirection(), 0);
+    _PopulateRay(&test_ray, ray);
 
     rtcOccluded1(rtc_scene, &test_ray);
 
@@ -209,15 +198,8 @@ bool Integrator::VisibilityTest(const GfRay& ray)
 
 bool Integrator::VisibilityTest(const GfVec3f& begin, const GfVec3f& end)
 {
-    GfRay ray;
-    ray.SetEnds(begin, end);
     RTCRay test_ray;
-    _PopulateRay(
-        &test_ray,
-        ray.GetStartPoint(),
-        ray.GetDirection().GetNormalized(),
-        0.0,
-        (end - begin).GetLength() - 0.0001f);
+    _PopulateRay(&test_ray, Ray::FromEnds(begin, end));
 
     rtcOccluded1(rtc_scene, &test_ray);
 
@@ -310,12 +292,16 @@ void SamplingIntegrator::_RenderTiles(
     minY = height - minY;
     maxY = height - maxY;
 
-    const unsigned int tileSize = Hd_USTC_CG_Config::GetInstance().tileSize;
+    const Hd_USTC_CG_Config& config = Hd_USTC_CG_Config::GetInstance();
+    const unsigned int tileSize = config.tileSize;
     const unsigned int numTilesX = (camera_->_dataWindow.GetWidth() + tileSize - 1) / tileSize;
 
     // Initialize the RNG for this tile (each tile creates one as
-    // a lazy way to do thread-local RNGs).
+    // a lazy way to do thread-local RNGs). In deterministic mode it is
+    // reseeded for every sample instead.
     size_t seed = std::chrono::system_clock::now().time_since_epoch().count();
+    uint32_t frame;
+    std::memcpy(&frame, &time_code, sizeof(frame));
     boost::hash_combine(seed, tileStart);
     std::default_random_engine random(seed);
 
@@ -325,6 +311,14 @@ void SamplingIntegrator::_RenderTiles(
         return uniform_dist(random);
     };
 
+    // A pixel's camera rays, and the random state each one leaves for its Li.
+    std::vector<Ray> rays(spp);
+    std::vector<std::default_random_engine> sample_random(spp);
+    RayBatch ray_batch;
+    ray_batch.reserve(spp);
+    std::vector<float> light_depth(spp, std::numeric_limits<float>::infinity());
+    std::vector<Color> light_radiance(spp, Color{ 0, 0, 0 });
+
     // _RenderTiles gets a range of tiles; iterate through them.
     for (unsigned int tile = tileStart; tile < tileEnd; ++tile) {
         // Cancellation point.
@@ -347,10 +341,27 @@ void SamplingIntegrator::_RenderTiles(
             for (unsigned int x = x0; x < x1; ++x) {
                 VtValue color;
 
+                ray_batch.clear();
                 for (int sample = 0; sample < spp; ++sample) {
+                    if (config.deterministic) {
+                        random.seed(static_cast<std::default_random_engine::result_type>(
+                            SampleSeed(config.randomSeed, frame, x, y, sample)));
+                        uniform_dist.reset();
+                    }
                     auto pixel_center_uv = GfVec2f(x, y);
-                    auto ray = camera_->generateRay(pixel_center_uv, uniform_float);
-                    auto sampled_color = Li(ray, random);
+                    rays[sample] = camera_->generateRay(pixel_center_uv, uniform_float);
+                    sample_random[sample] = random;
+                    ray_batch.push_back(rays[sample]);
+                }
+
+                // The lights along all the camera rays at once, for the miss and light hits of Li.
+                if (SeesLights()) {
+                    IntersectLights(ray_batch, light_depth.data(), light_radiance.data());
+                }
+
+                for (int sample = 0; sample < spp; ++sample) {
+                    CameraLightHit light{ light_radiance[sample], light_depth[sample] };
+                    auto sampled_color = Li(rays[sample], light, sample_random[sample]);
                     accumulate_color(color, sampled_color);
                 }
                 color = average_samples(color, spp);
@@ -364,6 +375,7 @@ void SamplingIntegrator::_RenderTiles(
 void SamplingIntegrator::Render()
 {
     camera_->film->Map();
+    light_batch_.Build(*render_param->lights);
     const unsigned int tileSize = Hd_USTC_CG_Config::GetInstance().tileSize;
 
     const unsigned int numTilesX = (camera_->_dataWindow.GetWidth() + tileSize - 1) / tileSize;
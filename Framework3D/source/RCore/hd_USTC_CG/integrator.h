@@ -1,19 +1,31 @@
 #pragma once
+#include <limits>
 #include <random>
 
 #include "camera.h"
 #include "color.h"
 #include "embree4/rtcore_geometry.h"
+#include "lightBatch.h"
 #include "pxr/base/gf/rect2i.h"
 #include "pxr/imaging/hd/renderThread.h"
 #include "pxr/imaging/hd/sceneDelegate.h"
 #include "pxr/pxr.h"
+#include "ray.h"
 #include "renderBuffer.h"
 
 USTC_CG_NAMESPACE_OPEN_SCOPE
 class Hd_USTC_CG_RenderParam;
 class SurfaceInteraction;
 using namespace pxr;
+
+// The closest light along a camera ray. The lights of all the samples of a pixel are intersected
+// together, see SamplingIntegrator::_RenderTiles.
+struct CameraLightHit {
+    Color radiance{ 0, 0, 0 };
+    // Infinity when the ray hits no light. The dome is hit by every ray, far away.
+    float depth = std::numeric_limits<float>::infinity();
+};
+
 class Integrator {
    public:
     Integrator(
@@ -31,6 +43,8 @@ class Integrator {
 
     RTCScene rtc_scene;
     Hd_USTC_CG_RenderParam* render_param;
+    // Part of the sample seeds in deterministic mode, see Hd_USTC_CG_Config::deterministic.
+    float time_code = 0;
 
    protected:
     // All the following utility functions, it is not best practice for all of them to be here.
@@ -52,21 +66,27 @@ class Integrator {
 
     /**
      * \brief for now, we only use very limited count of lights, thus we don't use any BVH on lights
+     * Goes through light_batch_, which has to be built at the start of Render().
      * \param ray the brdf sampled ray
      * \return
      */
-    Color IntersectLights(const GfRay& ray, GfVec3f& intersectPos);
-    Color IntersectDomeLight(const GfRay& ray);
+    Color IntersectLights(const Ray& ray, GfVec3f& intersectPos);
+    // The same for every ray of the batch, vectorized where the CPU allows. depth and radiance
+    // hold rays.size() elements.
+    void IntersectLights(const RayBatch& rays, float* depth, Color* radiance);
+    Color IntersectDomeLight(const Ray& ray);
 
 
-    bool Intersect(const GfRay& ray, SurfaceInteraction& si);
-    bool VisibilityTest(const GfRay& ray);
+    bool Intersect(const Ray& ray, SurfaceInteraction& si);
+    bool VisibilityTest(const Ray& ray);
     bool VisibilityTest(const GfVec3f& begin, const GfVec3f& end);
 
     Color EstimateDirectLight(SurfaceInteraction& si, const std::function<float()>& uniform_float);
 
     const Hd_USTC_CG_Camera* camera_;
     HdRenderThread* render_thread_;
+    // The lights of the current frame, laid out for batched evaluation.
+    Hd_USTC_CG_LightBatch light_batch_;
 };
 
 class SamplingIntegrator : public Integrator {
@@ -84,7 +104,16 @@ class SamplingIntegrator : public Integrator {
 
     void _writeBuffer(unsigned x, unsigned y, VtValue color);
 
-    virtual VtValue Li(const GfRay& ray, std::default_random_engine& uniform_float) = 0;
+    // light is what the camera ray runs into of the lights, when SeesLights().
+    virtual VtValue Li(
+        const Ray& ray,
+        const CameraLightHit& light,
+        std::default_random_engine& uniform_float) = 0;
+    // Whether Li shows the lights the camera sees. Otherwise they aren't intersected.
+    virtual bool SeesLights() const
+    {
+        return true;
+    }
     void accumulate_color(VtValue& color, const VtValue& vt_value);
     VtValue average_samples(const VtValue& color, unsigned spp);
     void _RenderTiles(HdRenderThread* renderThread, size_t tileStart, size_t tileEnd);
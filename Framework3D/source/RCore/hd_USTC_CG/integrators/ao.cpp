@@ -10,7 +10,7 @@
 USTC_CG_NAMESPACE_OPEN_SCOPE
 using namespace pxr;
 
-VtValue AOIntegrator::Li(const GfRay& ray, std::default_random_engine& random)
+VtValue AOIntegrator::Li(const Ray& ray, const CameraLightHit&, std::default_random_engine& random)
 {
     std::uniform_real_distribution<float> uniform_dist(0.0f, 1.0f);
     std::function<float()> uniform_float = std::bind(uniform_dist, random);
@@ -20,7 +20,7 @@ VtValue AOIntegrator::Li(const GfRay& ray, std::default_random_engine& random)
         return VtValue(GfVec4f{ 0, 0, 0, 1 });
 
     // Flip the normal if opposite
-    if (GfDot(si.shadingNormal, ray.GetDirection()) > 0) {
+    if (GfDot(si.shadingNormal, ray.direction) > 0) {
         si.flipNormal();
         si.PrepareTransforms();
     }
@@ -40,8 +40,7 @@ VtValue AOIntegrator::Li(const GfRay& ray, std::default_random_engine& random)
     for (int i = 0; i < spp; i++) {
         float pdf;
         GfVec3f shadowDir = si.TangentToWorld(CosineWeightedDirection(samples[i], pdf));
-        GfRay shadow_ray;
-        shadow_ray.SetPointAndDirection(si.position + 0.00001f * si.geometricNormal, shadowDir);
+        Ray shadow_ray(si.position + 0.00001f * si.geometricNormal, shadowDir);
 
         if (VisibilityTest(shadow_ray))
             color += GfDot(shadowDir, si.shadingNormal) / pdf;
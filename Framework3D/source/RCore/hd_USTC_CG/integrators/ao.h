@@ -6,7 +6,6 @@
 #include "renderParam.h"
 #include "renderer.h"
 #include "pxr/pxr.h"
-#include "pxr/base/gf/ray.h"
 
 USTC_CG_NAMESPACE_OPEN_SCOPE
 class SurfaceInteraction;
@@ -24,8 +23,15 @@ public:
 
 protected:
     
-    VtValue Li(const GfRay& ray, std::default_random_engine& uniform_float)
-    override;
+    VtValue Li(
+        const Ray& ray,
+        const CameraLightHit& light,
+        std::default_random_engine& uniform_float) override;
+    // Occlusion only.
+    bool SeesLights() const override
+    {
+        return false;
+    }
 };
 
 USTC_CG_NAMESPACE_CLOSE_SCOPE
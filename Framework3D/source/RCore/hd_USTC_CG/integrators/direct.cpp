@@ -6,18 +6,27 @@
 USTC_CG_NAMESPACE_OPEN_SCOPE
 using namespace pxr;
 
-VtValue DirectLightIntegrator::Li(const GfRay& ray, std::default_random_engine& random)
+VtValue DirectLightIntegrator::Li(
+    const Ray& ray,
+    const CameraLightHit& light,
+    std::default_random_engine& random)
 {
     std::uniform_real_distribution<float> uniform_dist(
         0.0f, 1.0f - std::numeric_limits<float>::epsilon());
     std::function<float()> uniform_float = std::bind(uniform_dist, random);
 
     SurfaceInteraction si;
-    if (!Intersect(ray, si))
-        return VtValue(GfVec3f{ 0, 0, 0 });
+    if (!Intersect(ray, si)) {
+        return VtValue(light.radiance);
+    }
+    // A light in front of the surface hides it.
+    float depth = GfDot(si.position - ray.origin, ray.direction) / ray.direction.GetLengthSq();
+    if (light.depth < depth) {
+        return VtValue(light.radiance);
+    }
 
     // Flip the normal if opposite
-    if (GfDot(si.shadingNormal, ray.GetDirection()) > 0) {
+    if (GfDot(si.shadingNormal, ray.direction) > 0) {
         si.flipNormal();
         si.PrepareTransforms();
     }
@@ -16,7 +16,10 @@ class DirectLightIntegrator : public SamplingIntegrator {
     }
 
    protected:
-    VtValue Li(const GfRay& ray, std::default_random_engine& uniform_float) override;
+    VtValue Li(
+        const Ray& ray,
+        const CameraLightHit& light,
+        std::default_random_engine& uniform_float) override;
 };
 
 USTC_CG_NAMESPACE_CLOSE_SCOPE
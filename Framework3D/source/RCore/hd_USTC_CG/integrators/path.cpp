@@ -6,21 +6,25 @@
 USTC_CG_NAMESPACE_OPEN_SCOPE
 using namespace pxr;
 
-VtValue PathIntegrator::Li(const GfRay& ray, std::default_random_engine& random)
+VtValue PathIntegrator::Li(
+    const Ray& ray,
+    const CameraLightHit& light,
+    std::default_random_engine& random)
 {
     std::uniform_real_distribution<float> uniform_dist(
         0.0f, 1.0f - std::numeric_limits<float>::epsilon());
     std::function<float()> uniform_float = std::bind(uniform_dist, random);
 
-    auto color = EstimateOutGoingRadiance(ray, uniform_float, 0);
+    auto color = EstimateOutGoingRadiance(ray, uniform_float, 0, &light);
 
     return VtValue(GfVec3f(color[0], color[1], color[2]));
 }
 
 GfVec3f PathIntegrator::EstimateOutGoingRadiance(
-    const GfRay& ray,
+    const Ray& ray,
     const std::function<float()>& uniform_float,
-    int recursion_depth)
+    int recursion_depth,
+    const CameraLightHit* camera_light)
 {
     if (recursion_depth >= 50) {
         return {};
@@ -29,18 +33,22 @@ GfVec3f PathIntegrator::EstimateOutGoingRadiance(
     SurfaceInteraction si;
     if (!Intersect(ray, si)) {
         if (recursion_depth == 0) {
-            return IntersectDomeLight(ray);
+            // The dome, or a light out in the open.
+            return camera_light ? camera_light->radiance : IntersectDomeLight(ray);
         }
 
         return GfVec3f{ 0, 0, 0 };
     }
 
-    // This can be customized : Do we want to see the lights? (Other than dome lights?)
-    if (recursion_depth == 0) {
+    // The camera sees the lights, and a light in front of the surface hides it.
+    if (recursion_depth == 0 && camera_light &&
+        camera_light->depth <
+            GfDot(si.position - ray.origin, ray.direction) / ray.direction.GetLengthSq()) {
+        return camera_light->radiance;
     }
 
     // Flip the normal if opposite
-    if (GfDot(si.shadingNormal, ray.GetDirection()) > 0) {
+    if (GfDot(si.shadingNormal, ray.direction) > 0) {
         si.flipNormal();
         si.PrepareTransforms();
     }
@@ -16,12 +16,17 @@ class PathIntegrator : public SamplingIntegrator {
     }
 
    protected:
-    VtValue Li(const GfRay& ray, std::default_random_engine& uniform_float) override;
+    VtValue Li(
+        const Ray& ray,
+        const CameraLightHit& light,
+        std::default_random_engine& uniform_float) override;
 
+    // camera_light is what the ray runs into of the lights, for the camera ray only.
     GfVec3f EstimateOutGoingRadiance(
-        const GfRay& ray,
+        const Ray& ray,
         const std::function<float()>& uniform_float,
-        int recursion_depth);
+        int recursion_depth,
+        const CameraLightHit* camera_light = nullptr);
 };
 
 USTC_CG_NAMESPACE_CLOSE_SCOPE
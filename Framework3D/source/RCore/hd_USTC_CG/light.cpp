@@ -2,7 +2,6 @@
 
 #include "Utils/Logging/Logging.h"
 #include "pxr/base/gf/plane.h"
-#include "pxr/base/gf/ray.h"
 #include "pxr/base/gf/rotation.h"
 #include "pxr/base/gf/vec2f.h"
 #include "pxr/imaging/glf/simpleLight.h"
@@ -142,13 +141,21 @@ Color Hd_USTC_CG_Sphere_Light::Sample(
     return irradiance / M_PI;
 }
 
-Color Hd_USTC_CG_Sphere_Light::Intersect(const GfRay& ray, float& depth)
+Color Hd_USTC_CG_Sphere_Light::Intersect(const Ray& ray, float& depth)
 {
-    double distance;
-    if (ray.Intersect(GfRange3d{ position - GfVec3d{ radius }, position + GfVec3d{ radius } })) {
-        if (ray.Intersect(position, radius, &distance)) {
-            depth = distance;
-
+    // The direction is normalized, so the quadratic reduces to t^2 + 2bt + c = 0.
+    auto oc = ray.origin - position;
+    float b = GfDot(oc, ray.direction);
+    float c = GfDot(oc, oc) - radius * radius;
+    float discriminant = b * b - c;
+    if (discriminant >= 0) {
+        float sqrt_discriminant = std::sqrt(discriminant);
+        float t = -b - sqrt_discriminant;
+        if (t < ray.tmin) {
+            t = -b + sqrt_discriminant;
+        }
+        if (t >= ray.tmin && t <= ray.tmax) {
+            depth = t;
             return irradiance / M_PI;
         }
     }
@@ -195,10 +202,10 @@ Color Hd_USTC_CG_Dome_Light::Sample(
     return Le(dir);
 }
 
-Color Hd_USTC_CG_Dome_Light::Intersect(const GfRay& ray, float& depth)
+Color Hd_USTC_CG_Dome_Light::Intersect(const Ray& ray, float& depth)
 {
     depth = 10000000.f;
-    return Le(GfVec3f(ray.GetDirection()).GetNormalized());
+    return Le(ray.direction);
 }
 
 void Hd_USTC_CG_Dome_Light::_PrepareDomeLight(SdfPath const& id, HdSceneDelegate* sceneDelegate)
@@ -235,18 +242,29 @@ void Hd_USTC_CG_Dome_Light::Sync(
 
 Color Hd_USTC_CG_Dome_Light::Le(const GfVec3f& dir)
 {
-    if (texture != nullptr) {
-        auto uv = GfVec2f((M_PI + std::atan2(dir[1], dir[0])) / 2.0 / M_PI, 0.5 - dir[2] * 0.5);
+    if (texture == nullptr) {
+        return radiance;
+    }
+    return LeFromUV(DirectionToUV(dir));
+}
 
-        auto value = texture->Evaluate(uv);
+GfVec2f Hd_USTC_CG_Dome_Light::DirectionToUV(const GfVec3f& dir)
+{
+    return GfVec2f((M_PI + std::atan2(dir[1], dir[0])) / 2.0 / M_PI, 0.5 - dir[2] * 0.5);
+}
 
-        if (texture->component_conut() >= 3) {
-            return GfCompMult(Color{ value[0], value[1], value[2] }, radiance);
-        }
-    }
-    else {
+Color Hd_USTC_CG_Dome_Light::LeFromUV(const GfVec2f& uv) const
+{
+    if (texture == nullptr) {
         return radiance;
     }
+
+    auto value = texture->Evaluate(uv);
+
+    if (texture->component_conut() >= 3) {
+        return GfCompMult(Color{ value[0], value[1], value[2] }, radiance);
+    }
+    return value[0] * radiance;
 }
 
 void Hd_USTC_CG_Dome_Light::Finalize(HdRenderParam* renderParam)
@@ -298,11 +316,11 @@ Color Hd_USTC_CG_Distant_Light::Sample(
     return radiance;
 }
 
-Color Hd_USTC_CG_Distant_Light::Intersect(const GfRay& ray, float& depth)
+Color Hd_USTC_CG_Distant_Light::Intersect(const Ray& ray, float& depth)
 {
     depth = 10000000.f;
 
-    if (GfDot(ray.GetDirection().GetNormalized(), -direction) > cos(angle)) {
+    if (GfDot(ray.direction, -direction) > cos(angle)) {
         return radiance;
     }
     return Color(0);
@@ -318,7 +336,7 @@ Color Hd_USTC_CG_Rect_Light::Sample(
     return {};
 }
 
-Color Hd_USTC_CG_Rect_Light::Intersect(const GfRay& ray, float& depth)
+Color Hd_USTC_CG_Rect_Light::Intersect(const Ray& ray, float& depth)
 {
     return {};
 }
@@ -7,6 +7,7 @@
 #include "pxr/imaging/hio/image.h"
 #include "pxr/pxr.h"
 #include "pxr/usd/sdf/assetPath.h"
+#include "ray.h"
 #include "texture.h"
 
 USTC_CG_NAMESPACE_OPEN_SCOPE
@@ -28,7 +29,7 @@ class Hd_USTC_CG_Light : public HdLight {
         GfVec3f& sampled_light_pos,
         float& sample_light_pdf,
         const std::function<float()>& uniform_float) = 0;
-    virtual Color Intersect(const GfRay& ray, float& depth) = 0;
+    virtual Color Intersect(const Ray& ray, float& depth) = 0;
 
     bool IsDomeLight();
 
@@ -56,7 +57,7 @@ class Hd_USTC_CG_Sphere_Light : public Hd_USTC_CG_Light {
         GfVec3f& sampled_light_pos,
         float& sample_light_pdf,
         const std::function<float()>& uniform_float) override;
-    Color Intersect(const GfRay& ray, float& depth) override;
+    Color Intersect(const Ray& ray, float& depth) override;
     void Sync(HdSceneDelegate* sceneDelegate, HdRenderParam* renderParam, HdDirtyBits* dirtyBits)
         override;
     float radius;
@@ -79,12 +80,20 @@ class Hd_USTC_CG_Dome_Light : public Hd_USTC_CG_Light {
         GfVec3f& sampled_light_pos,
         float& sample_light_pdf,
         const std::function<float()>& uniform_float) override;
-    Color Intersect(const GfRay& ray, float& depth) override;
+    Color Intersect(const Ray& ray, float& depth) override;
     void _PrepareDomeLight(SdfPath const& id, HdSceneDelegate* scene_delegate);
     void Sync(HdSceneDelegate* sceneDelegate, HdRenderParam* renderParam, HdDirtyBits* dirtyBits)
         override;
 
     Color Le(const GfVec3f& dir);
+    /// Le() split in two, for callers that compute the lat-long coordinates themselves (see
+    /// Hd_USTC_CG_LightBatch).
+    static GfVec2f DirectionToUV(const GfVec3f& dir);
+    Color LeFromUV(const GfVec2f& uv) const;
+    bool HasTexture() const
+    {
+        return texture != nullptr;
+    }
     void Finalize(HdRenderParam* renderParam) override;
 
    private:
@@ -108,7 +117,7 @@ class Hd_USTC_CG_Distant_Light : public Hd_USTC_CG_Light {
         GfVec3f& sampled_light_pos,
         float& sample_light_pdf,
         const std::function<float()>& uniform_float) override;
-    Color Intersect(const GfRay& ray, float& depth) override;
+    Color Intersect(const Ray& ray, float& depth) override;
 
    private:
     float angle;
@@ -129,7 +138,7 @@ class Hd_USTC_CG_Rect_Light : public Hd_USTC_CG_Light {
         GfVec3f& sampled_light_pos,
         float& sample_light_pdf,
         const std::function<float()>& uniform_float) override;
-    Color Intersect(const GfRay& ray, float& depth) override;
+    Color Intersect(const Ray& ray, float& depth) override;
     void Sync(HdSceneDelegate* sceneDelegate, HdRenderParam* renderParam, HdDirtyBits* dirtyBits)
         override;
 
@@ -0,0 +1,295 @@
+#include "lightBatch.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "light.h"
+#include "lightBatchKernels.h"
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <immintrin.h>
+#include <intrin.h>
+#endif
+
+USTC_CG_NAMESPACE_OPEN_SCOPE
+using namespace pxr;
+
+namespace light_kernels {
+
+bool CpuSupportsAvx2()
+{
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) {
+        return false;
+    }
+    // AVX needs both the CPU flag and the OS saving the YMM registers.
+    __cpuid(info, 1);
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    const bool avx = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6) {
+        return false;
+    }
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+    return __builtin_cpu_supports("avx2");
+#else
+    return false;
+#endif
+}
+
+void IntersectSpheresScalar(
+    const RaysSoA& rays,
+    const SpheresSoA& spheres,
+    size_t first,
+    float* depth,
+    int* sphere)
+{
+    for (size_t i = first; i < rays.count; ++i) {
+        for (size_t s = 0; s < spheres.count; ++s) {
+            const float ocx = rays.originX[i] - spheres.centerX[s];
+            const float ocy = rays.originY[i] - spheres.centerY[s];
+            const float ocz = rays.originZ[i] - spheres.centerZ[s];
+            const float b =
+                ocx * rays.directionX[i] + ocy * rays.directionY[i] + ocz * rays.directionZ[i];
+            const float c = ocx * ocx + ocy * ocy + ocz * ocz - spheres.radius2[s];
+            const float discriminant = b * b - c;
+            if (discriminant < 0) {
+                continue;
+            }
+            const float sqrtDiscriminant = std::sqrt(discriminant);
+            float t = -b - sqrtDiscriminant;
+            if (t < rays.tmin[i]) {
+                t = -b + sqrtDiscriminant;
+            }
+            if (t >= rays.tmin[i] && t <= rays.tmax[i] && t < depth[i]) {
+                depth[i] = t;
+                sphere[i] = static_cast<int>(s);
+            }
+        }
+    }
+}
+
+void DirectionsToUVScalar(const RaysSoA& rays, size_t first, float* u, float* v)
+{
+    for (size_t i = first; i < rays.count; ++i) {
+        const GfVec2f uv = Hd_USTC_CG_Dome_Light::DirectionToUV(
+            GfVec3f(rays.directionX[i], rays.directionY[i], rays.directionZ[i]));
+        u[i] = uv[0];
+        v[i] = uv[1];
+    }
+}
+
+}  // namespace light_kernels
+
+namespace {
+
+// Depth reported for lights at infinity, as in Hd_USTC_CG_Dome_Light::Intersect.
+constexpr float kInfiniteLightDepth = 10000000.f;
+
+bool HasAvx2()
+{
+    static const bool hasAvx2 = light_kernels::CpuSupportsAvx2();
+    return hasAvx2;
+}
+
+light_kernels::RaysSoA View(const RayBatch& rays)
+{
+    return { rays.originX.data(),    rays.originY.data(),    rays.originZ.data(),
+             rays.directionX.data(), rays.directionY.data(), rays.directionZ.data(),
+             rays.tmin.data(),       rays.tmax.data(),       rays.size() };
+}
+
+light_kernels::RaysSoA View(const Ray& ray)
+{
+    return { &ray.origin[0],    &ray.origin[1],    &ray.origin[2], &ray.direction[0],
+             &ray.direction[1], &ray.direction[2], &ray.tmin,      &ray.tmax,
+             1 };
+}
+
+}  // namespace
+
+void RayBatch::reserve(size_t n)
+{
+    for (auto* v : { &originX, &originY, &originZ, &directionX, &directionY, &directionZ, &tmin,
+                     &tmax }) {
+        v->reserve(n);
+    }
+}
+
+void RayBatch::clear()
+{
+    for (auto* v : { &originX, &originY, &originZ, &directionX, &directionY, &directionZ, &tmin,
+                     &tmax }) {
+        v->clear();
+    }
+}
+
+void RayBatch::push_back(const Ray& ray)
+{
+    originX.push_back(ray.origin[0]);
+    originY.push_back(ray.origin[1]);
+    originZ.push_back(ray.origin[2]);
+    directionX.push_back(ray.direction[0]);
+    directionY.push_back(ray.direction[1]);
+    directionZ.push_back(ray.direction[2]);
+    tmin.push_back(ray.tmin);
+    tmax.push_back(ray.tmax);
+}
+
+Ray RayBatch::operator[](size_t i) const
+{
+    return Ray(
+        GfVec3f(originX[i], originY[i], originZ[i]),
+        GfVec3f(directionX[i], directionY[i], directionZ[i]),
+        tmin[i],
+        tmax[i]);
+}
+
+void Hd_USTC_CG_LightBatch::Build(const VtArray<Hd_USTC_CG_Light*>& lights)
+{
+    _sphereCenterX.clear();
+    _sphereCenterY.clear();
+    _sphereCenterZ.clear();
+    _sphereRadius2.clear();
+    _sphereRadiance.clear();
+    _dome = nullptr;
+    _otherLights.clear();
+
+    for (auto light : lights) {
+        if (auto sphere = dynamic_cast<Hd_USTC_CG_Sphere_Light*>(light)) {
+            _sphereCenterX.push_back(sphere->position[0]);
+            _sphereCenterY.push_back(sphere->position[1]);
+            _sphereCenterZ.push_back(sphere->position[2]);
+            _sphereRadius2.push_back(sphere->radius * sphere->radius);
+            _sphereRadiance.push_back(sphere->irradiance / M_PI);
+            continue;
+        }
+        // Keep the authored order, so ties between infinite lights resolve as before.
+        if (light->IsDomeLight() && _dome == nullptr) {
+            _dome = static_cast<Hd_USTC_CG_Dome_Light*>(light);
+        }
+        _otherLights.push_back(light);
+    }
+}
+
+void Hd_USTC_CG_LightBatch::_IntersectSpheres(const RayBatch& rays, float* depth, int* sphere)
+    const
+{
+    const light_kernels::RaysSoA raysSoA = View(rays);
+    const light_kernels::SpheresSoA spheresSoA = { _sphereCenterX.data(),
+                                                   _sphereCenterY.data(),
+                                                   _sphereCenterZ.data(),
+                                                   _sphereRadius2.data(),
+                                                   _sphereRadius2.size() };
+
+    size_t done = 0;
+    if (HasAvx2()) {
+        done = light_kernels::IntersectSpheresAvx2(raysSoA, spheresSoA, depth, sphere);
+    }
+    light_kernels::IntersectSpheresScalar(raysSoA, spheresSoA, done, depth, sphere);
+}
+
+Color Hd_USTC_CG_LightBatch::Intersect(const Ray& ray, float& depth) const
+{
+    // A single ray gains nothing from the vector path, but still walks the compact sphere arrays
+    // instead of calling into every light.
+    const light_kernels::SpheresSoA spheresSoA = { _sphereCenterX.data(),
+                                                   _sphereCenterY.data(),
+                                                   _sphereCenterZ.data(),
+                                                   _sphereRadius2.data(),
+                                                   _sphereRadius2.size() };
+    depth = std::numeric_limits<float>::infinity();
+    int sphere = -1;
+    light_kernels::IntersectSpheresScalar(View(ray), spheresSoA, 0, &depth, &sphere);
+
+    Color color = sphere >= 0 ? _sphereRadiance[sphere] : Color{ 0, 0, 0 };
+    for (auto light : _otherLights) {
+        float lightDepth = std::numeric_limits<float>::infinity();
+        auto intersected_radiance = light->Intersect(ray, lightDepth);
+        if (lightDepth < depth) {
+            depth = lightDepth;
+            color = intersected_radiance;
+        }
+    }
+    return color;
+}
+
+void Hd_USTC_CG_LightBatch::Intersect(const RayBatch& rays, float* depth, Color* radiance) const
+{
+    const size_t count = rays.size();
+    std::fill(depth, depth + count, std::numeric_limits<float>::infinity());
+
+    std::vector<int> sphere(count, -1);
+    if (!_sphereRadius2.empty()) {
+        _IntersectSpheres(rays, depth, sphere.data());
+    }
+    for (size_t i = 0; i < count; ++i) {
+        radiance[i] = sphere[i] >= 0 ? _sphereRadiance[sphere[i]] : Color{ 0, 0, 0 };
+    }
+
+    if (_otherLights.empty()) {
+        return;
+    }
+
+    std::vector<Color> domeRadiance;
+    if (_dome) {
+        domeRadiance.resize(count);
+        EvaluateDome(rays, domeRadiance.data());
+    }
+
+    for (auto light : _otherLights) {
+        for (size_t i = 0; i < count; ++i) {
+            float lightDepth = std::numeric_limits<float>::infinity();
+            Color color;
+            if (light == _dome) {
+                lightDepth = kInfiniteLightDepth;
+                color = domeRadiance[i];
+            }
+            else {
+                color = light->Intersect(rays[i], lightDepth);
+            }
+            if (lightDepth < depth[i]) {
+                depth[i] = lightDepth;
+                radiance[i] = color;
+            }
+        }
+    }
+}
+
+Color Hd_USTC_CG_LightBatch::EvaluateDome(const Ray& ray) const
+{
+    if (_dome == nullptr) {
+        return Color{ 0.0 };
+    }
+    return _dome->Le(ray.direction);
+}
+
+void Hd_USTC_CG_LightBatch::EvaluateDome(const RayBatch& rays, Color* radiance) const
+{
+    const size_t count = rays.size();
+    if (_dome == nullptr || !_dome->HasTexture()) {
+        // Constant radiance (or none), no need for the lookup coordinates.
+        const Color constant = _dome ? _dome->LeFromUV(GfVec2f(0)) : Color{ 0.0 };
+        std::fill(radiance, radiance + count, constant);
+        return;
+    }
+
+    std::vector<float> u(count), v(count);
+    const light_kernels::RaysSoA raysSoA = View(rays);
+    size_t done = 0;
+    if (HasAvx2()) {
+        done = light_kernels::DirectionsToUVAvx2(raysSoA, u.data(), v.data());
+    }
+    light_kernels::DirectionsToUVScalar(raysSoA, done, u.data(), v.data());
+
+    // The texel fetches stay scalar; HioImage offers no gather.
+    for (size_t i = 0; i < count; ++i) {
+        radiance[i] = _dome->LeFromUV(GfVec2f(u[i], v[i]));
+    }
+}
+
+USTC_CG_NAMESPACE_CLOSE_SCOPE
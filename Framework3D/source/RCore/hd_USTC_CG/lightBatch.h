@@ -0,0 +1,71 @@
+#pragma once
+#include <vector>
+
+#include "USTC_CG.h"
+#include "color.h"
+#include "pxr/base/vt/array.h"
+#include "pxr/pxr.h"
+#include "ray.h"
+
+USTC_CG_NAMESPACE_OPEN_SCOPE
+using namespace pxr;
+class Hd_USTC_CG_Light;
+class Hd_USTC_CG_Dome_Light;
+
+/// Rays in structure-of-arrays layout, so that the light kernels can load eight lanes of the same
+/// component at once.
+struct RayBatch {
+    std::vector<float> originX, originY, originZ;
+    std::vector<float> directionX, directionY, directionZ;
+    std::vector<float> tmin, tmax;
+
+    size_t size() const
+    {
+        return originX.size();
+    }
+
+    void reserve(size_t n);
+    void clear();
+    void push_back(const Ray& ray);
+    Ray operator[](size_t i) const;
+};
+
+/// \class Hd_USTC_CG_LightBatch
+///
+/// A snapshot of the scene lights for the duration of a render. Sphere lights are flattened into
+/// SoA arrays and intersected with AVX2 when the CPU supports it (eight rays per iteration),
+/// with a scalar loop as fallback. The dome light keeps its texture but has its lat-long lookup
+/// coordinates computed in batches as well. Every other light type still goes through the virtual
+/// Hd_USTC_CG_Light::Intersect.
+///
+/// The results match calling Intersect() on every light and keeping the closest hit, which is what
+/// Integrator::IntersectLights used to do. The sampling integrators intersect the camera rays of a
+/// pixel as one batch.
+///
+class Hd_USTC_CG_LightBatch {
+   public:
+    void Build(const VtArray<Hd_USTC_CG_Light*>& lights);
+
+    /// Closest light hit along a single ray. depth is infinity when nothing is hit.
+    Color Intersect(const Ray& ray, float& depth) const;
+
+    /// Closest light hit for every ray of the batch. depth and radiance must hold rays.size()
+    /// elements.
+    void Intersect(const RayBatch& rays, float* depth, Color* radiance) const;
+
+    /// Radiance of the dome light seen along each ray (the miss shader); zero without a dome.
+    Color EvaluateDome(const Ray& ray) const;
+    void EvaluateDome(const RayBatch& rays, Color* radiance) const;
+
+   private:
+    void _IntersectSpheres(const RayBatch& rays, float* depth, int* sphere) const;
+
+    std::vector<float> _sphereCenterX, _sphereCenterY, _sphereCenterZ;
+    std::vector<float> _sphereRadius2;
+    std::vector<Color> _sphereRadiance;
+
+    Hd_USTC_CG_Dome_Light* _dome = nullptr;
+    std::vector<Hd_USTC_CG_Light*> _otherLights;
+};
+
+USTC_CG_NAMESPACE_CLOSE_SCOPE
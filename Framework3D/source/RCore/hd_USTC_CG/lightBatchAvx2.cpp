@@ -0,0 +1,139 @@
+#include "lightBatchKernels.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+USTC_CG_NAMESPACE_OPEN_SCOPE
+namespace light_kernels {
+
+#if defined(__AVX2__)
+
+size_t IntersectSpheresAvx2(
+    const RaysSoA& rays,
+    const SpheresSoA& spheres,
+    float* depth,
+    int* sphere)
+{
+    const size_t count = rays.count / 8 * 8;
+    for (size_t i = 0; i < count; i += 8) {
+        const __m256 ox = _mm256_loadu_ps(rays.originX + i);
+        const __m256 oy = _mm256_loadu_ps(rays.originY + i);
+        const __m256 oz = _mm256_loadu_ps(rays.originZ + i);
+        const __m256 dx = _mm256_loadu_ps(rays.directionX + i);
+        const __m256 dy = _mm256_loadu_ps(rays.directionY + i);
+        const __m256 dz = _mm256_loadu_ps(rays.directionZ + i);
+        const __m256 tmin = _mm256_loadu_ps(rays.tmin + i);
+        const __m256 tmax = _mm256_loadu_ps(rays.tmax + i);
+
+        __m256 best = _mm256_loadu_ps(depth + i);
+        __m256i bestSphere = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(sphere + i));
+
+        for (size_t s = 0; s < spheres.count; ++s) {
+            // Same quadratic as Hd_USTC_CG_Sphere_Light::Intersect, for eight rays at once.
+            const __m256 ocx = _mm256_sub_ps(ox, _mm256_set1_ps(spheres.centerX[s]));
+            const __m256 ocy = _mm256_sub_ps(oy, _mm256_set1_ps(spheres.centerY[s]));
+            const __m256 ocz = _mm256_sub_ps(oz, _mm256_set1_ps(spheres.centerZ[s]));
+
+            __m256 b = _mm256_mul_ps(ocx, dx);
+            b = _mm256_add_ps(b, _mm256_mul_ps(ocy, dy));
+            b = _mm256_add_ps(b, _mm256_mul_ps(ocz, dz));
+
+            __m256 c = _mm256_mul_ps(ocx, ocx);
+            c = _mm256_add_ps(c, _mm256_mul_ps(ocy, ocy));
+            c = _mm256_add_ps(c, _mm256_mul_ps(ocz, ocz));
+            c = _mm256_sub_ps(c, _mm256_set1_ps(spheres.radius2[s]));
+
+            const __m256 discriminant = _mm256_sub_ps(_mm256_mul_ps(b, b), c);
+            __m256 valid = _mm256_cmp_ps(discriminant, _mm256_setzero_ps(), _CMP_GE_OQ);
+
+            const __m256 sqrtDiscriminant =
+                _mm256_sqrt_ps(_mm256_max_ps(discriminant, _mm256_setzero_ps()));
+            const __m256 minusB = _mm256_sub_ps(_mm256_setzero_ps(), b);
+            const __m256 tNear = _mm256_sub_ps(minusB, sqrtDiscriminant);
+            const __m256 tFar = _mm256_add_ps(minusB, sqrtDiscriminant);
+            const __m256 t = _mm256_blendv_ps(tNear, tFar, _mm256_cmp_ps(tNear, tmin, _CMP_LT_OQ));
+
+            valid = _mm256_and_ps(valid, _mm256_cmp_ps(t, tmin, _CMP_GE_OQ));
+            valid = _mm256_and_ps(valid, _mm256_cmp_ps(t, tmax, _CMP_LE_OQ));
+            valid = _mm256_and_ps(valid, _mm256_cmp_ps(t, best, _CMP_LT_OQ));
+
+            best = _mm256_blendv_ps(best, t, valid);
+            bestSphere = _mm256_castps_si256(_mm256_blendv_ps(
+                _mm256_castsi256_ps(bestSphere),
+                _mm256_castsi256_ps(_mm256_set1_epi32(static_cast<int>(s))),
+                valid));
+        }
+
+        _mm256_storeu_ps(depth + i, best);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(sphere + i), bestSphere);
+    }
+    return count;
+}
+
+// atan2 with a minimax polynomial on [0, 1] and octant fix-up. The error stays below 1e-5 rad,
+// well under a texel of any reasonable environment map.
+static __m256 Atan2(__m256 y, __m256 x)
+{
+    const __m256 signMask = _mm256_set1_ps(-0.0f);
+    const __m256 absX = _mm256_andnot_ps(signMask, x);
+    const __m256 absY = _mm256_andnot_ps(signMask, y);
+
+    const __m256 maxXY = _mm256_max_ps(absX, absY);
+    const __m256 minXY = _mm256_min_ps(absX, absY);
+    // Avoid 0 / 0 for the zero vector; atan2(0, 0) comes out as 0 like std::atan2.
+    const __m256 a = _mm256_div_ps(minXY, _mm256_max_ps(maxXY, _mm256_set1_ps(1e-30f)));
+    const __m256 s = _mm256_mul_ps(a, a);
+
+    __m256 r = _mm256_set1_ps(-0.01172120f);
+    r = _mm256_add_ps(_mm256_mul_ps(r, s), _mm256_set1_ps(0.05265332f));
+    r = _mm256_add_ps(_mm256_mul_ps(r, s), _mm256_set1_ps(-0.11643287f));
+    r = _mm256_add_ps(_mm256_mul_ps(r, s), _mm256_set1_ps(0.19354346f));
+    r = _mm256_add_ps(_mm256_mul_ps(r, s), _mm256_set1_ps(-0.33262347f));
+    r = _mm256_add_ps(_mm256_mul_ps(r, s), _mm256_set1_ps(0.99997726f));
+    r = _mm256_mul_ps(r, a);
+
+    const __m256 halfPi = _mm256_set1_ps(1.57079637f);
+    const __m256 pi = _mm256_set1_ps(3.14159274f);
+    r = _mm256_blendv_ps(r, _mm256_sub_ps(halfPi, r), _mm256_cmp_ps(absY, absX, _CMP_GT_OQ));
+    r = _mm256_blendv_ps(
+        r, _mm256_sub_ps(pi, r), _mm256_cmp_ps(x, _mm256_setzero_ps(), _CMP_LT_OQ));
+    // Copy the sign of y.
+    return _mm256_xor_ps(r, _mm256_and_ps(y, signMask));
+}
+
+size_t DirectionsToUVAvx2(const RaysSoA& rays, float* u, float* v)
+{
+    const __m256 pi = _mm256_set1_ps(3.14159274f);
+    const __m256 inv2Pi = _mm256_set1_ps(0.159154943f);
+    const __m256 half = _mm256_set1_ps(0.5f);
+
+    const size_t count = rays.count / 8 * 8;
+    for (size_t i = 0; i < count; i += 8) {
+        const __m256 dx = _mm256_loadu_ps(rays.directionX + i);
+        const __m256 dy = _mm256_loadu_ps(rays.directionY + i);
+        const __m256 dz = _mm256_loadu_ps(rays.directionZ + i);
+
+        const __m256 phi = Atan2(dy, dx);
+        _mm256_storeu_ps(u + i, _mm256_mul_ps(_mm256_add_ps(pi, phi), inv2Pi));
+        _mm256_storeu_ps(v + i, _mm256_sub_ps(half, _mm256_mul_ps(dz, half)));
+    }
+    return count;
+}
+
+#else
+
+size_t IntersectSpheresAvx2(const RaysSoA&, const SpheresSoA&, float*, int*)
+{
+    return 0;
+}
+
+size_t DirectionsToUVAvx2(const RaysSoA&, float*, float*)
+{
+    return 0;
+}
+
+#endif
+
+}  // namespace light_kernels
+USTC_CG_NAMESPACE_CLOSE_SCOPE
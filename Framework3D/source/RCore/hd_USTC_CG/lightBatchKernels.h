@@ -0,0 +1,52 @@
+#pragma once
+#include <cstddef>
+
+#include "USTC_CG.h"
+
+USTC_CG_NAMESPACE_OPEN_SCOPE
+
+// The raw kernels behind Hd_USTC_CG_LightBatch. The AVX2 versions live in their own translation
+// unit (lightBatchAvx2.cpp), the only one built with AVX2 enabled, so no inline function compiled
+// with AVX2 instructions can leak into the code paths that run on older CPUs. For the same reason
+// this header only deals in plain pointers.
+namespace light_kernels {
+
+struct RaysSoA {
+    const float *originX, *originY, *originZ;
+    const float *directionX, *directionY, *directionZ;
+    const float *tmin, *tmax;
+    size_t count;
+};
+
+struct SpheresSoA {
+    const float *centerX, *centerY, *centerZ;
+    const float* radius2;
+    size_t count;
+};
+
+bool CpuSupportsAvx2();
+
+// For each ray, replace (depth, sphere) with the nearest sphere hit in [tmin, tmax] closer than
+// the current depth. Rays are processed from index `first` on.
+void IntersectSpheresScalar(
+    const RaysSoA& rays,
+    const SpheresSoA& spheres,
+    size_t first,
+    float* depth,
+    int* sphere);
+
+// Lat-long texture coordinates of the ray directions, matching Hd_USTC_CG_Dome_Light::Le.
+void DirectionsToUVScalar(const RaysSoA& rays, size_t first, float* u, float* v);
+
+// The AVX2 versions handle the rays in groups of eight and return how many rays they processed;
+// the scalar versions finish the remainder. They process nothing when built without AVX2.
+size_t IntersectSpheresAvx2(
+    const RaysSoA& rays,
+    const SpheresSoA& spheres,
+    float* depth,
+    int* sphere);
+size_t DirectionsToUVAvx2(const RaysSoA& rays, float* u, float* v);
+
+}  // namespace light_kernels
+
+USTC_CG_NAMESPACE_CLOSE_SCOPE
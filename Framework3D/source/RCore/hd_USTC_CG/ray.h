@@ -0,0 +1,55 @@
+#pragma once
+#include <limits>
+
+#include "USTC_CG.h"
+#include "pxr/base/gf/vec3f.h"
+
+USTC_CG_NAMESPACE_OPEN_SCOPE
+using namespace pxr;
+
+/// Single precision ray used inside the renderer. Embree consumes float rays directly, so the
+/// integrators, lights and materials all work with this type rather than GfRay, which stores
+/// doubles.
+///
+/// The direction is expected to be normalized; the constructors do not normalize for you.
+struct Ray {
+    GfVec3f origin;
+    GfVec3f direction;
+    float tmin = 0.0f;
+    float tmax = std::numeric_limits<float>::infinity();
+    float time = 0.0f;
+
+    Ray() = default;
+
+    Ray(const GfVec3f& origin,
+        const GfVec3f& direction,
+        float tmin = 0.0f,
+        float tmax = std::numeric_limits<float>::infinity(),
+        float time = 0.0f)
+        : origin(origin),
+          direction(direction),
+          tmin(tmin),
+          tmax(tmax),
+          time(time)
+    {
+    }
+
+    /// A segment ray from begin towards end, with tmax stopping epsilon short of end.
+    static Ray FromEnds(const GfVec3f& begin, const GfVec3f& end, float epsilon = 0.0001f);
+
+    GfVec3f GetPoint(float t) const;
+};
+
+inline Ray Ray::FromEnds(const GfVec3f& begin, const GfVec3f& end, float epsilon)
+{
+    GfVec3f dir = end - begin;
+    const float length = dir.Normalize();
+    return Ray(begin, dir, 0.0f, length - epsilon);
+}
+
+inline GfVec3f Ray::GetPoint(float t) const
+{
+    return origin + t * direction;
+}
+
+USTC_CG_NAMESPACE_CLOSE_SCOPE
@@ -80,7 +80,7 @@ HdResourceRegistrySharedPtr Hd_USTC_CG_RenderDelegate::_resourceRegistry;
 void Hd_USTC_CG_RenderDelegate::_Initialize()
 {
     // Initialize the settings and settings descriptors.
-    _settingDescriptors.resize(5);
+    _settingDescriptors.resize(6);
     _settingDescriptors[0] = { "Enable Scene Colors",
                                Hd_USTC_CG_RenderSettingsTokens->enableSceneColors,
                                VtValue(Hd_USTC_CG_Config::GetInstance().useFaceColors) };
@@ -100,12 +100,22 @@ void Hd_USTC_CG_RenderDelegate::_Initialize()
     _settingDescriptors[4] = { "Render Mode",
                                Hd_USTC_CG_RenderSettingsTokens->renderMode,
                                VtValue(0) };
+    // Set by the application to the time code being shown; it seeds the deterministic mode.
+    _settingDescriptors[5] = { "Time Code",
+                               Hd_USTC_CG_RenderSettingsTokens->timeCode,
+                               VtValue(0.0f) };
     _PopulateDefaultSettings(_settingDescriptors);
 
     _renderParam = std::make_shared<Hd_USTC_CG_RenderParam>(&_renderThread, &_sceneVersion);
     lights.reserve(16);
     _renderParam->lights = &lights;
     _renderParam->materials = &materials;
+    _renderParam->tessellationCache = &tessellationCache;
+    if (!Hd_USTC_CG_Config::GetInstance().meshCacheDirectory.empty()) {
+        meshDiskCache = std::make_unique<Hd_USTC_CG_MeshDiskCache>(
+            Hd_USTC_CG_Config::GetInstance().meshCacheDirectory);
+        _renderParam->meshDiskCache = meshDiskCache.get();
+    }
 
     _renderer = std::make_shared<Hd_USTC_CG_Renderer>(_renderParam.get());
 
@@ -177,6 +187,8 @@ HdResourceRegistrySharedPtr Hd_USTC_CG_RenderDelegate::GetResourceRegistry() con
 
 void Hd_USTC_CG_RenderDelegate::CommitResources(HdChangeTracker* tracker)
 {
+    // All rprims are synced by now, so tessellations no mesh holds on to can go.
+    tessellationCache.GarbageCollect();
 }
 
 HdRenderPassSharedPtr Hd_USTC_CG_RenderDelegate::CreateRenderPass(
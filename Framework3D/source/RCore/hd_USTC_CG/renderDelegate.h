@@ -24,6 +24,8 @@
 #ifndef EXTRAS_IMAGING_EXAMPLES_HD_TINY_RENDER_DELEGATE_H
 #define EXTRAS_IMAGING_EXAMPLES_HD_TINY_RENDER_DELEGATE_H
 
+#include "geometries/meshDiskCache.h"
+#include "geometries/tessellationCache.h"
 #include "pxr/base/tf/staticTokens.h"
 #include "pxr/imaging/hd/renderDelegate.h"
 #include "pxr/pxr.h"
@@ -33,7 +35,7 @@
 USTC_CG_NAMESPACE_OPEN_SCOPE
 using namespace pxr;
 #define HDEMBREE_RENDER_SETTINGS_TOKENS \
-    (enableAmbientOcclusion)(enableSceneColors)(ambientOcclusionSamples)(renderMode)
+    (enableAmbientOcclusion)(enableSceneColors)(ambientOcclusionSamples)(renderMode)(timeCode)
 // Also: HdRenderSettingsTokens->convergedSamplesPerPixel
 
 TF_DECLARE_PUBLIC_TOKENS(Hd_USTC_CG_RenderSettingsTokens, HDEMBREE_RENDER_SETTINGS_TOKENS);
@@ -92,6 +94,8 @@ class Hd_USTC_CG_RenderDelegate final : public HdRenderDelegate {
 
     pxr::VtArray<Hd_USTC_CG_Light*> lights;
     pxr::TfHashMap<SdfPath, Hd_USTC_CG_Material*, TfHash> materials;
+    Hd_USTC_CG_TessellationCache tessellationCache;
+    std::unique_ptr<Hd_USTC_CG_MeshDiskCache> meshDiskCache;
 
     static std::mutex _mutexResourceRegistry;
     static std::atomic_int _counterResourceRegistry;
@@ -26,6 +26,7 @@
 #include <embree4/rtcore.h>
 
 #include "USTC_CG.h"
+#include "pxr/base/gf/vec3f.h"
 #include "pxr/imaging/hd/renderDelegate.h"
 #include "pxr/imaging/hd/renderThread.h"
 #include "pxr/pxr.h"
@@ -33,6 +34,8 @@
 USTC_CG_NAMESPACE_OPEN_SCOPE
 class Hd_USTC_CG_Light;
 class Hd_USTC_CG_Material;
+class Hd_USTC_CG_TessellationCache;
+class Hd_USTC_CG_MeshDiskCache;
 using namespace pxr;
 
 ///
@@ -66,6 +69,15 @@ class Hd_USTC_CG_RenderParam final : public HdRenderParam {
     friend class Hd_USTC_CG_Renderer;
     pxr::TfHashMap<SdfPath, Hd_USTC_CG_Material *, TfHash> *materials = nullptr;
     pxr::VtArray<Hd_USTC_CG_Light *> *lights = nullptr;
+    Hd_USTC_CG_TessellationCache *tessellationCache = nullptr;
+    /// Null unless HDEMBREE_MESH_CACHE_DIR is set.
+    Hd_USTC_CG_MeshDiskCache *meshDiskCache = nullptr;
+    /// World space position of the camera used by the last render, for
+    /// view-dependent tessellation during the next Sync(). Until the first
+    /// render, the cameras set it as they sync, which happens before the
+    /// meshes sync.
+    GfVec3f cameraPosition = GfVec3f(0.0f);
+    bool cameraPositionFromRender = false;
 
    private:
     /// A handle to the top-level embree scene.
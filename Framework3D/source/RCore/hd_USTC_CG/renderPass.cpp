@@ -27,9 +27,13 @@
 
 #include <iostream>
 
+#include "geometries/mesh.h"
 #include "renderBuffer.h"
+#include "renderDelegate.h"
+#include "renderParam.h"
 #include "pxr/imaging/hd/renderBuffer.h"
 #include "pxr/imaging/hd/renderDelegate.h"
+#include "pxr/imaging/hd/renderIndex.h"
 
 USTC_CG_NAMESPACE_OPEN_SCOPE
 using namespace pxr;
@@ -94,6 +98,8 @@ Hd_USTC_CG_RenderPass::_Execute(
     {
         _renderThread->StopRender();
         _lastSettingsVersion = currentSettingsVersion;
+        _renderer->SetTimeCode(renderDelegate->GetRenderSetting<float>(
+            Hd_USTC_CG_RenderSettingsTokens->timeCode, 0.0f));
 
         needStartRender = true;
     }
@@ -113,6 +119,17 @@ Hd_USTC_CG_RenderPass::_Execute(
         _renderThread->StopRender();
         _renderer->renderTimeUpdateCamera(renderPassState);
 
+        // Pre-tessellated meshes the camera moved away from pick their
+        // refine level again on the next sync.
+        auto renderParam = static_cast<Hd_USTC_CG_RenderParam*>(
+            GetRenderIndex()->GetRenderDelegate()->GetRenderParam());
+        HdChangeTracker& changeTracker = GetRenderIndex()->GetChangeTracker();
+        for (const SdfPath& id :
+             renderParam->tessellationCache->TakeMovedMeshes(renderParam->cameraPosition))
+        {
+            changeTracker.MarkRprimDirty(id, Hd_USTC_CG_Mesh::DirtyTessellation);
+        }
+
         needStartRender = true;
     }
 
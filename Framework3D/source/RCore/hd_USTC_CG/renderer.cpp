@@ -51,6 +51,7 @@ void Hd_USTC_CG_Renderer::Render(HdRenderThread* renderThread)
 
     integrator->rtc_scene = _rtcScene;
     integrator->render_param = render_param;
+    integrator->time_code = _timeCode;
 
     integrator->Render();
 }
@@ -96,6 +97,11 @@ void Hd_USTC_CG_Renderer::SetScene(RTCScene scene)
     _rtcScene = scene;
 }
 
+void Hd_USTC_CG_Renderer::SetTimeCode(float time_code)
+{
+    _timeCode = time_code;
+}
+
 /* static */
 GfVec4f Hd_USTC_CG_Renderer::_GetClearColor(const VtValue& clearValue)
 {
@@ -165,6 +171,9 @@ void Hd_USTC_CG_Renderer::renderTimeUpdateCamera(const HdRenderPassStateSharedPt
 {
     camera_ = static_cast<const Hd_USTC_CG_Camera*>(renderPassState->GetCamera());
     camera_->update(renderPassState);
+    render_param->cameraPosition =
+        GfVec3f(renderPassState->GetWorldToViewMatrix().GetInverse().ExtractTranslation());
+    render_param->cameraPositionFromRender = true;
 }
 
 bool Hd_USTC_CG_Renderer::_ValidateAovBindings()
@@ -18,6 +18,8 @@ class Hd_USTC_CG_Renderer {
     virtual void Render(HdRenderThread* render_thread);
     virtual void Clear();
     void SetScene(RTCScene scene);
+    // The scene time code, part of the sample seeds in deterministic mode.
+    void SetTimeCode(float time_code);
 
     void MarkAovBuffersUnconverged();
 
@@ -32,6 +34,7 @@ class Hd_USTC_CG_Renderer {
 
     bool _enableSceneColors;
     std::atomic<int> _completedSamples;
+    float _timeCode = 0;
 
     Hd_USTC_CG_RenderParam* render_param;
     // A callback that interprets embree error codes and injects them into
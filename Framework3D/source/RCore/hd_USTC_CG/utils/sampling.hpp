@@ -1,3 +1,6 @@
+#pragma once
+#include <cstdint>
+
 #include "USTC_CG.h"
 #include "pxr/base/gf/math.h"
 
@@ -61,4 +64,19 @@ inline GfVec3f UniformSampleHemiSphere(const GfVec2f& uniform_float, float& pdf)
     return ret;
 }
 
+/// Seed for the random engine of one camera sample, so that it only depends on which sample it is
+/// and not on which thread or in which order it gets rendered. Every index goes through the
+/// splitmix64 finalizer, since neighbouring seeds give correlated streams with the LCG behind
+/// std::default_random_engine.
+inline uint64_t SampleSeed(uint64_t seed, uint64_t frame, uint64_t x, uint64_t y, uint64_t sample)
+{
+    auto mix = [](uint64_t h, uint64_t v) {
+        h += v + 0x9e3779b97f4a7c15ull;
+        h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ull;
+        h = (h ^ (h >> 27)) * 0x94d049bb133111ebull;
+        return h ^ (h >> 31);
+    };
+    return mix(mix(mix(mix(mix(0, seed), frame), x), y), sample);
+}
+
 USTC_CG_NAMESPACE_CLOSE_SCOPE
\ No newline at end of file
@@ -0,0 +1,443 @@
+// Runs a serialized node tree without the GUI, e.g. for nightly simulation caches and perf tests
+// on machines without a display.
+//
+//   graph_runner <tree.json> [options]
+//     The tree can also be in the binary form of NodeTree::SerializeBinary.
+//     --system geometry|composition   Kind of tree (default: geometry).
+//     --executor simulation|parallel|eager|lazy
+//                                     Default: simulation for geometry, lazy for composition,
+//                                     as in the editor.
+//     --frames <first> <last>         Time codes to execute, from first up to last (default: 0 0).
+//                                     A simulation tree steps by its geom_time_gain, as in the
+//                                     editor; other trees go one time code at a time.
+//     --output <stage.usda>           Where to export what the tree wrote to the stage
+//                                     (default: the tree file with a .usda extension).
+//     --timing <timing.json>          Per-node and per-frame timings.
+//     --trace <trace.json>            Every node execution, in the Chrome trace format.
+//     --wedge <wedge.json>            Execute every frame once per variant of the wedge file,
+//                                     exporting <output>_<variant>.usda for each (with the frame
+//                                     appended when there are several).
+//
+// A wedge file lists the variants, each overriding unlinked inputs by node id and identifier:
+//
+//   [ { "name": "soft", "overrides": { "12/Stiffness": 10.0, "12/Iterations": 4 } },
+//     { "name": "stiff", "overrides": { "12/Stiffness": 1000.0 } } ]
+//
+// Render trees need a GL context and are not supported here.
+
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+#include "Nodes/GlobalUsdStage.h"
+#include "Nodes/node_exec_eager.hpp"
+#include "Nodes/node_exec_lazy.hpp"
+#include "Nodes/node_exec_parallel.hpp"
+#include "Nodes/node_exec_simulation.hpp"
+#include "Nodes/node_exec_wedge.hpp"
+#include "Nodes/node_profiler.hpp"
+#include "Nodes/node_register.h"
+#include "Nodes/node_tree.hpp"
+#include "Nodes/pin.hpp"
+#include "Utils/json.hpp"
+#include "pxr/usd/usdGeom/metrics.h"
+#include "pxr/usd/usdGeom/tokens.h"
+
+using namespace USTC_CG;
+
+struct RunnerOptions {
+    std::string tree_path;
+    std::string system = "geometry";
+    std::string executor;
+    int first_frame = 0;
+    int last_frame = 0;
+    std::string output_path;
+    std::string timing_path;
+    std::string trace_path;
+    std::string wedge_path;
+};
+
+static void print_usage()
+{
+    std::cerr << "Usage: graph_runner <tree.json> [--system geometry|composition]\n"
+                 "                    [--executor simulation|parallel|eager|lazy]\n"
+                 "                    [--frames <first> <last>] [--output <stage.usda>]\n"
+                 "                    [--timing <timing.json>] [--trace <trace.json>]\n"
+                 "                    [--wedge <wedge.json>]\n";
+}
+
+static bool parse_options(int argc, char* argv[], RunnerOptions& options)
+{
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto has_values = [&](int count) { return i + count < argc; };
+
+        if (arg == "--system" && has_values(1)) {
+            options.system = argv[++i];
+        }
+        else if (arg == "--executor" && has_values(1)) {
+            options.executor = argv[++i];
+        }
+        else if (arg == "--frames" && has_values(2)) {
+            try {
+                options.first_frame = std::stoi(argv[i + 1]);
+                options.last_frame = std::stoi(argv[i + 2]);
+            }
+            catch (const std::logic_error&) {
+                std::cerr << "Invalid frames: " << argv[i + 1] << " " << argv[i + 2] << std::endl;
+                return false;
+            }
+            i += 2;
+        }
+        else if (arg == "--output" && has_values(1)) {
+            options.output_path = argv[++i];
+        }
+        else if (arg == "--timing" && has_values(1)) {
+            options.timing_path = argv[++i];
+        }
+        else if (arg == "--trace" && has_values(1)) {
+            options.trace_path = argv[++i];
+        }
+        else if (arg == "--wedge" && has_values(1)) {
+            options.wedge_path = argv[++i];
+        }
+        else if (!arg.starts_with("--") && options.tree_path.empty()) {
+            options.tree_path = arg;
+        }
+        else {
+            std::cerr << "Unknown or incomplete option: " << arg << std::endl;
+            return false;
+        }
+    }
+
+    if (options.tree_path.empty() || options.first_frame > options.last_frame) {
+        return false;
+    }
+    if (options.system != "geometry" && options.system != "composition") {
+        std::cerr << "Unknown system: " << options.system << std::endl;
+        return false;
+    }
+    if (options.executor.empty()) {
+        options.executor = options.system == "geometry" ? "simulation" : "lazy";
+    }
+    if (options.output_path.empty()) {
+        options.output_path =
+            std::filesystem::path(options.tree_path).replace_extension(".usda").string();
+    }
+    return true;
+}
+
+static std::unique_ptr<NodeTreeExecutor> create_executor(const std::string& name)
+{
+    if (name == "simulation") {
+        return CreateEagerNodeTreeExecutorSimulation();
+    }
+    if (name == "parallel") {
+        return CreateParallelNodeTreeExecutor();
+    }
+    if (name == "eager") {
+        return std::make_unique<EagerNodeTreeExecutor>();
+    }
+    if (name == "lazy") {
+        return CreateLazyNodeTreeExecutor();
+    }
+    return nullptr;
+}
+
+struct FrameTiming {
+    int frame;
+    float time_code;
+    double ms;
+};
+
+static bool write_timing(
+    const std::string& path,
+    const RunnerOptions& options,
+    const NodeProfiler& profiler,
+    const std::vector<FrameTiming>& frame_ms)
+{
+    nlohmann::json value;
+    value["tree"] = options.tree_path;
+    value["system"] = options.system;
+    value["executor"] = options.executor;
+
+    auto& frames = value["frames"] = nlohmann::json::array();
+    for (auto&& timing : frame_ms) {
+        frames.push_back(
+            { { "frame", timing.frame }, { "time_code", timing.time_code }, { "ms", timing.ms } });
+    }
+
+    auto& nodes = value["nodes"] = nlohmann::json::array();
+    for (auto&& profile : profiler.get_profiles()) {
+        nodes.push_back({ { "id", profile.node_id },
+                          { "name", profile.ui_name },
+                          { "type", profile.type_name },
+                          { "calls", profile.call_count },
+                          { "total_ms", profile.total_ms },
+                          { "average_ms", profile.average_ms() },
+                          { "max_ms", profile.max_ms },
+                          { "output_bytes", profile.output_bytes } });
+    }
+
+    std::ofstream file(path);
+    if (!file) {
+        return false;
+    }
+    file << value.dump(2);
+    return bool(file);
+}
+
+// Same preparation of the stage as the editor does before executing.
+static void prepare_stage(const RunnerOptions& options)
+{
+    auto& stage = GlobalUsdStage::global_usd_stage;
+    if (options.system == "geometry") {
+        stage->RemovePrim(pxr::SdfPath("/geom"));
+        stage->RemovePrim(pxr::SdfPath("/TexModel"));
+    }
+    else {
+        stage->RemovePrim(pxr::SdfPath("/Reference"));
+        pxr::UsdGeomSetStageUpAxis(stage, pxr::UsdGeomTokens->z);
+    }
+}
+
+static NodeSocket* find_input(NodeTree& tree, unsigned node_id, const std::string& identifier)
+{
+    for (auto&& node : tree.nodes) {
+        if (node->ID.Get() != node_id) {
+            continue;
+        }
+        for (auto input : node->inputs) {
+            if (identifier == input->identifier) {
+                return input;
+            }
+        }
+    }
+    return nullptr;
+}
+
+static bool load_wedge(const std::string& path, NodeTree& tree, std::vector<WedgeVariant>& variants)
+{
+    std::ifstream file(path);
+    if (!file) {
+        std::cerr << "Can't open " << path << std::endl;
+        return false;
+    }
+
+    try {
+        auto value = nlohmann::json::parse(file);
+        for (auto&& variant_json : value) {
+            auto& variant = variants.emplace_back();
+            variant.name = variant_json.value("name", std::to_string(variants.size() - 1));
+
+            for (auto&& [address, override_json] : variant_json["overrides"].items()) {
+                auto slash = address.find('/');
+                NodeSocket* socket = nullptr;
+                if (slash != std::string::npos) {
+                    socket = find_input(
+                        tree, std::stoul(address.substr(0, slash)), address.substr(slash + 1));
+                }
+                if (!socket) {
+                    std::cerr << "No input " << address << " in the tree" << std::endl;
+                    return false;
+                }
+
+                if (override_json.is_number_integer()) {
+                    variant.overrides.push_back({ socket, override_json.get<int>() });
+                }
+                else if (override_json.is_number()) {
+                    variant.overrides.push_back({ socket, override_json.get<float>() });
+                }
+                else {
+                    variant.overrides.push_back({ socket, override_json.get<std::string>() });
+                }
+            }
+        }
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Can't read the wedge: " << e.what() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+static std::string
+variant_output_path(const RunnerOptions& options, const WedgeVariant& variant, int frame)
+{
+    std::filesystem::path path = options.output_path;
+    auto name = path.stem().string() + "_" + variant.name;
+    if (options.first_frame != options.last_frame) {
+        name += "_" + std::to_string(frame);
+    }
+    return path.replace_filename(name + path.extension().string()).string();
+}
+
+// Executes one frame for every variant, each going on from its own state. Returns false when
+// something failed.
+static bool run_wedge(
+    const RunnerOptions& options,
+    NodeTree& tree,
+    NodeTreeExecutor& executor,
+    const std::vector<WedgeVariant>& variants,
+    WedgeState& state,
+    int frame,
+    float time_code)
+{
+    auto& stage = GlobalUsdStage::global_usd_stage;
+    bool succeeded = true;
+
+    auto results = execute_wedge(
+        &executor,
+        &tree,
+        variants,
+        [&](size_t) {
+            // Each variant starts from a clean stage, so that its file only holds its own output.
+            prepare_stage(options);
+            sync_time_code(&executor, &tree, time_code);
+        },
+        [&](size_t i) {
+            auto path = variant_output_path(options, variants[i], frame);
+            if (!stage->Export(path)) {
+                std::cerr << "Can't export the stage to " << path << std::endl;
+                succeeded = false;
+            }
+        },
+        &state);
+
+    for (size_t i = 0; i < results.size(); ++i) {
+        auto& result = results[i];
+        std::cout << "Frame " << frame << ", " << variants[i].name << ": ";
+        if (result.same_as != i) {
+            // Same result as an earlier variant, so the same file.
+            std::cout << "same as " << variants[result.same_as].name << std::endl;
+            std::error_code error;
+            std::filesystem::copy_file(
+                variant_output_path(options, variants[result.same_as], frame),
+                variant_output_path(options, variants[i], frame),
+                std::filesystem::copy_options::overwrite_existing,
+                error);
+            succeeded &= !error;
+        }
+        else {
+            std::cout << result.ms << " ms" << std::endl;
+        }
+        succeeded &= !result.failed;
+    }
+    return succeeded;
+}
+
+int main(int argc, char* argv[])
+{
+    RunnerOptions options;
+    if (!parse_options(argc, argv, options)) {
+        print_usage();
+        return 2;
+    }
+
+    std::ifstream file(options.tree_path, std::ios::binary);
+    if (!file) {
+        std::cerr << "Can't open " << options.tree_path << std::endl;
+        return 1;
+    }
+    std::stringstream content;
+    content << file.rdbuf();
+
+    register_all();
+
+    NodeTree tree;
+    try {
+        auto data = content.str();
+        if (NodeTree::IsBinary(data)) {
+            tree.DeserializeBinary(data);
+        }
+        else {
+            tree.Deserialize(data);
+        }
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Can't read the tree: " << e.what() << std::endl;
+        return 1;
+    }
+
+    auto executor = create_executor(options.executor);
+    if (!executor) {
+        std::cerr << "Unknown executor: " << options.executor << std::endl;
+        return 2;
+    }
+    NodeProfiler profiler;
+    executor->profiler = &profiler;
+
+    auto& stage = GlobalUsdStage::global_usd_stage;
+    prepare_stage(options);
+
+    std::vector<FrameTiming> frame_ms;
+    bool failed = false;
+
+    std::vector<WedgeVariant> variants;
+    WedgeState wedge_state;
+    if (!options.wedge_path.empty() && !load_wedge(options.wedge_path, tree, variants)) {
+        return 1;
+    }
+
+    // Frames count the executions, from the first one.
+    float time_code = float(options.first_frame);
+    for (int frame = options.first_frame; time_code <= options.last_frame; ++frame) {
+        if (!variants.empty()) {
+            failed |= !run_wedge(options, tree, *executor, variants, wedge_state, frame, time_code);
+        }
+        else {
+            auto start = std::chrono::steady_clock::now();
+
+            executor->prepare_tree(&tree);
+            sync_time_code(executor.get(), &tree, time_code);
+            executor->execute_tree(&tree);
+            executor->finalize(&tree);
+
+            double ms = std::chrono::duration<double, std::milli>(
+                            std::chrono::steady_clock::now() - start)
+                            .count();
+            frame_ms.push_back({ frame, time_code, ms });
+            std::cout << "Frame " << frame << " (time code " << time_code << "): " << ms << " ms"
+                      << std::endl;
+
+            for (auto&& node : tree.nodes) {
+                if (node->REQUIRED && !node->execution_failed.empty()) {
+                    std::cerr << "  " << node->ui_name << " failed: " << node->execution_failed
+                              << std::endl;
+                    failed = true;
+                }
+            }
+        }
+
+        auto time_gain = fetch_time_gain(executor.get(), &tree);
+        float next = time_gain ? next_simulation_time_code(time_code, *time_gain) : time_code + 1;
+        if (!(next > time_code)) {
+            std::cerr << "geom_time_gain doesn't move the time code on from " << time_code
+                      << std::endl;
+            failed = true;
+            break;
+        }
+        time_code = next;
+    }
+
+    if (variants.empty() && !stage->Export(options.output_path)) {
+        std::cerr << "Can't export the stage to " << options.output_path << std::endl;
+        failed = true;
+    }
+    if (!options.timing_path.empty() &&
+        !write_timing(options.timing_path, options, profiler, frame_ms)) {
+        std::cerr << "Can't write the timings to " << options.timing_path << std::endl;
+        failed = true;
+    }
+    if (!options.trace_path.empty() && !profiler.export_chrome_trace(options.trace_path)) {
+        std::cerr << "Can't write the trace to " << options.trace_path << std::endl;
+        failed = true;
+    }
+
+    return failed ? 1 : 0;
+}
@@ -17,6 +17,26 @@ int ExeParams::get_input_index(const char* identifier) const
     return -1;
 }
 
+DemandParams::DemandParams(const Node& node, std::function<GMutablePointer(int)> pull)
+    : node_(node),
+      needed_(node.inputs.size(), false),
+      pull_(std::move(pull))
+{
+}
+
+int DemandParams::get_input_index(const char* identifier) const
+{
+    int counter = 0;
+    for (NodeSocket* socket : node_.inputs) {
+        if (std::string(socket->identifier) == identifier) {
+            return counter;
+        }
+        counter++;
+    }
+    assert(false);
+    return -1;
+}
+
 int ExeParams::get_output_index(const char* identifier)
 {
     int counter = 0;
@@ -1,5 +1,10 @@
 #include "Nodes/node_exec_eager.hpp"
 
+#include <algorithm>
+#include <functional>
+#include <new>
+
+#include "Nodes/node_profiler.hpp"
 #include "Nodes/node_tree.hpp"
 #include "USTC_CG.h"
 // #include "Utils/Functions/GenericPointer_.hpp"
@@ -7,37 +12,93 @@
 
 USTC_CG_NAMESPACE_OPEN_SCOPE
 
+static uint64_t hash_combine(uint64_t seed, uint64_t value)
+{
+    return seed ^ (value + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2));
+}
+
+RuntimeArena::~RuntimeArena()
+{
+    if (data_) {
+        ::operator delete(data_, std::align_val_t(capacity_alignment_));
+    }
+}
+
+size_t RuntimeArena::add(const CPPType& type)
+{
+    size_t alignment = type.alignment();
+    size_t offset = (size_ + alignment - 1) / alignment * alignment;
+    size_ = offset + type.size();
+    alignment_ = std::max(alignment_, alignment);
+    return offset;
+}
+
+void RuntimeArena::commit()
+{
+    if (size_ <= capacity_ && alignment_ <= capacity_alignment_) {
+        return;
+    }
+    if (data_) {
+        ::operator delete(data_, std::align_val_t(capacity_alignment_));
+    }
+    // Some headroom, so that growing the tree a little doesn't reallocate every time.
+    capacity_ = size_ + size_ / 2;
+    capacity_alignment_ = alignment_;
+    data_ = static_cast<std::byte*>(
+        ::operator new(capacity_, std::align_val_t(capacity_alignment_)));
+}
+
+void RuntimeArena::reset()
+{
+    size_ = 0;
+}
+
+EagerNodeTreeExecutor::~EagerNodeTreeExecutor()
+{
+    clear();
+
+    for (auto&& [node, cached] : output_cache) {
+        clear_cached_outputs(cached);
+    }
+}
+
 ExeParams EagerNodeTreeExecutor::prepare_params(NodeTree* tree, Node* node)
 {
     node->MISSING_INPUT = false;
 
+    // A node's inputs and outputs have consecutive slots.
     ExeParams params{ *node };
-    for (auto&& input : node->inputs) {
+    int first_input = node->inputs.empty() ? 0 : runtime_index(node->inputs[0]);
+    for (int i = 0; i < node->inputs.size(); ++i) {
+        auto input = node->inputs[i];
         GMutablePointer input_ptr;
+        auto& input_state = input_states[first_input + i];
 
-        if (input_states[index_cache[input]].is_forwarded) {
+        if (input_state.is_forwarded) {
             // Is set by previous node
-            input_ptr = input_states[index_cache[input]].value;
+            input_ptr = input_state.value;
         }
         else if (input->directly_linked_sockets.empty() && input->default_value) {
             // Has default value
-            input_states[index_cache[input]].value.type()->copy_construct(
-                default_value_storage(input), input_states[index_cache[input]].value.get());
-            input_ptr = input_states[index_cache[input]].value;
+            input_state.value.type()->copy_construct(
+                default_value_storage(input), input_state.value.get());
+            input_ptr = input_state.value;
         }
         else {
             // Node not filled. Cannot run this node.
-            input_ptr = input_states[index_cache[input]].value;
+            input_ptr = input_state.value;
             input_ptr.type()->default_construct(input_ptr.get());
 
-            node->MISSING_INPUT = true;
+            if (is_input_required(input)) {
+                node->MISSING_INPUT = true;
+            }
         }
         params.inputs_.push_back(input_ptr);
     }
 
-    for (auto&& output : node->outputs) {
-        auto output_ptr = output_states[index_cache[output]].value;
-        params.outputs_.push_back(output_ptr);
+    int first_output = node->outputs.empty() ? 0 : runtime_index(node->outputs[0]);
+    for (int i = 0; i < node->outputs.size(); ++i) {
+        params.outputs_.push_back(output_states[first_output + i].value);
     }
 
     return params;
@@ -50,6 +111,7 @@ bool EagerNodeTreeExecutor::execute_node(NodeTree* tree, Node* node)
         return false;
     }
     auto typeinfo = node->typeinfo;
+    auto start = NodeProfiler::Clock::now();
     try {
         typeinfo->node_execute(params);
         node->execution_failed = {};
@@ -58,14 +120,22 @@ bool EagerNodeTreeExecutor::execute_node(NodeTree* tree, Node* node)
         node->execution_failed = err.what();
         return false;
     }
+    if (profiler && profiler->enabled) {
+        auto end = NodeProfiler::Clock::now();
+        size_t output_bytes = 0;
+        for (auto&& output : params.outputs_) {
+            output_bytes += output.type()->byte_size(output.get());
+        }
+        profiler->record(node, start, end, output_bytes);
+    }
     return true;
 }
 
 void EagerNodeTreeExecutor::forward_output_to_input(Node* node)
 {
     for (auto&& output : node->outputs) {
+        auto& output_state = output_states[runtime_index(output)];
         if (output->directly_linked_sockets.empty()) {
-            auto& output_state = output_states[index_cache[output]];
             assert(output_state.is_last_used == false);
             output_state.is_last_used = true;
         }
@@ -74,16 +144,14 @@ void EagerNodeTreeExecutor::forward_output_to_input(Node* node)
 
             for (int i = 0; i < output->directly_linked_sockets.size(); ++i) {
                 auto directly_linked_input_socket = output->directly_linked_sockets[i];
+                int input_index = runtime_index(directly_linked_input_socket);
 
-                if (index_cache.find(directly_linked_input_socket) != index_cache.end()) {
+                if (input_index >= 0) {
                     if (directly_linked_input_socket->Node->REQUIRED) {
-                        last_used_id =
-                            std::max(last_used_id, int(index_cache[directly_linked_input_socket]));
+                        last_used_id = std::max(last_used_id, input_index);
                     }
 
-                    auto& input_state = input_states[index_cache[directly_linked_input_socket]];
-
-                    auto& output_state = output_states[index_cache[output]];
+                    auto& input_state = input_states[input_index];
 
                     auto cpp_type = output->type_info->cpp_type;
                     auto is_last_target = i == output->directly_linked_sockets.size() - 1;
@@ -110,7 +178,7 @@ void EagerNodeTreeExecutor::forward_output_to_input(Node* node)
                 }
             }
             if (last_used_id == -1) {
-                output_states[index_cache[output]].is_last_used = true;
+                output_state.is_last_used = true;
             }
             else {
                 assert(input_states[last_used_id].is_last_used == false);
@@ -121,29 +189,285 @@ void EagerNodeTreeExecutor::forward_output_to_input(Node* node)
     }
 }
 
+bool EagerNodeTreeExecutor::is_cacheable(Node* node)
+{
+    auto typeinfo = node->typeinfo;
+    // Nodes that are there for their side effects have to run every time.
+    if (typeinfo->ALWAYS_REQUIRED || typeinfo->THREAD_UNSAFE || typeinfo->NO_CACHE) {
+        return false;
+    }
+    if (externally_synced.contains(node)) {
+        return false;
+    }
+    for (auto output : node->outputs) {
+        // An 'Any' output points to memory owned by someone else.
+        if (output->type_info->type == SocketType::Any ||
+            !output->type_info->cpp_type->has_special_member_functions()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool EagerNodeTreeExecutor::compute_input_hash(Node* node, uint64_t& hash)
+{
+    if (!is_cacheable(node)) {
+        return false;
+    }
+
+    hash = std::hash<const void*>()(node->typeinfo);
+    for (auto input : node->inputs) {
+        // Whatever decided to leave it out is itself an input, and part of the hash.
+        if (!is_input_required(input)) {
+            continue;
+        }
+        uint64_t input_hash = 0;
+        if (!input->directly_linked_sockets.empty()) {
+            int upstream_index = runtime_index(input->directly_linked_sockets[0]);
+            if (upstream_index < 0 || !input_states[runtime_index(input)].is_forwarded) {
+                return false;
+            }
+            input_hash = output_hashes[upstream_index];
+        }
+        else if (input->default_value && input->type_info->cpp_type->is_hashable()) {
+            input_hash = input->type_info->cpp_type->hash(default_value_storage(input));
+        }
+
+        if (input_hash == 0) {
+            return false;
+        }
+        hash = hash_combine(hash, input_hash);
+    }
+    return true;
+}
+
+bool EagerNodeTreeExecutor::reuse_cached_outputs(Node* node, uint64_t input_hash)
+{
+    auto found = output_cache.find(node);
+    if (found == output_cache.end() || found->second.input_hash != input_hash ||
+        found->second.values.size() != node->outputs.size()) {
+        return false;
+    }
+
+    // A node's outputs have consecutive slots.
+    auto& values = found->second.values;
+    int first_output = node->outputs.empty() ? 0 : runtime_index(node->outputs[0]);
+    for (int i = 0; i < node->outputs.size(); ++i) {
+        if (values[i].type() != output_states[first_output + i].value.type()) {
+            return false;
+        }
+    }
+    for (int i = 0; i < node->outputs.size(); ++i) {
+        auto& output_state = output_states[first_output + i];
+        values[i].type()->copy_assign(values[i].get(), output_state.value.get());
+    }
+    node->MISSING_INPUT = false;
+    node->execution_failed = {};
+    return true;
+}
+
+void EagerNodeTreeExecutor::update_output_hashes(Node* node, const uint64_t* input_hash)
+{
+    int first_output = node->outputs.empty() ? 0 : runtime_index(node->outputs[0]);
+    for (int i = 0; i < node->outputs.size(); ++i) {
+        auto index = first_output + i;
+        auto value = output_states[index].value;
+
+        uint64_t hash;
+        if (input_hash) {
+            // Same inputs, same outputs. Cheaper than hashing the values.
+            hash = hash_combine(*input_hash, i + 1);
+        }
+        else if (value.type()->is_hashable()) {
+            hash = value.type()->hash(value.get());
+        }
+        else {
+            output_hashes[index] = 0;
+            continue;
+        }
+        // 0 is taken to mean 'unknown'.
+        output_hashes[index] = hash == 0 ? 1 : hash;
+    }
+}
+
+void EagerNodeTreeExecutor::store_cached_outputs(Node* node, uint64_t input_hash)
+{
+    auto& cached = output_cache.at(node);
+    clear_cached_outputs(cached);
+
+    cached.input_hash = input_hash;
+    for (auto output : node->outputs) {
+        auto value = output_states[runtime_index(output)].value;
+        auto type = value.type();
+        GMutablePointer copy{ type, malloc(type->size()) };
+        type->copy_construct(value.get(), copy.get());
+        cached.values.push_back(copy);
+    }
+}
+
+void EagerNodeTreeExecutor::clear_cached_outputs(CachedOutputs& cached)
+{
+    for (auto&& value : cached.values) {
+        value.destruct();
+        free(value.get());
+    }
+    cached.values.clear();
+}
+
+void EagerNodeTreeExecutor::run_node(NodeTree* tree, Node* node)
+{
+    uint64_t input_hash = 0;
+    bool cacheable = compute_input_hash(node, input_hash);
+
+    if (cacheable && !node->dirty && reuse_cached_outputs(node, input_hash)) {
+        update_output_hashes(node, &input_hash);
+        forward_output_to_input(node);
+        return;
+    }
+
+    if (execute_node(tree, node)) {
+        node->dirty = false;
+        update_output_hashes(node, cacheable ? &input_hash : nullptr);
+        if (cacheable) {
+            store_cached_outputs(node, input_hash);
+        }
+        forward_output_to_input(node);
+    }
+}
+
+void EagerNodeTreeExecutor::resolve_demands(NodeTree* tree)
+{
+    pull_states.clear();
+    if (!has_demand_inputs) {
+        input_demanded.clear();
+        return;
+    }
+    input_demanded.assign(input_states.size(), false);
+    for (int i = 0; i < nodes_to_execute_count; ++i) {
+        auto node = nodes_to_execute[i];
+        if (node->typeinfo->ALWAYS_REQUIRED) {
+            pull(tree, node, false);
+        }
+    }
+}
+
+bool EagerNodeTreeExecutor::is_pending(Node* node) const
+{
+    if (!has_demand_inputs) {
+        return true;
+    }
+    auto found = pull_states.find(node);
+    return found != pull_states.end() && found->second == PullState::Demanded;
+}
+
+void EagerNodeTreeExecutor::pull(NodeTree* tree, Node* sink, bool run)
+{
+    // An explicit stack rather than recursion, so that a long chain of nodes can't overflow the
+    // call stack. A node stays on it until what it needs is there, and its demand_inputs is asked
+    // again each time the node comes back on top.
+    pull_stack.assign(1, { sink, run });
+    while (!pull_stack.empty()) {
+        Node* node = pull_stack.back().node;
+        const PullState target = pull_stack.back().run ? PullState::Ran : PullState::Demanded;
+        if (pull_states[node] >= target) {
+            pull_stack.pop_back();
+            continue;
+        }
+
+        const size_t depth = pull_stack.size();
+        // Pushes the node the input is linked to, unless it has already got that far.
+        auto push_upstream = [this](NodeSocket* input, PullState state) {
+            if (input->directly_linked_sockets.empty()) {
+                return false;
+            }
+            auto upstream = input->directly_linked_sockets[0];
+            if (runtime_index(upstream) < 0 || pull_states[upstream->Node] >= state) {
+                return false;
+            }
+            pull_stack.push_back({ upstream->Node, state == PullState::Ran });
+            return true;
+        };
+
+        std::vector<bool> needed(node->inputs.size(), true);
+        if (auto demand_inputs = node->typeinfo->demand_inputs) {
+            DemandParams params(*node, [&](int i) -> GMutablePointer {
+                if (push_upstream(node->inputs[i], PullState::Ran)) {
+                    return nullptr;
+                }
+                return current_input_value(node->inputs[i]);
+            });
+            demand_inputs(params);
+            // It read an input that isn't there yet, so what it asked for doesn't count.
+            if (pull_stack.size() > depth) {
+                continue;
+            }
+            needed = std::move(params.needed_);
+        }
+        for (int i = 0; i < node->inputs.size(); ++i) {
+            if (needed[i]) {
+                push_upstream(node->inputs[i], target);
+            }
+        }
+        if (pull_stack.size() > depth) {
+            continue;
+        }
+
+        for (int i = 0; i < node->inputs.size(); ++i) {
+            if (needed[i]) {
+                input_demanded[runtime_index(node->inputs[i])] = true;
+            }
+        }
+        pull_stack.pop_back();
+        pull_states[node] = target;
+        if (target == PullState::Ran) {
+            run_node(tree, node);
+        }
+    }
+}
+
+GMutablePointer EagerNodeTreeExecutor::current_input_value(NodeSocket* input)
+{
+    if (!input->directly_linked_sockets.empty()) {
+        auto& input_state = input_states[runtime_index(input)];
+        return input_state.is_forwarded ? input_state.value : nullptr;
+    }
+    if (input->default_value) {
+        return { input->type_info->cpp_type, default_value_storage(input) };
+    }
+    return nullptr;
+}
+
 void EagerNodeTreeExecutor::clear()
 {
+    // The memory itself stays with the arena.
     for (auto&& input_state : input_states) {
         if (input_state.value.get()) {
             input_state.value.destruct();
-            free(input_state.value.get());
         }
     }
 
     for (auto&& output_state : output_states) {
         if (output_state.value.get()) {
             output_state.value.destruct();
-            free(output_state.value.get());
         }
     }
 
+    for (auto&& target : any_input_targets) {
+        target.destruct();
+    }
+    any_input_targets.clear();
+    arena.reset();
+
     input_states.clear();
     output_states.clear();
-    index_cache.clear();
     nodes_to_execute.clear();
     nodes_to_execute_count = 0;
     input_of_nodes_to_execute.clear();
     output_of_nodes_to_execute.clear();
+    socket_slots.clear();
+    has_demand_inputs = false;
+    pull_states.clear();
+    input_demanded.clear();
 }
 
 void EagerNodeTreeExecutor::compile(NodeTree* tree)
@@ -184,6 +508,7 @@ void EagerNodeTreeExecutor::compile(NodeTree* tree)
     nodes_to_execute_count = std::distance(nodes_to_execute.begin(), split);
 
     for (int i = 0; i < nodes_to_execute_count; ++i) {
+        has_demand_inputs |= nodes_to_execute[i]->typeinfo->demand_inputs != nullptr;
         input_of_nodes_to_execute.insert(
             input_of_nodes_to_execute.end(),
             nodes_to_execute[i]->inputs.begin(),
@@ -194,41 +519,68 @@ void EagerNodeTreeExecutor::compile(NodeTree* tree)
             nodes_to_execute[i]->outputs.begin(),
             nodes_to_execute[i]->outputs.end());
     }
+
+    // Each socket gets a dense slot in the runtime states.
+    size_t max_id = 0;
+    for (auto socket : input_of_nodes_to_execute) {
+        max_id = std::max(max_id, size_t(socket->ID.Get()));
+    }
+    for (auto socket : output_of_nodes_to_execute) {
+        max_id = std::max(max_id, size_t(socket->ID.Get()));
+    }
+    socket_slots.assign(max_id + 1, -1);
+    for (int i = 0; i < input_of_nodes_to_execute.size(); ++i) {
+        socket_slots[input_of_nodes_to_execute[i]->ID.Get()] = i;
+    }
+    for (int i = 0; i < output_of_nodes_to_execute.size(); ++i) {
+        socket_slots[output_of_nodes_to_execute[i]->ID.Get()] = i;
+    }
 }
 
 void EagerNodeTreeExecutor::prepare_memory()
 {
+    std::vector<size_t> input_offsets(input_states.size());
+    std::vector<size_t> output_offsets(output_states.size());
+    std::vector<std::pair<size_t, size_t>> any_input_offsets;
+
+    for (int i = 0; i < input_states.size(); ++i) {
+        input_offsets[i] = arena.add(*input_of_nodes_to_execute[i]->type_info->cpp_type);
+    }
+    for (int i = 0; i < output_states.size(); ++i) {
+        output_offsets[i] = arena.add(*output_of_nodes_to_execute[i]->type_info->cpp_type);
+    }
+    // If the input is an 'Any' type, the value type is a GMutablePointer. If the input is
+    // connected, it also needs the memory it points to, of the type of the linked output.
+    for (int i = 0; i < input_states.size(); ++i) {
+        auto input = input_of_nodes_to_execute[i];
+        if (input->type_info->type == SocketType::Any) {
+            assert(input->directly_linked_sockets.size() <= 1);
+            if (!input->directly_linked_sockets.empty()) {
+                auto output = input->directly_linked_sockets[0];
+                any_input_offsets.emplace_back(i, arena.add(*output->type_info->cpp_type));
+            }
+        }
+    }
+    arena.commit();
+
     for (int i = 0; i < input_states.size(); ++i) {
-        index_cache[input_of_nodes_to_execute[i]] = i;
         auto type = input_of_nodes_to_execute[i]->type_info->cpp_type;
-        input_states[i].value = { type, malloc(type->size()) };
+        input_states[i].value = { type, arena.at(input_offsets[i]) };
         input_states[i].value.default_construct();
     }
 
     for (int i = 0; i < output_states.size(); ++i) {
-        index_cache[output_of_nodes_to_execute[i]] = i;
         auto type = output_of_nodes_to_execute[i]->type_info->cpp_type;
-        output_states[i].value = { type, malloc(type->size()) };
+        output_states[i].value = { type, arena.at(output_offsets[i]) };
         output_states[i].value.default_construct();
     }
 
-    for (int i = 0; i < input_states.size(); ++i) {
-        // If the input is an 'Any' type, the value type is a GMutablePointer. If the input is
-        // connected, we need to prepare the memory it points to.
-        if (input_states[i].value.is_type<GMutablePointer>()) {
-            auto& linked_sockets = input_of_nodes_to_execute[i]->directly_linked_sockets;
-            assert(linked_sockets.size() <= 1);
-
-            if (!linked_sockets.empty()) {
-                auto output_state = output_states[index_cache[linked_sockets[0]]];
-
-                auto storage_ptr = GMutablePointer{ output_state.value.type(),
-                                                    malloc(output_state.value.type()->size()) };
-                storage_ptr.default_construct();
-                input_states[i].value.type()->move_assign(
-                    &storage_ptr, input_states[i].value.get());
-            }
-        }
+    for (auto [i, offset] : any_input_offsets) {
+        auto output = input_of_nodes_to_execute[i]->directly_linked_sockets[0];
+        GMutablePointer target{ output->type_info->cpp_type, arena.at(offset) };
+        target.default_construct();
+        any_input_targets.push_back(target);
+        input_states[i].value.type()->copy_assign(&target, input_states[i].value.get());
     }
 }
 
@@ -241,17 +593,35 @@ void EagerNodeTreeExecutor::prepare_tree(NodeTree* tree)
 
     input_states.resize(input_of_nodes_to_execute.size(), { nullptr, false });
     output_states.resize(output_of_nodes_to_execute.size(), { nullptr });
+    output_hashes.assign(output_states.size(), 0);
+    externally_synced.clear();
 
     prepare_memory();
+
+    // Drop the cache of the nodes that are gone or no longer needed.
+    std::set<Node*> executed(
+        nodes_to_execute.begin(), nodes_to_execute.begin() + nodes_to_execute_count);
+    for (auto it = output_cache.begin(); it != output_cache.end();) {
+        if (!executed.contains(it->first)) {
+            clear_cached_outputs(it->second);
+            it = output_cache.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+    // Create the entries up front, so that executing never changes the map's structure.
+    for (auto node : executed) {
+        output_cache[node];
+    }
 }
 
 void EagerNodeTreeExecutor::execute_tree(NodeTree* tree)
 {
+    resolve_demands(tree);
     for (int i = 0; i < nodes_to_execute_count; ++i) {
-        auto node = nodes_to_execute[i];
-        auto result = execute_node(tree, node);
-        if (result) {
-            forward_output_to_input(node);
+        if (is_pending(nodes_to_execute[i])) {
+            run_node(tree, nodes_to_execute[i]);
         }
     }
 }
@@ -260,17 +630,18 @@ GMutablePointer EagerNodeTreeExecutor::FindPtr(NodeSocket* socket)
 {
     GMutablePointer ptr;
     if (socket->in_out == PinKind::Input) {
-        ptr = input_states[index_cache[socket]].value;
+        ptr = input_states[runtime_index(socket)].value;
     }
     else {
-        ptr = output_states[index_cache[socket]].value;
+        ptr = output_states[runtime_index(socket)].value;
     }
     return ptr;
 }
 
 void EagerNodeTreeExecutor::sync_node_from_external_storage(NodeSocket* socket, void* data)
 {
-    if (index_cache.find(socket) != index_cache.end()) {
+    if (runtime_index(socket) >= 0) {
+        externally_synced.insert(socket->Node);
         GMutablePointer ptr = FindPtr(socket);
         ptr.type()->copy_assign(data, ptr.get());
     }
@@ -278,7 +649,7 @@ void EagerNodeTreeExecutor::sync_node_from_external_storage(NodeSocket* socket,
 
 void EagerNodeTreeExecutor::sync_node_to_external_storage(NodeSocket* socket, void* data)
 {
-    if (index_cache.find(socket) != index_cache.end()) {
+    if (runtime_index(socket) >= 0) {
         GMutablePointer ptr = FindPtr(socket);
         ptr.type()->copy_assign(ptr.get(), data);
     }
@@ -0,0 +1,27 @@
+#include "Nodes/node_exec_lazy.hpp"
+
+#include "Nodes/node_tree.hpp"
+#include "USTC_CG.h"
+
+USTC_CG_NAMESPACE_OPEN_SCOPE
+
+void LazyNodeTreeExecutor::execute_tree(NodeTree* tree)
+{
+    pull_states.clear();
+    input_demanded.assign(input_states.size(), false);
+
+    // The sinks are what the tree is executed for; everything else runs because they ask for it.
+    for (int i = 0; i < nodes_to_execute_count; ++i) {
+        auto node = nodes_to_execute[i];
+        if (node->typeinfo->ALWAYS_REQUIRED) {
+            pull(tree, node, true);
+        }
+    }
+}
+
+std::unique_ptr<EagerNodeTreeExecutor> CreateLazyNodeTreeExecutor()
+{
+    return std::make_unique<LazyNodeTreeExecutor>();
+}
+
+USTC_CG_NAMESPACE_CLOSE_SCOPE
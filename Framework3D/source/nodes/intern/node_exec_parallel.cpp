@@ -0,0 +1,146 @@
+#include "Nodes/node_exec_parallel.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#include "Nodes/node_tree.hpp"
+#include "USTC_CG.h"
+#include "pxr/base/work/dispatcher.h"
+
+USTC_CG_NAMESPACE_OPEN_SCOPE
+
+void ParallelNodeTreeExecutor::prepare_tree(NodeTree* tree)
+{
+    serial_order_pairs.clear();
+    EagerNodeTreeExecutor::prepare_tree(tree);
+}
+
+void ParallelNodeTreeExecutor::keep_serial_order(Node* a, Node* b)
+{
+    serial_order_pairs.emplace_back(a, b);
+}
+
+void ParallelNodeTreeExecutor::execute_tree(NodeTree* tree)
+{
+    const size_t count = nodes_to_execute_count;
+    if (count == 0) {
+        return;
+    }
+    // Serial, but only runs what a demand_inputs reads to choose, e.g. a switch's selector.
+    resolve_demands(tree);
+
+    std::unordered_map<Node*, size_t> node_index;
+    for (size_t i = 0; i < count; ++i) {
+        node_index[nodes_to_execute[i]] = i;
+    }
+
+    // Dependency counters from the links between the nodes to execute. Links coming from nodes
+    // that are not required don't count, those nodes never run.
+    std::vector<std::vector<size_t>> successors(count);
+    auto pending = std::make_unique<std::atomic<int>[]>(count);
+    std::vector<int> dependency_count(count, 0);
+
+    auto add_edge = [&](size_t from, size_t to) {
+        successors[from].push_back(to);
+        dependency_count[to]++;
+    };
+    for (size_t i = 0; i < count; ++i) {
+        for (auto input : nodes_to_execute[i]->inputs) {
+            for (auto linked_socket : input->directly_linked_sockets) {
+                auto from = node_index.find(linked_socket->Node);
+                if (from != node_index.end()) {
+                    add_edge(from->second, i);
+                }
+            }
+        }
+    }
+    for (auto& [a, b] : serial_order_pairs) {
+        auto a_it = node_index.find(a);
+        auto b_it = node_index.find(b);
+        if (a_it != node_index.end() && b_it != node_index.end() && a != b) {
+            add_edge(std::min(a_it->second, b_it->second), std::max(a_it->second, b_it->second));
+        }
+    }
+    for (size_t i = 0; i < count; ++i) {
+        pending[i].store(dependency_count[i], std::memory_order_relaxed);
+    }
+
+    pxr::WorkDispatcher dispatcher;
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::deque<size_t> main_thread_queue;
+    std::atomic<size_t> remaining = count;
+
+    std::function<void(size_t)> schedule;
+    auto run = [&](size_t i) {
+        auto node = nodes_to_execute[i];
+        // The nodes no demand reaches are passed over, but still release their successors.
+        if (is_pending(node)) {
+            try {
+                run_node(tree, node);
+            }
+            catch (const std::exception& e) {
+                // Don't let one node take the scheduler down: its successors still have to be
+                // released, they will fail on the missing input.
+                node->execution_failed = e.what();
+            }
+        }
+
+        for (size_t successor : successors[i]) {
+            if (pending[successor].fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                schedule(successor);
+            }
+        }
+
+        if (remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            std::lock_guard lock(mutex);
+            condition.notify_all();
+        }
+    };
+
+    schedule = [&](size_t i) {
+        if (nodes_to_execute[i]->typeinfo->THREAD_UNSAFE) {
+            std::lock_guard lock(mutex);
+            main_thread_queue.push_back(i);
+            condition.notify_all();
+        }
+        else {
+            dispatcher.Run(run, i);
+        }
+    };
+
+    for (size_t i = 0; i < count; ++i) {
+        if (dependency_count[i] == 0) {
+            schedule(i);
+        }
+    }
+
+    // The calling thread takes care of the thread-unsafe nodes until everything has run.
+    while (true) {
+        std::unique_lock lock(mutex);
+        condition.wait(lock, [&] { return !main_thread_queue.empty() || remaining.load() == 0; });
+        if (main_thread_queue.empty()) {
+            break;
+        }
+        size_t i = main_thread_queue.front();
+        main_thread_queue.pop_front();
+        lock.unlock();
+
+        run(i);
+    }
+
+    dispatcher.Wait();
+}
+
+std::unique_ptr<EagerNodeTreeExecutor> CreateParallelNodeTreeExecutor()
+{
+    return std::make_unique<ParallelNodeTreeExecutor>();
+}
+
+USTC_CG_NAMESPACE_CLOSE_SCOPE
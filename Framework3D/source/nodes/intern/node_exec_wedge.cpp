@@ -0,0 +1,183 @@
+#include "Nodes/node_exec_wedge.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <unordered_map>
+
+#include "Nodes/node.hpp"
+#include "Nodes/node_tree.hpp"
+#include "Nodes/pin.hpp"
+
+USTC_CG_NAMESPACE_OPEN_SCOPE
+
+using OverrideValue = std::variant<int, float, std::string>;
+using SocketValues = std::vector<std::pair<NodeSocket*, OverrideValue>>;
+
+static uint64_t hash_combine(uint64_t seed, uint64_t value)
+{
+    return seed ^ (value + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2));
+}
+
+static bool read_value(NodeSocket* socket, OverrideValue& value)
+{
+    if (!socket->default_value) {
+        return false;
+    }
+    switch (socket->type_info->type) {
+        case SocketType::Int:
+            value = socket->default_value_typed<bNodeSocketValueInt>()->value;
+            return true;
+        case SocketType::Float:
+            value = socket->default_value_typed<bNodeSocketValueFloat>()->value;
+            return true;
+        case SocketType::String:
+            value = socket->default_value_typed<bNodeSocketValueString>()->value;
+            return true;
+        default: return false;
+    }
+}
+
+static void write_value(NodeSocket* socket, const OverrideValue& value)
+{
+    auto as_number = [&value]() -> double {
+        if (auto i = std::get_if<int>(&value)) {
+            return *i;
+        }
+        if (auto f = std::get_if<float>(&value)) {
+            return *f;
+        }
+        return 0;
+    };
+
+    switch (socket->type_info->type) {
+        case SocketType::Int:
+            socket->default_value_typed<bNodeSocketValueInt>()->value = int(as_number());
+            break;
+        case SocketType::Float:
+            socket->default_value_typed<bNodeSocketValueFloat>()->value = float(as_number());
+            break;
+        case SocketType::String:
+            if (auto s = std::get_if<std::string>(&value)) {
+                socket->default_value_typed<bNodeSocketValueString>()->value = *s;
+            }
+            break;
+        default: break;
+    }
+}
+
+std::vector<WedgeResult> execute_wedge(
+    NodeTreeExecutor* executor,
+    NodeTree* tree,
+    const std::vector<WedgeVariant>& variants,
+    const std::function<void(size_t variant)>& before_execute,
+    const std::function<void(size_t variant)>& after_execute,
+    WedgeState* state)
+{
+    // What the tree holds for every socket some variant overrides.
+    SocketValues originals;
+    for (auto&& variant : variants) {
+        for (auto&& socket_override : variant.overrides) {
+            auto socket = socket_override.socket;
+            bool known = std::any_of(originals.begin(), originals.end(), [socket](auto& original) {
+                return original.first == socket;
+            });
+            OverrideValue value;
+            if (!known && read_value(socket, value)) {
+                originals.emplace_back(socket, std::move(value));
+            }
+        }
+    }
+
+    auto restore = [&originals] {
+        for (auto&& [socket, value] : originals) {
+            write_value(socket, value);
+        }
+    };
+
+    std::vector<WedgeResult> results;
+    results.reserve(variants.size());
+    // By the hash of their effective values, which are kept to tell apart the ones that collide.
+    std::unordered_multimap<uint64_t, size_t> executed_variants;
+    std::vector<SocketValues> executed_values(variants.size());
+
+    WedgeState fresh_state;
+    if (!state) {
+        state = &fresh_state;
+    }
+    state->variants.resize(variants.size());
+
+    for (size_t i = 0; i < variants.size(); ++i) {
+        restore();
+        for (auto&& socket_override : variants[i].overrides) {
+            if (socket_override.socket->default_value) {
+                write_value(socket_override.socket, socket_override.value);
+            }
+        }
+
+        // The variant's state goes into the executor, and the executor's own is held in its place
+        // until it goes back. Only executors that keep any give one.
+        auto& variant_state = state->variants[i];
+        executor->swap_persistent_state(variant_state);
+        bool stateful = variant_state != nullptr;
+
+        auto start = std::chrono::steady_clock::now();
+        executor->prepare_tree(tree);
+
+        // Only the overridden values that the compiled tree reads tell the variants apart. The
+        // originals are all readable, so every variant has its values.
+        SocketValues values;
+        uint64_t key = 0;
+        for (auto&& [socket, original] : originals) {
+            if (!executor->is_socket_executed(socket) || !socket->directly_linked_sockets.empty()) {
+                continue;
+            }
+            OverrideValue value;
+            read_value(socket, value);
+            key = hash_combine(key, socket->ID.Get());
+            key = hash_combine(key, std::hash<OverrideValue>()(value));
+            values.emplace_back(socket, std::move(value));
+        }
+
+        WedgeResult result{ i };
+        auto [begin, end] = executed_variants.equal_range(key);
+        auto same = std::find_if(begin, end, [&](auto& executed) {
+            return executed_values[executed.second] == values;
+        });
+        if (same != end && !stateful) {
+            result.same_as = same->second;
+            result.failed = results[same->second].failed;
+            results.push_back(result);
+            executor->swap_persistent_state(variant_state);
+            continue;
+        }
+        executed_variants.emplace(key, i);
+        executed_values[i] = std::move(values);
+
+        if (before_execute) {
+            before_execute(i);
+        }
+        executor->execute_tree(tree);
+        executor->finalize(tree);
+        result.ms = std::chrono::duration<double, std::milli>(
+                        std::chrono::steady_clock::now() - start)
+                        .count();
+
+        for (auto&& node : tree->nodes) {
+            if (node->REQUIRED && !node->execution_failed.empty()) {
+                result.failed = true;
+            }
+        }
+        results.push_back(result);
+
+        if (after_execute) {
+            after_execute(i);
+        }
+        executor->swap_persistent_state(variant_state);
+    }
+
+    restore();
+    tree->SetDirty(true);
+    return results;
+}
+
+USTC_CG_NAMESPACE_CLOSE_SCOPE
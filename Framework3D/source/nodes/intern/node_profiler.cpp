@@ -0,0 +1,119 @@
+#include "Nodes/node_profiler.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <thread>
+
+#include "Nodes/node.hpp"
+#include "Utils/json.hpp"
+
+USTC_CG_NAMESPACE_OPEN_SCOPE
+
+NodeProfiler::NodeProfiler() : origin_(Clock::now())
+{
+}
+
+void NodeProfiler::record(
+    const Node* node,
+    Clock::time_point start,
+    Clock::time_point end,
+    size_t output_bytes)
+{
+    if (!enabled) {
+        return;
+    }
+    double ms = std::chrono::duration<double, std::milli>(end - start).count();
+
+    std::lock_guard lock(mutex_);
+    auto& profile = profiles_[node->ID.Get()];
+    profile.node_id = node->ID.Get();
+    profile.ui_name = node->ui_name;
+    profile.type_name = node->typeinfo->id_name;
+    profile.call_count++;
+    profile.last_ms = ms;
+    profile.total_ms += ms;
+    profile.max_ms = std::max(profile.max_ms, ms);
+    profile.output_bytes = output_bytes;
+    profile.history[profile.history_head] = float(ms);
+    profile.history_head = (profile.history_head + 1) % NodeProfile::kHistorySize;
+
+    if (trace_.size() == kMaxTraceEvents) {
+        trace_.pop_front();
+    }
+    trace_.push_back(
+        { node->ui_name,
+          node->typeinfo->id_name,
+          std::chrono::duration_cast<std::chrono::microseconds>(start - origin_).count(),
+          std::chrono::duration_cast<std::chrono::microseconds>(end - start).count(),
+          std::hash<std::thread::id>()(std::this_thread::get_id()) });
+}
+
+bool NodeProfiler::get_profile(const Node* node, NodeProfile& profile) const
+{
+    std::lock_guard lock(mutex_);
+    auto it = profiles_.find(node->ID.Get());
+    if (it == profiles_.end()) {
+        return false;
+    }
+    profile = it->second;
+    return true;
+}
+
+std::vector<NodeProfile> NodeProfiler::get_profiles() const
+{
+    std::lock_guard lock(mutex_);
+    std::vector<NodeProfile> profiles;
+    profiles.reserve(profiles_.size());
+    for (auto&& [id, profile] : profiles_) {
+        profiles.push_back(profile);
+    }
+    return profiles;
+}
+
+double NodeProfiler::max_last_ms() const
+{
+    std::lock_guard lock(mutex_);
+    double max = 0;
+    for (auto&& [id, profile] : profiles_) {
+        max = std::max(max, profile.last_ms);
+    }
+    return max;
+}
+
+void NodeProfiler::clear()
+{
+    std::lock_guard lock(mutex_);
+    profiles_.clear();
+    trace_.clear();
+    origin_ = Clock::now();
+}
+
+bool NodeProfiler::export_chrome_trace(const std::string& path) const
+{
+    nlohmann::json events = nlohmann::json::array();
+    {
+        std::lock_guard lock(mutex_);
+        // Chrome wants small thread ids, so number the threads in order of appearance.
+        std::unordered_map<size_t, int> thread_index;
+        for (auto&& event : trace_) {
+            auto [it, inserted] = thread_index.emplace(event.thread, int(thread_index.size()));
+            events.push_back({ { "name", event.name },
+                               { "cat", event.type_name },
+                               { "ph", "X" },
+                               { "ts", event.start_us },
+                               { "dur", event.duration_us },
+                               { "pid", 0 },
+                               { "tid", it->second } });
+        }
+    }
+
+    std::ofstream file(path);
+    if (!file) {
+        return false;
+    }
+    file << nlohmann::json{ { "traceEvents", events }, { "displayTimeUnit", "ms" } }.dump();
+    return bool(file);
+}
+
+USTC_CG_NAMESPACE_CLOSE_SCOPE
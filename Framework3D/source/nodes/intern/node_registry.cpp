@@ -1,3 +1,6 @@
+#include <string_view>
+#include <unordered_map>
+
 #include "Nodes/all_socket_types.hpp"
 #include "Nodes/node.hpp"
 #include "Nodes/node_register.h"
@@ -34,6 +37,21 @@ void build_node_declaration(
     node_decl_builder.finalize();
 }
 
+// Lookup by id name through string_view, without building a std::string per query.
+struct IdNameHash {
+    using is_transparent = void;
+    size_t operator()(std::string_view id_name) const
+    {
+        return std::hash<std::string_view>()(id_name);
+    }
+};
+
+template<typename T>
+using IdNameTable = std::unordered_map<std::string, T, IdNameHash, std::equal_to<>>;
+
+// All the node types of the four registries below, for nodeTypeFind.
+static IdNameTable<NodeTypeInfo*> node_type_table;
+
 static std::map<std::string, NodeTypeInfo*> geo_node_registry;
 
 const std::map<std::string, NodeTypeInfo*>& get_geo_node_registry()
@@ -73,6 +91,7 @@ void nodeRegisterType(NodeTypeInfo* type_info)
             break;
         default: logging("Unknown graph type of node.", Error);
     }
+    node_type_table[type_info->id_name] = type_info;
 
     if (type_info->declare) {
         type_info->static_declaration = std::make_unique<NodeDeclaration>();
@@ -83,34 +102,22 @@ void nodeRegisterType(NodeTypeInfo* type_info)
 NodeTypeInfo* nodeTypeFind(const char* idname)
 {
     if (idname[0]) {
-        NodeTypeInfo* nt;
-
-        auto find_type = [idname, &nt](const std::map<std::string, NodeTypeInfo*>& node_registry) {
-            if (node_registry.find(std::string(idname)) != node_registry.end()) {
-                nt = node_registry.at(std::string(idname));
-            }
-        };
-
-        find_type(get_geo_node_registry());
-        find_type(get_render_node_registry());
-        find_type(get_func_node_registry());
-        find_type(get_composition_node_registry());
-
-        if (nt)
-            return nt;
+        auto found = node_type_table.find(std::string_view(idname));
+        if (found != node_type_table.end()) {
+            return found->second;
+        }
     }
     throw std::runtime_error("Id name not found.");
 }
 
-static std::map<std::string, std::unique_ptr<SocketTypeInfo>> socket_registry;
+static IdNameTable<std::unique_ptr<SocketTypeInfo>> socket_registry;
 
 SocketTypeInfo* socketTypeFind(const char* idname)
 {
     if (idname[0]) {
-        auto& registry = socket_registry;
-        auto nt = registry.at(std::string(idname)).get();
-        if (nt) {
-            return nt;
+        auto found = socket_registry.find(std::string_view(idname));
+        if (found != socket_registry.end()) {
+            return found->second.get();
         }
     }
 
@@ -1,11 +1,13 @@
 #include "Nodes/node_tree.hpp"
 
 #include <stack>
+#include <stdexcept>
+#include <unordered_map>
 
 #include "Nodes/node.hpp"
 #include "Nodes/node_declare.hpp"
 #include "Nodes/pin.hpp"
-#include "Utils/json.hpp"
+#include "node_tree_serialization.hpp"
 
 USTC_CG_NAMESPACE_OPEN_SCOPE
 unsigned NodeTree::input_socket_id(NodeSocket* socket)
@@ -99,7 +101,17 @@ NodeLink*
 NodeTree::nodeAddLink(Node* fromnode, NodeSocket* fromsock, Node* tonode, NodeSocket* tosock)
 {
     SetDirty(true);
+    auto link = add_link(fromnode, fromsock, tonode, tosock);
+    ensure_topology_cache();
+    return link;
+}
 
+NodeLink* NodeTree::add_link(
+    Node* fromnode,
+    NodeSocket* fromsock,
+    Node* tonode,
+    NodeSocket* tosock)
+{
     auto link = std::make_unique<NodeLink>(UniqueID(), fromsock->ID, tosock->ID);
 
     if ((fromsock->in_out) == PinKind::Output && (tosock->in_out) == PinKind::Input) {
@@ -118,9 +130,6 @@ NodeTree::nodeAddLink(Node* fromnode, NodeSocket* fromsock, Node* tonode, NodeSo
     }
     auto bare_ptr = link.get();
     links.push_back(std::move(link));
-
-    ensure_topology_cache();
-
     return bare_ptr;
 }
 
@@ -147,6 +156,29 @@ void NodeTree::RemoveLink(LinkId linkId)
     }
 }
 
+void NodeTree::MarkNodeDirty(Node* node)
+{
+    SetDirty(true);
+
+    // The tree may hold a cycle while being edited, so keep track of the visited nodes.
+    std::unordered_set<Node*> visited;
+    std::stack<Node*> to_visit;
+    to_visit.push(node);
+    while (!to_visit.empty()) {
+        auto current = to_visit.top();
+        to_visit.pop();
+        if (!visited.insert(current).second) {
+            continue;
+        }
+        current->dirty = true;
+        for (auto output : current->outputs) {
+            for (auto linked_socket : output->directly_linked_sockets) {
+                to_visit.push(linked_socket->Node);
+            }
+        }
+    }
+}
+
 void NodeTree::delete_node(NodeId nodeId)
 {
     auto id = std::find_if(
@@ -470,87 +502,195 @@ void NodeTree::refresh_node(Node* node)
     node->outputs = new_outputs;
 }
 
-std::string NodeTree::Serialize()
+void NodeTree::describe(SerializedTree& tree) const
 {
-    nlohmann::json value;
+    tree.sockets.reserve(sockets.size());
+    for (auto&& socket : sockets) {
+        auto& info = tree.sockets.emplace_back();
+        info.id = socket->ID.Get();
+        info.id_name = socket->type_info->type_name;
+        info.identifier = socket->identifier;
+        info.ui_name = socket->ui_name;
+        info.in_out = int(socket->in_out);
+
+        if (socket->default_value) {
+            using ValueKind = SerializedTree::Socket::ValueKind;
+            switch (socket->type_info->type) {
+                case SocketType::Int:
+                    info.value_kind = ValueKind::Int;
+                    info.number = socket->default_value_typed<bNodeSocketValueInt>()->value;
+                    break;
+                case SocketType::Float:
+                    info.value_kind = ValueKind::Float;
+                    info.number = socket->default_value_typed<bNodeSocketValueFloat>()->value;
+                    break;
+                case SocketType::String:
+                    info.value_kind = ValueKind::String;
+                    info.text =
+                        socket->default_value_typed<bNodeSocketValueString>()->value.c_str();
+                    break;
+                default: break;
+            }
+        }
+    }
 
-    auto& node_info = value["nodes_info"];
+    tree.nodes.reserve(nodes.size());
     for (auto&& node : nodes) {
-        node->Serialize(node_info);
+        auto& info = tree.nodes.emplace_back();
+        info.id = node->ID.Get();
+        info.id_name = node->typeinfo->id_name;
+        for (auto* input : node->inputs) {
+            info.inputs.push_back(input->ID.Get());
+        }
+        for (auto* output : node->outputs) {
+            info.outputs.push_back(output->ID.Get());
+        }
     }
 
-    auto& links_info = value["links_info"];
+    tree.links.reserve(links.size());
     for (auto&& link : links) {
-        link->Serialize(links_info);
-    }
-
-    auto& sockets_info = value["sockets_info"];
-    for (auto&& socket : sockets) {
-        socket->Serialize(sockets_info);
+        tree.links.push_back({ link->ID.Get(), link->StartPinID.Get(), link->EndPinID.Get() });
     }
-
-    std::ostringstream s;
-    s << value;
-    return s.str();
 }
 
-void NodeTree::Deserialize(const std::string& str)
+void NodeTree::build_from(const SerializedTree& tree)
 {
-    nlohmann::json value;
-    std::istringstream in(str);
-    in >> value;
     clear();
 
     // To avoid reuse of ID, push up the ID in the beginning
-
-    for (auto&& socket_json : value["sockets_info"]) {
-        used_ids.emplace(socket_json["ID"]);
-    }
-
-    for (auto&& node_json : value["nodes_info"]) {
-        used_ids.emplace(node_json["ID"]);
-    }
-
-    for (auto&& link_json : value["links_info"]) {
-        used_ids.emplace(link_json["ID"]);
-    }
-
-    for (auto&& socket_json : value["sockets_info"]) {
-        auto socket = std::make_unique<NodeSocket>();
-        socket->DeserializeInfo(socket_json);
+    for (auto&& socket : tree.sockets) {
+        used_ids.emplace(socket.id);
+    }
+    for (auto&& node : tree.nodes) {
+        used_ids.emplace(node.id);
+    }
+    for (auto&& link : tree.links) {
+        used_ids.emplace(link.id);
+    }
+
+    // FindPin is a linear search, which made loading quadratic in the size of the tree.
+    std::unordered_map<unsigned, NodeSocket*> socket_by_id;
+    socket_by_id.reserve(tree.sockets.size());
+    sockets.reserve(tree.sockets.size());
+    for (auto&& info : tree.sockets) {
+        auto socket = std::make_unique<NodeSocket>(info.id);
+        socket->type_info = socketTypeFind(info.id_name.c_str());
+        socket->in_out = PinKind(info.in_out);
+        strncpy(socket->ui_name, info.ui_name.c_str(), sizeof(socket->ui_name) - 1);
+        strncpy(socket->identifier, info.identifier.c_str(), sizeof(socket->identifier) - 1);
+        socket_by_id[info.id] = socket.get();
         sockets.push_back(std::move(socket));
     }
 
-    for (auto&& node_json : value["nodes_info"]) {
+    auto find_socket = [&socket_by_id](unsigned id) -> NodeSocket* {
+        auto it = socket_by_id.find(id);
+        return it == socket_by_id.end() ? nullptr : it->second;
+    };
+
+    nodes.reserve(tree.nodes.size());
+    for (auto&& info : tree.nodes) {
         auto node = std::make_unique<Node>();
-        node->ID = node_json["ID"].get<unsigned>();
-        auto id_name = node_json["id_name"].get<std::string>();
-        if (!pre_init_node(id_name.c_str(), node.get()))
+        node->ID = info.id;
+        if (!pre_init_node(info.id_name.c_str(), node.get()))
             continue;
 
-        for (auto&& input_id : node_json["inputs"]) {
-            assert(FindPin(input_id.get<unsigned>()));
-            node->inputs.push_back(FindPin(input_id.get<unsigned>()));
+        for (auto input_id : info.inputs) {
+            assert(find_socket(input_id));
+            node->inputs.push_back(find_socket(input_id));
         }
 
-        for (auto&& output_id : node_json["outputs"]) {
-            node->outputs.push_back(FindPin(output_id.get<unsigned>()));
+        for (auto output_id : info.outputs) {
+            node->outputs.push_back(find_socket(output_id));
         }
         refresh_node(node.get());
         nodes.push_back(std::move(node));
     }
 
+    // Refreshing the nodes deletes the outdated sockets, so look the survivors up again.
+    socket_by_id.clear();
+    for (auto&& socket : sockets) {
+        socket_by_id[socket->ID.Get()] = socket.get();
+    }
+
     // Get the saved value in the sockets
-    for (auto&& node_socket : sockets) {
-        const auto& socket_value = value["sockets_info"][std::to_string(node_socket->ID.Get())];
-        node_socket->DeserializeValue(socket_value);
+    for (auto&& info : tree.sockets) {
+        auto socket = find_socket(info.id);
+        if (!socket || !socket->default_value) {
+            continue;
+        }
+        using ValueKind = SerializedTree::Socket::ValueKind;
+        bool is_number = info.value_kind == ValueKind::Int || info.value_kind == ValueKind::Float;
+        switch (socket->type_info->type) {
+            case SocketType::Int:
+                if (is_number) {
+                    socket->default_value_typed<bNodeSocketValueInt>()->value = int(info.number);
+                }
+                break;
+            case SocketType::Float:
+                if (is_number) {
+                    socket->default_value_typed<bNodeSocketValueFloat>()->value =
+                        float(info.number);
+                }
+                break;
+            case SocketType::String:
+                if (info.value_kind == ValueKind::String) {
+                    strcpy(
+                        (socket->default_value_typed<bNodeSocketValueString>()->value).data(),
+                        info.text.c_str());
+                }
+                break;
+            default: break;
+        }
     }
 
-    for (auto&& link_json : value["links_info"]) {
-        nodeAddLink(link_json["StartPinID"].get<unsigned>(), link_json["EndPinID"].get<unsigned>());
+    links.reserve(tree.links.size());
+    for (auto&& info : tree.links) {
+        auto socket1 = find_socket(info.start_pin);
+        auto socket2 = find_socket(info.end_pin);
+        if (socket1 && socket2) {
+            add_link(socket1->Node, socket1, socket2->Node, socket2);
+        }
     }
 
+    SetDirty(true);
     ensure_topology_cache();
 }
 
+std::string NodeTree::Serialize()
+{
+    SerializedTree tree;
+    describe(tree);
+    return write_tree_json(tree);
+}
+
+void NodeTree::Deserialize(const std::string& str)
+{
+    SerializedTree tree;
+    if (!read_tree_json(str, tree)) {
+        throw std::runtime_error("Malformed node tree JSON.");
+    }
+    build_from(tree);
+}
+
+std::string NodeTree::SerializeBinary()
+{
+    SerializedTree tree;
+    describe(tree);
+    return write_tree_binary(tree);
+}
+
+void NodeTree::DeserializeBinary(std::string_view data)
+{
+    SerializedTree tree;
+    if (!read_tree_binary(data, tree)) {
+        throw std::runtime_error("Malformed or truncated binary node tree.");
+    }
+    build_from(tree);
+}
+
+bool NodeTree::IsBinary(std::string_view data)
+{
+    return is_tree_binary(data);
+}
+
 USTC_CG_NAMESPACE_CLOSE_SCOPE
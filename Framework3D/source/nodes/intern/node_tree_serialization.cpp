@@ -0,0 +1,613 @@
+#include "node_tree_serialization.hpp"
+
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+
+#include "Utils/json.hpp"
+
+USTC_CG_NAMESPACE_OPEN_SCOPE
+
+// JSON writing
+
+static void write_string(std::string& out, std::string_view value)
+{
+    out += '"';
+    for (char c : value) {
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char escaped[8];
+                    snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                    out += escaped;
+                }
+                else {
+                    out += c;
+                }
+        }
+    }
+    out += '"';
+}
+
+template<typename T>
+static void write_number(std::string& out, T value)
+{
+    char buffer[32];
+    auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    out.append(buffer, result.ptr);
+}
+
+static void write_key(std::string& out, std::string_view key)
+{
+    write_string(out, key);
+    out += ':';
+}
+
+static void write_id_list(std::string& out, const std::vector<unsigned>& ids)
+{
+    out += '{';
+    for (size_t i = 0; i < ids.size(); ++i) {
+        if (i) {
+            out += ',';
+        }
+        write_key(out, std::to_string(i));
+        write_number(out, ids[i]);
+    }
+    out += '}';
+}
+
+std::string write_tree_json(const SerializedTree& tree)
+{
+    std::string out;
+    out.reserve(
+        64 + tree.links.size() * 64 + tree.nodes.size() * 128 + tree.sockets.size() * 128);
+
+    out += '{';
+
+    write_key(out, "links_info");
+    out += '{';
+    for (size_t i = 0; i < tree.links.size(); ++i) {
+        auto& link = tree.links[i];
+        if (i) {
+            out += ',';
+        }
+        write_key(out, std::to_string(link.id));
+        out += "{\"EndPinID\":";
+        write_number(out, link.end_pin);
+        out += ",\"ID\":";
+        write_number(out, link.id);
+        out += ",\"StartPinID\":";
+        write_number(out, link.start_pin);
+        out += '}';
+    }
+    out += "},";
+
+    write_key(out, "nodes_info");
+    out += '{';
+    for (size_t i = 0; i < tree.nodes.size(); ++i) {
+        auto& node = tree.nodes[i];
+        if (i) {
+            out += ',';
+        }
+        write_key(out, std::to_string(node.id));
+        out += "{\"ID\":";
+        write_number(out, node.id);
+        out += ",\"id_name\":";
+        write_string(out, node.id_name);
+        out += ",\"inputs\":";
+        write_id_list(out, node.inputs);
+        out += ",\"outputs\":";
+        write_id_list(out, node.outputs);
+        out += '}';
+    }
+    out += "},";
+
+    write_key(out, "sockets_info");
+    out += '{';
+    for (size_t i = 0; i < tree.sockets.size(); ++i) {
+        auto& socket = tree.sockets[i];
+        if (i) {
+            out += ',';
+        }
+        write_key(out, std::to_string(socket.id));
+        out += "{\"ID\":";
+        write_number(out, socket.id);
+        out += ",\"id_name\":";
+        write_string(out, socket.id_name);
+        out += ",\"identifier\":";
+        write_string(out, socket.identifier);
+        out += ",\"in_out\":";
+        write_number(out, socket.in_out);
+        out += ",\"ui_name\":";
+        write_string(out, socket.ui_name);
+        switch (socket.value_kind) {
+            case SerializedTree::Socket::ValueKind::Int:
+                out += ",\"value\":";
+                write_number(out, int64_t(socket.number));
+                break;
+            case SerializedTree::Socket::ValueKind::Float:
+                out += ",\"value\":";
+                write_number(out, float(socket.number));
+                break;
+            case SerializedTree::Socket::ValueKind::String:
+                out += ",\"value\":";
+                write_string(out, socket.text);
+                break;
+            default: break;
+        }
+        out += '}';
+    }
+    out += "}}";
+
+    return out;
+}
+
+// JSON reading
+
+namespace {
+using json = nlohmann::json;
+
+class TreeSaxReader : public nlohmann::json_sax<json> {
+   public:
+    explicit TreeSaxReader(SerializedTree& tree) : tree(tree)
+    {
+    }
+
+    bool null() override
+    {
+        return true;
+    }
+
+    bool boolean(bool value) override
+    {
+        return true;
+    }
+
+    bool number_integer(number_integer_t value) override
+    {
+        return number(double(value), true);
+    }
+
+    bool number_unsigned(number_unsigned_t value) override
+    {
+        return number(double(value), true);
+    }
+
+    bool number_float(number_float_t value, const string_t&) override
+    {
+        return number(value, false);
+    }
+
+    bool string(string_t& value) override
+    {
+        if (depth != 3) {
+            return true;
+        }
+        if (section == Section::Nodes && field == "id_name") {
+            tree.nodes.back().id_name = std::move(value);
+        }
+        else if (section == Section::Sockets) {
+            auto& socket = tree.sockets.back();
+            if (field == "id_name") {
+                socket.id_name = std::move(value);
+            }
+            else if (field == "identifier") {
+                socket.identifier = std::move(value);
+            }
+            else if (field == "ui_name") {
+                socket.ui_name = std::move(value);
+            }
+            else if (field == "value") {
+                socket.value_kind = SerializedTree::Socket::ValueKind::String;
+                socket.text = std::move(value);
+            }
+        }
+        return true;
+    }
+
+    bool binary(binary_t&) override
+    {
+        return true;
+    }
+
+    bool start_object(std::size_t) override
+    {
+        return open();
+    }
+
+    bool end_object() override
+    {
+        return close();
+    }
+
+    bool start_array(std::size_t) override
+    {
+        return open();
+    }
+
+    bool end_array() override
+    {
+        return close();
+    }
+
+    bool key(string_t& value) override
+    {
+        if (depth == 1) {
+            if (value == "nodes_info") {
+                next_section = Section::Nodes;
+            }
+            else if (value == "links_info") {
+                next_section = Section::Links;
+            }
+            else if (value == "sockets_info") {
+                next_section = Section::Sockets;
+            }
+            else {
+                next_section = Section::Other;
+            }
+        }
+        else if (depth == 3) {
+            field = std::move(value);
+        }
+        else if (depth == 4) {
+            list_index = -1;
+            std::from_chars(value.data(), value.data() + value.size(), list_index);
+        }
+        return true;
+    }
+
+    bool parse_error(std::size_t, const std::string&, const nlohmann::detail::exception&) override
+    {
+        return false;
+    }
+
+   private:
+    enum class Section { None, Nodes, Links, Sockets, Other };
+
+    // Depth 1 is the root, 2 a section, 3 a record, 4 the socket ids of a node.
+    bool open()
+    {
+        depth++;
+        if (depth == 2) {
+            section = next_section;
+        }
+        else if (depth == 3) {
+            switch (section) {
+                case Section::Nodes: tree.nodes.emplace_back(); break;
+                case Section::Links: tree.links.emplace_back(); break;
+                case Section::Sockets: tree.sockets.emplace_back(); break;
+                default: break;
+            }
+        }
+        else if (depth == 4 && section == Section::Nodes) {
+            if (field == "inputs") {
+                id_list = &tree.nodes.back().inputs;
+            }
+            else if (field == "outputs") {
+                id_list = &tree.nodes.back().outputs;
+            }
+        }
+        return true;
+    }
+
+    bool close()
+    {
+        if (depth == 4) {
+            id_list = nullptr;
+            list_index = -1;
+        }
+        else if (depth == 2) {
+            section = Section::None;
+        }
+        depth--;
+        return true;
+    }
+
+    bool number(double value, bool integral)
+    {
+        if (depth == 4 && id_list) {
+            // The lists are objects keyed by position, which the DOM writer sorted as strings
+            // ("10" before "2"), so place by key rather than by order.
+            if (list_index >= 0) {
+                if (id_list->size() <= size_t(list_index)) {
+                    id_list->resize(list_index + 1);
+                }
+                (*id_list)[list_index] = unsigned(value);
+            }
+            else {
+                id_list->push_back(unsigned(value));
+            }
+            return true;
+        }
+        if (depth != 3) {
+            return true;
+        }
+        switch (section) {
+            case Section::Nodes:
+                if (field == "ID") {
+                    tree.nodes.back().id = unsigned(value);
+                }
+                break;
+            case Section::Links: {
+                auto& link = tree.links.back();
+                if (field == "ID") {
+                    link.id = unsigned(value);
+                }
+                else if (field == "StartPinID") {
+                    link.start_pin = unsigned(value);
+                }
+                else if (field == "EndPinID") {
+                    link.end_pin = unsigned(value);
+                }
+            } break;
+            case Section::Sockets: {
+                auto& socket = tree.sockets.back();
+                if (field == "ID") {
+                    socket.id = unsigned(value);
+                }
+                else if (field == "in_out") {
+                    socket.in_out = int(value);
+                }
+                else if (field == "value") {
+                    socket.value_kind = integral ? SerializedTree::Socket::ValueKind::Int
+                                                 : SerializedTree::Socket::ValueKind::Float;
+                    socket.number = value;
+                }
+            } break;
+            default: break;
+        }
+        return true;
+    }
+
+    SerializedTree& tree;
+    int depth = 0;
+    Section section = Section::None;
+    Section next_section = Section::None;
+    std::string field;
+    std::vector<unsigned>* id_list = nullptr;
+    int list_index = -1;
+};
+}  // namespace
+
+bool read_tree_json(std::string_view json, SerializedTree& tree)
+{
+    TreeSaxReader reader(tree);
+    return nlohmann::json::sax_parse(json.begin(), json.end(), &reader);
+}
+
+// Binary
+
+static constexpr char kBinaryMagic[4] = { 'U', 'C', 'G', 'T' };
+static constexpr uint32_t kBinaryVersion = 1;
+
+enum BinarySection : uint32_t { SocketsSection = 1, NodesSection = 2, LinksSection = 3 };
+
+// Written as the host lays them out, which is little-endian on every platform we build for.
+template<typename T>
+static void put(std::string& out, T value)
+{
+    char bytes[sizeof(T)];
+    memcpy(bytes, &value, sizeof(T));
+    out.append(bytes, sizeof(T));
+}
+
+static void put_string(std::string& out, std::string_view value)
+{
+    put(out, uint32_t(value.size()));
+    out.append(value);
+}
+
+static void put_ids(std::string& out, const std::vector<unsigned>& ids)
+{
+    put(out, uint32_t(ids.size()));
+    for (auto id : ids) {
+        put(out, uint32_t(id));
+    }
+}
+
+// Tag and length first; the length is filled in once the section is written.
+static size_t begin_section(std::string& out, BinarySection tag)
+{
+    put(out, uint32_t(tag));
+    put(out, uint64_t(0));
+    return out.size();
+}
+
+static void end_section(std::string& out, size_t begin)
+{
+    uint64_t length = out.size() - begin;
+    memcpy(out.data() + begin - sizeof(uint64_t), &length, sizeof(length));
+}
+
+std::string write_tree_binary(const SerializedTree& tree)
+{
+    std::string out;
+    out.append(kBinaryMagic, sizeof(kBinaryMagic));
+    put(out, kBinaryVersion);
+
+    auto begin = begin_section(out, SocketsSection);
+    put(out, uint32_t(tree.sockets.size()));
+    for (auto&& socket : tree.sockets) {
+        put(out, uint32_t(socket.id));
+        put_string(out, socket.id_name);
+        put_string(out, socket.identifier);
+        put_string(out, socket.ui_name);
+        put(out, uint8_t(socket.in_out));
+        put(out, uint8_t(socket.value_kind));
+        switch (socket.value_kind) {
+            case SerializedTree::Socket::ValueKind::Int:
+            case SerializedTree::Socket::ValueKind::Float: put(out, socket.number); break;
+            case SerializedTree::Socket::ValueKind::String: put_string(out, socket.text); break;
+            default: break;
+        }
+    }
+    end_section(out, begin);
+
+    begin = begin_section(out, NodesSection);
+    put(out, uint32_t(tree.nodes.size()));
+    for (auto&& node : tree.nodes) {
+        put(out, uint32_t(node.id));
+        put_string(out, node.id_name);
+        put_ids(out, node.inputs);
+        put_ids(out, node.outputs);
+    }
+    end_section(out, begin);
+
+    begin = begin_section(out, LinksSection);
+    put(out, uint32_t(tree.links.size()));
+    for (auto&& link : tree.links) {
+        put(out, uint32_t(link.id));
+        put(out, uint32_t(link.start_pin));
+        put(out, uint32_t(link.end_pin));
+    }
+    end_section(out, begin);
+
+    return out;
+}
+
+namespace {
+// Bounds-checked reads over the buffer. Once a read fails, every following one fails too.
+struct BinaryCursor {
+    std::string_view data;
+    bool ok = true;
+
+    template<typename T>
+    T get()
+    {
+        T value{};
+        if (!ok || data.size() < sizeof(T)) {
+            ok = false;
+            return value;
+        }
+        memcpy(&value, data.data(), sizeof(T));
+        data.remove_prefix(sizeof(T));
+        return value;
+    }
+
+    std::string_view get_bytes(size_t size)
+    {
+        if (!ok || data.size() < size) {
+            ok = false;
+            return {};
+        }
+        auto bytes = data.substr(0, size);
+        data.remove_prefix(size);
+        return bytes;
+    }
+
+    std::string get_string()
+    {
+        return std::string(get_bytes(get<uint32_t>()));
+    }
+
+    // A count of records, each taking at least record_size bytes. 0 when what is left can't hold
+    // them, so that a corrupted count doesn't allocate for records that aren't there.
+    size_t get_count(size_t record_size)
+    {
+        size_t count = get<uint32_t>();
+        if (!ok || data.size() / record_size < count) {
+            ok = false;
+            return 0;
+        }
+        return count;
+    }
+
+    void get_ids(std::vector<unsigned>& ids)
+    {
+        ids.resize(get_count(sizeof(uint32_t)));
+        for (auto& id : ids) {
+            id = get<uint32_t>();
+        }
+    }
+};
+}  // namespace
+
+bool is_tree_binary(std::string_view data)
+{
+    return data.size() >= sizeof(kBinaryMagic) &&
+           memcmp(data.data(), kBinaryMagic, sizeof(kBinaryMagic)) == 0;
+}
+
+bool read_tree_binary(std::string_view data, SerializedTree& tree)
+{
+    if (!is_tree_binary(data)) {
+        return false;
+    }
+    BinaryCursor cursor{ data.substr(sizeof(kBinaryMagic)) };
+    auto version = cursor.get<uint32_t>();
+    if (!cursor.ok || version > kBinaryVersion) {
+        return false;
+    }
+
+    while (cursor.ok && !cursor.data.empty()) {
+        auto tag = cursor.get<uint32_t>();
+        auto length = cursor.get<uint64_t>();
+        BinaryCursor section{ cursor.get_bytes(length) };
+        if (!cursor.ok) {
+            return false;
+        }
+
+        switch (tag) {
+            case SocketsSection: {
+                // Id, three string lengths, in_out and value kind.
+                tree.sockets.resize(section.get_count(4 * sizeof(uint32_t) + 2));
+                for (auto& socket : tree.sockets) {
+                    socket.id = section.get<uint32_t>();
+                    socket.id_name = section.get_string();
+                    socket.identifier = section.get_string();
+                    socket.ui_name = section.get_string();
+                    socket.in_out = section.get<uint8_t>();
+                    socket.value_kind =
+                        SerializedTree::Socket::ValueKind(section.get<uint8_t>());
+                    switch (socket.value_kind) {
+                        case SerializedTree::Socket::ValueKind::Int:
+                        case SerializedTree::Socket::ValueKind::Float:
+                            socket.number = section.get<double>();
+                            break;
+                        case SerializedTree::Socket::ValueKind::String:
+                            socket.text = section.get_string();
+                            break;
+                        default: break;
+                    }
+                    if (!section.ok) {
+                        return false;
+                    }
+                }
+            } break;
+            case NodesSection: {
+                // Id, id name length and two id counts.
+                tree.nodes.resize(section.get_count(4 * sizeof(uint32_t)));
+                for (auto& node : tree.nodes) {
+                    node.id = section.get<uint32_t>();
+                    node.id_name = section.get_string();
+                    section.get_ids(node.inputs);
+                    section.get_ids(node.outputs);
+                    if (!section.ok) {
+                        return false;
+                    }
+                }
+            } break;
+            case LinksSection: {
+                tree.links.resize(section.get_count(3 * sizeof(uint32_t)));
+                for (auto& link : tree.links) {
+                    link.id = section.get<uint32_t>();
+                    link.start_pin = section.get<uint32_t>();
+                    link.end_pin = section.get<uint32_t>();
+                }
+            } break;
+            // Sections of later versions.
+            default: break;
+        }
+        if (!section.ok) {
+            return false;
+        }
+    }
+    return cursor.ok;
+}
+
+USTC_CG_NAMESPACE_CLOSE_SCOPE
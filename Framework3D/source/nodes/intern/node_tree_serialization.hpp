@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "USTC_CG.h"
+
+USTC_CG_NAMESPACE_OPEN_SCOPE
+
+// The flat content of a saved tree, what both the JSON and the binary forms hold. Reading either
+// form fills it in one pass, and NodeTree builds itself from it.
+struct SerializedTree {
+    struct Socket {
+        enum class ValueKind : uint8_t { None, Int, Float, String };
+
+        unsigned id = 0;
+        std::string id_name;
+        std::string identifier;
+        std::string ui_name;
+        int in_out = 0;
+        ValueKind value_kind = ValueKind::None;
+        // Int and Float values.
+        double number = 0;
+        std::string text;
+    };
+
+    struct Node {
+        unsigned id = 0;
+        std::string id_name;
+        std::vector<unsigned> inputs;
+        std::vector<unsigned> outputs;
+    };
+
+    struct Link {
+        unsigned id = 0;
+        unsigned start_pin = 0;
+        unsigned end_pin = 0;
+    };
+
+    std::vector<Socket> sockets;
+    std::vector<Node> nodes;
+    std::vector<Link> links;
+};
+
+// Same layout as the DOM based writer used to produce: objects keyed by id under "nodes_info",
+// "links_info" and "sockets_info". Written straight into the string.
+std::string write_tree_json(const SerializedTree& tree);
+// Streams through the text without building a DOM. Keys other than the three sections, e.g. the
+// editor's view settings saved in the same file, are skipped.
+bool read_tree_json(std::string_view json, SerializedTree& tree);
+
+// "UCGT", a version, then tagged sections, each prefixed with its byte length so that readers
+// skip the ones they don't know. Strings are length-prefixed, numbers little-endian.
+std::string write_tree_binary(const SerializedTree& tree);
+// Reads in place: `data` can be a memory-mapped file. Fails on a truncated or foreign buffer.
+bool read_tree_binary(std::string_view data, SerializedTree& tree);
+bool is_tree_binary(std::string_view data);
+
+USTC_CG_NAMESPACE_CLOSE_SCOPE
@@ -11,6 +11,8 @@ inline void comp_node_type_base(NodeTypeInfo* ntype)
     ntype->color[3] = 1.0f;
 
     ntype->node_type_of_grpah = NodeTypeOfGrpah::Composition;
+    // Composition nodes edit the global stage.
+    ntype->THREAD_UNSAFE = true;
 }
 
 USTC_CG_NAMESPACE_CLOSE_SCOPE
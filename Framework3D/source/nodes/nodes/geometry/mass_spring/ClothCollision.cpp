@@ -0,0 +1,509 @@
+#include "ClothCollision.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+
+#include "pxr/base/work/loops.h"
+#include "utils.h"
+
+namespace USTC_CG::node_mass_spring {
+
+using namespace Eigen;
+
+using CellKey = uint64_t;
+
+// 21 bits per axis, centered on the origin.
+static CellKey cell_key(const Vector3i& cell)
+{
+    constexpr int kOffset = 1 << 20;
+    return CellKey(cell[0] + kOffset) | (CellKey(cell[1] + kOffset) << 21) |
+           (CellKey(cell[2] + kOffset) << 42);
+}
+
+static Vector3i cell_of(const Vector3d& x, double cell_size)
+{
+    return (x / cell_size).array().floor().cast<int>().matrix();
+}
+
+// A uniform grid over boxes, hashed: the (cell, item) entries of every cell each box overlaps,
+// sorted by cell.
+class HashGrid {
+   public:
+    // Fills the grid with count items, item i spanning the box box(i) = { min, max }.
+    template<typename Box>
+    void build(unsigned count, double cell_size, Box&& box)
+    {
+        cell_size_ = cell_size;
+        std::vector<unsigned> offsets(count + 1, 0);
+        pxr::WorkParallelForN(count, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                auto [min, max] = box(i);
+                Vector3i extent = cell_of(max, cell_size) - cell_of(min, cell_size);
+                offsets[i + 1] = (extent.array() + 1).prod();
+            }
+        });
+        for (unsigned i = 0; i < count; i++) {
+            offsets[i + 1] += offsets[i];
+        }
+
+        entries_.resize(offsets[count]);
+        pxr::WorkParallelForN(count, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                auto [min, max] = box(i);
+                unsigned next = offsets[i];
+                for_each_cell(min, max, [&](const Vector3i& cell) {
+                    entries_[next++] = { cell_key(cell), unsigned(i) };
+                });
+            }
+        });
+        std::sort(entries_.begin(), entries_.end());
+    }
+
+    template<typename F>
+    void for_each_cell(const Vector3d& min, const Vector3d& max, F&& f) const
+    {
+        Vector3i lo = cell_of(min, cell_size_), hi = cell_of(max, cell_size_);
+        for (int x = lo[0]; x <= hi[0]; x++) {
+            for (int y = lo[1]; y <= hi[1]; y++) {
+                for (int z = lo[2]; z <= hi[2]; z++) {
+                    f(Vector3i(x, y, z));
+                }
+            }
+        }
+    }
+
+    // Calls f(item) for each item in the cell.
+    template<typename F>
+    void for_each_item(const Vector3i& cell, F&& f) const
+    {
+        const CellKey key = cell_key(cell);
+        auto it = std::lower_bound(
+            entries_.begin(), entries_.end(), std::pair<CellKey, unsigned>(key, 0));
+        for (; it != entries_.end() && it->first == key; ++it) {
+            f(it->second);
+        }
+    }
+
+   private:
+    double cell_size_ = 1;
+    std::vector<std::pair<CellKey, unsigned>> entries_;
+};
+
+// Barycentric coordinates of the point of triangle abc closest to p (Ericson, Real-Time Collision
+// Detection, 5.1.5).
+static Vector3d closest_on_triangle(
+    const Vector3d& p,
+    const Vector3d& a,
+    const Vector3d& b,
+    const Vector3d& c)
+{
+    const Vector3d ab = b - a, ac = c - a, ap = p - a;
+    const double d1 = ab.dot(ap), d2 = ac.dot(ap);
+    if (d1 <= 0 && d2 <= 0) {
+        return { 1, 0, 0 };
+    }
+    const Vector3d bp = p - b;
+    const double d3 = ab.dot(bp), d4 = ac.dot(bp);
+    if (d3 >= 0 && d4 <= d3) {
+        return { 0, 1, 0 };
+    }
+    const double vc = d1 * d4 - d3 * d2;
+    if (vc <= 0 && d1 >= 0 && d3 <= 0) {
+        const double v = d1 / (d1 - d3);
+        return { 1 - v, v, 0 };
+    }
+    const Vector3d cp = p - c;
+    const double d5 = ab.dot(cp), d6 = ac.dot(cp);
+    if (d6 >= 0 && d5 <= d6) {
+        return { 0, 0, 1 };
+    }
+    const double vb = d5 * d2 - d1 * d6;
+    if (vb <= 0 && d2 >= 0 && d6 <= 0) {
+        const double w = d2 / (d2 - d6);
+        return { 1 - w, 0, w };
+    }
+    const double va = d3 * d6 - d5 * d4;
+    if (va <= 0 && (d4 - d3) >= 0 && (d5 - d6) >= 0) {
+        const double w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+        return { 0, 1 - w, w };
+    }
+    const double denom = 1 / (va + vb + vc);
+    const double v = vb * denom, w = vc * denom;
+    return { 1 - v - w, v, w };
+}
+
+// Parameters s and t of the closest points p1 + s (q1 - p1) and p2 + t (q2 - p2) of two segments
+// (Ericson, 5.1.9).
+static Vector2d closest_on_segments(
+    const Vector3d& p1,
+    const Vector3d& q1,
+    const Vector3d& p2,
+    const Vector3d& q2)
+{
+    const Vector3d d1 = q1 - p1, d2 = q2 - p2, r = p1 - p2;
+    const double a = d1.squaredNorm(), e = d2.squaredNorm(), f = d2.dot(r);
+    constexpr double kEpsilon = 1e-20;
+    if (a <= kEpsilon && e <= kEpsilon) {
+        return { 0, 0 };
+    }
+    double s, t;
+    if (a <= kEpsilon) {
+        s = 0;
+        t = std::clamp(f / e, 0.0, 1.0);
+    }
+    else {
+        const double c = d1.dot(r);
+        if (e <= kEpsilon) {
+            t = 0;
+            s = std::clamp(-c / a, 0.0, 1.0);
+        }
+        else {
+            const double b = d1.dot(d2), denom = a * e - b * b;
+            s = denom > kEpsilon ? std::clamp((b * f - c * e) / denom, 0.0, 1.0) : 0.0;
+            t = (b * s + f) / e;
+            if (t < 0) {
+                t = 0;
+                s = std::clamp(-c / a, 0.0, 1.0);
+            }
+            else if (t > 1) {
+                t = 1;
+                s = std::clamp((b - c) / a, 0.0, 1.0);
+            }
+        }
+    }
+    return { s, t };
+}
+
+void ClothCollision::set_cloth(unsigned n_vertices, const MatrixXi& F)
+{
+    n_cloth_vertices = n_vertices;
+    cloth_faces = F;
+    update_topology();
+}
+
+void ClothCollision::set_obstacle(const MatrixXd& V, const MatrixXi& F)
+{
+    n_obstacle_vertices = V.rows();
+    obstacle_vertices = V;
+    obstacle_faces = F;
+    update_topology();
+}
+
+bool ClothCollision::update_obstacle(const MatrixXd& V)
+{
+    if (V.rows() != n_obstacle_vertices) {
+        return false;
+    }
+    obstacle_vertices = V;
+    for (unsigned i = 0; i < n_obstacle_vertices; i++) {
+        points[n_cloth_vertices + i] = V.row(i);
+    }
+    return true;
+}
+
+void ClothCollision::update_topology()
+{
+    points.resize(n_cloth_vertices + n_obstacle_vertices);
+    for (unsigned i = 0; i < n_obstacle_vertices; i++) {
+        points[n_cloth_vertices + i] = obstacle_vertices.row(i);
+    }
+
+    triangles.clear();
+    edges.clear();
+    auto add_mesh = [&](const MatrixXi& F, int offset) {
+        for (int f = 0; f < F.rows(); f++) {
+            triangles.push_back({ F(f, 0) + offset, F(f, 1) + offset, F(f, 2) + offset });
+        }
+        for (const auto& [i, j] : get_edges(F)) {
+            edges.push_back({ i + offset, j + offset });
+        }
+    };
+    add_mesh(cloth_faces, 0);
+    n_cloth_triangles = triangles.size();
+    n_cloth_edges = edges.size();
+    add_mesh(obstacle_faces, n_cloth_vertices);
+
+    force = MatrixXd::Zero(n_cloth_vertices, 3);
+    built_points.clear();
+}
+
+bool ClothCollision::needs_rebuild() const
+{
+    if (built_points.size() != points.size() || built_thickness != thickness ||
+        built_self_collision != self_collision || built_obstacle_collision != obstacle_collision) {
+        return true;
+    }
+    const double limit2 = 0.25 * skin * skin;
+    std::atomic<bool> moved = false;
+    pxr::WorkParallelForN(points.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end && !moved.load(std::memory_order_relaxed); i++) {
+            if ((points[i] - built_points[i]).squaredNorm() > limit2) {
+                moved = true;
+            }
+        }
+    });
+    return moved;
+}
+
+void ClothCollision::rebuild()
+{
+    double mean_edge_length = 0;
+    for (const auto& [i, j] : edges) {
+        mean_edge_length += (points[i] - points[j]).norm();
+    }
+    mean_edge_length /= std::max<size_t>(edges.size(), 1);
+    skin = std::max(thickness, 0.25 * mean_edge_length);
+    const double r = thickness + skin;
+    const double size = std::max(mean_edge_length, 2 * r);
+
+    auto colliding = [&](bool cloth) { return cloth ? self_collision : obstacle_collision; };
+    auto shares_point = [](const auto& a, const auto& b) {
+        for (int p : a) {
+            if (std::find(b.begin(), b.end(), p) != b.end()) {
+                return true;
+            }
+        }
+        return false;
+    };
+    const Vector3d inflate = Vector3d::Constant(r);
+    auto triangle_box = [&](size_t t) {
+        const auto& [a, b, c] = triangles[t];
+        const Vector3d min = points[a].cwiseMin(points[b]).cwiseMin(points[c]);
+        const Vector3d max = points[a].cwiseMax(points[b]).cwiseMax(points[c]);
+        return std::pair<Vector3d, Vector3d>(min - inflate, max + inflate);
+    };
+    auto edge_box = [&](size_t e) {
+        const auto& [a, b] = edges[e];
+        return std::pair<Vector3d, Vector3d>(
+            points[a].cwiseMin(points[b]) - inflate, points[a].cwiseMax(points[b]) + inflate);
+    };
+    auto inside = [](const Vector3d& x, const std::pair<Vector3d, Vector3d>& box) {
+        return (x.array() >= box.first.array()).all() && (x.array() <= box.second.array()).all();
+    };
+
+    // Only the triangles and edges that can collide go into the grids; item i of a grid is
+    // triangles[ids[i]].
+    std::vector<unsigned> triangle_ids, edge_ids;
+    for (unsigned t = 0; t < triangles.size(); t++) {
+        if (colliding(t < n_cloth_triangles)) {
+            triangle_ids.push_back(t);
+        }
+    }
+    for (unsigned e = 0; e < edges.size(); e++) {
+        if (colliding(e < n_cloth_edges)) {
+            edge_ids.push_back(e);
+        }
+    }
+    HashGrid triangle_grid, edge_grid;
+    triangle_grid.build(
+        triangle_ids.size(), size, [&](size_t i) { return triangle_box(triangle_ids[i]); });
+    edge_grid.build(edge_ids.size(), size, [&](size_t i) { return edge_box(edge_ids[i]); });
+
+    // The pairs of cloth vertex v and cloth edge e. Each vertex looks in its own cell, which
+    // holds every enlarged box that contains it. Each edge looks in the cells of its box, and a
+    // pair counts in the cell of the low corner of the two boxes' overlap, so only once.
+    auto find_pairs = [&](size_t item, auto&& visit) {
+        if (item < n_cloth_vertices) {
+            const int v = item;
+            const Vector3d& x = points[v];
+            triangle_grid.for_each_item(cell_of(x, size), [&](unsigned i) {
+                const unsigned t = triangle_ids[i];
+                const auto& corners = triangles[t];
+                if (!shares_point(std::array<int, 1>{ v }, corners) &&
+                    inside(x, triangle_box(t))) {
+                    visit(Pair{ { v, corners[0], corners[1], corners[2] }, false, t });
+                }
+            });
+            return;
+        }
+        const unsigned e = item - n_cloth_vertices;
+        const auto box = edge_box(e);
+        const std::pair<Vector3d, Vector3d> own_box = { box.first + inflate, box.second - inflate };
+        edge_grid.for_each_cell(own_box.first, own_box.second, [&](const Vector3i& cell) {
+            edge_grid.for_each_item(cell, [&](unsigned i) {
+                const unsigned other = edge_ids[i];
+                if ((other < n_cloth_edges && other <= e) || shares_point(edges[e], edges[other])) {
+                    return;
+                }
+                const auto other_box = edge_box(other);
+                const Vector3d low = own_box.first.cwiseMax(other_box.first);
+                if ((low.array() > own_box.second.cwiseMin(other_box.second).array()).any() ||
+                    cell_of(low, size) != cell) {
+                    return;
+                }
+                visit(Pair{
+                    { edges[e][0], edges[e][1], edges[other][0], edges[other][1] }, true, other });
+            });
+        });
+    };
+
+    // Count, scan, then fill, as the SPH neighbor lists.
+    const size_t n_items = n_cloth_vertices + n_cloth_edges;
+    auto& offsets = item_pair_offsets;
+    offsets.assign(n_items + 1, 0);
+    pxr::WorkParallelForN(n_items, [&](size_t begin, size_t end) {
+        for (size_t item = begin; item < end; item++) {
+            find_pairs(item, [&](const Pair&) { offsets[item + 1]++; });
+        }
+    });
+    for (size_t item = 0; item < n_items; item++) {
+        offsets[item + 1] += offsets[item];
+    }
+    pairs.resize(offsets[n_items]);
+    pxr::WorkParallelForN(n_items, [&](size_t begin, size_t end) {
+        for (size_t item = begin; item < end; item++) {
+            unsigned next = offsets[item];
+            find_pairs(item, [&](const Pair& pair) { pairs[next++] = pair; });
+        }
+    });
+
+    vertex_pair_offsets.assign(n_cloth_vertices + 1, 0);
+    for (const auto& pair : pairs) {
+        for (int p : pair.points) {
+            if (unsigned(p) < n_cloth_vertices) {
+                vertex_pair_offsets[p + 1]++;
+            }
+        }
+    }
+    for (unsigned v = 0; v < n_cloth_vertices; v++) {
+        vertex_pair_offsets[v + 1] += vertex_pair_offsets[v];
+    }
+    vertex_pairs.resize(vertex_pair_offsets[n_cloth_vertices]);
+    std::vector<unsigned> next(vertex_pair_offsets.begin(), vertex_pair_offsets.end() - 1);
+    for (unsigned c = 0; c < pairs.size(); c++) {
+        for (int k = 0; k < 4; k++) {
+            const int p = pairs[c].points[k];
+            if (unsigned(p) < n_cloth_vertices) {
+                vertex_pairs[next[p]++] = 4 * c + k;
+            }
+        }
+    }
+    pair_force.resize(pairs.size());
+    pair_weight.resize(pairs.size());
+    pair_feature.resize(pairs.size());
+    pair_energy.resize(pairs.size());
+
+    cell_size = size;
+    built_points = points;
+    built_thickness = thickness;
+    built_self_collision = self_collision;
+    built_obstacle_collision = obstacle_collision;
+    n_rebuilds++;
+}
+
+// Closest points this near an end of their segment, or a side of their triangle, are on it.
+static constexpr double kFeatureTolerance = 1e-6;
+
+static bool at_end(double t)
+{
+    return t <= kFeatureTolerance || t >= 1 - kFeatureTolerance;
+}
+
+const MatrixXd&
+ClothCollision::compute_forces(const MatrixXd& X, const MatrixXd& V, double stiffness)
+{
+    for (unsigned v = 0; v < n_cloth_vertices; v++) {
+        points[v] = X.row(v);
+    }
+    if (needs_rebuild()) {
+        rebuild();
+    }
+    auto velocity = [&](int p) -> Vector3d {
+        return unsigned(p) < n_cloth_vertices ? Vector3d(V.row(p)) : Vector3d::Zero();
+    };
+    const double damping = 2 * damping_ratio * std::sqrt(stiffness);
+
+    pxr::WorkParallelForN(pairs.size(), [&](size_t begin, size_t end) {
+        for (size_t c = begin; c < end; c++) {
+            const auto& p = pairs[c].points;
+            auto& w = pair_weight[c];
+            auto& feature = pair_feature[c];
+            feature = { -1, -1, -1 };
+            bool covered = false;
+            if (pairs[c].edge_edge) {
+                Vector2d st = closest_on_segments(
+                    points[p[0]], points[p[1]], points[p[2]], points[p[3]]);
+                w = { 1 - st[0], st[0], st[1] - 1, -st[1] };
+                // Where the closest point is an end of a cloth edge, the vertex-triangle pairs of
+                // that vertex already push; counting it again would stiffen the contact.
+                covered = at_end(st[0]) || (at_end(st[1]) && unsigned(p[2]) < n_cloth_vertices);
+                if (!at_end(st[1])) {
+                    feature = { std::min(p[2], p[3]), std::max(p[2], p[3]), -1 };
+                }
+                else {
+                    feature[0] = st[1] < 0.5 ? p[2] : p[3];
+                }
+            }
+            else {
+                Vector3d b = closest_on_triangle(points[p[0]], points[p[1]], points[p[2]],
+                                                 points[p[3]]);
+                w = { 1, -b[0], -b[1], -b[2] };
+                int n = 0;
+                for (int k = 0; k < 3; k++) {
+                    if (b[k] > kFeatureTolerance) {
+                        feature[n++] = p[k + 1];
+                    }
+                }
+                std::sort(feature.begin(), feature.begin() + n);
+            }
+            Vector3d d = w[0] * points[p[0]] + w[1] * points[p[1]] + w[2] * points[p[2]] +
+                         w[3] * points[p[3]];
+            const double distance = d.norm();
+            if (!covered && distance < thickness && distance > 1e-12) {
+                const double depth = thickness - distance;
+                const Vector3d normal = d / distance;
+                const Vector3d relative_velocity = w[0] * velocity(p[0]) + w[1] * velocity(p[1]) +
+                                                   w[2] * velocity(p[2]) + w[3] * velocity(p[3]);
+                const double push = stiffness * depth - damping * normal.dot(relative_velocity);
+                pair_force[c] = std::max(push, 0.0) * normal;
+                pair_energy[c] = 0.5 * stiffness * depth * depth;
+            }
+            else {
+                pair_force[c].setZero();
+                pair_energy[c] = 0;
+            }
+        }
+    });
+
+    // A vertex over an edge or a corner of the other mesh, or an edge over a corner, is as close
+    // to each triangle or edge around it. Of the pairs of one item that reach the same feature,
+    // only the one with the lowest triangle or edge pushes.
+    const size_t n_items = n_cloth_vertices + n_cloth_edges;
+    pxr::WorkParallelForN(n_items, [&](size_t begin, size_t end) {
+        for (size_t item = begin; item < end; item++) {
+            const unsigned first = item_pair_offsets[item], last = item_pair_offsets[item + 1];
+            for (unsigned c = first; c < last; c++) {
+                for (unsigned other = first; other < last && pair_energy[c] > 0; other++) {
+                    if (other != c && pair_energy[other] > 0 &&
+                        pair_feature[other] == pair_feature[c] &&
+                        pairs[other].primitive < pairs[c].primitive) {
+                        pair_force[c].setZero();
+                        pair_energy[c] = 0;
+                    }
+                }
+            }
+        }
+    });
+
+    pxr::WorkParallelForN(n_cloth_vertices, [&](size_t begin, size_t end) {
+        for (size_t v = begin; v < end; v++) {
+            Vector3d f = Vector3d::Zero();
+            for (unsigned a = vertex_pair_offsets[v]; a < vertex_pair_offsets[v + 1]; a++) {
+                const unsigned c = vertex_pairs[a] / 4;
+                f += pair_weight[c][vertex_pairs[a] % 4] * pair_force[c];
+            }
+            force.row(v) = f.transpose();
+        }
+    });
+
+    last_energy = 0;
+    n_contacts = 0;
+    for (size_t c = 0; c < pairs.size(); c++) {
+        last_energy += pair_energy[c];
+        n_contacts += pair_energy[c] > 0;
+    }
+    return force;
+}
+}  // namespace USTC_CG::node_mass_spring
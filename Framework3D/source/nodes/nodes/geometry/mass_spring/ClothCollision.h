@@ -0,0 +1,117 @@
+#pragma once
+#include <Eigen/Dense>
+#include <array>
+#include <vector>
+
+namespace USTC_CG::node_mass_spring {
+
+// Penalty collisions of a triangle cloth with itself and with an obstacle mesh.
+//
+// The broad phase hashes the triangles and edges into a uniform grid, with their bounding boxes
+// enlarged by thickness + skin, and keeps the vertex-triangle and edge-edge pairs whose boxes
+// meet. Like a Verlet list, the pairs stay valid as long as no vertex has moved more than half
+// the skin, so most steps only run the narrow phase over them: the closest points of each pair,
+// and a penalty force where they are closer than the thickness. Both phases run in parallel; the
+// forces are gathered per vertex, so no two threads write one vertex.
+//
+// The obstacle has infinite mass: it pushes the cloth, and is moved only by update_obstacle().
+class ClothCollision {
+   public:
+    // The cloth triangles. Without them, only the cloth vertices collide with the obstacle.
+    void set_cloth(unsigned n_vertices, const Eigen::MatrixXi& F);
+    void set_obstacle(const Eigen::MatrixXd& V, const Eigen::MatrixXi& F);
+    // New positions of the obstacle's vertices, in the order of set_obstacle().
+    bool update_obstacle(const Eigen::MatrixXd& V);
+    bool has_obstacle() const
+    {
+        return n_obstacle_vertices > 0;
+    }
+
+    // Penalty forces on the cloth vertices at X moving at V, stiffness * depth along the separating
+    // direction, less a damping of the approach speed along it. The obstacle counts as still.
+    const Eigen::MatrixXd&
+    compute_forces(const Eigen::MatrixXd& X, const Eigen::MatrixXd& V, double stiffness);
+    // Penalty energy of the last compute_forces().
+    double energy() const
+    {
+        return last_energy;
+    }
+
+    // Should stay below the rest edge length, or the vertices of a flat cloth a few edges apart
+    // push each other.
+    double thickness = 0.01;
+    // Of the critical damping of one vertex on one contact, 2 sqrt(stiffness). The contact force
+    // never pulls.
+    double damping_ratio = 0.5;
+    bool self_collision = true;
+    bool obstacle_collision = true;
+
+    // Statistics
+    unsigned rebuilds() const
+    {
+        return n_rebuilds;
+    }
+    size_t candidates() const
+    {
+        return pairs.size();
+    }
+    unsigned contacts() const
+    {
+        return n_contacts;
+    }
+
+   protected:
+    // A candidate pair, as four points with weights that give the separation w . p: the vertex
+    // and the triangle's corners, or the two ends of each edge. primitive is the triangle, or the
+    // second edge.
+    struct Pair {
+        std::array<int, 4> points;
+        bool edge_edge;
+        unsigned primitive;
+    };
+    // The points of the closest feature on the pair's triangle or second edge, sorted, -1 past
+    // the last.
+    using Feature = std::array<int, 3>;
+
+    void update_topology();
+    bool needs_rebuild() const;
+    void rebuild();
+
+    unsigned n_cloth_vertices = 0;
+    unsigned n_obstacle_vertices = 0;
+    Eigen::MatrixXi cloth_faces;
+    Eigen::MatrixXd obstacle_vertices;
+    Eigen::MatrixXi obstacle_faces;
+    // Cloth points first, then the obstacle's; the triangles and edges of both index into them.
+    std::vector<Eigen::Vector3d> points;
+    std::vector<std::array<int, 3>> triangles;
+    std::vector<std::array<int, 2>> edges;
+    unsigned n_cloth_triangles = 0;
+    unsigned n_cloth_edges = 0;
+    // Set at each rebuild from the mean edge length.
+    double cell_size = 1;
+    double skin = 0;
+
+    // The pairs of each cloth vertex with the triangles, then of each cloth edge with the edges:
+    // those of item i are pairs[item_pair_offsets[i]...], the edges following the vertices.
+    std::vector<Pair> pairs;
+    std::vector<unsigned> item_pair_offsets;
+    // For each cloth vertex, the pairs it takes part in, in CSR form, as 4 * pair + point.
+    std::vector<unsigned> vertex_pair_offsets;
+    std::vector<unsigned> vertex_pairs;
+    // The state the pairs were found for.
+    std::vector<Eigen::Vector3d> built_points;
+    double built_thickness = -1;
+    bool built_self_collision = false;
+    bool built_obstacle_collision = false;
+
+    std::vector<Eigen::Vector3d> pair_force;
+    std::vector<std::array<double, 4>> pair_weight;
+    std::vector<Feature> pair_feature;
+    std::vector<double> pair_energy;
+    Eigen::MatrixXd force;
+    double last_energy = 0;
+    unsigned n_rebuilds = 0;
+    unsigned n_contacts = 0;
+};
+}  // namespace USTC_CG::node_mass_spring
@@ -1,6 +1,7 @@
 #include "FastMassSpring.h"
 #include <iostream>
 
+#include "pxr/base/work/loops.h"
 
 namespace USTC_CG::node_mass_spring {
 FastMassSpring::FastMassSpring(const Eigen::MatrixXd& X, const EdgeSet& E, const float stiffness, const float h): 
@@ -12,21 +13,162 @@ MassSpring(X, E){
     this->stiffness = stiffness; 
     this->h = h; 
 
-    Eigen::SparseMatrix<double> A(n_vertices * 3, n_vertices * 3);
-    A.setZero();
+    factorize();
+}
+
+const FastMassSpring::Solver& FastMassSpring::factorize()
+{
+    // More sizes than advance() takes mean h itself was changed: the old ones are of no use.
+    constexpr size_t kMaxSolvers = 16;
+    if (factorized_stiffness != stiffness || factorized_dirichlet_bc_mask != dirichlet_bc_mask ||
+        (solvers.size() >= kMaxSolvers && !solvers.count(h))) {
+        solvers.clear();
+        factorized_stiffness = stiffness;
+        factorized_dirichlet_bc_mask = dirichlet_bc_mask;
+    }
+    auto [it, inserted] = solvers.try_emplace(h);
+    Solver& solver = it->second;
+    if (!inserted) {
+        return solver;
+    }
+
+    TIC(factorize)
+    const unsigned n_vertices = X.rows();
+    const double k = stiffness;
+    const double inertia = mass / n_vertices / (h * h);
+
+    // A fixed vertex keeps its row and column only for the identity, and its springs move to the
+    // right-hand side of the free vertices they end.
+    std::vector<Trip_d> triplets;
+    triplets.reserve(n_vertices + 4 * springs.size());
+    for (unsigned v = 0; v < n_vertices; v++) {
+        triplets.emplace_back(v, v, dirichlet_bc_mask[v] ? 1.0 : inertia);
+    }
+    for (const auto& [i, j] : springs) {
+        if (!dirichlet_bc_mask[i]) {
+            triplets.emplace_back(i, i, k);
+        }
+        if (!dirichlet_bc_mask[j]) {
+            triplets.emplace_back(j, j, k);
+        }
+        if (!dirichlet_bc_mask[i] && !dirichlet_bc_mask[j]) {
+            triplets.emplace_back(i, j, -k);
+            triplets.emplace_back(j, i, -k);
+        }
+    }
+    SparseMatrix_d A(n_vertices, n_vertices);
+    A.setFromTriplets(triplets.begin(), triplets.end());
 
-    // (HW Optional) precompute A and prefactorize
-    // Note: one thing to take care of: A is related with stiffness, if stiffness changes, A need to be recomputed
+    solver.compute(A);
+    if (solver.info() != Eigen::Success) {
+        std::cerr << "Fast mass spring: factorization failed" << std::endl;
+    }
+    n_factorizations++;
+    TOC(factorize)
+    return solver;
+}
+
+void FastMassSpring::solve(const Solver& solver, MatrixX3r& rhs)
+{
+    // A = P^T L L^T P, with the diagonal first in each column of L.
+    const SparseMatrix_d& L = solver.matrixL().nestedExpression();
+    const auto* outer = L.outerIndexPtr();
+    const auto* inner = L.innerIndexPtr();
+    const double* value = L.valuePtr();
+    const int n = L.cols();
+
+    MatrixX3r y = solver.permutationP() * rhs;
+    for (int j = 0; j < n; j++) {
+        const Eigen::RowVector3d y_j = y.row(j) / value[outer[j]];
+        y.row(j) = y_j;
+        for (auto k = outer[j] + 1; k < outer[j + 1]; k++) {
+            y.row(inner[k]) -= value[k] * y_j;
+        }
+    }
+    for (int j = n - 1; j >= 0; j--) {
+        Eigen::RowVector3d y_j = y.row(j);
+        for (auto k = outer[j] + 1; k < outer[j + 1]; k++) {
+            y_j -= value[k] * y.row(inner[k]);
+        }
+        y.row(j) = y_j / value[outer[j]];
+    }
+    rhs = solver.permutationPinv() * y;
 }
 
 void FastMassSpring::step()
 {
-    // (HW Optional) Necessary preparation
-    // ...
+    const Solver& solver = factorize();
+
+    TIC(step)
+    const unsigned n_vertices = X.rows();
+    const double k = stiffness;
+    const double inertia = mass / n_vertices / (h * h);
+
+    Eigen::MatrixXd acceleration = Eigen::MatrixXd::Zero(n_vertices, 3);
+    if (enable_sphere_collision) {
+        acceleration = getSphereCollisionForce(sphere_center.cast<double>(), sphere_radius);
+    }
+    if (enable_self_collision || enable_mesh_collision) {
+        acceleration += getMeshCollisionForce();
+    }
+    acceleration.rowwise() += (gravity + wind_ext_acc).transpose();
+
+    // Inertial positions, which also start the iterations.
+    MatrixX3r Y = X + h * vel + h * h * acceleration;
+    for (unsigned v = 0; v < n_vertices; v++) {
+        if (dirichlet_bc_mask[v]) {
+            Y.row(v) = X.row(v);
+        }
+    }
+
+    MatrixX3r x = Y;
+    std::vector<Eigen::Vector3d> d(springs.size());
     for (unsigned iter = 0; iter < max_iter; iter++) {
-        // (HW Optional)
-        // local_step and global_step alternating solving
+        // Local step: the spring directions, at rest length.
+        pxr::WorkParallelForN(springs.size(), [&](size_t begin, size_t end) {
+            for (size_t s = begin; s < end; s++) {
+                Eigen::Vector3d diff = x.row(springs[s].first) - x.row(springs[s].second);
+                double length = diff.norm();
+                d[s] = length > 1e-12 ? (E_rest_length[s] / length * diff).eval() : diff;
+            }
+        });
+
+        // Global step, on the right-hand side M / h^2 y + k J d plus the springs to fixed
+        // vertices, assembled in place.
+        pxr::WorkParallelForN(n_vertices, [&](size_t begin, size_t end) {
+            for (size_t v = begin; v < end; v++) {
+                if (dirichlet_bc_mask[v]) {
+                    x.row(v) = X.row(v);
+                    continue;
+                }
+                Eigen::Vector3d b = Eigen::Vector3d::Zero();
+                for (unsigned a = vertex_spring_offsets[v]; a < vertex_spring_offsets[v + 1];
+                     a++) {
+                    const unsigned s = vertex_springs[a] / 2;
+                    const bool second = vertex_springs[a] % 2;
+                    const int other = second ? springs[s].first : springs[s].second;
+                    b += second ? -d[s] : d[s];
+                    if (dirichlet_bc_mask[other]) {
+                        b += X.row(other).transpose();
+                    }
+                }
+                x.row(v) = inertia * Y.row(v) + k * b.transpose();
+            }
+        });
+        solve(solver, x);
+    }
+
+    vel = (x - X) / h;
+    if (enable_damping) {
+        vel *= damping;
+    }
+    for (unsigned v = 0; v < n_vertices; v++) {
+        if (dirichlet_bc_mask[v]) {
+            vel.row(v).setZero();
+        }
     }
+    X = x;
+    TOC(step)
 }
 
 }  // namespace USTC_CG::node_mass_spring
@@ -1,11 +1,20 @@
 #pragma once 
 #include "MassSpring.h"
+#include <map>
 #include <memory>
 
 namespace USTC_CG::node_mass_spring {
 // Impliment the Liu13's paper: https://tiantianliu.cn/papers/liu13fast/liu13fast.pdf
+//
+// Each step alternates a local step, which projects every spring onto its rest length, and a
+// global step, which solves (M / h^2 + k L) x = M / h^2 y + k J d. L is the same for the three
+// coordinates, so the system is n x n with three right-hand sides. It only depends on the
+// stiffness, h and the fixed vertices. advance() only steps with a few sizes of h, so one
+// factorization is kept for each; they are all dropped when the stiffness or the fixed vertices
+// change.
 class FastMassSpring : public MassSpring {
    public:
+    using MatrixX3r = Eigen::Matrix<double, Eigen::Dynamic, 3, Eigen::RowMajor>;
     FastMassSpring() = default;
     ~FastMassSpring() = default; 
 
@@ -13,8 +22,26 @@ class FastMassSpring : public MassSpring {
     void step() override;
     unsigned max_iter = 100; // (HW Optional) add UI for this parameter
 
+    // Number of times the system matrix was factored, for profiling.
+    unsigned factorizations() const
+    {
+        return n_factorizations;
+    }
+
    protected:
-    // Custom variables, like prefactorized A 
-   
+    using Solver = Eigen::SimplicialLLT<SparseMatrix_d>;
+
+    // The factorization for the current stiffness, h and fixed vertices, assembled and factored
+    // if there is none yet.
+    const Solver& factorize();
+    // Solves A x = rhs for the three coordinates at once. Eigen's solve() runs the triangular
+    // solves once per column; here the factor is read once for all three.
+    static void solve(const Solver& solver, MatrixX3r& rhs);
+
+    // By h, for the stiffness and fixed vertices below.
+    std::map<double, Solver> solvers;
+    unsigned n_factorizations = 0;
+    double factorized_stiffness = 0;
+    std::vector<bool> factorized_dirichlet_bc_mask;
 };
-}  // namespace USTC_CG::node_mass_spring
\ No newline at end of file
+}  // namespace USTC_CG::node_mass_spring
@@ -1,23 +1,90 @@
 #include "MassSpring.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
 #include <iostream>
 
+#include "pxr/base/work/loops.h"
+
 namespace USTC_CG::node_mass_spring {
 MassSpring::MassSpring(const Eigen::MatrixXd& X, const EdgeSet& E)
 {
     this->X = this->init_X = X;
     this->vel = Eigen::MatrixXd::Zero(X.rows(), X.cols());
-    this->E = E;
+    this->springs.assign(E.begin(), E.end());
 
     std::cout << "number of edges: " << E.size() << std::endl;
     std::cout << "init mass spring" << std::endl;
 
     // Compute the rest pose edge length
-    for (const auto& e : E) {
+    for (const auto& e : springs) {
         Eigen::Vector3d x0 = X.row(e.first);
         Eigen::Vector3d x1 = X.row(e.second);
         this->E_rest_length.push_back((x0 - x1).norm());
     }
 
+    const unsigned n_vertices = X.rows();
+    vertex_spring_offsets.assign(n_vertices + 1, 0);
+    for (const auto& e : springs) {
+        vertex_spring_offsets[e.first + 1]++;
+        vertex_spring_offsets[e.second + 1]++;
+    }
+    for (unsigned v = 0; v < n_vertices; v++) {
+        vertex_spring_offsets[v + 1] += vertex_spring_offsets[v];
+    }
+    vertex_springs.resize(vertex_spring_offsets[n_vertices]);
+    std::vector<unsigned> next(vertex_spring_offsets.begin(), vertex_spring_offsets.end() - 1);
+    for (unsigned s = 0; s < springs.size(); s++) {
+        vertex_springs[next[springs[s].first]++] = 2 * s;
+        vertex_springs[next[springs[s].second]++] = 2 * s + 1;
+    }
+
+    // The Hessian's pattern, and where each block sits in it.
+    std::vector<Trip_d> triplets;
+    triplets.reserve(9 * (n_vertices + 2 * springs.size()));
+    auto add_block = [&](int a, int b) {
+        for (int c = 0; c < 3; c++) {
+            for (int r = 0; r < 3; r++) {
+                triplets.emplace_back(3 * a + r, 3 * b + c, 0.0);
+            }
+        }
+    };
+    for (unsigned v = 0; v < n_vertices; v++) {
+        add_block(v, v);
+    }
+    for (const auto& [i, j] : springs) {
+        add_block(i, j);
+        add_block(j, i);
+    }
+    hessian.resize(3 * n_vertices, 3 * n_vertices);
+    hessian.setFromTriplets(triplets.begin(), triplets.end());
+    hessian.makeCompressed();
+
+    // Rows are sorted within a column, so a block's three rows are contiguous, at the same place
+    // in each of the three columns of its vertex.
+    auto block_position = [&](int row_vertex, int column_vertex) {
+        const auto* rows = hessian.innerIndexPtr();
+        const auto* first = rows + hessian.outerIndexPtr()[3 * column_vertex];
+        const auto* last = rows + hessian.outerIndexPtr()[3 * column_vertex + 1];
+        return unsigned(std::lower_bound(first, last, 3 * row_vertex) - first);
+    };
+    hessian_diagonal.resize(n_vertices);
+    hessian_off_diagonal.resize(vertex_springs.size());
+    for (unsigned v = 0; v < n_vertices; v++) {
+        hessian_diagonal[v] = block_position(v, v);
+        for (unsigned a = vertex_spring_offsets[v]; a < vertex_spring_offsets[v + 1]; a++) {
+            const auto& e = springs[vertex_springs[a] / 2];
+            const int other = vertex_springs[a] % 2 ? e.first : e.second;
+            hessian_off_diagonal[a] = block_position(other, v);
+        }
+    }
+    implicit_solver.analyzePattern(hessian);
+
+    spring_grad.resize(springs.size());
+    spring_hessian.resize(springs.size());
+    grad.resize(n_vertices, 3);
+    collision.set_cloth(n_vertices, Eigen::MatrixXi(0, 3));
+
     // Initialize the mask for Dirichlet boundary condition
     dirichlet_bc_mask.resize(X.rows(), false);
 
@@ -39,42 +106,66 @@ void MassSpring::step()
 
     //----------------------------------------------------
     // (HW Optional) Bonus part: Sphere collision
-    Eigen::MatrixXd acceleration_collision =
-        getSphereCollisionForce(sphere_center.cast<double>(), sphere_radius);
+    Eigen::MatrixXd acceleration_collision = Eigen::MatrixXd::Zero(n_vertices, 3);
+    if (enable_sphere_collision) {
+        acceleration_collision =
+            getSphereCollisionForce(sphere_center.cast<double>(), sphere_radius);
+    }
+    if (enable_self_collision || enable_mesh_collision) {
+        acceleration_collision += getMeshCollisionForce();
+    }
     //----------------------------------------------------
 
     if (time_integrator == IMPLICIT_EULER) {
-        // Implicit Euler
+        // Implicit Euler, one Newton step from X towards the minimum of
+        // m / (2 h^2) |x - y|^2 + E(x), with y the position under the external forces alone.
         TIC(step)
 
-        // (HW TODO) 
-        // auto H_elastic = computeHessianSparse(stiffness);  // size = [nx3, nx3]
+        const double h2 = h * h;
+        Eigen::MatrixXd Y = X + h * vel + h2 * acceleration_collision;
+        Y.rowwise() += h2 * acceleration_ext.transpose();
 
-        // compute Y 
+        Eigen::MatrixXd rhs = mass_per_vertex / h2 * (Y - X) - updateGrad(stiffness);
+        for (unsigned i = 0; i < n_vertices; i++) {
+            if (dirichlet_bc_mask[i]) {
+                rhs.row(i).setZero();
+            }
+        }
 
-        // Solve Newton's search direction with linear solver 
-        
-        // update X and vel 
+        implicit_solver.factorize(updateHessian(stiffness, mass_per_vertex / h2));
+        Eigen::MatrixXd dX = unflatten(implicit_solver.solve(flatten(rhs)));
+
+        vel = dX / h;
+        if (enable_damping) {
+            vel *= damping;
+        }
+        X += dX;
 
         TOC(step)
     }
     else if (time_integrator == SEMI_IMPLICIT_EULER) {
 
         // Semi-implicit Euler
-        Eigen::MatrixXd acceleration = -computeGrad(stiffness) / mass_per_vertex;
+        Eigen::MatrixXd acceleration = -updateGrad(stiffness) / mass_per_vertex;
         acceleration.rowwise() += acceleration_ext.transpose();
 
         // -----------------------------------------------
         // (HW Optional)
-        if (enable_sphere_collision) {
+        if (enable_sphere_collision || enable_self_collision || enable_mesh_collision) {
             acceleration += acceleration_collision;
         }
         // -----------------------------------------------
 
-        // (HW TODO): Implement semi-implicit Euler time integration
-
-        // Update X and vel 
-        
+        vel += h * acceleration;
+        if (enable_damping) {
+            vel *= damping;
+        }
+        for (unsigned i = 0; i < n_vertices; i++) {
+            if (dirichlet_bc_mask[i]) {
+                vel.row(i).setZero();
+            }
+        }
+        X += h * vel;
     }
     else {
         std::cerr << "Unknown time integrator!" << std::endl;
@@ -82,6 +173,101 @@ void MassSpring::step()
     }
 }
 
+void MassSpring::advance(double duration)
+{
+    constexpr int kGrowAfter = 4;
+    constexpr int kLevels = 11;
+    const double max_h = h;
+
+    // Step sizes are the even split of the frame into steps of at most h, halved up to ten times.
+    // Every size fits the frame a whole number of times, so there is no sliver at its end, and the
+    // few sizes let FastMassSpring keep a factorization for each. Time is counted in steps of the
+    // finest size.
+    const int64_t base_steps = std::max<int64_t>(1, int64_t(std::ceil(duration / max_h - 1e-9)));
+    const double base_h = duration / base_steps;
+    const int64_t finest_per_base = int64_t(1) << (kLevels - 1);
+    const int64_t total = base_steps * finest_per_base;
+    int level = 0;
+    if (adaptive_h > 0) {
+        level = std::clamp(int(std::lround(std::log2(base_h / adaptive_h))), 0, kLevels - 1);
+    }
+
+    // Scale of the energies at play, for the tolerance: the work the external acceleration does
+    // across the mesh, plus the energy the mesh holds.
+    const Eigen::Vector3d acceleration_ext = gravity + wind_ext_acc;
+    const double extent = (init_X.colwise().maxCoeff() - init_X.colwise().minCoeff()).norm();
+    const double external_scale = mass * acceleration_ext.norm() * extent;
+
+    last_substeps = 0;
+    last_rejected_substeps = 0;
+    last_min_h = max_h;
+    double energy = computeTotalEnergy();
+    int64_t time = 0;
+    while (time < total) {
+        const int64_t ticks = finest_per_base >> level;
+        h = std::ldexp(base_h, -level);
+
+        const Eigen::MatrixXd X0 = X;
+        const Eigen::MatrixXd vel0 = vel;
+        const double kinetic = 0.5 * mass / X.rows() * vel.squaredNorm();
+        const double scale = external_scale + kinetic + computeEnergy(stiffness) + 1e-12;
+
+        step();
+        const double new_energy = computeTotalEnergy();
+        if (new_energy - energy > energy_tolerance * scale && level < kLevels - 1) {
+            X = X0;
+            vel = vel0;
+            level++;
+            adaptive_calm_steps = 0;
+            last_rejected_substeps++;
+            continue;
+        }
+
+        energy = new_energy;
+        time += ticks;
+        last_substeps++;
+        last_min_h = std::min(last_min_h, h);
+        // A longer step has to start on its own grid, which may take a few more steps.
+        if (++adaptive_calm_steps >= kGrowAfter && level > 0 && time % (2 * ticks) == 0) {
+            level--;
+            adaptive_calm_steps = 0;
+        }
+    }
+    adaptive_h = std::ldexp(base_h, -level);
+    h = max_h;
+
+    if (enable_debug_output) {
+        std::cout << "Mass spring: " << last_substeps << " substeps, " << last_rejected_substeps
+                  << " rejected, shortest " << last_min_h << std::endl;
+    }
+}
+
+double MassSpring::computeTotalEnergy()
+{
+    const unsigned n_vertices = X.rows();
+    const double mass_per_vertex = mass / n_vertices;
+    const Eigen::Vector3d acceleration_ext = gravity + wind_ext_acc;
+
+    double energy = computeEnergy(stiffness) + 0.5 * mass_per_vertex * vel.squaredNorm();
+    energy -= mass_per_vertex * ((X - init_X) * acceleration_ext).sum();
+
+    if (enable_sphere_collision) {
+        const Eigen::Vector3d center = sphere_center.cast<double>();
+        const double r = sphere_radius * collision_scale_factor;
+        for (unsigned i = 0; i < n_vertices; i++) {
+            double depth = r - (X.row(i).transpose() - center).norm();
+            if (depth > 0) {
+                energy += 0.5 * mass_per_vertex * collision_penalty_k * depth * depth;
+            }
+        }
+    }
+    if (enable_self_collision || enable_mesh_collision) {
+        getMeshCollisionForce();
+        energy += mass_per_vertex * collision.energy();
+    }
+    return energy;
+}
+
 // There are different types of mass spring energy:
 // For this homework we will adopt Prof. Huamin Wang's energy definition introduced in GAMES103
 // course Lecture 2 E = 0.5 * stiffness * sum_{i=1}^{n} (||x_i - x_j|| - l)^2 There exist other
@@ -90,54 +276,107 @@ void MassSpring::step()
 double MassSpring::computeEnergy(double stiffness)
 {
     double sum = 0.;
-    unsigned i = 0;
-    for (const auto& e : E) {
-        auto diff = X.row(e.first) - X.row(e.second);
-        auto l = E_rest_length[i];
+    for (unsigned s = 0; s < springs.size(); s++) {
+        auto diff = X.row(springs[s].first) - X.row(springs[s].second);
+        auto l = E_rest_length[s];
         sum += 0.5 * stiffness * std::pow((diff.norm() - l), 2);
-        i++;
     }
     return sum;
 }
 
 Eigen::MatrixXd MassSpring::computeGrad(double stiffness)
 {
-    Eigen::MatrixXd g = Eigen::MatrixXd::Zero(X.rows(), X.cols());
-    unsigned i = 0;
-    for (const auto& e : E) {
-        // --------------------------------------------------
-        // (HW TODO): Implement the gradient computation
-        
-        // --------------------------------------------------
-        i++;
-    }
-    return g;
+    return updateGrad(stiffness);
+}
+
+const Eigen::MatrixXd& MassSpring::updateGrad(double stiffness)
+{
+    pxr::WorkParallelForN(springs.size(), [&](size_t begin, size_t end) {
+        for (size_t s = begin; s < end; s++) {
+            Eigen::Vector3d diff = X.row(springs[s].first) - X.row(springs[s].second);
+            double length = diff.norm();
+            spring_grad[s] = length > 1e-12
+                                 ? (stiffness * (length - E_rest_length[s]) / length * diff).eval()
+                                 : Eigen::Vector3d::Zero();
+        }
+    });
+
+    pxr::WorkParallelForN(X.rows(), [&](size_t begin, size_t end) {
+        for (size_t v = begin; v < end; v++) {
+            Eigen::Vector3d g = Eigen::Vector3d::Zero();
+            for (unsigned a = vertex_spring_offsets[v]; a < vertex_spring_offsets[v + 1]; a++) {
+                const unsigned s = vertex_springs[a] / 2;
+                g += vertex_springs[a] % 2 ? -spring_grad[s] : spring_grad[s];
+            }
+            grad.row(v) = g.transpose();
+        }
+    });
+    return grad;
 }
 
 Eigen::SparseMatrix<double> MassSpring::computeHessianSparse(double stiffness)
 {
-    unsigned n_vertices = X.rows();
-    Eigen::SparseMatrix<double> H(n_vertices * 3, n_vertices * 3);
+    return updateHessian(stiffness);
+}
 
-    unsigned i = 0;
+const SparseMatrix_d& MassSpring::updateHessian(double stiffness, double diagonal_shift)
+{
     auto k = stiffness;
-    const auto I = Eigen::MatrixXd::Identity(3, 3);
-    for (const auto& e : E) {
-        // --------------------------------------------------
-        // (HW TODO): Implement the sparse version Hessian computation
-        // Remember to consider fixed points 
-        // You can also consider positive definiteness here
-       
-        // --------------------------------------------------
-
-        i++;
-    }
-    
-    H.makeCompressed();
-    return H;
+    const Eigen::Matrix3d I = Eigen::Matrix3d::Identity();
+    pxr::WorkParallelForN(springs.size(), [&](size_t begin, size_t end) {
+        for (size_t s = begin; s < end; s++) {
+            Eigen::Vector3d diff = X.row(springs[s].first) - X.row(springs[s].second);
+            double length = diff.norm();
+            if (length < 1e-12) {
+                spring_hessian[s].setZero();
+                continue;
+            }
+            Eigen::Vector3d d = diff / length;
+            // Compressed springs have an indefinite transverse part; dropping it keeps H SPD.
+            double transverse = 1 - E_rest_length[s] / length;
+            if (enable_make_SPD) {
+                transverse = std::max(transverse, 0.0);
+            }
+            spring_hessian[s] = k * (transverse * (I - d * d.transpose()) + d * d.transpose());
+        }
+    });
+
+    // Each vertex fills its own three columns. Fixed points don't move, so their rows and
+    // columns only keep the shift.
+    const auto* outer = hessian.outerIndexPtr();
+    double* value = hessian.valuePtr();
+    pxr::WorkParallelForN(X.rows(), [&](size_t begin, size_t end) {
+        for (size_t v = begin; v < end; v++) {
+            for (int c = 0; c < 3; c++) {
+                std::fill(value + outer[3 * v + c], value + outer[3 * v + c + 1], 0.0);
+            }
+            auto add_block = [&](unsigned position, const Eigen::Matrix3d& K) {
+                for (int c = 0; c < 3; c++) {
+                    double* column = value + outer[3 * v + c] + position;
+                    for (int r = 0; r < 3; r++) {
+                        column[r] += K(r, c);
+                    }
+                }
+            };
+
+            Eigen::Matrix3d diagonal = diagonal_shift * I;
+            if (!dirichlet_bc_mask[v]) {
+                for (unsigned a = vertex_spring_offsets[v]; a < vertex_spring_offsets[v + 1];
+                     a++) {
+                    const unsigned s = vertex_springs[a] / 2;
+                    const auto& e = springs[s];
+                    diagonal += spring_hessian[s];
+                    if (!dirichlet_bc_mask[vertex_springs[a] % 2 ? e.first : e.second]) {
+                        add_block(hessian_off_diagonal[a], -spring_hessian[s]);
+                    }
+                }
+            }
+            add_block(hessian_diagonal[v], diagonal);
+        }
+    });
+    return hessian;
 }
 
-
 bool MassSpring::checkSPD(const Eigen::SparseMatrix<double>& A)
 {
     // Eigen::SimplicialLDLT<SparseMatrix_d> ldlt(A);
@@ -154,17 +393,69 @@ void MassSpring::reset()
     this->vel.setZero();
 }
 
+MassSpring::State MassSpring::getState() const
+{
+    return { X, vel, adaptive_h, adaptive_calm_steps };
+}
+
+bool MassSpring::canSetState(const State& state) const
+{
+    return state.X.rows() == X.rows() && state.vel.rows() == vel.rows();
+}
+
+bool MassSpring::setState(const State& state)
+{
+    if (!canSetState(state)) {
+        return false;
+    }
+    X = state.X;
+    vel = state.vel;
+    adaptive_h = state.adaptive_h;
+    adaptive_calm_steps = state.adaptive_calm_steps;
+    return true;
+}
+
 // ----------------------------------------------------------------------------------
 // (HW Optional) Bonus part
 Eigen::MatrixXd MassSpring::getSphereCollisionForce(Eigen::Vector3d center, double radius)
 {
     Eigen::MatrixXd force = Eigen::MatrixXd::Zero(X.rows(), X.cols());
+    // Pushes the vertices within the enlarged sphere out along the normal, in proportion to how
+    // deep they are.
+    const double r = radius * collision_scale_factor;
     for (int i = 0; i < X.rows(); i++) {
-       // (HW Optional) Implement penalty-based force here 
+        Eigen::Vector3d diff = X.row(i).transpose() - center;
+        double distance = diff.norm();
+        if (distance < r && distance > 1e-12) {
+            force.row(i) = collision_penalty_k * (r - distance) * diff.transpose() / distance;
+        }
     }
     return force;
 }
 // ----------------------------------------------------------------------------------
+
+Eigen::MatrixXd MassSpring::getMeshCollisionForce()
+{
+    collision.thickness = collision_thickness;
+    collision.self_collision = enable_self_collision;
+    collision.obstacle_collision = enable_mesh_collision;
+    return collision.compute_forces(X, vel, collision_penalty_k);
+}
+
+void MassSpring::set_collision_faces(const Eigen::MatrixXi& F)
+{
+    collision.set_cloth(X.rows(), F);
+}
+
+void MassSpring::set_obstacle(const Eigen::MatrixXd& V, const Eigen::MatrixXi& F)
+{
+    collision.set_obstacle(V, F);
+}
+
+bool MassSpring::update_obstacle(const Eigen::MatrixXd& V)
+{
+    return collision.update_obstacle(V);
+}
  
 bool MassSpring::set_dirichlet_bc_mask(const std::vector<bool>& mask)
 {
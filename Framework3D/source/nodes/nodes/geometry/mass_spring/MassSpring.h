@@ -2,6 +2,7 @@
 #include <Eigen/Dense>
 #include <Eigen/Sparse>
 #include <set>
+#include "ClothCollision.h"
 #include "utils.h"
 #include <chrono>
 #include <cassert>
@@ -34,6 +35,26 @@ class MassSpring {
     virtual void step();
     void reset();
 
+    // What a step changes, to checkpoint the simulation and set it back.
+    struct State {
+        Eigen::MatrixXd X;
+        Eigen::MatrixXd vel;
+        double adaptive_h = 0;
+        int adaptive_calm_steps = 0;
+    };
+    State getState() const;
+    // False if the state is for another number of vertices. setState then changes nothing.
+    bool canSetState(const State &state) const;
+    bool setState(const State &state);
+
+    // Steps through the given time, each step at most h long and the given time split evenly, then
+    // halved a few times. A step that raises the total energy by more than energy_tolerance of the
+    // energies at play is undone and retried at half the size; after a few accepted steps the size
+    // doubles back. h is restored at the end.
+    void advance(double duration);
+    // Spring, kinetic, external and collision potential energy.
+    double computeTotalEnergy();
+
     // energy related function
     virtual double computeEnergy(double stiffness);
     virtual Eigen::MatrixXd computeGrad(double stiffness);
@@ -54,6 +75,16 @@ class MassSpring {
 
     // Detect collision and compute the penalty-based collision force with given sphere
     Eigen::MatrixXd getSphereCollisionForce(Eigen::Vector3d center, double radius);
+    // Penalty force of the cloth against itself and the obstacle, see ClothCollision. Self
+    // collision needs the cloth's triangles.
+    Eigen::MatrixXd getMeshCollisionForce();
+    void set_collision_faces(const Eigen::MatrixXi &F);
+    void set_obstacle(const Eigen::MatrixXd &V, const Eigen::MatrixXi &F);
+    bool update_obstacle(const Eigen::MatrixXd &V);
+    const ClothCollision &getCollision() const
+    {
+        return collision;
+    }
 
     bool set_dirichlet_bc_mask(const std::vector<bool>& mask);
     bool update_dirichlet_bc_vertices(const MatrixXd &control_vertices); 
@@ -68,27 +99,67 @@ class MassSpring {
     double h = 1e-2;    // time step
     Eigen::Vector3d gravity = { 0, 0, -9.8 };
     Eigen::Vector3d wind_ext_acc = { 0, 0, 0 }; // (HW TODO) feel free to change the wind acceleration
+    double energy_tolerance = 1e-3;  // for advance()
 
     // (HW Optional) sphere collision parameters
     double collision_penalty_k = 10000.0;
     double collision_scale_factor = 1.1; 
     Eigen::Vector3f sphere_center = Eigen::Vector3f(0, -0.5, 0.2);
     double sphere_radius = 0.4;
+    // Distance the cloth keeps from itself and the obstacle
+    double collision_thickness = 0.01;
 
     // Useful switches
     bool enable_sphere_collision = false;
+    bool enable_self_collision = false;
+    bool enable_mesh_collision = false;
     bool enable_time_profiling = false;
     bool enable_make_SPD = false;
     bool enable_check_SPD = false;
     bool enable_damping = true;
     bool enable_debug_output = false;
 
+    // Statistics of the last advance()
+    int last_substeps = 0;
+    int last_rejected_substeps = 0;
+    double last_min_h = 0;
+
    protected:
+    // The gradient and the Hessian, updated in place. The Hessian has a fixed pattern, with a 3 x 3
+    // block for each vertex and each spring, and gets diagonal_shift * I added.
+    const Eigen::MatrixXd &updateGrad(double stiffness);
+    const SparseMatrix_d &updateHessian(double stiffness, double diagonal_shift = 0);
+
+    // State advance() carries over from one call to the next: the step size, and the steps
+    // accepted since it last changed.
+    double adaptive_h = 0;
+    int adaptive_calm_steps = 0;
+
     Eigen::MatrixXd init_X;  // For reset
     Eigen::MatrixXd X;
     Eigen::MatrixXd vel;
-    EdgeSet E;
+    // Springs as flat arrays, by increasing first vertex, so that the loops walk X in order.
+    std::vector<Edge> springs;
     std::vector<double> E_rest_length;
+    // For each vertex, the springs it ends, in CSR form: vertex v ends the springs
+    // vertex_springs[vertex_spring_offsets[v]...], each stored as 2 * spring + (v is its second
+    // end). Per-vertex sums gather through it in parallel, without two threads writing one vertex.
+    std::vector<unsigned> vertex_spring_offsets;
+    std::vector<unsigned> vertex_springs;
+
+    // Per-spring terms, and the buffers updateGrad() and updateHessian() fill.
+    std::vector<Eigen::Vector3d> spring_grad;
+    std::vector<Eigen::Matrix3d> spring_hessian;
+    Eigen::MatrixXd grad;
+    SparseMatrix_d hessian;
+    // Where the blocks of vertex v's columns start, counted from the top of each column: its
+    // diagonal block, and for each entry of vertex_springs, the block of the spring's other end.
+    std::vector<unsigned> hessian_diagonal;
+    std::vector<unsigned> hessian_off_diagonal;
+    ClothCollision collision;
+
+    // Implicit Euler's solver, with the ordering of the fixed pattern analyzed once.
+    Eigen::SimplicialLDLT<SparseMatrix_d> implicit_solver;
     std::vector<bool>
         dirichlet_bc_mask;  // mask for marking fixed points (Dirichlet boundary condition)
     std::vector<std::pair<int, int>> dirichlet_bc_control_pair;
@@ -57,6 +57,8 @@ static void node_register()
     geo_node_type_base(&ntype);
     ntype.node_execute = node_exec;
     ntype.declare = node_declare;
+    // The animator is advanced in place by every execution.
+    ntype.NO_CACHE = true;
     nodeRegisterType(&ntype);
 }
 
@@ -8,6 +8,7 @@
 #include "GCore/Components/MeshOperand.h"
 #include "Nodes/node.hpp"
 #include "Nodes/node_declare.hpp"
+#include "Nodes/node_exec_simulation.hpp"
 #include "Nodes/node_register.h"
 #include "geom_node_base.h"
 #include "mass_spring/FastMassSpring.h"
@@ -22,6 +23,9 @@ using namespace Eigen;
 static void node_mass_spring_declare(NodeDeclarationBuilder& b)
 {
     b.add_input<decl::Geometry>("Mesh");
+    // Optional triangle mesh the cloth collides with. It may move from frame to frame, as long as
+    // its vertex count stays the same.
+    b.add_input<decl::Geometry>("Collider");
 
     b.add_input<decl::MassSpringSocket>("Mass Spring");
 
@@ -30,12 +34,16 @@ static void node_mass_spring_declare(NodeDeclarationBuilder& b)
     b.add_input<decl::Float>("h").default_val(0.01).min(0.0).max(0.5);
     b.add_input<decl::Float>("damping").default_val(0.995).min(0.0).max(1.0);
     b.add_input<decl::Float>("gravity").default_val(-9.8);
+    // With a frame duration, each frame takes as many steps of at most h as the energy allows.
+    // 0 steps once by h.
+    b.add_input<decl::Float>("frame duration").default_val(0).min(0.0).max(1.0);
 
     // --------- HW Optional: if you implement sphere collision, please uncomment the following lines ------------
     b.add_input<decl::Float>("collision penalty_k").default_val(10000).min(100).max(100000); 
     b.add_input<decl::Float>("collision scale factor").default_val(1.1).min(1.0).max(2.0); 
     b.add_input<decl::Float>("sphere radius").default_val(0.4).min(0.0).max(5.0);; 
     b.add_input<decl::Float3>("sphere center");
+    b.add_input<decl::Float>("collision thickness").default_val(0.01).min(0.0).max(0.1);
     // -----------------------------------------------------------------------------------------------------------
 
     // Useful switches (0 or 1). You can add more if you like.
@@ -46,7 +54,9 @@ static void node_mass_spring_declare(NodeDeclarationBuilder& b)
 
     // Optional switches
     b.add_input<decl::Int>("enable Liu13").default_val(0).min(0).max(1);
+    b.add_input<decl::Int>("Liu13 iterations").default_val(10).min(1).max(100);
     b.add_input<decl::Int>("enable sphere collision").default_val(0).min(0).max(1);
+    b.add_input<decl::Int>("enable self collision").default_val(0).min(0).max(1);
 
     // Current time in node system 
     b.add_input<decl::Float>("time_code");
@@ -54,6 +64,8 @@ static void node_mass_spring_declare(NodeDeclarationBuilder& b)
     // Output 
     b.add_output<decl::MassSpringSocket>("Mass Spring Class");
     b.add_output<decl::Geometry>("Output Mesh");
+    b.add_output<decl::Int>("Substeps");
+    b.add_output<decl::Int>("Rejected Substeps");
 }
 
 static void node_mass_spring_exec(ExeParams params)
@@ -70,14 +82,20 @@ static void node_mass_spring_exec(ExeParams params)
         throw std::runtime_error("Read USD error.");
     }
 
+    const auto collider_geometry = params.get_input<GOperandBase>("Collider");
+    auto collider = collider_geometry.get_component<MeshComponent>();
+    if (collider && collider->faceVertexCounts.size() == 0) {
+        collider = nullptr;
+    }
+
 
     if (time_code == 0) {  // If time = 0, reset and initialize the mass spring class
         if (mesh) {
             if (mass_spring != nullptr)
 				mass_spring.reset();
 
-            auto edges =
-                get_edges(usd_faces_to_eigen(mesh->faceVertexCounts, mesh->faceVertexIndices));
+            auto faces = usd_faces_to_eigen(mesh->faceVertexCounts, mesh->faceVertexIndices);
+            auto edges = get_edges(faces);
             auto vertices = usd_vertices_to_eigen(mesh->vertices);
             const float k = params.get_input<float>("stiffness");
             const float h = params.get_input<float>("h");
@@ -85,7 +103,9 @@ static void node_mass_spring_exec(ExeParams params)
             bool enable_liu13 =  params.get_input<int>("enable Liu13") == 1 ? true : false;
             if (enable_liu13) { 
                 // HW Optional 
-				mass_spring = std::make_shared<FastMassSpring>(vertices, edges, k, h);
+				auto fast_mass_spring = std::make_shared<FastMassSpring>(vertices, edges, k, h);
+				fast_mass_spring->max_iter = params.get_input<int>("Liu13 iterations");
+				mass_spring = fast_mass_spring;
 			}
 			else
 				mass_spring = std::make_shared<MassSpring>(vertices, edges);
@@ -105,6 +125,19 @@ static void node_mass_spring_exec(ExeParams params)
             mass_spring->sphere_radius = params.get_input<float>("sphere radius");
 			// --------------------------------------------------------------------------------------------------------
 
+            mass_spring->collision_thickness = params.get_input<float>("collision thickness");
+            mass_spring->enable_self_collision =
+                params.get_input<int>("enable self collision") == 1 ? true : false;
+            if (mass_spring->enable_self_collision) {
+                mass_spring->set_collision_faces(faces);
+            }
+            if (collider) {
+                mass_spring->set_obstacle(
+                    usd_vertices_to_eigen(collider->vertices),
+                    usd_faces_to_eigen(collider->faceVertexCounts, collider->faceVertexIndices));
+                mass_spring->enable_mesh_collision = true;
+            }
+
 			mass_spring->enable_sphere_collision = params.get_input<int>("enable sphere collision") == 1 ? true : false;
 			mass_spring->enable_damping = params.get_input<int>("enable damping") == 1 ? true : false;
 			mass_spring->time_integrator = params.get_input<int>("time integrator type") == 0 ? MassSpring::IMPLICIT_EULER : MassSpring::SEMI_IMPLICIT_EULER;
@@ -118,13 +151,69 @@ static void node_mass_spring_exec(ExeParams params)
     }
     else  // otherwise, step forward the simulation
     {
-        mass_spring->step(); 
+        if (collider) {
+            mass_spring->update_obstacle(usd_vertices_to_eigen(collider->vertices));
+        }
+        auto frame_duration = params.get_input<float>("frame duration");
+        if (frame_duration > 0) {
+            mass_spring->advance(frame_duration);
+        }
+        else {
+            mass_spring->step();
+        }
     }
 
     mesh->vertices = eigen_to_usd_vertices(mass_spring->getX());
 
     params.set_output("Mass Spring Class", mass_spring);
     params.set_output("Output Mesh", geometry);
+
+    bool adaptive = time_code != 0 && params.get_input<float>("frame duration") > 0;
+    params.set_output("Substeps", adaptive ? mass_spring->last_substeps : 1);
+    params.set_output("Rejected Substeps", adaptive ? mass_spring->last_rejected_substeps : 0);
+}
+
+// The solver is stepped in place, so checkpoints of the simulation hold its state.
+static void register_checkpoint()
+{
+    using Handle = std::shared_ptr<MassSpring>;
+    CheckpointFunctions functions;
+    functions.save = [](const void* value) -> std::shared_ptr<void> {
+        auto& mass_spring = *static_cast<const Handle*>(value);
+        if (!mass_spring) {
+            return nullptr;
+        }
+        return std::make_shared<MassSpring::State>(mass_spring->getState());
+    };
+    functions.can_restore = [](const void* snapshot, const void* value) {
+        auto& mass_spring = *static_cast<const Handle*>(value);
+        return mass_spring &&
+               mass_spring->canSetState(*static_cast<const MassSpring::State*>(snapshot));
+    };
+    functions.restore = [](const void* snapshot, void* value) {
+        auto& mass_spring = *static_cast<Handle*>(value);
+        mass_spring->setState(*static_cast<const MassSpring::State*>(snapshot));
+    };
+    functions.byte_size = [](const void* snapshot) {
+        auto& state = *static_cast<const MassSpring::State*>(snapshot);
+        return sizeof(state) + (state.X.size() + state.vel.size()) * sizeof(double);
+    };
+    functions.write = [](const void* snapshot, std::ostream& out) {
+        auto& state = *static_cast<const MassSpring::State*>(snapshot);
+        write_checkpoint_matrix(out, state.X);
+        write_checkpoint_matrix(out, state.vel);
+        write_checkpoint_value(out, state.adaptive_h);
+        write_checkpoint_value(out, state.adaptive_calm_steps);
+    };
+    functions.read = [](std::istream& in) {
+        auto state = std::make_shared<MassSpring::State>();
+        read_checkpoint_matrix(in, state->X);
+        read_checkpoint_matrix(in, state->vel);
+        read_checkpoint_value(in, state->adaptive_h);
+        read_checkpoint_value(in, state->adaptive_calm_steps);
+        return state;
+    };
+    register_checkpoint_type(CPPType::get<Handle>(), std::move(functions));
 }
 
 static void node_register()
@@ -137,7 +226,9 @@ static void node_register()
     geo_node_type_base(&ntype);
     ntype.node_execute = node_mass_spring_exec;
     ntype.declare = node_mass_spring_declare;
+    ntype.NO_CACHE = true;
     nodeRegisterType(&ntype);
+    register_checkpoint();
 }
 
 NOD_REGISTER_NODE(node_register)
@@ -135,6 +135,8 @@ static void node_register()
     geo_node_type_base(&ntype);
     ntype.node_execute = node_mass_spring_exec;
     ntype.declare = node_mass_spring_declare;
+    // The mass spring object is stepped in place.
+    ntype.NO_CACHE = true;
     nodeRegisterType(&ntype);
 }
 
@@ -0,0 +1,153 @@
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+
+#include "GCore/Components/PointsComponent.h"
+#include "Nodes/node.hpp"
+#include "Nodes/node_declare.hpp"
+#include "Nodes/node_register.h"
+#include "geom_node_base.h"
+#include "particle_cache/particle_cache.h"
+
+namespace USTC_CG::node_particle_cache {
+
+// The frames of a cache are named by the frame they hold.
+static std::string frame_path(const std::string& directory, float time_code)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "frame_%06ld.pcache", std::lround(time_code));
+    return (std::filesystem::path(directory) / name).string();
+}
+
+static ParticleCacheWriter& cache_writer()
+{
+    static ParticleCacheWriter writer;
+    return writer;
+}
+
+static void node_declare_write(NodeDeclarationBuilder& b)
+{
+    b.add_input<decl::Geometry>("Points");
+    // Optional channels, by point.
+    b.add_input<decl::Float3Buffer>("Velocities");
+    b.add_input<decl::Float1Buffer>("Densities");
+    b.add_input<decl::String>("Directory").default_val("particle_cache");
+    b.add_input<decl::Float>("Time Code").default_val(0).min(0).max(240);
+}
+
+// Streams the points to one file per frame instead of the stage, which holds every frame.
+static void node_exec_write(ExeParams params)
+{
+    const auto geometry = params.get_input<GOperandBase>("Points");
+    auto points = geometry.get_component<PointsComponent>();
+    if (!points) {
+        throw std::runtime_error("Write Particle Cache: Need Points Input.");
+    }
+    auto directory = std::string(params.get_input<std::string>("Directory").c_str());
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+
+    const size_t n = points->vertices.size();
+    auto velocities = params.get_input<pxr::VtArray<pxr::GfVec3f>>("Velocities");
+    auto densities = params.get_input<pxr::VtArray<float>>("Densities");
+
+    ParticleFrame frame;
+    frame.positions.resize(n);
+    for (size_t i = 0; i < n; i++) {
+        frame.positions[i] = Eigen::Vector3f(points->vertices[i].data());
+    }
+    if (velocities.size() == n) {
+        frame.velocities.resize(n);
+        for (size_t i = 0; i < n; i++) {
+            frame.velocities[i] = Eigen::Vector3f(velocities[i].data());
+        }
+    }
+    if (densities.size() == n) {
+        frame.densities.assign(densities.begin(), densities.end());
+    }
+
+    // Frames are written in the background, so a failure shows on the next one.
+    auto& writer = cache_writer();
+    writer.write(frame_path(directory, params.get_input<float>("Time Code")), std::move(frame));
+    if (writer.take_failures()) {
+        throw std::runtime_error("Write Particle Cache: Failed to write to " + directory);
+    }
+}
+
+static void node_declare_read(NodeDeclarationBuilder& b)
+{
+    b.add_input<decl::String>("Directory").default_val("particle_cache");
+    b.add_input<decl::Float>("Time Code").default_val(0).min(0).max(240);
+    b.add_input<decl::Float>("Width").default_val(0.05).min(0).max(1);
+
+    b.add_output<decl::Geometry>("Points");
+    // Empty when the cache doesn't hold them.
+    b.add_output<decl::Float3Buffer>("Velocities");
+    b.add_output<decl::Float1Buffer>("Densities");
+}
+
+// Maps the frame at the time code, so that playing a cache back only ever holds one frame.
+static void node_exec_read(ExeParams params)
+{
+    auto directory = std::string(params.get_input<std::string>("Directory").c_str());
+    auto path = frame_path(directory, params.get_input<float>("Time Code"));
+
+    // The frame may still be queued for writing.
+    cache_writer().flush();
+    ParticleCacheFile file;
+    if (!file.open(path)) {
+        throw std::runtime_error("Read Particle Cache: No frame at " + path);
+    }
+    ParticleFrame frame;
+    file.read(frame);
+
+    auto geometry = GOperandBase();
+    auto points = std::make_shared<PointsComponent>(&geometry);
+    geometry.attach_component(points);
+    points->vertices.resize(frame.positions.size());
+    for (size_t i = 0; i < frame.positions.size(); i++) {
+        auto& x = frame.positions[i];
+        points->vertices[i] = pxr::GfVec3f(x[0], x[1], x[2]);
+    }
+    points->width = pxr::VtArray<float>(frame.positions.size(), params.get_input<float>("Width"));
+
+    pxr::VtArray<pxr::GfVec3f> velocities(frame.velocities.size());
+    for (size_t i = 0; i < frame.velocities.size(); i++) {
+        auto& v = frame.velocities[i];
+        velocities[i] = pxr::GfVec3f(v[0], v[1], v[2]);
+    }
+    params.set_output("Points", std::move(geometry));
+    params.set_output("Velocities", std::move(velocities));
+    params.set_output(
+        "Densities", pxr::VtArray<float>(frame.densities.begin(), frame.densities.end()));
+}
+
+static void node_register()
+{
+    static NodeTypeInfo write_ntype;
+
+    strcpy(write_ntype.ui_name, "Write Particle Cache");
+    strcpy_s(write_ntype.id_name, "geom_write_particle_cache");
+    write_ntype.ALWAYS_REQUIRED = true;
+
+    geo_node_type_base(&write_ntype);
+    write_ntype.node_execute = node_exec_write;
+    write_ntype.declare = node_declare_write;
+    nodeRegisterType(&write_ntype);
+
+    static NodeTypeInfo read_ntype;
+
+    strcpy(read_ntype.ui_name, "Read Particle Cache");
+    strcpy_s(read_ntype.id_name, "geom_read_particle_cache");
+
+    geo_node_type_base(&read_ntype);
+    read_ntype.node_execute = node_exec_read;
+    read_ntype.declare = node_declare_read;
+    // The files change under the same inputs while a cache is written.
+    read_ntype.NO_CACHE = true;
+    nodeRegisterType(&read_ntype);
+}
+
+NOD_REGISTER_NODE(node_register)
+}  // namespace USTC_CG::node_particle_cache
@@ -63,7 +63,7 @@ struct WrappingParticleList {
 
 static void node_exec(ExeParams params)
 {
-    auto points_geometry = params.get_input<GOperandBase>("Points");
+    const auto points_geometry = params.get_input<GOperandBase>("Points");
 
     auto points = points_geometry.get_component<PointsComponent>();
 
@@ -7,6 +7,7 @@
 #include "GCore/Components/PointsComponent.h"
 #include "Nodes/node.hpp"
 #include "Nodes/node_declare.hpp"
+#include "Nodes/node_exec_simulation.hpp"
 #include "Nodes/node_register.h"
 #include "geom_node_base.h"
 #include "sph_fluid/wcsph.h"
@@ -44,20 +45,22 @@ static void node_sph_fluid_declare(NodeDeclarationBuilder& b)
     b.add_input<decl::Float3>("num particle per axis");
 
     // general parameters
-    b.add_input<decl::Float>("dt").default_val(0.01).min(0.0).max(0.5);
+    b.add_input<decl::Float>("dt").default_val(0.005).min(0.0).max(0.5);
     b.add_input<decl::Float>("viscosity").default_val(0.03).min(0.0).max(0.5);
     b.add_input<decl::Float>("gravity").default_val(-9.8);
+    // With a frame duration, each frame takes as many steps of at most dt as the CFL condition
+    // allows. 0 steps once by dt.
+    b.add_input<decl::Float>("frame duration").default_val(0).min(0.0).max(1.0);
+    b.add_input<decl::Float>("CFL number").default_val(0.4).min(0.05).max(1.0);
 
     // WCSPH parameters 
     b.add_input<decl::Float>("stiffness").default_val(500).min(100).max(10000);
     b.add_input<decl::Float>("exponent").default_val(7).min(1).max(10);
 
-    // --------- (HW Optional) if you implement IISPH, please uncomment the following lines ------------
-
-    //b.add_input<decl::Float>("omega").default_val(0.5).min(0.).max(1.);
-    //b.add_input<decl::Int>("max iter").default_val(20).min(0).max(1000);
-
-    // -----------------------------------------------------------------------------------------------------------
+    // IISPH parameters. IISPH stays stable at a few times the dt WCSPH needs.
+    b.add_input<decl::Float>("omega").default_val(0.5).min(0.).max(1.);
+    b.add_input<decl::Int>("max iter").default_val(20).min(0).max(1000);
+    b.add_input<decl::Float>("max density error").default_val(0.001).min(0.0001).max(0.1);
 
     // Useful switches (0 or 1). You can add more if you like.
     b.add_input<decl::Int>("enable time profiling").default_val(0).min(0).max(1);
@@ -73,6 +76,14 @@ static void node_sph_fluid_declare(NodeDeclarationBuilder& b)
     b.add_output<decl::SPHFluidSocket>("SPH Class");
     b.add_output<decl::Geometry>("Points");
     b.add_output<decl::Float3Buffer>("Point Colors");
+    // By particle, for the particle cache.
+    b.add_output<decl::Float3Buffer>("Velocities");
+    b.add_output<decl::Float1Buffer>("Densities");
+    // Convergence of the IISPH pressure solve in the last step, zero for WCSPH.
+    b.add_output<decl::Int>("Pressure Iterations");
+    b.add_output<decl::Float>("Density Error");
+    b.add_output<decl::Int>("Substeps");
+    b.add_output<decl::Float>("Min Substep");
 }
 
 static void node_sph_fluid_exec(ExeParams params)
@@ -134,18 +145,17 @@ static void node_sph_fluid_exec(ExeParams params)
             sph_base->dt() = params.get_input<float>("dt");
             sph_base->viscosity() = params.get_input<float>("viscosity");
             sph_base->gravity()  = { 0, 0, params.get_input<float>("gravity") };
+            sph_base->cfl_number() = params.get_input<float>("CFL number");
 
             // Useful switches
             sph_base->enable_time_profiling = params.get_input<int>("enable time profiling") == 1 ? true : false;
             sph_base->enable_debug_output = params.get_input<int>("enable debug output") == 1 ? true : false;
 
             if (enable_IISPH) {
-			// --------- (HW Optional) if you implement IISPH please uncomment the following lines -----------		
-            
-                //std::dynamic_pointer_cast<IISPH>(sph_base)->max_iter() = params.get_input<int>("max iter");
-                //std::dynamic_pointer_cast<IISPH>(sph_base)->omega() = params.get_input<float>("omega");
-
-            // --------------------------------------------------------------------------------------------------------
+                auto iisph = std::dynamic_pointer_cast<IISPH>(sph_base);
+                iisph->max_iter() = params.get_input<int>("max iter");
+                iisph->omega() = params.get_input<float>("omega");
+                iisph->max_density_error() = params.get_input<float>("max density error");
             }
             else {
                 std::dynamic_pointer_cast<WCSPH>(sph_base)->stiffness() = params.get_input<float>("stiffness");
@@ -155,7 +165,13 @@ static void node_sph_fluid_exec(ExeParams params)
     }
     else  // otherwise, step forward the simulation
     {
-       sph_base->step(); 
+        auto frame_duration = params.get_input<float>("frame duration");
+        if (frame_duration > 0) {
+            sph_base->advance(frame_duration);
+        }
+        else {
+            sph_base->step();
+        }
     }
 
     // ------------------------- construct necessary output ---------------
@@ -173,11 +189,73 @@ static void node_sph_fluid_exec(ExeParams params)
     auto color = eigen_to_usd_vertices(sph_base->get_vel_color_jet());
 
 	params.set_output("Point Colors", std::move(color));
+    params.set_output("Velocities", eigen_to_usd_vertices(sph_base->getVel()));
+    auto density = sph_base->getDensity();
+    params.set_output(
+        "Densities", pxr::VtArray<float>(density.data(), density.data() + density.size()));
     params.set_output("Points", std::move(geometry));
+
+    int pressure_iterations = 0;
+    float density_error = 0;
+    if (auto iisph = std::dynamic_pointer_cast<IISPH>(sph_base)) {
+        pressure_iterations = iisph->last_iterations();
+        density_error = iisph->last_density_error();
+    }
+    params.set_output("Pressure Iterations", pressure_iterations);
+    params.set_output("Density Error", density_error);
+
+    bool adaptive = time_code != 0 && params.get_input<float>("frame duration") > 0;
+    params.set_output("Substeps", adaptive ? sph_base->last_substeps() : 1);
+    params.set_output("Min Substep", float(adaptive ? sph_base->last_min_dt() : sph_base->dt()));
     // ----------------------------------------------------------------------------------------
 
 }
 
+// The fluid is stepped in place, so checkpoints of the simulation hold its particles' state.
+static void register_checkpoint()
+{
+    using Handle = std::shared_ptr<SPHBase>;
+    CheckpointFunctions functions;
+    functions.save = [](const void* value) -> std::shared_ptr<void> {
+        auto& sph_base = *static_cast<const Handle*>(value);
+        if (!sph_base) {
+            return nullptr;
+        }
+        return std::make_shared<SPHBase::State>(sph_base->save_state());
+    };
+    functions.can_restore = [](const void* snapshot, const void* value) {
+        auto& sph_base = *static_cast<const Handle*>(value);
+        return sph_base &&
+               sph_base->can_restore_state(*static_cast<const SPHBase::State*>(snapshot));
+    };
+    functions.restore = [](const void* snapshot, void* value) {
+        auto& sph_base = *static_cast<Handle*>(value);
+        sph_base->restore_state(*static_cast<const SPHBase::State*>(snapshot));
+    };
+    functions.byte_size = [](const void* snapshot) {
+        auto& state = *static_cast<const SPHBase::State*>(snapshot);
+        return sizeof(state) + (state.X.size() + state.vel.size() + state.acceleration.size() +
+                                state.pressure.size()) *
+                                   sizeof(double);
+    };
+    functions.write = [](const void* snapshot, std::ostream& out) {
+        auto& state = *static_cast<const SPHBase::State*>(snapshot);
+        write_checkpoint_matrix(out, state.X);
+        write_checkpoint_matrix(out, state.vel);
+        write_checkpoint_matrix(out, state.acceleration);
+        write_checkpoint_matrix(out, state.pressure);
+    };
+    functions.read = [](std::istream& in) {
+        auto state = std::make_shared<SPHBase::State>();
+        read_checkpoint_matrix(in, state->X);
+        read_checkpoint_matrix(in, state->vel);
+        read_checkpoint_matrix(in, state->acceleration);
+        read_checkpoint_matrix(in, state->pressure);
+        return state;
+    };
+    register_checkpoint_type(CPPType::get<Handle>(), std::move(functions));
+}
+
 static void node_register()
 {
     static NodeTypeInfo ntype;
@@ -188,7 +266,10 @@ static void node_register()
     geo_node_type_base(&ntype);
     ntype.node_execute = node_sph_fluid_exec;
     ntype.declare = node_sph_fluid_declare;
+    // Steps the fluid held in its output.
+    ntype.NO_CACHE = true;
     nodeRegisterType(&ntype);
+    register_checkpoint();
 }
 
 NOD_REGISTER_NODE(node_register)
@@ -0,0 +1,48 @@
+#include "GCore/GOP.h"
+#include "Nodes/node.hpp"
+#include "Nodes/node_declare.hpp"
+#include "Nodes/node_register.h"
+#include "geom_node_base.h"
+
+namespace USTC_CG::node_switch {
+static void node_declare(NodeDeclarationBuilder& b)
+{
+    b.add_input<decl::Int>("Selector").default_val(0).min(0).max(1);
+    b.add_input<decl::Geometry>("False");
+    b.add_input<decl::Geometry>("True");
+    b.add_output<decl::Geometry>("Geometry");
+}
+
+static const char* selected_input(int selector)
+{
+    return selector ? "True" : "False";
+}
+
+// The branch that isn't selected is never evaluated.
+static void node_demand(DemandParams& params)
+{
+    params.need_input(selected_input(params.get_input<int>("Selector")));
+}
+
+static void node_exec(ExeParams params)
+{
+    auto selector = params.get_input<int>("Selector");
+    params.set_output("Geometry", params.get_input<GOperandBase>(selected_input(selector)));
+}
+
+static void node_register()
+{
+    static NodeTypeInfo ntype;
+
+    strcpy(ntype.ui_name, "Switch");
+    strcpy_s(ntype.id_name, "geom_switch");
+
+    geo_node_type_base(&ntype);
+    ntype.node_execute = node_exec;
+    ntype.declare = node_declare;
+    ntype.demand_inputs = node_demand;
+    nodeRegisterType(&ntype);
+}
+
+NOD_REGISTER_NODE(node_register)
+}  // namespace USTC_CG::node_switch
@@ -45,7 +45,7 @@ static void node_exec(ExeParams params)
     auto file_name = params.get_input<std::string>("File Name");
     auto prim_path = params.get_input<std::string>("Prim Path");
 
-    auto geometry = params.get_input<GOperandBase>("Geometry");
+    const auto geometry = params.get_input<GOperandBase>("Geometry");
 
     auto mesh = geometry.get_component<MeshComponent>();
 
@@ -236,6 +236,8 @@ static void node_register()
     ntype.ALWAYS_REQUIRED = true;
 
     geo_node_type_base(&ntype);
+    // Writes to the global stage.
+    ntype.THREAD_UNSAFE = true;
     ntype.node_execute = node_exec;
     ntype.declare = node_declare;
     nodeRegisterType(&ntype);
@@ -0,0 +1,368 @@
+#include "particle_cache.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+#include "pxr/base/work/loops.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace USTC_CG::node_particle_cache {
+
+static constexpr char kMagic[8] = { 'P', 'C', 'A', 'C', 'H', 'E', '0', '1' };
+enum Channel : uint32_t { kVelocities = 1, kDensities = 2 };
+
+struct Header {
+    char magic[8];
+    uint32_t channels;
+    uint32_t reserved;
+    uint64_t count;
+    float box_min[3];
+    float box_max[3];
+    // Velocity components are stored as fractions of velocity_scale.
+    float velocity_scale;
+    float density_min;
+    float density_max;
+    float padding;
+};
+static_assert(sizeof(Header) == 64);
+
+// Where the channels start, and where the file ends.
+struct Layout {
+    size_t positions, velocities, densities, end;
+
+    Layout(uint32_t channels, size_t count)
+    {
+        positions = sizeof(Header);
+        velocities = positions + 3 * count * sizeof(uint16_t);
+        densities = velocities + (channels & kVelocities ? 3 * count * sizeof(int16_t) : 0);
+        end = densities + (channels & kDensities ? count * sizeof(uint16_t) : 0);
+    }
+};
+
+static uint16_t quantize(float x, float lo, float extent)
+{
+    if (!(extent > 0)) {
+        return 0;
+    }
+    return uint16_t(std::clamp(std::lround((x - lo) / extent * 65535.f), 0l, 65535l));
+}
+
+static float dequantize(uint16_t q, float lo, float extent)
+{
+    return lo + q * (extent / 65535.f);
+}
+
+template<typename F>
+static void parallel_for(size_t n, F&& f)
+{
+    pxr::WorkParallelForN(n, [&f](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            f(i);
+        }
+    });
+}
+
+bool write_particle_frame(const std::string& path, const ParticleFrame& frame)
+{
+    const size_t n = frame.positions.size();
+    Header header = {};
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.count = n;
+    header.channels = (frame.velocities.size() == n && n ? uint32_t(kVelocities) : 0u) |
+                      (frame.densities.size() == n && n ? uint32_t(kDensities) : 0u);
+
+    Eigen::Vector3f box_min = Eigen::Vector3f::Zero(), box_max = Eigen::Vector3f::Zero();
+    if (n) {
+        box_min = box_max = frame.positions[0];
+        for (auto& x : frame.positions) {
+            box_min = box_min.cwiseMin(x);
+            box_max = box_max.cwiseMax(x);
+        }
+    }
+    for (int d = 0; d < 3; d++) {
+        header.box_min[d] = box_min[d];
+        header.box_max[d] = box_max[d];
+    }
+    if (header.channels & kVelocities) {
+        for (auto& v : frame.velocities) {
+            header.velocity_scale = std::max(header.velocity_scale, v.cwiseAbs().maxCoeff());
+        }
+    }
+    if (header.channels & kDensities) {
+        auto [lo, hi] = std::minmax_element(frame.densities.begin(), frame.densities.end());
+        header.density_min = *lo;
+        header.density_max = *hi;
+    }
+
+    const Layout layout(header.channels, n);
+    std::vector<std::byte> buffer(layout.end);
+    std::memcpy(buffer.data(), &header, sizeof(header));
+
+    auto positions = reinterpret_cast<uint16_t*>(buffer.data() + layout.positions);
+    const Eigen::Vector3f extent = box_max - box_min;
+    parallel_for(n, [&](size_t i) {
+        for (int d = 0; d < 3; d++) {
+            positions[3 * i + d] = quantize(frame.positions[i][d], box_min[d], extent[d]);
+        }
+    });
+    if (header.channels & kVelocities) {
+        auto velocities = reinterpret_cast<int16_t*>(buffer.data() + layout.velocities);
+        const float scale = header.velocity_scale > 0 ? 32767.f / header.velocity_scale : 0.f;
+        parallel_for(n, [&](size_t i) {
+            for (int d = 0; d < 3; d++) {
+                velocities[3 * i + d] = int16_t(std::lround(frame.velocities[i][d] * scale));
+            }
+        });
+    }
+    if (header.channels & kDensities) {
+        auto densities = reinterpret_cast<uint16_t*>(buffer.data() + layout.densities);
+        const float range = header.density_max - header.density_min;
+        parallel_for(n, [&](size_t i) {
+            densities[i] = quantize(frame.densities[i], header.density_min, range);
+        });
+    }
+
+    const std::string temporary = path + ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+        if (!out) {
+            return false;
+        }
+    }
+    std::error_code error;
+    std::filesystem::rename(temporary, path, error);
+    return !error;
+}
+
+ParticleCacheWriter::ParticleCacheWriter(size_t max_pending)
+    : max_pending_(std::max<size_t>(max_pending, 1)),
+      thread_([this] { run(); })
+{
+}
+
+ParticleCacheWriter::~ParticleCacheWriter()
+{
+    {
+        std::lock_guard lock(mutex_);
+        stop_ = true;
+    }
+    changed_.notify_all();
+    thread_.join();
+}
+
+void ParticleCacheWriter::write(std::string path, ParticleFrame frame)
+{
+    std::unique_lock lock(mutex_);
+    changed_.wait(lock, [this] { return queue_.size() < max_pending_; });
+    queue_.emplace_back(std::move(path), std::move(frame));
+    changed_.notify_all();
+}
+
+void ParticleCacheWriter::flush()
+{
+    std::unique_lock lock(mutex_);
+    changed_.wait(lock, [this] { return queue_.empty() && !writing_; });
+}
+
+unsigned ParticleCacheWriter::take_failures()
+{
+    std::lock_guard lock(mutex_);
+    return std::exchange(failures_, 0);
+}
+
+void ParticleCacheWriter::run()
+{
+    std::unique_lock lock(mutex_);
+    while (true) {
+        // What is queued is still written when stopping.
+        changed_.wait(lock, [this] { return !queue_.empty() || stop_; });
+        if (queue_.empty()) {
+            return;
+        }
+        auto [path, frame] = std::move(queue_.front());
+        queue_.pop_front();
+        writing_ = true;
+        changed_.notify_all();
+
+        lock.unlock();
+        bool written = write_particle_frame(path, frame);
+        lock.lock();
+
+        failures_ += written ? 0 : 1;
+        writing_ = false;
+        changed_.notify_all();
+    }
+}
+
+ParticleCacheFile::~ParticleCacheFile()
+{
+    close();
+}
+
+bool ParticleCacheFile::open(const std::string& path)
+{
+    close();
+#ifdef _WIN32
+    HANDLE file = CreateFileA(
+        path.c_str(),
+        GENERIC_READ,
+        FILE_SHARE_READ | FILE_SHARE_DELETE,
+        nullptr,
+        OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL,
+        nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    file_ = file;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart < LONGLONG(sizeof(Header))) {
+        close();
+        return false;
+    }
+    mapping_ = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping_) {
+        close();
+        return false;
+    }
+    data_ = static_cast<const std::byte*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+    file_size_ = size_t(size.QuadPart);
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat status;
+    if (fstat(fd, &status) != 0 || status.st_size < off_t(sizeof(Header))) {
+        ::close(fd);
+        return false;
+    }
+    void* data = mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (data != MAP_FAILED) {
+        data_ = static_cast<const std::byte*>(data);
+        file_size_ = size_t(status.st_size);
+    }
+#endif
+    if (!data_) {
+        close();
+        return false;
+    }
+
+    auto& header = *reinterpret_cast<const Header*>(data_);
+    if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 ||
+        Layout(header.channels, header.count).end != file_size_) {
+        close();
+        return false;
+    }
+    count_ = header.count;
+    return true;
+}
+
+void ParticleCacheFile::close()
+{
+#ifdef _WIN32
+    if (data_) {
+        UnmapViewOfFile(data_);
+    }
+    if (mapping_) {
+        CloseHandle(mapping_);
+    }
+    if (file_) {
+        CloseHandle(file_);
+    }
+    mapping_ = nullptr;
+    file_ = nullptr;
+#else
+    if (data_) {
+        munmap(const_cast<std::byte*>(data_), file_size_);
+    }
+#endif
+    data_ = nullptr;
+    file_size_ = 0;
+    count_ = 0;
+}
+
+static const Header& header_of(const std::byte* data)
+{
+    return *reinterpret_cast<const Header*>(data);
+}
+
+bool ParticleCacheFile::has_velocities() const
+{
+    return data_ && header_of(data_).channels & kVelocities;
+}
+
+bool ParticleCacheFile::has_densities() const
+{
+    return data_ && header_of(data_).channels & kDensities;
+}
+
+Eigen::Vector3f ParticleCacheFile::box_min() const
+{
+    return Eigen::Vector3f(header_of(data_).box_min);
+}
+
+Eigen::Vector3f ParticleCacheFile::box_max() const
+{
+    return Eigen::Vector3f(header_of(data_).box_max);
+}
+
+Eigen::Vector3f ParticleCacheFile::position(size_t i) const
+{
+    const Layout layout(header_of(data_).channels, count_);
+    auto positions = reinterpret_cast<const uint16_t*>(data_ + layout.positions);
+    const Eigen::Vector3f lo = box_min(), extent = box_max() - lo;
+    return { dequantize(positions[3 * i], lo[0], extent[0]),
+             dequantize(positions[3 * i + 1], lo[1], extent[1]),
+             dequantize(positions[3 * i + 2], lo[2], extent[2]) };
+}
+
+void ParticleCacheFile::read(ParticleFrame& frame) const
+{
+    auto& header = header_of(data_);
+    const Layout layout(header.channels, count_);
+
+    frame.positions.resize(count_);
+    auto positions = reinterpret_cast<const uint16_t*>(data_ + layout.positions);
+    const Eigen::Vector3f lo = box_min(), extent = box_max() - lo;
+    parallel_for(count_, [&](size_t i) {
+        for (int d = 0; d < 3; d++) {
+            frame.positions[i][d] = dequantize(positions[3 * i + d], lo[d], extent[d]);
+        }
+    });
+
+    frame.velocities.resize(has_velocities() ? count_ : 0);
+    if (has_velocities()) {
+        auto velocities = reinterpret_cast<const int16_t*>(data_ + layout.velocities);
+        const float scale = header.velocity_scale / 32767.f;
+        parallel_for(count_, [&](size_t i) {
+            for (int d = 0; d < 3; d++) {
+                frame.velocities[i][d] = velocities[3 * i + d] * scale;
+            }
+        });
+    }
+
+    frame.densities.resize(has_densities() ? count_ : 0);
+    if (has_densities()) {
+        auto densities = reinterpret_cast<const uint16_t*>(data_ + layout.densities);
+        const float range = header.density_max - header.density_min;
+        parallel_for(count_, [&](size_t i) {
+            frame.densities[i] = dequantize(densities[i], header.density_min, range);
+        });
+    }
+}
+}  // namespace USTC_CG::node_particle_cache
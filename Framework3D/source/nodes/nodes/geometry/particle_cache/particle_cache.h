@@ -0,0 +1,95 @@
+#pragma once
+#include <Eigen/Dense>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace USTC_CG::node_particle_cache {
+
+// One frame of particles. The optional channels are empty when they aren't stored.
+struct ParticleFrame {
+    std::vector<Eigen::Vector3f> positions;
+    std::vector<Eigen::Vector3f> velocities;
+    std::vector<float> densities;
+};
+
+// A frame on disk is a 64-byte header followed by the quantized channels, 16 bits per value:
+// positions relative to the frame's bounding box, velocities relative to their largest
+// component, densities relative to their range. That is half the size of the float arrays a
+// stage holds, with positions within 1/65535 of the box.
+//
+// Writes the frame to a temporary file and renames it into place, so that a reader never sees a
+// frame half written. Returns false if it couldn't be written.
+bool write_particle_frame(const std::string& path, const ParticleFrame& frame);
+
+// Writes frames on a thread of its own, so that the simulation doesn't wait for the disk.
+class ParticleCacheWriter {
+   public:
+    // At most max_pending frames wait to be written: past that, write() blocks, so that a slow
+    // disk holds the simulation back rather than filling the memory.
+    explicit ParticleCacheWriter(size_t max_pending = 4);
+    ~ParticleCacheWriter();
+    ParticleCacheWriter(const ParticleCacheWriter&) = delete;
+    ParticleCacheWriter& operator=(const ParticleCacheWriter&) = delete;
+
+    void write(std::string path, ParticleFrame frame);
+    // Waits for the queued frames to be written.
+    void flush();
+    // Frames that couldn't be written since the last call.
+    unsigned take_failures();
+
+   private:
+    void run();
+
+    size_t max_pending_;
+    mutable std::mutex mutex_;
+    std::condition_variable changed_;
+    std::deque<std::pair<std::string, ParticleFrame>> queue_;
+    bool writing_ = false;
+    bool stop_ = false;
+    unsigned failures_ = 0;
+    std::thread thread_;
+};
+
+// A frame written by write_particle_frame, mapped into memory. Only the pages that are read get
+// loaded, and nothing is kept once the file is closed.
+class ParticleCacheFile {
+   public:
+    ParticleCacheFile() = default;
+    ~ParticleCacheFile();
+    ParticleCacheFile(const ParticleCacheFile&) = delete;
+    ParticleCacheFile& operator=(const ParticleCacheFile&) = delete;
+
+    // False if the file is missing or isn't a complete frame.
+    bool open(const std::string& path);
+    void close();
+
+    size_t size() const
+    {
+        return count_;
+    }
+    bool has_velocities() const;
+    bool has_densities() const;
+    Eigen::Vector3f box_min() const;
+    Eigen::Vector3f box_max() const;
+
+    Eigen::Vector3f position(size_t i) const;
+    // Decodes the whole frame.
+    void read(ParticleFrame& frame) const;
+
+   private:
+    const std::byte* data_ = nullptr;
+    size_t file_size_ = 0;
+    size_t count_ = 0;
+#ifdef _WIN32
+    void* file_ = nullptr;
+    void* mapping_ = nullptr;
+#endif
+};
+}  // namespace USTC_CG::node_particle_cache
@@ -1,34 +1,132 @@
-#include "Nodes/node_exec_eager.hpp"
+#include "Nodes/node_exec_simulation.hpp"
+
+#include "Nodes/GlobalUsdStage.h"
 #include "Nodes/node_tree.hpp"
 #include "USTC_CG.h"
+#include "Utils/Logging/Logging.h"
 // #include "Utils/Functions/GenericPointer_.hpp"
 //  #include "graph/node_exec_graph.h"
 #include <algorithm>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <limits>
 #include <map>
 #include <set>
 USTC_CG_NAMESPACE_OPEN_SCOPE
-class EagerNodeTreeExecutorSimulation : public EagerNodeTreeExecutor {
-   public:
-    void prepare_tree(NodeTree* node_tree) override;
-    void execute_tree(NodeTree* tree) override;
-    ~EagerNodeTreeExecutorSimulation();
+// Compare type pointers instead of id names in the per-socket loops.
+static NodeTypeInfo* storage_in_type()
+{
+    static NodeTypeInfo* type = nodeTypeFind("geom_storage_in");
+    return type;
+}
 
-   protected:
-    bool execute_node(NodeTree* tree, Node* node) override;
+static NodeTypeInfo* storage_out_type()
+{
+    static NodeTypeInfo* type = nodeTypeFind("geom_storage_out");
+    return type;
+}
 
-    std::map<std::string, GMutablePointer> storage;
-    std::vector<GMutablePointer> to_destroy;
-};
+static Node* find_node(NodeTree* tree, const char* id_name)
+{
+    for (auto&& node : tree->nodes) {
+        if (std::string(node->typeinfo->id_name) == id_name) {
+            return node.get();
+        }
+    }
+    return nullptr;
+}
+
+void sync_time_code(NodeTreeExecutor* executor, NodeTree* tree, float time_code)
+{
+    if (auto node = find_node(tree, "geom_time_code")) {
+        executor->sync_node_from_external_storage(node->outputs[0], &time_code);
+    }
+}
+
+std::optional<float> fetch_time_gain(NodeTreeExecutor* executor, NodeTree* tree)
+{
+    auto node = find_node(tree, "geom_time_gain");
+    if (!node || !executor->is_socket_executed(node->inputs[0])) {
+        return std::nullopt;
+    }
+    float time_gain = 0;
+    executor->sync_node_to_external_storage(node->inputs[0], &time_gain);
+    return time_gain;
+}
+
+float next_simulation_time_code(float time_code, float time_gain)
+{
+    // The first execution is told apart from the ones after it by its time code of 0.
+    if (time_code == 0) {
+        return std::numeric_limits<float>::epsilon();
+    }
+    return time_code + time_gain * GlobalUsdStage::timeCodesPerSecond;
+}
+
+static std::map<const CPPType*, CheckpointFunctions>& checkpoint_types()
+{
+    static std::map<const CPPType*, CheckpointFunctions> types;
+    return types;
+}
+
+void register_checkpoint_type(const CPPType& type, CheckpointFunctions functions)
+{
+    checkpoint_types()[&type] = std::move(functions);
+}
+
+// The registered functions, or the ones that copy the value.
+static CheckpointFunctions checkpoint_functions(const CPPType& type)
+{
+    auto found = checkpoint_types().find(&type);
+    if (found != checkpoint_types().end()) {
+        return found->second;
+    }
+
+    auto allocate = [&type]() {
+        return std::shared_ptr<void>(malloc(type.size()), [&type](void* value) {
+            type.destruct(value);
+            free(value);
+        });
+    };
+
+    CheckpointFunctions functions;
+    functions.save = [&type, allocate](const void* value) -> std::shared_ptr<void> {
+        if (!type.is_copy_constructible()) {
+            return nullptr;
+        }
+        auto snapshot = allocate();
+        type.copy_construct(value, snapshot.get());
+        return snapshot;
+    };
+    functions.restore = [&type](const void* snapshot, void* value) {
+        type.copy_assign(snapshot, value);
+    };
+    functions.byte_size = [&type](const void* snapshot) {
+        return size_t(type.byte_size(snapshot));
+    };
+    if (type.is_trivial()) {
+        functions.write = [&type](const void* snapshot, std::ostream& out) {
+            out.write(static_cast<const char*>(snapshot), type.size());
+        };
+        functions.read = [&type, allocate](std::istream& in) {
+            auto snapshot = allocate();
+            type.default_construct(snapshot.get());
+            in.read(static_cast<char*>(snapshot.get()), type.size());
+            return snapshot;
+        };
+    }
+    return functions;
+}
 
 void EagerNodeTreeExecutorSimulation::prepare_tree(NodeTree* node_tree)
 {
-    EagerNodeTreeExecutor::prepare_tree(node_tree);
+    ParallelNodeTreeExecutor::prepare_tree(node_tree);
     std::set<std::string> refreshed;
 
     for (int i = 0; i < input_states.size(); ++i) {
-        // If the input is an 'Any' type, the value type is a GMutablePointer. If the input is
-        // connected, we need to prepare the memory it points to.
+        // If the input is an 'Any' type, the value type is a GMutablePointer. The 'Any' input of a
+        // storage in is redirected to the storage, which lives across executions.
         if (input_states[i].value.is_type<GMutablePointer>()) {
             auto& linked_sockets = input_of_nodes_to_execute[i]->directly_linked_sockets;
             assert(linked_sockets.size() <= 1);
@@ -39,7 +137,7 @@ void EagerNodeTreeExecutorSimulation::prepare_tree(NodeTree* node_tree)
                 // Implementation for now.
                 assert(node);
 
-                auto output_state = output_states[index_cache[linked_sockets[0]]];
+                auto output_state = output_states[runtime_index(linked_sockets[0])];
 
                 auto create_new_storage = [&output_state, this, i]() {
                     auto storage_ptr = GMutablePointer{ output_state.value.type(),
@@ -49,7 +147,7 @@ void EagerNodeTreeExecutorSimulation::prepare_tree(NodeTree* node_tree)
                     return storage_ptr;
                 };
 
-                if (std::string(node->typeinfo->id_name) == "geom_storage_in") {
+                if (node->typeinfo == storage_in_type()) {
                     std::string name;
                     CPPType::get<std::string>().copy_assign(
                         default_value_storage(node->inputs[0]), &name);
@@ -73,12 +171,20 @@ void EagerNodeTreeExecutorSimulation::prepare_tree(NodeTree* node_tree)
                     }
                     // This really prepares the memory of the underlying GMutablePointer
                     input_states[i].value.type()->copy_assign(&ptr, input_states[i].value.get());
-                }
-                else {
-                    auto ptr = create_new_storage();
-                    to_destroy.push_back(ptr);
-                    // This really prepares the memory of the underlying GMutablePointer
-                    input_states[i].value.type()->copy_assign(&ptr, input_states[i].value.get());
+
+                    // The storage is written when the node linked to this input forwards its
+                    // output, and read when a matching storage out forwards. Keep them in order.
+                    for (int j = 0; j < nodes_to_execute_count; ++j) {
+                        auto other = nodes_to_execute[j];
+                        if (other->typeinfo == storage_out_type()) {
+                            std::string other_name;
+                            CPPType::get<std::string>().copy_assign(
+                                default_value_storage(other->inputs[0]), &other_name);
+                            if (std::string(other_name.c_str()) == name) {
+                                keep_serial_order(other, linked_sockets[0]->Node);
+                            }
+                        }
+                    }
                 }
             }
         }
@@ -90,23 +196,50 @@ void EagerNodeTreeExecutorSimulation::prepare_tree(NodeTree* node_tree)
         }
     }
     for (auto& key : keysToDelete) {
+        storage[key].destruct();
+        free(storage[key].get());
         storage.erase(key);
     }
 }
 
 void EagerNodeTreeExecutorSimulation::execute_tree(NodeTree* tree)
 {
-    EagerNodeTreeExecutor::execute_tree(tree);
+    ParallelNodeTreeExecutor::execute_tree(tree);
 }
 
-EagerNodeTreeExecutorSimulation::~EagerNodeTreeExecutorSimulation()
+static void free_storage(std::map<std::string, GMutablePointer>& storage)
 {
     for (auto&& value : storage) {
         value.second.destruct();
+        free(value.second.get());
     }
-    for (auto destroy : to_destroy) {
-        destroy.destruct();
+    storage.clear();
+}
+
+// The storage while it is swapped out of the executor.
+struct PersistentStorage {
+    std::map<std::string, GMutablePointer> storage;
+
+    ~PersistentStorage()
+    {
+        free_storage(storage);
     }
+};
+
+void EagerNodeTreeExecutorSimulation::swap_persistent_state(std::shared_ptr<void>& state)
+{
+    auto swapped_out = std::make_shared<PersistentStorage>();
+    swapped_out->storage.swap(storage);
+    if (state) {
+        storage.swap(static_cast<PersistentStorage*>(state.get())->storage);
+    }
+    state = std::move(swapped_out);
+}
+
+EagerNodeTreeExecutorSimulation::~EagerNodeTreeExecutorSimulation()
+{
+    clear_checkpoints();
+    free_storage(storage);
 }
 
 bool EagerNodeTreeExecutorSimulation::execute_node(NodeTree* tree, Node* node)
@@ -114,7 +247,7 @@ bool EagerNodeTreeExecutorSimulation::execute_node(NodeTree* tree, Node* node)
     // Identify the special storage node, and do a special execution here.
 
     if (node->REQUIRED) {  // requirement info is valid.
-        if (std::string(node->typeinfo->id_name) == "geom_storage_out") {
+        if (node->typeinfo == storage_out_type()) {
             auto input = node->inputs[0];
             std::string name;
             CPPType::get<std::string>().copy_assign(default_value_storage(input), &name);
@@ -125,14 +258,18 @@ bool EagerNodeTreeExecutorSimulation::execute_node(NodeTree* tree, Node* node)
                 // Check all the connected input type
 
                 for (auto input : node->outputs[0]->directly_linked_sockets) {
-                    if (pointer.type() != input_states[index_cache[input]].value.type()) {
+                    int index = runtime_index(input);
+                    if (index < 0) {
+                        continue;
+                    }
+                    if (pointer.type() != input_states[index].value.type()) {
                         node->execution_failed = "Type Mismatch";
                         return false;
                     }
                 }
 
                 CPPType::get<GMutablePointer>().copy_assign(
-                    &pointer, output_states[index_cache[node->outputs[0]]].value.get());
+                    &pointer, output_states[runtime_index(node->outputs[0])].value.get());
 
                 node->execution_failed = {};
                 return true;
@@ -147,6 +284,160 @@ bool EagerNodeTreeExecutorSimulation::execute_node(NodeTree* tree, Node* node)
     return EagerNodeTreeExecutor::execute_node(tree, node);
 }
 
+void EagerNodeTreeExecutorSimulation::save_checkpoint(float time_code)
+{
+    Checkpoint checkpoint;
+    for (auto&& [name, value] : storage) {
+        auto functions = checkpoint_functions(*value.type());
+        auto snapshot = functions.save(value.get());
+        if (!snapshot) {
+            logging("Storage '" + name + "' can't be checkpointed.", Warning);
+            return;
+        }
+        checkpoint.bytes += functions.byte_size(snapshot.get());
+        checkpoint.snapshots.push_back({ name, value.type(), std::move(snapshot) });
+    }
+
+    auto found = checkpoints.find(time_code);
+    if (found != checkpoints.end()) {
+        drop(found);
+    }
+    checkpoint_memory += checkpoint.bytes;
+    checkpoints.emplace(time_code, std::move(checkpoint));
+    enforce_checkpoint_budget();
+}
+
+std::optional<float> EagerNodeTreeExecutorSimulation::restore_checkpoint(float time_code)
+{
+    auto found = checkpoints.upper_bound(time_code);
+    if (found == checkpoints.begin()) {
+        return std::nullopt;
+    }
+    --found;
+
+    auto snapshots = load(found->second);
+    if (!snapshots || snapshots->size() != storage.size()) {
+        return std::nullopt;
+    }
+    // Every value is asked before any is set back, so that a checkpoint is restored whole or not
+    // at all.
+    for (auto&& snapshot : *snapshots) {
+        auto value = storage.find(snapshot.name);
+        if (value == storage.end() || value->second.type() != snapshot.type) {
+            return std::nullopt;
+        }
+        auto functions = checkpoint_functions(*snapshot.type);
+        if (functions.can_restore &&
+            !functions.can_restore(snapshot.value.get(), value->second.get())) {
+            return std::nullopt;
+        }
+    }
+    for (auto&& snapshot : *snapshots) {
+        checkpoint_functions(*snapshot.type)
+            .restore(snapshot.value.get(), storage.at(snapshot.name).get());
+    }
+    return found->first;
+}
+
+void EagerNodeTreeExecutorSimulation::clear_checkpoints()
+{
+    while (!checkpoints.empty()) {
+        drop(checkpoints.begin());
+    }
+}
+
+void EagerNodeTreeExecutorSimulation::drop(std::map<float, Checkpoint>::iterator checkpoint)
+{
+    if (checkpoint->second.file.empty()) {
+        checkpoint_memory -= checkpoint->second.bytes;
+    }
+    else {
+        std::error_code error;
+        std::filesystem::remove(checkpoint->second.file, error);
+    }
+    checkpoints.erase(checkpoint);
+}
+
+void EagerNodeTreeExecutorSimulation::enforce_checkpoint_budget()
+{
+    while (checkpoint_memory > checkpoint_budget) {
+        // Of the checkpoints in memory, the one that leaves the smallest gap behind once gone.
+        // The newest one is where the simulation goes on from, so it stays.
+        auto victim = checkpoints.end();
+        float smallest_gap = std::numeric_limits<float>::max();
+        float previous = 0;
+        for (auto it = checkpoints.begin(); std::next(it) != checkpoints.end(); ++it) {
+            float gap = std::next(it)->first - previous;
+            previous = it->first;
+            if (it->second.file.empty() && gap < smallest_gap) {
+                smallest_gap = gap;
+                victim = it;
+            }
+        }
+        if (victim == checkpoints.end()) {
+            return;
+        }
+        if (!spill(victim->second)) {
+            drop(victim);
+        }
+    }
+}
+
+bool EagerNodeTreeExecutorSimulation::spill(Checkpoint& checkpoint)
+{
+    if (checkpoint_directory.empty()) {
+        return false;
+    }
+    std::vector<CheckpointFunctions> functions;
+    for (auto&& snapshot : checkpoint.snapshots) {
+        functions.push_back(checkpoint_functions(*snapshot.type));
+        if (!functions.back().write || !functions.back().read) {
+            return false;
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::create_directories(checkpoint_directory, error);
+    auto file = (std::filesystem::path(checkpoint_directory) /
+                 ("checkpoint_" + std::to_string(spilled_files++) + ".bin"))
+                    .string();
+    std::ofstream out(file, std::ios::binary);
+    for (size_t i = 0; i < checkpoint.snapshots.size(); ++i) {
+        functions[i].write(checkpoint.snapshots[i].value.get(), out);
+    }
+    if (!out) {
+        out.close();
+        std::filesystem::remove(file, error);
+        return false;
+    }
+
+    // The names and types stay, to read the values back.
+    for (auto&& snapshot : checkpoint.snapshots) {
+        snapshot.value.reset();
+    }
+    checkpoint.file = file;
+    checkpoint_memory -= checkpoint.bytes;
+    return true;
+}
+
+std::optional<std::vector<EagerNodeTreeExecutorSimulation::Snapshot>>
+EagerNodeTreeExecutorSimulation::load(const Checkpoint& checkpoint)
+{
+    if (checkpoint.file.empty()) {
+        return checkpoint.snapshots;
+    }
+    std::ifstream in(checkpoint.file, std::ios::binary);
+    auto snapshots = checkpoint.snapshots;
+    for (auto&& snapshot : snapshots) {
+        snapshot.value = checkpoint_functions(*snapshot.type).read(in);
+        if (!in || !snapshot.value) {
+            logging("Failed to read the checkpoint in " + checkpoint.file, Warning);
+            return std::nullopt;
+        }
+    }
+    return snapshots;
+}
+
 std::unique_ptr<EagerNodeTreeExecutor> CreateEagerNodeTreeExecutorSimulation()
 {
     return std::make_unique<EagerNodeTreeExecutorSimulation>();
@@ -1,4 +1,5 @@
 #include "iisph.h"
+#include <algorithm>
 #include <iostream>
 
 namespace USTC_CG::node_sph_fluid {
@@ -8,47 +9,135 @@ using namespace Eigen;
 IISPH::IISPH(const MatrixXd& X, const Vector3d& box_min, const Vector3d& box_max)
     : SPHBase(X, box_min, box_max)
 {
-    // (HW TODO) Feel free to modify this part to remove or add necessary member variables
-    predict_density_ = VectorXd::Zero(ps_.particles().size());
-    aii_ = VectorXd::Zero(ps_.particles().size());
-    Api_ = VectorXd::Zero(ps_.particles().size());
-    last_pressure_ = VectorXd::Zero(ps_.particles().size());
+    predict_density_ = VectorXd::Zero(ps_.size());
+    aii_ = VectorXd::Zero(ps_.size());
+    Api_ = VectorXd::Zero(ps_.size());
 }
 
 void IISPH::step()
 {
-    // (HW Optional)
+    TIC(step)
+
+    ps_.search_neighbors();
+    predict_advection();
+    compute_pressure();
+    compute_pressure_gradient_acceleration();
+    advect();
+
+    TOC(step)
+
+    if (enable_debug_output) {
+        std::cout << "IISPH: " << last_iterations_ << " iterations, density error "
+                  << last_density_error_ << std::endl;
+    }
 }
 
 void IISPH::compute_pressure()
 {
-    // (HW Optional) solve pressure using relaxed Jacobi iteration 
-    // Something like this: 
-
-    //double threshold = 0.001;
-    //for (unsigned iter = 0; iter < max_iter_; iter++) {
-    //    double avg_density_error = pressure_solve_iteration();
-    //    if (avg_density_error < threshold)
-    //        break;
-    //}
+    // At least two sweeps, as the first error is measured on the warm start only.
+    last_iterations_ = 0;
+    last_density_error_ = 0;
+    while (last_iterations_ < max_iter_) {
+        last_density_error_ = pressure_solve_iteration();
+        last_iterations_++;
+        if (last_iterations_ >= 2 && std::abs(last_density_error_) < max_density_error_) {
+            break;
+        }
+    }
 }
 
 void IISPH::predict_advection()
 {
-    // (HW Optional)
-    // predict new density based on non-pressure forces,
-    // compute necessary variables for pressure solve, etc. 
+    const unsigned n = ps_.size();
+    predict_density_.resize(n);
+    aii_.resize(n);
+    Api_.resize(n);
+
+    compute_density();
+    compute_non_pressure_acceleration();
+
+    const CubicKernel kernel(ps_.h());
+    const double m = ps_.mass();
+    std::vector<Vector3d> vel_adv(n);
+    for_each_particle([&](unsigned i) { vel_adv[i] = ps_.vel(i) + dt_ * ps_.acceleration(i); });
 
-    // Note: feel free to remove or add functions based on your need,
-    // you can also rename this function. 
+    for_each_particle([&](unsigned i) {
+        const Vector3d v_i = vel_adv[i];
+        Batch gx = Batch::Zero(), gy = Batch::Zero(), gz = Batch::Zero();
+        Batch grad2 = Batch::Zero(), divergence = Batch::Zero();
+        for_each_neighbor_batch(i, [&](const NeighborBatch& batch) {
+            Batch vx, vy, vz;
+            for (int l = 0; l < kBatchSize; l++) {
+                const Vector3d v_ij = v_i - vel_adv[batch.j[l]];
+                vx[l] = Real(v_ij[0]);
+                vy[l] = Real(v_ij[1]);
+                vz[l] = Real(v_ij[2]);
+            }
+            const Batch g = kernel.grad_factor(batch.r2);
+            gx += g * batch.dx;
+            gy += g * batch.dy;
+            gz += g * batch.dz;
+            grad2 += g * g * batch.r2;
+            divergence += g * (vx * batch.dx + vy * batch.dy + vz * batch.dz);
+        });
+
+        const double density = ps_.density(i);
+        predict_density_[i] = density + dt_ * m * divergence.sum();
+
+        // With d_ii = -dt^2 m / rho_i^2 sum_j grad W_ij and d_ji = dt^2 m / rho_i^2 grad W_ij,
+        // a_ii = sum_j m (d_ii - d_ji) . grad W_ij folds into one pass over the neighbors.
+        const double c = dt_ * dt_ * m / (density * density);
+        const Vector3d sum_grad(gx.sum(), gy.sum(), gz.sum());
+        aii_[i] = -m * c * (sum_grad.squaredNorm() + grad2.sum());
+
+        ps_.pressure(i) *= 0.5;
+    });
 }
 
 double IISPH::pressure_solve_iteration()
 {
-    // (HW Optional)   
-    // One step iteration to solve the pressure poisson equation of IISPH
+    const unsigned n = ps_.size();
+    pressure_acceleration_.resize(n);
+    for_each_pressure_acceleration([this](unsigned i, const Vector3d& acceleration) {
+        pressure_acceleration_[i] = acceleration;
+    });
+
+    // (A p)_i = dt^2 sum_j m (a_i - a_j) . grad W_ij is the density change the pressure
+    // accelerations cause; it should make up for the advected density, A p = rho_0 - rho_adv.
+    const CubicKernel kernel(ps_.h());
+    const double dt2_m = dt_ * dt_ * ps_.mass();
+    const double density0 = ps_.density0();
+    for_each_particle([&](unsigned i) {
+        const Vector3d a_i = pressure_acceleration_[i];
+        Batch sum = Batch::Zero();
+        for_each_neighbor_batch(i, [&](const NeighborBatch& batch) {
+            Batch ax, ay, az;
+            for (int l = 0; l < kBatchSize; l++) {
+                const Vector3d a_ij = a_i - pressure_acceleration_[batch.j[l]];
+                ax[l] = Real(a_ij[0]);
+                ay[l] = Real(a_ij[1]);
+                az[l] = Real(a_ij[2]);
+            }
+            sum += kernel.grad_factor(batch.r2) * (ax * batch.dx + ay * batch.dy + az * batch.dz);
+        });
+        Api_[i] = dt2_m * sum.sum();
+
+        double pressure = 0;
+        if (aii_[i] < 0) {
+            const double source = density0 - predict_density_[i];
+            pressure = ps_.pressure(i) + omega_ / aii_[i] * (source - Api_[i]);
+        }
+        ps_.pressure(i) = std::max(pressure, 0.0);
+    });
 
-    return 1.0; 
+    // Particles left without pressure are at the surface or expanding, which is fine.
+    double error = 0;
+    for (unsigned i = 0; i < n; i++) {
+        if (ps_.pressure(i) > 0) {
+            error += predict_density_[i] + Api_[i] - density0;
+        }
+    }
+    return n > 0 ? error / n / density0 : 0.0;
 }
 
 // ------------------ helper function, no need to modify ---------------------
@@ -56,9 +145,11 @@ void IISPH::reset()
 {
     SPHBase::reset();
 
-    predict_density_ = VectorXd::Zero(ps_.particles().size());
-    aii_ = VectorXd::Zero(ps_.particles().size());
-    Api_ = VectorXd::Zero(ps_.particles().size());
-    last_pressure_ = VectorXd::Zero(ps_.particles().size());
+    predict_density_ = VectorXd::Zero(ps_.size());
+    aii_ = VectorXd::Zero(ps_.size());
+    Api_ = VectorXd::Zero(ps_.size());
+    for (unsigned i = 0; i < ps_.size(); i++) {
+        ps_.pressure(i) = 0;
+    }
 }
-}  // namespace USTC_CG::node_sph_fluid
\ No newline at end of file
+}  // namespace USTC_CG::node_sph_fluid
@@ -3,6 +3,7 @@
 #include "particle_system.h"
 #include "sph_base.h"
 #include <Eigen/Dense>
+#include <vector>
 
 namespace USTC_CG::node_sph_fluid {
 
@@ -17,7 +18,10 @@ class IISPH : public SPHBase {
     void step() override;
     void compute_pressure() override;
 
+    // Relaxed Jacobi sweep; returns the average density error of the compressed particles,
+    // relative to the rest density.
     double pressure_solve_iteration();
+    // Advected density and diagonal of the pressure system, from the non-pressure accelerations.
     void predict_advection();
 
     void reset() override;
@@ -30,15 +34,34 @@ class IISPH : public SPHBase {
     {
         return omega_;
     }
+    double& max_density_error()
+    {
+        return max_density_error_;
+    }
+
+    // Convergence of the last pressure solve.
+    int last_iterations() const
+    {
+        return last_iterations_;
+    }
+    double last_density_error() const
+    {
+        return last_density_error_;
+    }
 
    protected:
     int max_iter_ = 50;
     double omega_ = 0.5;
+    double max_density_error_ = 0.001;
+
+    int last_iterations_ = 0;
+    double last_density_error_ = 0;
 
-    // (HW TODO) Feel free to modify this part to remove or add necessary member variables
+    // Per slot, recomputed every step. The pressures themselves live in the particle system,
+    // which keeps them in step with the slots, so each solve starts from the last one.
     VectorXd predict_density_;
     VectorXd aii_;
-    VectorXd Api_;  
-    VectorXd last_pressure_;
+    VectorXd Api_;
+    std::vector<Vector3d> pressure_acceleration_;
 };
 }  // namespace USTC_CG::node_sph_fluid
\ No newline at end of file
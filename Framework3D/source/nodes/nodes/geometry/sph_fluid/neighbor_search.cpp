@@ -0,0 +1,291 @@
+#include "neighbor_search.h"
+
+#include <algorithm>
+#include <atomic>
+#include <numeric>
+
+#include "pxr/base/work/loops.h"
+
+namespace USTC_CG::node_sph_fluid {
+
+using namespace Eigen;
+
+// Morton keys interleave 10 bits per axis.
+static constexpr int kMaxCellsPerAxis = 1 << 10;
+// Particles per block of the parallel sort and scans.
+static constexpr size_t kBlockSize = 1 << 14;
+
+static size_t block_count(size_t n)
+{
+    return (n + kBlockSize - 1) / kBlockSize;
+}
+
+// Exclusive scan in place, by blocks in parallel. Returns the total.
+static unsigned parallel_exclusive_scan(std::vector<unsigned>& values)
+{
+    const size_t n = values.size();
+    std::vector<unsigned> block_sums(block_count(n));
+    pxr::WorkParallelForN(block_sums.size(), [&](size_t begin, size_t end) {
+        for (size_t b = begin; b < end; b++) {
+            auto first = values.begin() + b * kBlockSize;
+            auto last = values.begin() + std::min(n, (b + 1) * kBlockSize);
+            block_sums[b] = std::accumulate(first, last, 0u);
+        }
+    });
+
+    unsigned total = 0;
+    for (auto& sum : block_sums) {
+        unsigned block = sum;
+        sum = total;
+        total += block;
+    }
+
+    pxr::WorkParallelForN(block_sums.size(), [&](size_t begin, size_t end) {
+        for (size_t b = begin; b < end; b++) {
+            unsigned running = block_sums[b];
+            for (size_t i = b * kBlockSize; i < std::min(n, (b + 1) * kBlockSize); i++) {
+                unsigned value = values[i];
+                values[i] = running;
+                running += value;
+            }
+        }
+    });
+    return total;
+}
+
+// LSD radix sort of the keys, 8 bits per pass. Each pass counts the digits of every block in
+// parallel, scans the counts digit-major so that the blocks keep their order, and scatters in
+// parallel. The sort is stable.
+static void parallel_radix_sort(std::vector<uint32_t>& keys, std::vector<unsigned>& order, int bits)
+{
+    const size_t n = keys.size();
+    const size_t n_blocks = block_count(n);
+    order.resize(n);
+    std::iota(order.begin(), order.end(), 0u);
+
+    std::vector<uint32_t> sorted_keys(n);
+    std::vector<unsigned> sorted_order(n);
+    std::vector<unsigned> counts(n_blocks * 256);
+
+    for (int shift = 0; shift < bits; shift += 8) {
+        pxr::WorkParallelForN(n_blocks, [&](size_t begin, size_t end) {
+            for (size_t b = begin; b < end; b++) {
+                unsigned* count = counts.data() + b * 256;
+                std::fill(count, count + 256, 0u);
+                for (size_t i = b * kBlockSize; i < std::min(n, (b + 1) * kBlockSize); i++) {
+                    count[(keys[i] >> shift) & 0xff]++;
+                }
+            }
+        });
+
+        unsigned total = 0;
+        for (int digit = 0; digit < 256; digit++) {
+            for (size_t b = 0; b < n_blocks; b++) {
+                unsigned count = counts[b * 256 + digit];
+                counts[b * 256 + digit] = total;
+                total += count;
+            }
+        }
+
+        pxr::WorkParallelForN(n_blocks, [&](size_t begin, size_t end) {
+            for (size_t b = begin; b < end; b++) {
+                unsigned* next = counts.data() + b * 256;
+                for (size_t i = b * kBlockSize; i < std::min(n, (b + 1) * kBlockSize); i++) {
+                    unsigned slot = next[(keys[i] >> shift) & 0xff]++;
+                    sorted_keys[slot] = keys[i];
+                    sorted_order[slot] = order[i];
+                }
+            }
+        });
+        keys.swap(sorted_keys);
+        order.swap(sorted_order);
+    }
+}
+
+// Spreads the 10 low bits of v to every third bit.
+static uint32_t spread_bits(uint32_t v)
+{
+    v &= 0x3ff;
+    v = (v | (v << 16)) & 0x030000ff;
+    v = (v | (v << 8)) & 0x0300f00f;
+    v = (v | (v << 4)) & 0x030c30c3;
+    v = (v | (v << 2)) & 0x09249249;
+    return v;
+}
+
+uint32_t NeighborSearch::morton_key(const Vector3i& xyz)
+{
+    return spread_bits(xyz[0]) | (spread_bits(xyz[1]) << 1) | (spread_bits(xyz[2]) << 2);
+}
+
+NeighborSearch::NeighborSearch(const Vector3d& box_min, const Vector3d& box_max, double radius)
+    : box_min_(box_min),
+      box_max_(box_max),
+      radius_(radius),
+      skin_(0.1 * radius)
+{
+    update_grid();
+}
+
+void NeighborSearch::set_skin(double skin)
+{
+    skin_ = skin;
+    built_x_.clear();
+}
+
+void NeighborSearch::update_grid()
+{
+    // A cell is as wide as the search radius, so the 27 cells around a particle cover it.
+    cell_size_ = radius_ + skin_;
+    n_cell_per_axis_ = ((box_max_ - box_min_) / cell_size_)
+                           .array()
+                           .ceil()
+                           .cast<int>()
+                           .max(1)
+                           .min(kMaxCellsPerAxis)
+                           .matrix();
+}
+
+Vector3i NeighborSearch::cell_xyz(const Vector3d& x) const
+{
+    Vector3i xyz = ((x - box_min_) / cell_size_).array().floor().cast<int>().matrix();
+    // Clamping keeps every pair within the radius in adjacent cells.
+    return xyz.array().max(0).min(n_cell_per_axis_.array() - 1).matrix();
+}
+
+void NeighborSearch::sort(const std::vector<Vector3d>& x, std::vector<unsigned>& order)
+{
+    update_grid();
+
+    keys_.resize(x.size());
+    pxr::WorkParallelForN(x.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            keys_[i] = morton_key(cell_xyz(x[i]));
+        }
+    });
+
+    int bits_per_axis = 0;
+    while ((1 << bits_per_axis) < n_cell_per_axis_.maxCoeff()) {
+        bits_per_axis++;
+    }
+    parallel_radix_sort(keys_, order, 3 * bits_per_axis);
+}
+
+std::pair<unsigned, unsigned> NeighborSearch::cell_range(uint32_t key) const
+{
+    auto it = std::lower_bound(cell_keys_.begin(), cell_keys_.end(), key);
+    if (it == cell_keys_.end() || *it != key) {
+        return { 0, 0 };
+    }
+    size_t c = it - cell_keys_.begin();
+    return { cell_start_[c], cell_start_[c + 1] };
+}
+
+void NeighborSearch::build(const std::vector<Vector3d>& x)
+{
+    const size_t n = x.size();
+
+    keys_.resize(n);
+    pxr::WorkParallelForN(n, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            keys_[i] = morton_key(cell_xyz(x[i]));
+        }
+    });
+
+    // The cell table: a slot starts a cell when its key differs from the previous one.
+    std::vector<unsigned> cell_index(n);
+    pxr::WorkParallelForN(n, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            cell_index[i] = i == 0 || keys_[i] != keys_[i - 1];
+        }
+    });
+    std::vector<unsigned> is_start = cell_index;
+    const unsigned n_cells = parallel_exclusive_scan(cell_index);
+
+    cell_keys_.resize(n_cells);
+    cell_start_.resize(n_cells + 1);
+    cell_start_[n_cells] = n;
+    pxr::WorkParallelForN(n, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            if (is_start[i]) {
+                cell_keys_[cell_index[i]] = keys_[i];
+                cell_start_[cell_index[i]] = i;
+            }
+        }
+    });
+
+    // The ranges of the up to 27 occupied cells around each cell, found once for its particles.
+    constexpr int kAround = 27;
+    std::vector<std::pair<unsigned, unsigned>> ranges(size_t(n_cells) * kAround);
+    std::vector<unsigned char> n_ranges(n_cells);
+    pxr::WorkParallelForN(n_cells, [&](size_t begin, size_t end) {
+        for (size_t c = begin; c < end; c++) {
+            Vector3i xyz = cell_xyz(x[cell_start_[c]]);
+            auto* out = ranges.data() + c * kAround;
+            int count = 0;
+            for (int dx = -1; dx <= 1; dx++) {
+                for (int dy = -1; dy <= 1; dy++) {
+                    for (int dz = -1; dz <= 1; dz++) {
+                        Vector3i around = xyz + Vector3i(dx, dy, dz);
+                        if ((around.array() < 0).any() ||
+                            (around.array() >= n_cell_per_axis_.array()).any()) {
+                            continue;
+                        }
+                        auto range = cell_range(morton_key(around));
+                        if (range.first != range.second) {
+                            out[count++] = range;
+                        }
+                    }
+                }
+            }
+            n_ranges[c] = count;
+        }
+    });
+
+    const double radius2 = (radius_ + skin_) * (radius_ + skin_);
+    auto gather = [&](auto&& visit) {
+        pxr::WorkParallelForN(n_cells, [&](size_t begin, size_t end) {
+            for (size_t c = begin; c < end; c++) {
+                auto* around = ranges.data() + c * kAround;
+                for (unsigned i = cell_start_[c]; i < cell_start_[c + 1]; i++) {
+                    for (int r = 0; r < n_ranges[c]; r++) {
+                        for (unsigned j = around[r].first; j < around[r].second; j++) {
+                            if (j != i && (x[i] - x[j]).squaredNorm() < radius2) {
+                                visit(i, j);
+                            }
+                        }
+                    }
+                }
+            }
+        });
+    };
+
+    // Count, scan, then fill: every particle writes its own range, so no locks.
+    neighbor_offsets_.assign(n + 1, 0);
+    gather([this](unsigned i, unsigned) { neighbor_offsets_[i]++; });
+    neighbor_offsets_[n] = parallel_exclusive_scan(neighbor_offsets_);
+
+    neighbors_.resize(neighbor_offsets_[n]);
+    std::vector<unsigned> next(neighbor_offsets_.begin(), neighbor_offsets_.end() - 1);
+    gather([this, &next](unsigned i, unsigned j) { neighbors_[next[i]++] = j; });
+
+    built_x_ = x;
+}
+
+bool NeighborSearch::needs_rebuild(const std::vector<Vector3d>& x) const
+{
+    if (built_x_.size() != x.size()) {
+        return true;
+    }
+    const double limit2 = 0.25 * skin_ * skin_;
+    std::atomic<bool> moved = false;
+    pxr::WorkParallelForN(x.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end && !moved.load(std::memory_order_relaxed); i++) {
+            if ((x[i] - built_x_[i]).squaredNorm() > limit2) {
+                moved = true;
+            }
+        }
+    });
+    return moved;
+}
+}  // namespace USTC_CG::node_sph_fluid
@@ -0,0 +1,69 @@
+#pragma once
+#include <Eigen/Dense>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace USTC_CG::node_sph_fluid {
+
+// Fixed-radius neighbor search on a uniform grid, in parallel.
+//
+// Cells are keyed by the Morton (Z-order) code of their coordinates, and the particles are sorted
+// by key with a parallel radix sort, so that a cell's particles are contiguous and neighboring
+// cells mostly sit close in memory. Only the occupied cells are kept, as a sorted table of keys
+// with the range of particles of each. The neighbor lists are gathered per cell in parallel into
+// CSR arrays: a counting pass, a scan, then each particle fills its own range.
+//
+// The lists hold the particles within radius + skin. As long as no particle has moved more than
+// half the skin since the lists were built, they still contain every pair within the radius, and
+// needs_rebuild() is false.
+class NeighborSearch {
+   public:
+    NeighborSearch(const Eigen::Vector3d& box_min, const Eigen::Vector3d& box_max, double radius);
+
+    double skin() const
+    {
+        return skin_;
+    }
+    // Lists built with another skin can't be trusted, so this forces a rebuild.
+    void set_skin(double skin);
+
+    // Order in which the particles have to be stored before build(): order[i] is the particle
+    // that goes to slot i.
+    void sort(const std::vector<Eigen::Vector3d>& x, std::vector<unsigned>& order);
+    // Builds the lists for the particles at x, which are in the order given by sort().
+    void build(const std::vector<Eigen::Vector3d>& x);
+    bool needs_rebuild(const std::vector<Eigen::Vector3d>& x) const;
+
+    std::span<const unsigned> neighbors(unsigned i) const
+    {
+        return { neighbors_.data() + neighbor_offsets_[i],
+                 neighbors_.data() + neighbor_offsets_[i + 1] };
+    }
+
+    Eigen::Vector3i cell_xyz(const Eigen::Vector3d& x) const;
+    static uint32_t morton_key(const Eigen::Vector3i& xyz);
+
+   private:
+    void update_grid();
+    // Range of slots of the occupied cell with this key, empty when it has no particle.
+    std::pair<unsigned, unsigned> cell_range(uint32_t key) const;
+
+    Eigen::Vector3d box_min_, box_max_;
+    Eigen::Vector3i n_cell_per_axis_;
+    double radius_;
+    double skin_;
+    double cell_size_;
+
+    std::vector<uint32_t> keys_;
+    // Occupied cells, by increasing key. Cell c holds the slots from cell_start_[c] to
+    // cell_start_[c + 1].
+    std::vector<uint32_t> cell_keys_;
+    std::vector<unsigned> cell_start_;
+
+    std::vector<unsigned> neighbor_offsets_;
+    std::vector<unsigned> neighbors_;
+    // Positions when the lists were built, to measure how far the particles moved since.
+    std::vector<Eigen::Vector3d> built_x_;
+};
+}  // namespace USTC_CG::node_sph_fluid
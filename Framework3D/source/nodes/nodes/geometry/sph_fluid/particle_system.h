@@ -1,83 +1,66 @@
-#pragma once 
+#pragma once
 #include <Eigen/Dense>
+#include <span>
 #include <vector>
-#include <memory>
+
+#include "neighbor_search.h"
+#include "pxr/base/work/loops.h"
 
 using namespace Eigen;
 
 namespace USTC_CG::node_sph_fluid {
 
-class Particle {
+// Particles are stored as one contiguous array per attribute, indexed by slot. Rebuilding the
+// neighbor lists sorts the slots by cell, so that particles close in space are close in memory;
+// idx(i) is the original index of the particle in slot i, i.e. its row in the input positions.
+class ParticleSystem {
    public:
-    enum particleType { FLUID, BOUNDARY };
+    ParticleSystem(const MatrixXd& X, const Vector3d& box_min, const Vector3d& box_max);
 
-    unsigned idx() const
-    {
-        return idx_;
-    };
-    Eigen::Vector3d& x()
+    unsigned size() const
     {
-        return X_;
-    };
-    Eigen::Vector3d& vel()
-    {
-        return vel_;
-    };
-    Eigen::Vector3d& acceleration()
+        return num_particles_;
+    }
+    unsigned idx(unsigned i) const
     {
-        return acceleration_;
-    };
-    double& density()
+        return idx_[i];
+    }
+    Vector3d& x(unsigned i)
     {
-        return density_;
-    };
-    double& pressure()
+        return x_[i];
+    }
+    Vector3d& vel(unsigned i)
     {
-        return pressure_;
-    };
-
-    particleType type() const
+        return vel_[i];
+    }
+    Vector3d& acceleration(unsigned i)
     {
-        return type_;
-    };
-
-    bool is_boundary() const
+        return acceleration_[i];
+    }
+    double& density(unsigned i)
     {
-        return type_ == BOUNDARY;
+        return density_[i];
     }
-
-    const std::vector<std::shared_ptr<Particle>>& const neighbors()
+    double& pressure(unsigned i)
     {
-        return neighbors_;
-    };
-
-    // protected:
-    double density_;
-    double pressure_;
-    particleType type_;
-    unsigned idx_;
-
-    Eigen::Vector3d X_;
-    Eigen::Vector3d vel_;
-    Eigen::Vector3d acceleration_;
-
-    // should be a vector of pointers?.
-    std::vector<std::shared_ptr<Particle>> neighbors_;
-};
-
-// This class is for particle neighbor search
-class ParticleSystem {
-   public:
-    ParticleSystem(const MatrixXd& X, const Vector3d& box_min, const Vector3d& box_max);
+        return pressure_[i];
+    }
 
-    const std::vector<std::shared_ptr<Particle>>& particles() const
+    // Slots of the particles near slot i, as of the last search. The lists include every particle
+    // within the support radius, and may hold some up to a skin distance further.
+    std::span<const unsigned> neighbors(unsigned i) const
     {
-        return particles_;
+        return neighbor_search_.neighbors(i);
     }
+
     const double h() const
     {
         return support_radius_;
     }
+    const double radius() const
+    {
+        return particle_radius_;
+    }
 
     const double volume() const
     {
@@ -91,26 +74,29 @@ class ParticleSystem {
     {
         return density0_;
     }
-    std::vector<std::vector<std::shared_ptr<Particle>>> cells() const
+
+    // Once the particles have moved more than half the skin since the last search, sorts them by
+    // cell and rebuilds the neighbor lists. Returns whether the slots were reordered.
+    bool search_neighbors();
+    double skin() const
     {
-        return cells_;
+        return neighbor_search_.skin();
     }
+    void set_skin(double skin)
+    {
+        neighbor_search_.set_skin(skin);
+    }
+    // Applies the reordering of the last sort to a per-slot array kept outside the system.
+    template<typename T>
+    void reorder(std::vector<T>& values) const;
+    void reorder(VectorXd& values) const;
 
-    void search_neighbors();
-    void add_particle();
     static MatrixXd sample_particle_pos_in_a_box(
         const Vector3d min,
         const Vector3d max,
         const Vector3i n_particle_per_axis);
-    unsigned pos_to_cell_index(const Vector3d& x) const;
-    unsigned cell_xyz_to_cell_index(const unsigned x, const unsigned y, const unsigned z) const;
-    Vector3i pos_to_cell_xyz(const Vector3d& x) const;
-
-    void assign_particles_to_cells();
-    std::vector<unsigned> get_neighbor_cell_indices(const Vector3d& x) const;
 
    protected:
-    std::vector<std::shared_ptr<Particle>> particles_;
     double particle_radius_ = 0.025;
     double support_radius_;
 
@@ -121,20 +107,29 @@ class ParticleSystem {
 
     unsigned num_particles_;
 
-    // ------------------- Particle properties --------------------------------------
-    // If store as a big matrix, cache hit may be a problem.
-    // MatrixXd init_X_;
-    // MatrixXd X_;
-    // MatrixXd vel_;
-    // MatrixXd acceleration_;
-    // MatrixXd density_;
-    // MatrixXd pressure_;
+    // ------------------- Particle properties, by slot -------------------------------
+    std::vector<unsigned> idx_;
+    std::vector<Vector3d> x_;
+    std::vector<Vector3d> vel_;
+    std::vector<Vector3d> acceleration_;
+    std::vector<double> density_;
+    std::vector<double> pressure_;
 
     //-------------- Spatial acceleration structure for neighbor search -------------
-    // store pointer to particles: TODO: cache friendly?
-    std::vector<std::vector<std::shared_ptr<Particle>>> cells_;
-    double cell_size_;
-    Vector3i n_cell_per_axis_;  // number of cells per axis
-    Vector3d box_min_, box_max_;
+    NeighborSearch neighbor_search_;
+    // Slot i of the last sort was slot sort_order_[i] before it.
+    std::vector<unsigned> sort_order_;
 };
-}  // namespace USTC_CG::node_sph_fluid
\ No newline at end of file
+
+template<typename T>
+void ParticleSystem::reorder(std::vector<T>& values) const
+{
+    std::vector<T> sorted(values.size());
+    pxr::WorkParallelForN(num_particles_, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            sorted[i] = std::move(values[sort_order_[i]]);
+        }
+    });
+    values.swap(sorted);
+}
+}  // namespace USTC_CG::node_sph_fluid
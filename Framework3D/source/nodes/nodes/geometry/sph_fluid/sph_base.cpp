@@ -1,13 +1,30 @@
 #include "sph_base.h"
+#include <algorithm>
 #include <cmath>
+#include <limits>
 #define M_PI 3.14159265358979323846
-#include <omp.h>
 #include <iostream>
 #include "colormap_jet.h"
 
 namespace USTC_CG::node_sph_fluid {
 using namespace Eigen;
-using Real = double;
+
+const char* simd_instruction_set()
+{
+#if defined(EIGEN_VECTORIZE_AVX512)
+    return "AVX-512";
+#elif defined(EIGEN_VECTORIZE_AVX2)
+    return "AVX2";
+#elif defined(EIGEN_VECTORIZE_AVX)
+    return "AVX";
+#elif defined(EIGEN_VECTORIZE_SSE2)
+    return "SSE2";
+#elif defined(EIGEN_VECTORIZE_NEON)
+    return "NEON";
+#else
+    return "scalar";
+#endif
+}
 
 SPHBase::SPHBase(const Eigen::MatrixXd& X, const Vector3d& box_min, const Vector3d& box_max)
     : init_X_(X),
@@ -59,7 +76,7 @@ Vector3d SPHBase::grad_W(const Vector3d& r, double h)
     Vector3d result = Vector3d::Zero();
 
     if (q <= 1.0 && rl > 1e-9) {
-        Vector3d grad_q = r / rl;
+        Vector3d grad_q = r / (rl * h);
         if (q <= 0.5) {
             result = m_l * q * (3.0 * q - 2.0) * grad_q;
         }
@@ -75,19 +92,7 @@ Vector3d SPHBase::grad_W(const Vector3d& r, double h)
 
 void SPHBase::compute_density()
 {
-    // (HW TODO) Traverse all particles to compute each particle's density
-    // (Optional) This operation can be done in parallel using OpenMP 
-    for (auto& p : ps_.particles()) {
-
-        // ... necessary initialization of particle p's density here  
-
-        // Then traverse all neighbor fluid particles of p
-        for (auto& q : p->neighbors()) {
-
-            // ... compute the density contribution from q to p
-
-        }
-    }
+    sum_density([](unsigned) {});
 }
 
 void SPHBase::compute_pressure()
@@ -97,44 +102,42 @@ void SPHBase::compute_pressure()
 
 void SPHBase::compute_non_pressure_acceleration()
 {
-    // (HW TODO) Traverse all particles to compute each particle's non-pressure acceleration 
-    for (auto& p : ps_.particles()) {
-
-        // necessary code here to compute particle p's acceleration include gravity and viscosity
-        // We do not consider surface tension in this assignment, but you can add it if you like
-
-        //for (auto& q : p->neighbors()) {
-        // 
-        // Prompt: use the "compute_viscosity_acceleration" function to compute the viscosity acceleration between p and q"
-        // 
-        //}
-
-
-    }
-}
-
-// compute viscosity acceleration between two particles
-Vector3d SPHBase::compute_viscosity_acceleration(
-    const std::shared_ptr<Particle>& p,
-    const std::shared_ptr<Particle>& q)
-{
-    auto v_ij = p->vel() - q->vel();
-    auto x_ij = p->x() - q->x();
-    Vector3d grad = grad_W(p->x() - q->x(), ps_.h());
-
-    // Vector3d laplace_v = ... 
-
-    //return this->viscosity_ * laplace_v;
-
-    return Vector3d::Zero();
+    // Gravity and viscosity. We do not consider surface tension.
+    const double h = ps_.h();
+    const CubicKernel kernel(h);
+    // 2 (d + 2) with d = 3 dimensions; the 0.01 h^2 keeps close pairs finite.
+    const Real c = Real(10.0 * viscosity_ * ps_.mass());
+    const Real eps2 = Real(0.01 * h * h);
+
+    for_each_particle([&](unsigned i) {
+        const Vector3d v_i = ps_.vel(i);
+        Batch ax = Batch::Zero(), ay = Batch::Zero(), az = Batch::Zero();
+        for_each_neighbor_batch(i, [&](const NeighborBatch& batch) {
+            Batch vx, vy, vz, density;
+            for (int l = 0; l < kBatchSize; l++) {
+                const unsigned j = batch.j[l];
+                const Vector3d v_ij = v_i - ps_.vel(j);
+                vx[l] = Real(v_ij[0]);
+                vy[l] = Real(v_ij[1]);
+                vz[l] = Real(v_ij[2]);
+                density[l] = Real(ps_.density(j));
+            }
+            const Batch v_dot_x = vx * batch.dx + vy * batch.dy + vz * batch.dz;
+            const Batch s =
+                c / density * v_dot_x / (batch.r2 + eps2) * kernel.grad_factor(batch.r2);
+            ax += s * batch.dx;
+            ay += s * batch.dy;
+            az += s * batch.dz;
+        });
+        ps_.acceleration(i) = gravity_ + Vector3d(ax.sum(), ay.sum(), az.sum());
+    });
 }
 
 // Traverse all particles and compute pressure gradient acceleration
 void SPHBase::compute_pressure_gradient_acceleration()
 {
-    for (auto& p : ps_.particles()) {
-        // (HW TODO) Traverse all particles and compute each particle's acceleration from pressure gradient force
-    }
+    for_each_pressure_acceleration(
+        [this](unsigned i, const Vector3d& acceleration) { ps_.acceleration(i) += acceleration; });
 }
 
 void SPHBase::step()
@@ -142,27 +145,77 @@ void SPHBase::step()
     // Not implemented, should be implemented in children classes WCSPH, IISPH, etc. 
 }
 
-
-void SPHBase::advect()
+double SPHBase::cfl_time_step()
 {
-    for (auto& p : ps_.particles())  
-    {
+    double max_vel2 = 0;
+    double max_acceleration2 = 0;
+    for (unsigned i = 0; i < ps_.size(); i++) {
+        max_vel2 = std::max(max_vel2, ps_.vel(i).squaredNorm());
+        max_acceleration2 = std::max(max_acceleration2, ps_.acceleration(i).squaredNorm());
+    }
 
-        // ---------------------------------------------------------
-        // (HW TODO) Implement the advection step of each particle
-        // Remember to check collision after advection
+    const double diameter = 2 * ps_.radius();
+    double dt = std::numeric_limits<double>::infinity();
+    if (max_vel2 > 0) {
+        dt = std::min(dt, cfl_number_ * diameter / std::sqrt(max_vel2));
+    }
+    if (max_acceleration2 > 0) {
+        dt = std::min(dt, std::sqrt(2 * cfl_number_ * diameter / std::sqrt(max_acceleration2)));
+    }
+    return dt;
+}
 
-        // Your code here 
+void SPHBase::advance(double duration)
+{
+    const double max_dt = dt_;
+    // Below this the fluid is blowing up anyway; it keeps a frame from taking forever.
+    const double min_dt = max_dt / 1000;
+
+    last_substeps_ = 0;
+    last_min_dt_ = max_dt;
+    double time = 0;
+    while (duration - time > 1e-9 * duration) {
+        const double remaining = duration - time;
+        double dt = std::clamp(cfl_time_step(), min_dt, max_dt);
+        if (dt >= remaining) {
+            dt = remaining;
+        }
+        else if (dt > remaining / 2) {
+            // Two even steps rather than a full one and a sliver.
+            dt = remaining / 2;
+        }
 
-        // ---------------------------------------------------------
-        vel_.row(p->idx()) = p->vel().transpose();
-        X_.row(p->idx()) = p->x().transpose();
+        dt_ = dt;
+        step();
+        time += dt;
+        last_substeps_++;
+        last_min_dt_ = std::min(last_min_dt_, dt);
+    }
+    dt_ = max_dt;
+
+    if (enable_debug_output) {
+        std::cout << "SPH: " << last_substeps_ << " substeps, shortest " << last_min_dt_
+                  << std::endl;
     }
 }
 
+
+void SPHBase::advect()
+{
+    // Symplectic Euler, then the particles are kept in the box.
+    for_each_particle([this](unsigned i) {
+        ps_.vel(i) += dt_ * ps_.acceleration(i);
+        ps_.x(i) += dt_ * ps_.vel(i);
+        check_collision(i);
+
+        vel_.row(ps_.idx(i)) = ps_.vel(i).transpose();
+        X_.row(ps_.idx(i)) = ps_.x(i).transpose();
+    });
+}
+
 // ------------------------------- helper functions -----------------------
 // Basic collision detection and process
-void SPHBase::check_collision(const std::shared_ptr<Particle>& p)
+void SPHBase::check_collision(unsigned i)
 {
     // coefficient of restitution, you can make this parameter adjustable in the UI 
     double restitution = 0.2; 
@@ -170,14 +223,16 @@ void SPHBase::check_collision(const std::shared_ptr<Particle>& p)
     // add epsilon offset to avoid particles sticking to the boundary
     Vector3d eps_ = 0.0001 * (box_max_ - box_min_);
 
-    for (int i = 0; i < 3; i++) {
-        if (p->x()[i] < box_min_[i]) {
-            p->x()[i] = box_min_[i] + eps_[i];
-            p->vel()[i] = -restitution * p->vel()[i];
+    Vector3d& x = ps_.x(i);
+    Vector3d& vel = ps_.vel(i);
+    for (int d = 0; d < 3; d++) {
+        if (x[d] < box_min_[d]) {
+            x[d] = box_min_[d] + eps_[d];
+            vel[d] = -restitution * vel[d];
         }
-        if (p->x()[i] > box_max_[i]) {
-            p->x()[i] = box_max_[i] - eps_[i];
-            p->vel()[i] = -restitution * p->vel()[i];
+        if (x[d] > box_max_[d]) {
+            x[d] = box_max_[d] - eps_[d];
+            vel[d] = -restitution * vel[d];
         }
     }
 }
@@ -208,10 +263,51 @@ void SPHBase::reset()
     X_ = init_X_;
     vel_ = MatrixXd::Zero(X_.rows(), X_.cols());
 
-    for (auto& p : ps_.particles()) {
-        p->vel() = Vector3d::Zero();
-        p->x() = init_X_.row(p->idx()).transpose();
+    for (unsigned i = 0; i < ps_.size(); i++) {
+        ps_.vel(i) = Vector3d::Zero();
+        ps_.x(i) = init_X_.row(ps_.idx(i)).transpose();
+    }
+}
+
+Eigen::VectorXd SPHBase::getDensity()
+{
+    VectorXd density(ps_.size());
+    for (unsigned i = 0; i < ps_.size(); i++) {
+        density[ps_.idx(i)] = ps_.density(i);
+    }
+    return density;
+}
+
+SPHBase::State SPHBase::save_state()
+{
+    State state{ X_, vel_, MatrixXd(ps_.size(), 3), VectorXd(ps_.size()) };
+    for (unsigned i = 0; i < ps_.size(); i++) {
+        state.acceleration.row(ps_.idx(i)) = ps_.acceleration(i).transpose();
+        state.pressure[ps_.idx(i)] = ps_.pressure(i);
+    }
+    return state;
+}
+
+bool SPHBase::can_restore_state(const State& state) const
+{
+    return state.X.rows() == ps_.size() && state.pressure.size() == ps_.size();
+}
+
+bool SPHBase::restore_state(const State& state)
+{
+    if (!can_restore_state(state)) {
+        return false;
+    }
+    X_ = state.X;
+    vel_ = state.vel;
+    // The neighbor lists are checked against the restored positions at the next search.
+    for (unsigned i = 0; i < ps_.size(); i++) {
+        ps_.x(i) = X_.row(ps_.idx(i)).transpose();
+        ps_.vel(i) = vel_.row(ps_.idx(i)).transpose();
+        ps_.acceleration(i) = state.acceleration.row(ps_.idx(i)).transpose();
+        ps_.pressure(i) = state.pressure[ps_.idx(i)];
     }
+    return true;
 }
 
 // ---------------------------------------------------------------------------------------
@@ -1,6 +1,8 @@
 #pragma once 
 #include <Eigen/Dense>
 #include "particle_system.h"
+#include "sph_kernel.h"
+#include <algorithm>
 #include <memory>
 #include <chrono>
 
@@ -24,6 +26,27 @@ class SPHBase {
     virtual void step();
     virtual void reset();
 
+    // What a step changes, to checkpoint the simulation and set it back. By particle index, as
+    // the slots are reordered from one step to the next. The pressures are the ones IISPH starts
+    // its next solve from.
+    struct State {
+        Eigen::MatrixXd X;
+        Eigen::MatrixXd vel;
+        Eigen::MatrixXd acceleration;
+        Eigen::VectorXd pressure;
+    };
+    State save_state();
+    // False if the state is for another number of particles. restore_state then changes nothing.
+    bool can_restore_state(const State& state) const;
+    bool restore_state(const State& state);
+
+    // Steps through the given time with as few steps as the CFL condition allows, each at most
+    // dt() long, then restores dt().
+    void advance(double duration);
+    // Largest step for which no particle moves more than cfl_number() particle diameters, from
+    // its velocity or from its last acceleration.
+    double cfl_time_step();
+
     inline Eigen::MatrixXd getX() const
     {
         return X_;
@@ -32,6 +55,8 @@ class SPHBase {
     {
         return vel_;
     };
+    // Densities of the last step, by particle index.
+    Eigen::VectorXd getDensity();
 
     // SPH kernel function: h is the support radius, instead of time step size 
     static double W(const Eigen::Vector3d& r, double h);
@@ -41,17 +66,13 @@ class SPHBase {
     // SPH functions
     virtual void compute_density();
 
-    virtual Vector3d compute_viscosity_acceleration(
-        const std::shared_ptr<Particle>& p,
-        const std::shared_ptr<Particle>& q);
-
     virtual void compute_pressure_gradient_acceleration();
 
     virtual void compute_non_pressure_acceleration();
 
     virtual void compute_pressure();
 
-    virtual void check_collision(const std::shared_ptr<Particle>& p);
+    virtual void check_collision(unsigned i);
 
     virtual void advect();
 
@@ -71,6 +92,20 @@ class SPHBase {
 	{
 		return gravity_;
 	}
+    double& cfl_number()
+    {
+        return cfl_number_;
+    }
+
+    // Steps taken by the last advance(), and the shortest of them.
+    int last_substeps() const
+    {
+        return last_substeps_;
+    }
+    double last_min_dt() const
+    {
+        return last_min_dt_;
+    }
 
     Vector3d gravity_ = Vector3d(0, 0, -9.8);
 
@@ -82,14 +117,117 @@ class SPHBase {
     MatrixXd get_vel_color_jet(); 
    
   protected:
+    // The per-particle loops are templates over what they do with each particle, so that the
+    // solvers plug into them without a virtual call per particle or per pair.
+
+    // Calls f(i) for every slot, in parallel.
+    template<typename F>
+    void for_each_particle(F&& f);
+    // Calls f(batch) for the neighbors of slot i, kBatchSize at a time.
+    template<typename F>
+    void for_each_neighbor_batch(unsigned i, F&& f);
+    // Sums the density of every particle, then calls finish(i) while it is still in cache.
+    template<typename Finish>
+    void sum_density(Finish&& finish);
+    // Calls out(i, a) with the pressure acceleration of every particle,
+    // a = -sum_j m (p_i / rho_i^2 + p_j / rho_j^2) grad W_ij.
+    template<typename Out>
+    void for_each_pressure_acceleration(Out&& out);
+
     ParticleSystem ps_;
     double dt_ = 0.005;  // You can adjust this parameter in the UI of node "SPH Fluid"
     double viscosity_ = 0.03; // You can adjust this parameter in the UI of node "SPH Fluid"
+    double cfl_number_ = 0.4;
+
+    int last_substeps_ = 0;
+    double last_min_dt_ = 0;
 
     Vector3d box_min_, box_max_; // simulation box area
 
     Eigen::MatrixXd init_X_;
     Eigen::MatrixXd X_;
     Eigen::MatrixXd vel_;
+
+   private:
+    std::vector<Real> pressure_over_density2_;
 };
+
+template<typename F>
+void SPHBase::for_each_particle(F&& f)
+{
+    pxr::WorkParallelForN(ps_.size(), [&f](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            f(unsigned(i));
+        }
+    });
+}
+
+template<typename F>
+void SPHBase::for_each_neighbor_batch(unsigned i, F&& f)
+{
+    const Vector3d x_i = ps_.x(i);
+    const Real far = Real(2 * ps_.h());
+    const auto neighbors = ps_.neighbors(i);
+
+    NeighborBatch batch;
+    for (size_t first = 0; first < neighbors.size(); first += kBatchSize) {
+        batch.count = int(std::min<size_t>(kBatchSize, neighbors.size() - first));
+        for (int l = 0; l < kBatchSize; l++) {
+            if (l < batch.count) {
+                const unsigned j = neighbors[first + l];
+                const Vector3d d = x_i - ps_.x(j);
+                batch.j[l] = j;
+                batch.dx[l] = Real(d[0]);
+                batch.dy[l] = Real(d[1]);
+                batch.dz[l] = Real(d[2]);
+            }
+            else {
+                batch.j[l] = i;
+                batch.dx[l] = far;
+                batch.dy[l] = 0;
+                batch.dz[l] = 0;
+            }
+        }
+        batch.r2 = batch.dx * batch.dx + batch.dy * batch.dy + batch.dz * batch.dz;
+        f(batch);
+    }
+}
+
+template<typename Finish>
+void SPHBase::sum_density(Finish&& finish)
+{
+    const CubicKernel kernel(ps_.h());
+    const double m = ps_.mass();
+    for_each_particle([&](unsigned i) {
+        Batch sum = Batch::Zero();
+        for_each_neighbor_batch(i, [&](const NeighborBatch& batch) { sum += kernel.W(batch.r2); });
+        ps_.density(i) = m * double(kernel.W_zero() + sum.sum());
+        finish(i);
+    });
+}
+
+template<typename Out>
+void SPHBase::for_each_pressure_acceleration(Out&& out)
+{
+    const CubicKernel kernel(ps_.h());
+    const Real m = Real(ps_.mass());
+
+    pressure_over_density2_.resize(ps_.size());
+    for_each_particle([&](unsigned i) {
+        pressure_over_density2_[i] = Real(ps_.pressure(i) / (ps_.density(i) * ps_.density(i)));
+    });
+
+    for_each_particle([&](unsigned i) {
+        const Real p_i = pressure_over_density2_[i];
+        Batch ax = Batch::Zero(), ay = Batch::Zero(), az = Batch::Zero();
+        for_each_neighbor_batch(i, [&](const NeighborBatch& batch) {
+            const Batch p_j = gather(batch, [&](unsigned j) { return pressure_over_density2_[j]; });
+            const Batch s = -m * (p_i + p_j) * kernel.grad_factor(batch.r2);
+            ax += s * batch.dx;
+            ay += s * batch.dy;
+            az += s * batch.dz;
+        });
+        out(i, Vector3d(ax.sum(), ay.sum(), az.sum()));
+    });
+}
 }  // namespace USTC_CG::node_sph_fluid
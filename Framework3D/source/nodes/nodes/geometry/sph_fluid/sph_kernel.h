@@ -0,0 +1,78 @@
+#pragma once
+#include <Eigen/Dense>
+#include <array>
+
+namespace USTC_CG::node_sph_fluid {
+
+// Precision of the kernel evaluations. Positions are always stored in double; with float here,
+// the pair offsets, kernel values and per-pair terms are computed in single precision.
+using Real = double;
+
+// Neighbors are processed this many at a time as Eigen arrays, which compile to SSE, AVX2 or
+// AVX-512 packets depending on the target, see USTC_CG_NATIVE_ARCH in the top-level CMakeLists.
+constexpr int kBatchSize = 8;
+using Batch = Eigen::Array<Real, kBatchSize, 1>;
+
+// The instruction set the batches were compiled for, e.g. "AVX2".
+const char* simd_instruction_set();
+
+// Neighbors of one particle, in structure-of-arrays form. The lanes past count repeat the
+// particle itself and are placed out of the support radius, so every kernel value there is zero.
+struct NeighborBatch {
+    int count;
+    std::array<unsigned, kBatchSize> j;
+    // x_i - x_j
+    Batch dx, dy, dz;
+    Batch r2;
+};
+
+// Reads a value of every neighbor of the batch.
+template<typename F>
+Batch gather(const NeighborBatch& batch, F&& value_of)
+{
+    Batch values;
+    for (int l = 0; l < kBatchSize; l++) {
+        values[l] = Real(value_of(batch.j[l]));
+    }
+    return values;
+}
+
+// The cubic spline kernel of SPHBase::W and SPHBase::grad_W for a fixed support radius h, with
+// its constants folded in. Written without branches, so that a batch evaluates lane-parallel:
+//     W = k (2 max(1 - q, 0)^3 - 8 max(1/2 - q, 0)^3),  q = |r| / h
+class CubicKernel {
+   public:
+    explicit CubicKernel(double h) : inv_h_(Real(1.0 / h)), k_(Real(8.0 / (EIGEN_PI * h * h * h)))
+    {
+    }
+
+    Real W_zero() const
+    {
+        return k_;
+    }
+
+    Batch W(const Batch& r2) const
+    {
+        const Batch q = r2.sqrt() * inv_h_;
+        const Batch a = (Real(1) - q).max(Real(0));
+        const Batch b = (Real(0.5) - q).max(Real(0));
+        return k_ * (Real(2) * a * a * a - Real(8) * b * b * b);
+    }
+
+    // grad W(r) = grad_factor(|r|^2) * r. It goes to zero with r, so coincident particles are
+    // harmless.
+    Batch grad_factor(const Batch& r2) const
+    {
+        const Batch r = r2.sqrt();
+        const Batch q = r * inv_h_;
+        const Batch a = (Real(1) - q).max(Real(0));
+        const Batch b = (Real(0.5) - q).max(Real(0));
+        const Batch dW_dq = k_ * (Real(24) * b * b - Real(6) * a * a);
+        return dW_dq * inv_h_ / r.max(Real(1e-9));
+    }
+
+   private:
+    Real inv_h_;
+    Real k_;
+};
+}  // namespace USTC_CG::node_sph_fluid
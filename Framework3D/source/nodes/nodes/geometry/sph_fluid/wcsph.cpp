@@ -1,4 +1,6 @@
 #include "wcsph.h"
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 using namespace Eigen;
 
@@ -11,23 +13,23 @@ WCSPH::WCSPH(const MatrixXd& X, const Vector3d& box_min, const Vector3d& box_max
 
 void WCSPH::compute_density()
 {
-	// -------------------------------------------------------------
-	// (HW TODO) Implement the density computation
-    // You can also compute pressure in this function 
-	// -------------------------------------------------------------
+    // Tait equation. Negative pressures would pull the particles together, so they are clamped.
+    const double density0 = ps_.density0();
+    sum_density([this, density0](unsigned i) {
+        double pressure = stiffness_ * (std::pow(ps_.density(i) / density0, exponent_) - 1.0);
+        ps_.pressure(i) = std::max(pressure, 0.0);
+    });
 }
 
 void WCSPH::step()
 {
     TIC(step)
-    // -------------------------------------------------------------
-    // (HW TODO) Follow the instruction in documents and PPT, 
-    // implement the pipeline of fluid simulation 
-    // -------------------------------------------------------------
-
-	// Search neighbors, compute density, advect, solve pressure acceleration, etc. 
-
 
+    ps_.search_neighbors();
+    compute_density();
+    compute_non_pressure_acceleration();
+    compute_pressure_gradient_acceleration();
+    advect();
 
     TOC(step)
 }
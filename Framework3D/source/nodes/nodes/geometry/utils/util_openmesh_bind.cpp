@@ -3,7 +3,7 @@
 #include "GCore/Components/MeshOperand.h"
 
 USTC_CG_NAMESPACE_OPEN_SCOPE
-std::shared_ptr<PolyMesh> operand_to_openmesh(GOperandBase* mesh_oeprand)
+std::shared_ptr<PolyMesh> operand_to_openmesh(const GOperandBase* mesh_oeprand)
 {
     auto openmesh = std::make_shared<PolyMesh>();
     auto topology = mesh_oeprand->get_component<MeshComponent>();
@@ -16,8 +16,9 @@ std::shared_ptr<PolyMesh> operand_to_openmesh(GOperandBase* mesh_oeprand)
         openmesh->add_vertex(v);
     }
 
-    auto faceVertexIndices = topology->faceVertexIndices;
-    auto faceVertexCounts = topology->faceVertexCounts;
+    // Only read through const references, so the arrays stay shared with the input.
+    const auto& faceVertexIndices = topology->faceVertexIndices;
+    const auto& faceVertexCounts = topology->faceVertexCounts;
 
     int vertexIndex = 0;
     for (int i = 0; i < faceVertexCounts.size(); i++) {
@@ -33,10 +33,11 @@ bool EagerNodeTreeExecutorRender::execute_node(NodeTree* tree, Node* node)
 {
     if (EagerNodeTreeExecutor::execute_node(tree, node)) {
         for (auto&& input : node->inputs) {
-            if (!node->typeinfo->ALWAYS_REQUIRED && input_states[index_cache[input]].is_last_used) {
-                if (input_states[index_cache[input]].value.get())
-                    resource_allocator.destroy(input_states[index_cache[input]].value);
-                input_states[index_cache[input]].is_last_used = false;
+            auto& input_state = input_states[runtime_index(input)];
+            if (!node->typeinfo->ALWAYS_REQUIRED && input_state.is_last_used) {
+                if (input_state.value.get())
+                    resource_allocator.destroy(input_state.value);
+                input_state.is_last_used = false;
             }
         }
         return true;
@@ -44,8 +45,9 @@ bool EagerNodeTreeExecutorRender::execute_node(NodeTree* tree, Node* node)
     else {
         for (auto&& output : node->outputs) {
             {
-                if (output_states[index_cache[output]].value.get())
-                    resource_allocator.destroy(output_states[index_cache[output]].value);
+                auto& output_state = output_states[runtime_index(output)];
+                if (output_state.value.get())
+                    resource_allocator.destroy(output_state.value);
             }
         }
     }
@@ -13,6 +13,8 @@ inline void render_node_type_base(NodeTypeInfo* ntype)
     ntype->color[3] = 1.0f;
 
     ntype->node_type_of_grpah = NodeTypeOfGrpah::Render;
+    // They all talk to the GL context of the calling thread.
+    ntype->THREAD_UNSAFE = true;
 }
 
 inline Hd_USTC_CG_Camera* get_free_camera(ExeParams& params)
@@ -53,6 +53,10 @@ void NodeWindow::BuildUI()
 
         geonode_system->set_required_time_code(time_code_to_render);
     }
+    else if (time_code_to_render < geonode_system->cached_first_time_code()) {
+        // Made again from the checkpoint before it.
+        geonode_system->set_required_time_code(time_code_to_render);
+    }
 
     file_viewer->ShowFileTree();
     file_viewer->ShowPrimInfo();
@@ -0,0 +1,221 @@
+#include <gtest/gtest.h>
+
+#include "nodes/nodes/geometry/mass_spring/FastMassSpring.h"
+#include "nodes/nodes/geometry/mass_spring/MassSpring.h"
+
+using namespace USTC_CG::node_mass_spring;
+
+// An n x n grid in the xy plane, and its edges.
+static std::pair<Eigen::MatrixXd, EdgeSet> make_grid(int n)
+{
+    Eigen::MatrixXd V(n * n, 3);
+    Eigen::MatrixXi F(2 * (n - 1) * (n - 1), 3);
+    int f = 0;
+    for (int i = 0; i < n; ++i) {
+        for (int j = 0; j < n; ++j) {
+            V.row(i * n + j) << double(j) / (n - 1), double(i) / (n - 1), 0;
+            if (i < n - 1 && j < n - 1) {
+                int v = i * n + j;
+                F.row(f++) << v, v + 1, v + n + 1;
+                F.row(f++) << v, v + n + 1, v + n;
+            }
+        }
+    }
+    return { V, get_edges(F) };
+}
+
+// An n x n cloth hanging from two corners.
+static MassSpring make_cloth(int n)
+{
+    auto [V, E] = make_grid(n);
+    return MassSpring(V, E);
+}
+
+TEST(MassSpring, AdaptiveStepsStayStable)
+{
+    // h is well past the stability limit of semi-implicit Euler for this stiffness.
+    MassSpring fixed = make_cloth(12);
+    fixed.time_integrator = MassSpring::SEMI_IMPLICIT_EULER;
+    fixed.h = 0.01;
+    for (int i = 0; i < 100; ++i) {
+        fixed.step();
+    }
+    EXPECT_FALSE(fixed.getX().allFinite());
+
+    MassSpring adaptive = make_cloth(12);
+    adaptive.time_integrator = MassSpring::SEMI_IMPLICIT_EULER;
+    adaptive.h = 0.01;
+    for (int frame = 0; frame < 24; ++frame) {
+        adaptive.advance(1.0 / 24);
+    }
+    EXPECT_TRUE(adaptive.getX().allFinite());
+    EXPECT_GT(adaptive.last_substeps, 5);
+    EXPECT_DOUBLE_EQ(adaptive.h, 0.01);
+}
+
+// Implicit Euler is stable at any step, so the frames soon take one step each.
+TEST(MassSpring, ImplicitTakesFullSteps)
+{
+    MassSpring cloth = make_cloth(12);
+    cloth.time_integrator = MassSpring::IMPLICIT_EULER;
+    cloth.h = 0.05;
+    int substeps = 0;
+    for (int frame = 0; frame < 24; ++frame) {
+        cloth.advance(1.0 / 24);
+        substeps += cloth.last_substeps;
+    }
+    EXPECT_EQ(cloth.last_substeps, 1);
+    EXPECT_LT(substeps, 48);
+    EXPECT_TRUE(cloth.getX().allFinite());
+    EXPECT_LT(cloth.getX().col(2).minCoeff(), -0.1);
+}
+
+// Set back to a checkpoint, the cloth goes through the same frames again, adaptive steps included.
+TEST(MassSpring, SetStateReplaysFrames)
+{
+    MassSpring cloth = make_cloth(12);
+    cloth.time_integrator = MassSpring::SEMI_IMPLICIT_EULER;
+    cloth.h = 0.01;
+    for (int frame = 0; frame < 10; ++frame) {
+        cloth.advance(1.0 / 24);
+    }
+    auto state = cloth.getState();
+    for (int frame = 0; frame < 10; ++frame) {
+        cloth.advance(1.0 / 24);
+    }
+    Eigen::MatrixXd X = cloth.getX();
+    int substeps = cloth.last_substeps;
+
+    EXPECT_TRUE(cloth.setState(state));
+    for (int frame = 0; frame < 10; ++frame) {
+        cloth.advance(1.0 / 24);
+    }
+    EXPECT_TRUE(cloth.getX() == X);
+    EXPECT_EQ(cloth.last_substeps, substeps);
+
+    EXPECT_FALSE(cloth.setState(make_cloth(4).getState()));
+    EXPECT_TRUE(cloth.getX() == X);
+}
+
+// Run to convergence, the local/global iterations find the implicit Euler step, which one Newton
+// step also reaches closely from rest. A new h takes a new factorization, the old ones are kept.
+TEST(MassSpring, FastMassSpringMatchesImplicitEuler)
+{
+    MassSpring implicit = make_cloth(8);
+    implicit.time_integrator = MassSpring::IMPLICIT_EULER;
+    implicit.enable_damping = false;
+    implicit.h = 0.01;
+    implicit.step();
+
+    auto [V, E] = make_grid(8);
+    FastMassSpring fast(V, E, implicit.stiffness, 0.01);
+    fast.enable_damping = false;
+    fast.max_iter = 200;
+    fast.step();
+    EXPECT_LT((fast.getX() - implicit.getX()).cwiseAbs().maxCoeff(), 1e-5);
+
+    for (int i = 0; i < 10; ++i) {
+        fast.step();
+    }
+    EXPECT_EQ(fast.factorizations(), 1u);
+    const double h = fast.h;
+    fast.h = 0.005;
+    fast.step();
+    EXPECT_EQ(fast.factorizations(), 2u);
+    fast.h = h;
+    fast.step();
+    EXPECT_EQ(fast.factorizations(), 2u);
+    EXPECT_TRUE(fast.getX().allFinite());
+}
+
+// The adaptive steps only take a few sizes, whose factorizations are all kept: once they are
+// there, frames don't factor anything.
+TEST(MassSpring, FastMassSpringReusesFactorizations)
+{
+    auto [V, E] = make_grid(12);
+    FastMassSpring cloth(V, E, 1000, 0.01);
+    cloth.max_iter = 20;
+    for (int frame = 0; frame < 10; ++frame) {
+        cloth.advance(1.0 / 24);
+    }
+    const unsigned factorizations = cloth.factorizations();
+    EXPECT_LE(factorizations, 12u);
+
+    for (int frame = 0; frame < 20; ++frame) {
+        cloth.advance(1.0 / 24);
+        EXPECT_EQ(cloth.factorizations(), factorizations) << "frame " << frame;
+    }
+    EXPECT_TRUE(cloth.getX().allFinite());
+}
+
+// A sheet dropped onto a ground plane comes to rest on it, the penalty holding its weight a
+// fraction of the thickness deep. The pairs are only searched for now and then.
+TEST(MassSpring, ClothRestsOnObstacle)
+{
+    const double ground = -0.1, thickness = 0.02;
+    auto [V, E] = make_grid(8);
+    Eigen::MatrixXd ground_V(4, 3);
+    ground_V << -1, -1, ground, 2, -1, ground, 2, 2, ground, -1, 2, ground;
+    Eigen::MatrixXi ground_F(2, 3);
+    ground_F << 0, 1, 2, 0, 2, 3;
+
+    MassSpring cloth(V, E);
+    cloth.set_dirichlet_bc_mask(std::vector<bool>(V.rows(), false));
+    cloth.h = 0.0025;
+    cloth.collision_penalty_k = 2e4;
+    cloth.collision_thickness = thickness;
+    cloth.enable_mesh_collision = true;
+    cloth.set_obstacle(ground_V, ground_F);
+
+    const int steps = 400;
+    for (int i = 0; i < steps; ++i) {
+        cloth.step();
+    }
+    const Eigen::VectorXd height = cloth.getX().col(2).array() - ground;
+    ASSERT_TRUE(height.allFinite());
+    EXPECT_LT(cloth.getVelocity().rowwise().norm().maxCoeff(), 1e-3);
+    EXPECT_NEAR(height.minCoeff(), thickness, 0.1 * thickness);
+    EXPECT_NEAR(height.maxCoeff(), thickness, 0.1 * thickness);
+    EXPECT_GT(cloth.getCollision().contacts(), 0u);
+    EXPECT_LT(cloth.getCollision().rebuilds(), steps / 4u);
+}
+
+// A sheet dropped onto a fixed sheet of the same mesh comes to rest on top of it.
+TEST(MassSpring, ClothRestsOnItself)
+{
+    const int n = 8;
+    const double gap = 0.1, thickness = 0.02;
+    auto [V, E] = make_grid(n);
+    Eigen::MatrixXd sheets(2 * n * n, 3);
+    sheets << V, V;
+    sheets.bottomRows(n * n).col(2).array() += gap;
+    Eigen::MatrixXi F(4 * (n - 1) * (n - 1), 3);
+    for (int sheet = 0, f = 0; sheet < 2; ++sheet) {
+        for (int i = 0; i < n - 1; ++i) {
+            for (int j = 0; j < n - 1; ++j) {
+                int v = sheet * n * n + i * n + j;
+                F.row(f++) << v, v + 1, v + n + 1;
+                F.row(f++) << v, v + n + 1, v + n;
+            }
+        }
+    }
+    std::vector<bool> fixed(2 * n * n, false);
+    std::fill(fixed.begin(), fixed.begin() + n * n, true);
+
+    MassSpring cloth(sheets, get_edges(F));
+    cloth.set_dirichlet_bc_mask(fixed);
+    cloth.h = 0.0025;
+    cloth.collision_penalty_k = 2e4;
+    cloth.collision_thickness = thickness;
+    cloth.enable_self_collision = true;
+    cloth.set_collision_faces(F);
+
+    for (int i = 0; i < 400; ++i) {
+        cloth.step();
+    }
+    const Eigen::VectorXd upper = cloth.getX().bottomRows(n * n).col(2);
+    ASSERT_TRUE(upper.allFinite());
+    EXPECT_LT(cloth.getVelocity().rowwise().norm().maxCoeff(), 1e-3);
+    EXPECT_NEAR(upper.minCoeff(), thickness, 0.1 * thickness);
+    EXPECT_NEAR(upper.maxCoeff(), thickness, 0.1 * thickness);
+}
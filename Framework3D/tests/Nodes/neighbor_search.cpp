@@ -0,0 +1,147 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <numeric>
+#include <random>
+
+#include "nodes/nodes/geometry/sph_fluid/neighbor_search.h"
+
+using namespace USTC_CG::node_sph_fluid;
+using Eigen::Vector3d;
+
+static const Vector3d box_min(0, 0, 0), box_max(1, 1, 1);
+static const double radius = 0.1;
+
+// Particles spread over the box, some a little outside of it where the cells are clamped.
+static std::vector<Vector3d> random_particles(std::mt19937& rng, size_t n)
+{
+    std::uniform_real_distribution<double> coordinate(-0.05, 1.05);
+    std::vector<Vector3d> x(n);
+    for (auto& p : x) {
+        p = Vector3d(coordinate(rng), coordinate(rng), coordinate(rng));
+    }
+    return x;
+}
+
+// The slots within the distance of slot i, by brute force.
+static std::vector<unsigned>
+brute_force_neighbors(const std::vector<Vector3d>& x, unsigned i, double distance)
+{
+    std::vector<unsigned> neighbors;
+    for (unsigned j = 0; j < x.size(); ++j) {
+        if (j != i && (x[i] - x[j]).squaredNorm() < distance * distance) {
+            neighbors.push_back(j);
+        }
+    }
+    return neighbors;
+}
+
+static std::vector<unsigned> sorted_neighbors(const NeighborSearch& search, unsigned i)
+{
+    auto span = search.neighbors(i);
+    std::vector<unsigned> neighbors(span.begin(), span.end());
+    std::sort(neighbors.begin(), neighbors.end());
+    return neighbors;
+}
+
+// Sorts the particles as the particle system does, then builds the lists.
+static void sort_and_build(NeighborSearch& search, std::vector<Vector3d>& x)
+{
+    std::vector<unsigned> order;
+    search.sort(x, order);
+
+    std::vector<unsigned> slots(order);
+    std::sort(slots.begin(), slots.end());
+    std::vector<unsigned> identity(x.size());
+    std::iota(identity.begin(), identity.end(), 0u);
+    ASSERT_EQ(slots, identity);
+
+    std::vector<Vector3d> sorted(x.size());
+    for (size_t i = 0; i < x.size(); ++i) {
+        sorted[i] = x[order[i]];
+    }
+    x.swap(sorted);
+
+    // In Morton order, a cell's particles are contiguous.
+    for (size_t i = 1; i < x.size(); ++i) {
+        ASSERT_LE(
+            NeighborSearch::morton_key(search.cell_xyz(x[i - 1])),
+            NeighborSearch::morton_key(search.cell_xyz(x[i])));
+    }
+    search.build(x);
+}
+
+// Freshly built, the lists hold exactly the particles within radius + skin.
+TEST(NeighborSearch, MatchesBruteForce)
+{
+    std::mt19937 rng(3);
+    auto x = random_particles(rng, 2000);
+    NeighborSearch search(box_min, box_max, radius);
+    sort_and_build(search, x);
+    EXPECT_FALSE(search.needs_rebuild(x));
+
+    size_t pairs = 0;
+    for (unsigned i = 0; i < x.size(); ++i) {
+        auto expected = brute_force_neighbors(x, i, radius + search.skin());
+        ASSERT_EQ(sorted_neighbors(search, i), expected) << "particle " << i;
+        pairs += expected.size();
+    }
+    EXPECT_GT(pairs, x.size());
+}
+
+// While no particle has moved half the skin, the old lists still hold every pair within the
+// radius. Once one has, the lists are rebuilt and exact again.
+TEST(NeighborSearch, SkinKeepsListsValid)
+{
+    std::mt19937 rng(5);
+    auto x = random_particles(rng, 1000);
+    NeighborSearch search(box_min, box_max, radius);
+    sort_and_build(search, x);
+
+    std::uniform_real_distribution<double> step(-0.1 * search.skin(), 0.1 * search.skin());
+    int reused = 0, rebuilt = 0;
+    for (int s = 0; s < 20; ++s) {
+        for (auto& p : x) {
+            p += Vector3d(step(rng), step(rng), step(rng));
+        }
+
+        if (search.needs_rebuild(x)) {
+            sort_and_build(search, x);
+            rebuilt++;
+            for (unsigned i = 0; i < x.size(); ++i) {
+                ASSERT_EQ(
+                    sorted_neighbors(search, i),
+                    brute_force_neighbors(x, i, radius + search.skin()));
+            }
+            continue;
+        }
+
+        reused++;
+        for (unsigned i = 0; i < x.size(); ++i) {
+            auto listed = sorted_neighbors(search, i);
+            for (unsigned j : brute_force_neighbors(x, i, radius)) {
+                ASSERT_TRUE(std::binary_search(listed.begin(), listed.end(), j))
+                    << "step " << s << ": " << j << " missing from the list of " << i;
+            }
+        }
+    }
+    EXPECT_GT(reused, 0);
+    EXPECT_GT(rebuilt, 0);
+}
+
+// A new skin makes the lists stale, whatever the positions.
+TEST(NeighborSearch, SetSkinForcesRebuild)
+{
+    std::mt19937 rng(7);
+    auto x = random_particles(rng, 200);
+    NeighborSearch search(box_min, box_max, radius);
+    sort_and_build(search, x);
+    EXPECT_FALSE(search.needs_rebuild(x));
+
+    search.set_skin(0.3 * radius);
+    EXPECT_TRUE(search.needs_rebuild(x));
+    sort_and_build(search, x);
+    for (unsigned i = 0; i < x.size(); ++i) {
+        ASSERT_EQ(sorted_neighbors(search, i), brute_force_neighbors(x, i, 1.3 * radius));
+    }
+}
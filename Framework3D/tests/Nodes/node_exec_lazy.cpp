@@ -0,0 +1,202 @@
+#include <gtest/gtest.h>
+
+#include "Nodes/node.hpp"
+#include "Nodes/node_declare.hpp"
+#include "Nodes/node_exec_lazy.hpp"
+#include "Nodes/node_exec_parallel.hpp"
+#include "Nodes/node_register.h"
+#include "Nodes/node_tree.hpp"
+#include "Nodes/pin.hpp"
+#include "test_node_types.hpp"
+
+using namespace USTC_CG;
+
+static int source_a_runs = 0;
+static int source_b_runs = 0;
+static int selector_value = 0;
+static float sink_value = 0;
+
+static void source_declare(NodeDeclarationBuilder& b)
+{
+    b.add_output<decl::Float>("Out");
+}
+
+static void selector_declare(NodeDeclarationBuilder& b)
+{
+    b.add_output<decl::Int>("Out");
+}
+
+static void switch_declare(NodeDeclarationBuilder& b)
+{
+    b.add_input<decl::Int>("Selector").default_val(0).min(0).max(1);
+    b.add_input<decl::Float>("A");
+    b.add_input<decl::Float>("B");
+    b.add_output<decl::Float>("Out");
+}
+
+static void sink_declare(NodeDeclarationBuilder& b)
+{
+    b.add_input<decl::Float>("In");
+}
+
+static void source_a_exec(ExeParams params)
+{
+    source_a_runs++;
+    params.set_output("Out", 1.0f);
+}
+
+static void source_b_exec(ExeParams params)
+{
+    source_b_runs++;
+    params.set_output("Out", 2.0f);
+}
+
+static void selector_exec(ExeParams params)
+{
+    params.set_output("Out", selector_value);
+}
+
+static void switch_demand(DemandParams& params)
+{
+    params.need_input(params.get_input<int>("Selector") ? "B" : "A");
+}
+
+static void switch_exec(ExeParams params)
+{
+    auto selector = params.get_input<int>("Selector");
+    params.set_output("Out", params.get_input<float>(selector ? "B" : "A"));
+}
+
+static void sink_exec(ExeParams params)
+{
+    sink_value = params.get_input<float>("In");
+}
+
+static void register_types()
+{
+    auto uncached = [](NodeTypeInfo& type) { type.NO_CACHE = true; };
+    register_test_types(
+        { { "test_lazy_source_a", source_declare, source_a_exec, uncached },
+          { "test_lazy_source_b", source_declare, source_b_exec, uncached },
+          { "test_lazy_selector", selector_declare, selector_exec, uncached },
+          { "test_lazy_switch",
+            switch_declare,
+            switch_exec,
+            [](NodeTypeInfo& type) { type.demand_inputs = switch_demand; } },
+          { "test_lazy_sink",
+            sink_declare,
+            sink_exec,
+            [](NodeTypeInfo& type) { type.ALWAYS_REQUIRED = true; } } });
+}
+
+TEST(NodeExecLazy, OnlySelectedBranchRuns)
+{
+    register_types();
+
+    NodeTree tree;
+    Node* a = tree.nodeAddNode("test_lazy_source_a");
+    Node* b = tree.nodeAddNode("test_lazy_source_b");
+    Node* switch_node = tree.nodeAddNode("test_lazy_switch");
+    Node* sink = tree.nodeAddNode("test_lazy_sink");
+    tree.nodeAddLink(a, a->outputs[0], switch_node, switch_node->inputs[1]);
+    tree.nodeAddLink(b, b->outputs[0], switch_node, switch_node->inputs[2]);
+    tree.nodeAddLink(switch_node, switch_node->outputs[0], sink, sink->inputs[0]);
+
+    auto executor = CreateLazyNodeTreeExecutor();
+    source_a_runs = source_b_runs = 0;
+
+    executor->execute(&tree);
+    EXPECT_EQ(source_a_runs, 1);
+    EXPECT_EQ(source_b_runs, 0);
+    EXPECT_EQ(sink_value, 1.0f);
+    EXPECT_TRUE(switch_node->execution_failed.empty());
+
+    *static_cast<int*>(default_value_storage(switch_node->inputs[0])) = 1;
+    tree.MarkNodeDirty(switch_node);
+
+    executor->execute(&tree);
+    EXPECT_EQ(source_a_runs, 1);
+    EXPECT_EQ(source_b_runs, 1);
+    EXPECT_EQ(sink_value, 2.0f);
+}
+
+TEST(NodeExecLazy, UnconsumedNodesNeverRun)
+{
+    register_types();
+
+    NodeTree tree;
+    Node* a = tree.nodeAddNode("test_lazy_source_a");
+    Node* sink = tree.nodeAddNode("test_lazy_sink");
+    tree.nodeAddNode("test_lazy_source_b");
+    tree.nodeAddLink(a, a->outputs[0], sink, sink->inputs[0]);
+
+    auto executor = CreateLazyNodeTreeExecutor();
+    source_a_runs = source_b_runs = 0;
+
+    executor->execute(&tree);
+    EXPECT_EQ(source_a_runs, 1);
+    EXPECT_EQ(source_b_runs, 0);
+}
+
+// A source for each branch, and a switch whose selector comes from a node.
+struct SwitchTree {
+    NodeTree tree;
+    Node* a;
+    Node* b;
+    Node* switch_node;
+
+    SwitchTree()
+    {
+        a = tree.nodeAddNode("test_lazy_source_a");
+        b = tree.nodeAddNode("test_lazy_source_b");
+        Node* selector = tree.nodeAddNode("test_lazy_selector");
+        switch_node = tree.nodeAddNode("test_lazy_switch");
+        Node* sink = tree.nodeAddNode("test_lazy_sink");
+        tree.nodeAddLink(selector, selector->outputs[0], switch_node, switch_node->inputs[0]);
+        tree.nodeAddLink(a, a->outputs[0], switch_node, switch_node->inputs[1]);
+        tree.nodeAddLink(b, b->outputs[0], switch_node, switch_node->inputs[2]);
+        tree.nodeAddLink(switch_node, switch_node->outputs[0], sink, sink->inputs[0]);
+    }
+};
+
+static void expect_selected_branch_only(NodeTreeExecutor& executor)
+{
+    SwitchTree tree;
+    source_a_runs = source_b_runs = 0;
+
+    selector_value = 1;
+    executor.execute(&tree.tree);
+    EXPECT_EQ(source_a_runs, 0);
+    EXPECT_EQ(source_b_runs, 1);
+    EXPECT_EQ(sink_value, 2.0f);
+    EXPECT_TRUE(tree.switch_node->execution_failed.empty());
+    EXPECT_FALSE(tree.switch_node->MISSING_INPUT);
+
+    selector_value = 0;
+    executor.execute(&tree.tree);
+    EXPECT_EQ(source_a_runs, 1);
+    EXPECT_EQ(source_b_runs, 1);
+    EXPECT_EQ(sink_value, 1.0f);
+}
+
+TEST(NodeExecLazy, SelectorFromNode)
+{
+    register_types();
+    auto executor = CreateLazyNodeTreeExecutor();
+    expect_selected_branch_only(*executor);
+}
+
+// The eager executors honor demand_inputs as well, as the simulation one does through them.
+TEST(NodeExecLazy, EagerSkipsUnselectedBranch)
+{
+    register_types();
+    EagerNodeTreeExecutor executor;
+    expect_selected_branch_only(executor);
+}
+
+TEST(NodeExecLazy, ParallelSkipsUnselectedBranch)
+{
+    register_types();
+    auto executor = CreateParallelNodeTreeExecutor();
+    expect_selected_branch_only(*executor);
+}
@@ -0,0 +1,102 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <iostream>
+
+#include "Nodes/node.hpp"
+#include "Nodes/node_declare.hpp"
+#include "Nodes/node_exec_eager.hpp"
+#include "Nodes/node_exec_parallel.hpp"
+#include "Nodes/node_register.h"
+#include "Nodes/node_tree.hpp"
+#include "test_node_types.hpp"
+
+using namespace USTC_CG;
+
+// Measures what the executors cost on their own: every node here does nothing, so all the time
+// goes to compiling, preparing the memory, forwarding and the cache lookups.
+
+static void noop_declare(NodeDeclarationBuilder& b)
+{
+    b.add_input<decl::Float>("In");
+    b.add_output<decl::Float>("Out");
+}
+
+static void sink_declare(NodeDeclarationBuilder& b)
+{
+    b.add_input<decl::Float>("In");
+}
+
+static void noop_exec(ExeParams params)
+{
+}
+
+static void register_types()
+{
+    auto uncached = [](NodeTypeInfo& type) { type.NO_CACHE = true; };
+    auto always_required = [](NodeTypeInfo& type) { type.ALWAYS_REQUIRED = true; };
+    register_test_types({ { "test_noop", noop_declare, noop_exec },
+                          { "test_noop_uncached", noop_declare, noop_exec, uncached },
+                          { "test_sink", sink_declare, noop_exec, always_required } });
+}
+
+// `chains` independent chains of `length` nodes, each ending in a sink.
+static std::unique_ptr<NodeTree> make_tree(const char* id_name, int chains, int length)
+{
+    auto tree = std::make_unique<NodeTree>();
+    for (int c = 0; c < chains; ++c) {
+        Node* previous = tree->nodeAddNode(id_name);
+        for (int i = 1; i < length; ++i) {
+            Node* node = tree->nodeAddNode(id_name);
+            tree->nodeAddLink(previous, previous->outputs[0], node, node->inputs[0]);
+            previous = node;
+        }
+        Node* sink = tree->nodeAddNode("test_sink");
+        tree->nodeAddLink(previous, previous->outputs[0], sink, sink->inputs[0]);
+    }
+    return tree;
+}
+
+static void benchmark(
+    const char* label,
+    NodeTreeExecutor& executor,
+    const char* id_name,
+    int chains,
+    int length)
+{
+    auto tree = make_tree(id_name, chains, length);
+    constexpr int kRuns = 200;
+
+    executor.execute(tree.get());  // Warm up, fills the cache.
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < kRuns; ++i) {
+        executor.execute(tree.get());
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    for (auto&& node : tree->nodes) {
+        EXPECT_TRUE(node->execution_failed.empty());
+    }
+
+    double ns = std::chrono::duration<double, std::nano>(end - start).count();
+    std::cout << label << ": " << tree->nodes.size() << " nodes, "
+              << ns / kRuns / 1000.0 << " us per execution, "
+              << ns / kRuns / tree->nodes.size() << " ns per node" << std::endl;
+}
+
+TEST(NodeExecOverhead, Eager)
+{
+    register_types();
+    EagerNodeTreeExecutor executor;
+    benchmark("eager, uncached", executor, "test_noop_uncached", 4, 100);
+    benchmark("eager, cached", executor, "test_noop", 4, 100);
+}
+
+TEST(NodeExecOverhead, Parallel)
+{
+    register_types();
+    auto executor = CreateParallelNodeTreeExecutor();
+    benchmark("parallel, uncached", *executor, "test_noop_uncached", 4, 100);
+    benchmark("parallel, cached", *executor, "test_noop", 4, 100);
+}
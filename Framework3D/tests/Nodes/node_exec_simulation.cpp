@@ -0,0 +1,214 @@
+#include <gtest/gtest.h>
+
+#include <filesystem>
+
+#include "Nodes/node.hpp"
+#include "Nodes/node_declare.hpp"
+#include "Nodes/node_exec_simulation.hpp"
+#include "Nodes/node_register.h"
+#include "Nodes/node_tree.hpp"
+#include "Nodes/pin.hpp"
+#include "test_node_types.hpp"
+
+using namespace USTC_CG;
+
+static std::vector<float> sink_values;
+static bool count_restorable = true;
+
+static void accumulate_declare(NodeDeclarationBuilder& b)
+{
+    b.add_input<decl::Float>("In");
+    b.add_input<decl::Float>("Time");
+    b.add_output<decl::Float>("Out");
+}
+
+// One more than it stored the frame before, or 1 at the first frame.
+static void accumulate_exec(ExeParams params)
+{
+    float previous = params.get_input<float>("Time") == 0 ? 0 : params.get_input<float>("In");
+    params.set_output("Out", previous + 1);
+}
+
+static void count_declare(NodeDeclarationBuilder& b)
+{
+    b.add_input<decl::Int>("In");
+    b.add_input<decl::Float>("Time");
+    b.add_output<decl::Int>("Out");
+}
+
+static void count_exec(ExeParams params)
+{
+    int previous = params.get_input<float>("Time") == 0 ? 0 : params.get_input<int>("In");
+    params.set_output("Out", previous + 1);
+}
+
+static void sink_declare(NodeDeclarationBuilder& b)
+{
+    b.add_input<decl::Float>("In");
+}
+
+static void sink_exec(ExeParams params)
+{
+    sink_values.push_back(params.get_input<float>("In"));
+}
+
+static void register_types()
+{
+    register_test_types({ { "test_simulation_accumulate", accumulate_declare, accumulate_exec },
+                          { "test_simulation_count", count_declare, count_exec },
+                          { "test_simulation_sink",
+                            sink_declare,
+                            sink_exec,
+                            [](NodeTypeInfo& type) { type.ALWAYS_REQUIRED = true; } } });
+
+    // A count that can be told not to take its checkpoints back.
+    CheckpointFunctions functions;
+    functions.save = [](const void* value) -> std::shared_ptr<void> {
+        return std::make_shared<int>(*static_cast<const int*>(value));
+    };
+    functions.can_restore = [](const void*, const void*) { return count_restorable; };
+    functions.restore = [](const void* snapshot, void* value) {
+        *static_cast<int*>(value) = *static_cast<const int*>(snapshot);
+    };
+    functions.byte_size = [](const void*) { return sizeof(int); };
+    functions.write = [](const void* snapshot, std::ostream& out) {
+        write_checkpoint_value(out, *static_cast<const int*>(snapshot));
+    };
+    functions.read = [](std::istream& in) {
+        auto snapshot = std::make_shared<int>();
+        read_checkpoint_value(in, *snapshot);
+        return snapshot;
+    };
+    register_checkpoint_type(CPPType::get<int>(), std::move(functions));
+}
+
+// Two storages, 'a' for a float and 'b' for an int, each one more every frame. The sink gets
+// the float.
+class SimulationTree : public ::testing::Test {
+   protected:
+    void SetUp() override
+    {
+        register_types();
+        count_restorable = true;
+
+        Node* time = tree.nodeAddNode("geom_time_code");
+        Node* a = add_counter("test_simulation_accumulate", "a", time);
+        add_counter("test_simulation_count", "b", time);
+
+        Node* sink = tree.nodeAddNode("test_simulation_sink");
+        tree.nodeAddLink(a, a->outputs[0], sink, sink->inputs[0]);
+    }
+
+    // Storage out, a node counting on from it, and the storage in it goes back to.
+    Node* add_counter(const char* id_name, const char* name, Node* time)
+    {
+        Node* storage_out = tree.nodeAddNode("geom_storage_out");
+        Node* counter = tree.nodeAddNode(id_name);
+        Node* storage_in = tree.nodeAddNode("geom_storage_in");
+        *static_cast<std::string*>(default_value_storage(storage_out->inputs[0])) = name;
+        *static_cast<std::string*>(default_value_storage(storage_in->inputs[0])) = name;
+        tree.nodeAddLink(storage_out, storage_out->outputs[0], counter, counter->inputs[0]);
+        tree.nodeAddLink(time, time->outputs[0], counter, counter->inputs[1]);
+        tree.nodeAddLink(counter, counter->outputs[0], storage_in, storage_in->inputs[1]);
+        return counter;
+    }
+
+    // What the sink got at this frame.
+    float run_frame(int frame)
+    {
+        sink_values.clear();
+        executor.prepare_tree(&tree);
+        sync_time_code(&executor, &tree, float(frame));
+        executor.execute_tree(&tree);
+        executor.finalize(&tree);
+        EXPECT_EQ(sink_values.size(), 1);
+        return sink_values.empty() ? 0 : sink_values.back();
+    }
+
+    NodeTree tree;
+    EagerNodeTreeExecutorSimulation executor;
+};
+
+TEST_F(SimulationTree, RestoresByTimeCode)
+{
+    for (int frame = 0; frame < 5; ++frame) {
+        EXPECT_EQ(run_frame(frame), frame + 1);
+        executor.save_checkpoint(float(frame));
+    }
+    EXPECT_EQ(executor.checkpoint_count(), 5);
+
+    EXPECT_FALSE(executor.restore_checkpoint(-1));
+    // The latest one at or before the time code.
+    EXPECT_EQ(executor.restore_checkpoint(2.5f), 2.0f);
+    EXPECT_EQ(run_frame(3), 4);
+    EXPECT_EQ(executor.restore_checkpoint(0), 0.0f);
+    EXPECT_EQ(run_frame(1), 2);
+}
+
+TEST_F(SimulationTree, RestoresAllOrNothing)
+{
+    run_frame(0);
+    executor.save_checkpoint(0);
+    run_frame(1);
+
+    // 'b' can't take its snapshot back, so 'a' mustn't either.
+    count_restorable = false;
+    EXPECT_FALSE(executor.restore_checkpoint(0));
+    EXPECT_EQ(run_frame(2), 3);
+
+    count_restorable = true;
+    EXPECT_EQ(executor.restore_checkpoint(0), 0.0f);
+    EXPECT_EQ(run_frame(1), 2);
+}
+
+TEST_F(SimulationTree, DropsCheckpointsOverBudget)
+{
+    run_frame(0);
+    executor.save_checkpoint(0);
+    size_t checkpoint_size = executor.checkpoint_bytes();
+    ASSERT_GT(checkpoint_size, 0);
+    executor.checkpoint_budget = 3 * checkpoint_size;
+
+    for (int frame = 1; frame < 10; ++frame) {
+        run_frame(frame);
+        executor.save_checkpoint(float(frame));
+        EXPECT_LE(executor.checkpoint_bytes(), executor.checkpoint_budget);
+    }
+    EXPECT_EQ(executor.checkpoint_count(), 3);
+
+    // The newest one always stays.
+    EXPECT_EQ(executor.restore_checkpoint(9), 9.0f);
+    EXPECT_EQ(run_frame(10), 11);
+}
+
+TEST_F(SimulationTree, SpillsCheckpointsToDisk)
+{
+    auto directory = std::filesystem::temp_directory_path() / "node_exec_simulation_checkpoints";
+    std::filesystem::remove_all(directory);
+    executor.checkpoint_directory = directory.string();
+
+    run_frame(0);
+    executor.save_checkpoint(0);
+    executor.checkpoint_budget = executor.checkpoint_bytes();
+    for (int frame = 1; frame < 4; ++frame) {
+        run_frame(frame);
+        executor.save_checkpoint(float(frame));
+    }
+
+    // Only the newest one is left in memory; none is lost.
+    EXPECT_EQ(executor.checkpoint_count(), 4);
+    EXPECT_LE(executor.checkpoint_bytes(), executor.checkpoint_budget);
+    auto spilled = std::distance(
+        std::filesystem::directory_iterator(directory), std::filesystem::directory_iterator());
+    EXPECT_EQ(spilled, 3);
+
+    // Read back from its file.
+    EXPECT_EQ(executor.restore_checkpoint(1), 1.0f);
+    EXPECT_EQ(run_frame(2), 3);
+    EXPECT_EQ(executor.restore_checkpoint(0), 0.0f);
+    EXPECT_EQ(run_frame(1), 2);
+
+    executor.clear_checkpoints();
+    EXPECT_TRUE(std::filesystem::is_empty(directory));
+    std::filesystem::remove_all(directory);
+}
@@ -0,0 +1,198 @@
+#include <gtest/gtest.h>
+
+#include "Nodes/node.hpp"
+#include "Nodes/node_declare.hpp"
+#include "Nodes/node_exec_eager.hpp"
+#include "Nodes/node_exec_simulation.hpp"
+#include "Nodes/node_exec_wedge.hpp"
+#include "Nodes/node_register.h"
+#include "Nodes/node_tree.hpp"
+#include "Nodes/pin.hpp"
+#include "test_node_types.hpp"
+
+using namespace USTC_CG;
+
+static int source_runs = 0;
+static int scale_runs = 0;
+static std::vector<float> sink_values;
+
+static void source_declare(NodeDeclarationBuilder& b)
+{
+    b.add_output<decl::Float>("Out");
+}
+
+static void scale_declare(NodeDeclarationBuilder& b)
+{
+    b.add_input<decl::Float>("In");
+    b.add_input<decl::Float>("Factor").default_val(1.0f);
+    b.add_output<decl::Float>("Out");
+}
+
+static void sink_declare(NodeDeclarationBuilder& b)
+{
+    b.add_input<decl::Float>("In");
+}
+
+static void source_exec(ExeParams params)
+{
+    source_runs++;
+    params.set_output("Out", 3.0f);
+}
+
+static void scale_exec(ExeParams params)
+{
+    scale_runs++;
+    params.set_output("Out", params.get_input<float>("In") * params.get_input<float>("Factor"));
+}
+
+static void sink_exec(ExeParams params)
+{
+    sink_values.push_back(params.get_input<float>("In"));
+}
+
+static void accumulate_declare(NodeDeclarationBuilder& b)
+{
+    b.add_input<decl::Float>("In");
+    b.add_input<decl::Float>("Step").default_val(1.0f);
+    b.add_input<decl::Float>("Time");
+    b.add_output<decl::Float>("Out");
+}
+
+// Adds the step to what it stored the frame before, or starts over at the first frame.
+static void accumulate_exec(ExeParams params)
+{
+    float step = params.get_input<float>("Step");
+    if (params.get_input<float>("Time") == 0) {
+        params.set_output("Out", step);
+    }
+    else {
+        params.set_output("Out", params.get_input<float>("In") + step);
+    }
+}
+
+static void register_types()
+{
+    register_test_types({ { "test_wedge_source", source_declare, source_exec },
+                          { "test_wedge_scale", scale_declare, scale_exec },
+                          { "test_wedge_sink",
+                            sink_declare,
+                            sink_exec,
+                            [](NodeTypeInfo& type) { type.ALWAYS_REQUIRED = true; } },
+                          { "test_wedge_accumulate", accumulate_declare, accumulate_exec } });
+}
+
+TEST(NodeExecWedge, SharedPrefixRunsOnce)
+{
+    register_types();
+
+    NodeTree tree;
+    Node* source = tree.nodeAddNode("test_wedge_source");
+    Node* scale = tree.nodeAddNode("test_wedge_scale");
+    Node* sink = tree.nodeAddNode("test_wedge_sink");
+    tree.nodeAddLink(source, source->outputs[0], scale, scale->inputs[0]);
+    tree.nodeAddLink(scale, scale->outputs[0], sink, sink->inputs[0]);
+
+    NodeSocket* factor = scale->inputs[1];
+    std::vector<WedgeVariant> variants = {
+        { "double", { { factor, 2.0f } } },
+        { "triple", { { factor, 3 } } },
+        { "double again", { { factor, 2.0f } } },
+        // The sink's input is linked, so overriding it changes nothing.
+        { "linked", { { factor, 2.0f }, { sink->inputs[0], 9.0f } } },
+    };
+
+    auto executor = std::make_unique<EagerNodeTreeExecutor>();
+    source_runs = scale_runs = 0;
+    sink_values.clear();
+
+    auto results = execute_wedge(executor.get(), &tree, variants);
+    ASSERT_EQ(results.size(), 4);
+    EXPECT_EQ(results[0].same_as, 0);
+    EXPECT_EQ(results[1].same_as, 1);
+    EXPECT_EQ(results[2].same_as, 0);
+    EXPECT_EQ(results[3].same_as, 0);
+
+    EXPECT_EQ(source_runs, 1);
+    EXPECT_EQ(scale_runs, 2);
+    EXPECT_EQ(sink_values, (std::vector<float>{ 6.0f, 9.0f }));
+
+    // The tree keeps its own value.
+    EXPECT_EQ(*static_cast<float*>(default_value_storage(factor)), 1.0f);
+}
+
+// Runs the frames one after the other, as graph_runner does, and gives what the sink got.
+static std::vector<float>
+run_frames(NodeTreeExecutor* executor, NodeTree* tree, int first_frame, int last_frame)
+{
+    sink_values.clear();
+    for (int frame = first_frame; frame <= last_frame; ++frame) {
+        executor->prepare_tree(tree);
+        sync_time_code(executor, tree, float(frame));
+        executor->execute_tree(tree);
+        executor->finalize(tree);
+    }
+    return sink_values;
+}
+
+TEST(NodeExecWedge, VariantsKeepTheirOwnStorage)
+{
+    register_types();
+
+    // Each frame adds the step to what the frame before stored.
+    NodeTree tree;
+    Node* time = tree.nodeAddNode("geom_time_code");
+    Node* storage_out = tree.nodeAddNode("geom_storage_out");
+    Node* accumulate = tree.nodeAddNode("test_wedge_accumulate");
+    Node* storage_in = tree.nodeAddNode("geom_storage_in");
+    Node* sink = tree.nodeAddNode("test_wedge_sink");
+    tree.nodeAddLink(storage_out, storage_out->outputs[0], accumulate, accumulate->inputs[0]);
+    tree.nodeAddLink(time, time->outputs[0], accumulate, accumulate->inputs[2]);
+    tree.nodeAddLink(accumulate, accumulate->outputs[0], storage_in, storage_in->inputs[1]);
+    tree.nodeAddLink(accumulate, accumulate->outputs[0], sink, sink->inputs[0]);
+
+    NodeSocket* step = accumulate->inputs[1];
+    std::vector<WedgeVariant> variants = {
+        { "one", { { step, 1.0f } } },
+        { "two", { { step, 2.0f } } },
+        { "one again", { { step, 1.0f } } },
+    };
+    const int last_frame = 2;
+
+    // Each variant on its own, from a fresh executor.
+    std::vector<std::vector<float>> standalone;
+    for (auto&& variant : variants) {
+        float value = std::get<float>(variant.overrides[0].value);
+        *static_cast<float*>(default_value_storage(step)) = value;
+        auto executor = std::make_unique<EagerNodeTreeExecutorSimulation>();
+        standalone.push_back(run_frames(executor.get(), &tree, 0, last_frame));
+    }
+    *static_cast<float*>(default_value_storage(step)) = 1.0f;
+    EXPECT_EQ(standalone[1], (std::vector<float>{ 2.0f, 4.0f, 6.0f }));
+
+    // The executor has a storage of its own to go on from afterwards.
+    auto executor = std::make_unique<EagerNodeTreeExecutorSimulation>();
+    run_frames(executor.get(), &tree, 0, 0);
+
+    WedgeState state;
+    std::vector<std::vector<float>> wedged(variants.size());
+    for (int frame = 0; frame <= last_frame; ++frame) {
+        sink_values.clear();
+        auto results = execute_wedge(
+            executor.get(),
+            &tree,
+            variants,
+            [&](size_t) { sync_time_code(executor.get(), &tree, float(frame)); },
+            [&](size_t i) { wedged[i].push_back(sink_values.back()); },
+            &state);
+
+        // A variant skipped for an equal one would miss a step of its own.
+        ASSERT_EQ(results.size(), variants.size());
+        for (size_t i = 0; i < results.size(); ++i) {
+            EXPECT_EQ(results[i].same_as, i);
+            EXPECT_FALSE(results[i].failed);
+        }
+    }
+    EXPECT_EQ(wedged, standalone);
+
+    EXPECT_EQ(run_frames(executor.get(), &tree, 1, 1), (std::vector<float>{ 2.0f }));
+}
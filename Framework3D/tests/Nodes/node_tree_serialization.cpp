@@ -0,0 +1,115 @@
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <stdexcept>
+
+#include "Nodes/node.hpp"
+#include "Nodes/node_declare.hpp"
+#include "Nodes/node_register.h"
+#include "Nodes/node_tree.hpp"
+#include "Nodes/pin.hpp"
+#include "test_node_types.hpp"
+
+using namespace USTC_CG;
+
+static void source_declare(NodeDeclarationBuilder& b)
+{
+    b.add_output<decl::Float>("Out");
+}
+
+static void sink_declare(NodeDeclarationBuilder& b)
+{
+    b.add_input<decl::Float>("In");
+    b.add_input<decl::Int>("Count").default_val(1);
+    b.add_input<decl::Float>("Scale").default_val(1.0f);
+}
+
+static void register_types()
+{
+    register_test_types({ { "test_serialization_source", source_declare },
+                          { "test_serialization_sink", sink_declare } });
+}
+
+static void build_tree(NodeTree& tree)
+{
+    Node* source = tree.nodeAddNode("test_serialization_source");
+    Node* sink = tree.nodeAddNode("test_serialization_sink");
+    tree.nodeAddLink(source, source->outputs[0], sink, sink->inputs[0]);
+    *static_cast<int*>(default_value_storage(sink->inputs[1])) = 7;
+    *static_cast<float*>(default_value_storage(sink->inputs[2])) = 0.25f;
+}
+
+static void expect_same_tree(NodeTree& loaded)
+{
+    ASSERT_EQ(loaded.nodes.size(), 2);
+    ASSERT_EQ(loaded.links.size(), 1);
+
+    Node* sink = loaded.nodes[1].get();
+    EXPECT_STREQ(sink->typeinfo->id_name, "test_serialization_sink");
+    EXPECT_EQ(loaded.links[0]->tosock, sink->inputs[0]);
+    EXPECT_EQ(loaded.links[0]->fromsock, loaded.nodes[0]->outputs[0]);
+    EXPECT_EQ(*static_cast<int*>(default_value_storage(sink->inputs[1])), 7);
+    EXPECT_EQ(*static_cast<float*>(default_value_storage(sink->inputs[2])), 0.25f);
+}
+
+TEST(NodeTreeSerialization, JsonRoundTrip)
+{
+    register_types();
+
+    NodeTree tree;
+    build_tree(tree);
+    auto json = tree.Serialize();
+    EXPECT_FALSE(NodeTree::IsBinary(json));
+
+    // The editor appends its view settings to the same file.
+    json.pop_back();
+    json += ",\"nodes\":{\"node:1\":{\"location\":{\"x\":0,\"y\":0}}}}";
+
+    NodeTree loaded;
+    loaded.Deserialize(json);
+    expect_same_tree(loaded);
+}
+
+TEST(NodeTreeSerialization, BinaryRoundTrip)
+{
+    register_types();
+
+    NodeTree tree;
+    build_tree(tree);
+    auto binary = tree.SerializeBinary();
+    EXPECT_TRUE(NodeTree::IsBinary(binary));
+
+    NodeTree loaded;
+    loaded.DeserializeBinary(binary);
+    expect_same_tree(loaded);
+
+    NodeTree truncated;
+    EXPECT_THROW(
+        truncated.DeserializeBinary(std::string_view(binary).substr(0, binary.size() / 2)),
+        std::runtime_error);
+}
+
+// A count larger than its section could hold is rejected before anything is allocated for it.
+TEST(NodeTreeSerialization, BinaryCorruptedCount)
+{
+    register_types();
+
+    NodeTree tree;
+    build_tree(tree);
+    const auto binary = tree.SerializeBinary();
+
+    // Magic and version, then each section's tag and length, and the count it starts with.
+    const size_t sockets_count = 8 + 4 + 8;
+    uint64_t sockets_length;
+    memcpy(&sockets_length, binary.data() + sockets_count - 8, sizeof(sockets_length));
+    const size_t nodes_count = sockets_count + sockets_length + 4 + 8;
+
+    for (size_t offset : { sockets_count, nodes_count }) {
+        auto corrupted = binary;
+        const uint32_t count = 0xffffffff;
+        memcpy(corrupted.data() + offset, &count, sizeof(count));
+
+        NodeTree loaded;
+        EXPECT_THROW(loaded.DeserializeBinary(corrupted), std::runtime_error);
+    }
+}
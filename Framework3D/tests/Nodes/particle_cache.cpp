@@ -0,0 +1,83 @@
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <random>
+
+#include "nodes/nodes/geometry/particle_cache/particle_cache.h"
+
+using namespace USTC_CG::node_particle_cache;
+
+static std::string cache_path(const std::string& name)
+{
+    auto directory = std::filesystem::temp_directory_path() / "particle_cache_test";
+    std::filesystem::create_directories(directory);
+    return (directory / name).string();
+}
+
+TEST(ParticleCache, RoundTrip)
+{
+    std::mt19937 random(0);
+    std::uniform_real_distribution<float> uniform(-1, 1);
+    ParticleFrame frame;
+    for (int i = 0; i < 10000; ++i) {
+        frame.positions.emplace_back(uniform(random), 2 * uniform(random), 0.5f);
+        frame.velocities.emplace_back(uniform(random), 0, -3 * uniform(random));
+        frame.densities.push_back(1000 + 10 * uniform(random));
+    }
+
+    std::vector<std::string> paths;
+    {
+        ParticleCacheWriter writer(2);
+        for (int f = 0; f < 5; ++f) {
+            paths.push_back(cache_path("frame_" + std::to_string(f) + ".pcache"));
+            writer.write(paths.back(), frame);
+        }
+        writer.flush();
+        EXPECT_EQ(writer.take_failures(), 0);
+    }
+
+    ParticleCacheFile file;
+    for (auto& path : paths) {
+        ASSERT_TRUE(file.open(path));
+        EXPECT_EQ(std::filesystem::file_size(path), 64 + 10000 * 14);
+    }
+    EXPECT_EQ(file.size(), 10000);
+    EXPECT_TRUE(file.has_velocities());
+    EXPECT_TRUE(file.has_densities());
+
+    ParticleFrame read;
+    file.read(read);
+    ASSERT_EQ(read.positions.size(), 10000);
+    const Eigen::Vector3f extent = file.box_max() - file.box_min();
+    for (int i = 0; i < 10000; ++i) {
+        auto error = (read.positions[i] - frame.positions[i]).cwiseAbs();
+        EXPECT_TRUE((error.array() <= extent.array() / 65535 + 1e-6f).all());
+        EXPECT_EQ(file.position(i), read.positions[i]);
+        EXPECT_LT((read.velocities[i] - frame.velocities[i]).cwiseAbs().maxCoeff(), 3.f / 32767);
+        EXPECT_LT(std::abs(read.densities[i] - frame.densities[i]), 20.f / 65535 + 1e-3f);
+    }
+}
+
+// Without the optional channels, only the positions are stored. A frame that isn't complete
+// doesn't open.
+TEST(ParticleCache, PositionsOnly)
+{
+    ParticleFrame frame;
+    frame.positions = { { 0, 0, 0 }, { 1, 2, 3 }, { 1, 2, 3 } };
+    auto path = cache_path("positions.pcache");
+    ASSERT_TRUE(write_particle_frame(path, frame));
+
+    ParticleCacheFile file;
+    ASSERT_TRUE(file.open(path));
+    EXPECT_FALSE(file.has_velocities());
+    EXPECT_FALSE(file.has_densities());
+    ParticleFrame read;
+    file.read(read);
+    EXPECT_EQ(read.positions, frame.positions);
+    EXPECT_TRUE(read.velocities.empty());
+    file.close();
+
+    std::filesystem::resize_file(path, std::filesystem::file_size(path) - 2);
+    EXPECT_FALSE(file.open(path));
+    EXPECT_FALSE(file.open(cache_path("missing.pcache")));
+}
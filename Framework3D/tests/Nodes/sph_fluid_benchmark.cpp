@@ -0,0 +1,102 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+
+#include "nodes/nodes/geometry/sph_fluid/iisph.h"
+#include "nodes/nodes/geometry/sph_fluid/sph_kernel.h"
+#include "nodes/nodes/geometry/sph_fluid/wcsph.h"
+#include "pxr/base/work/threadLimits.h"
+
+using namespace USTC_CG::node_sph_fluid;
+
+TEST(SPHFluid, BatchedKernelMatchesReference)
+{
+    const double h = 0.1;
+    const CubicKernel kernel(h);
+
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<double> coordinate(-1.2 * h, 1.2 * h);
+    for (int round = 0; round < 100; ++round) {
+        Batch dx, dy, dz;
+        for (int l = 0; l < kBatchSize; ++l) {
+            dx[l] = coordinate(rng);
+            dy[l] = coordinate(rng);
+            dz[l] = coordinate(rng);
+        }
+        const Batch r2 = dx * dx + dy * dy + dz * dz;
+        const Batch W = kernel.W(r2);
+        const Batch grad_factor = kernel.grad_factor(r2);
+
+        for (int l = 0; l < kBatchSize; ++l) {
+            const Vector3d r(dx[l], dy[l], dz[l]);
+            const double W_reference = SPHBase::W(r, h);
+            const Vector3d grad_reference = SPHBase::grad_W(r, h);
+            EXPECT_NEAR(W[l], W_reference, 1e-6 * kernel.W_zero());
+            EXPECT_NEAR(
+                (grad_factor[l] * r - grad_reference).norm(), 0.0, 1e-6 * kernel.W_zero() / h);
+        }
+    }
+}
+
+// A column settling at twice the largest step WCSPH takes calmly.
+TEST(SPHFluid, IISPHConverges)
+{
+    const MatrixXd X = ParticleSystem::sample_particle_pos_in_a_box(
+        Vector3d(0.05, 0.05, 0.05), Vector3d(0.45, 0.45, 0.85), Vector3i(8, 8, 16));
+    IISPH sph(X, Vector3d(0, 0, 0), Vector3d(0.5, 0.5, 1.0));
+    sph.dt() = 0.01;
+    sph.max_iter() = 50;
+
+    for (int i = 0; i < 100; ++i) {
+        sph.step();
+    }
+
+    EXPECT_FALSE(sph.getX().hasNaN());
+    EXPECT_LT(sph.getVel().rowwise().norm().maxCoeff(), 3.0);
+    EXPECT_LT(sph.last_iterations(), sph.max_iter());
+    EXPECT_LT(std::abs(sph.last_density_error()), sph.max_density_error());
+}
+
+// Particle updates per second of a WCSPH dam break, for thread counts up to what the machine has.
+TEST(SPHFluid, Benchmark)
+{
+    // A column of particles one diameter apart.
+    const Vector3d box_min(0, 0, 0), box_max(1, 1, 1.5);
+    const MatrixXd X = ParticleSystem::sample_particle_pos_in_a_box(
+        Vector3d(0.05, 0.05, 0.05), Vector3d(0.85, 0.85, 1.25), Vector3i(16, 16, 24));
+    constexpr int kSteps = 20;
+
+    const unsigned max_threads = pxr::WorkGetPhysicalConcurrencyLimit();
+    std::vector<unsigned> thread_counts;
+    for (unsigned threads = 1; threads < max_threads; threads *= 2) {
+        thread_counts.push_back(threads);
+    }
+    thread_counts.push_back(max_threads);
+
+    std::cout << "SPH kernels built for " << simd_instruction_set() << std::endl;
+    for (unsigned threads : thread_counts) {
+        pxr::WorkSetConcurrencyLimit(threads);
+
+        WCSPH sph(X, box_min, box_max);
+        sph.dt() = 0.002;
+        sph.step();  // Warm up.
+
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < kSteps; ++i) {
+            sph.step();
+        }
+        auto end = std::chrono::steady_clock::now();
+
+        EXPECT_FALSE(sph.getX().hasNaN());
+
+        double seconds = std::chrono::duration<double>(end - start).count();
+        std::cout << threads << " threads: " << X.rows() << " particles, "
+                  << seconds / kSteps * 1000.0 << " ms per step, "
+                  << X.rows() * kSteps / seconds / 1e6 << " M particle updates/s" << std::endl;
+    }
+    pxr::WorkSetMaximumConcurrencyLimit();
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <cstring>
+#include <functional>
+#include <initializer_list>
+#include <mutex>
+
+#include "Nodes/node.hpp"
+#include "Nodes/node_declare.hpp"
+#include "Nodes/node_register.h"
+#include "Nodes/socket_types/basic_socket_types.hpp"
+
+USTC_CG_NAMESPACE_OPEN_SCOPE
+
+// A function node type made up by a test. configure sets whatever else it needs, such as its
+// flags or demand_inputs.
+struct TestNodeType {
+    const char* id_name;
+    NodeDeclareFunction declare;
+    ExecFunction execute = nullptr;
+    std::function<void(NodeTypeInfo&)> configure = {};
+};
+
+// Registers the built-in node types and the test's own, once per test program however many tests
+// ask for them. The types stay registered until the program exits.
+inline void register_test_types(std::initializer_list<TestNodeType> types)
+{
+    static std::once_flag flag;
+    std::call_once(flag, [types] {
+        register_all();
+        for (auto&& type : types) {
+            auto info = new NodeTypeInfo();
+            strncpy(info->id_name, type.id_name, sizeof(info->id_name) - 1);
+            strncpy(info->ui_name, type.id_name, sizeof(info->ui_name) - 1);
+            info->node_type_of_grpah = NodeTypeOfGrpah::Function;
+            info->declare = type.declare;
+            info->node_execute = type.execute;
+            if (type.configure) {
+                type.configure(*info);
+            }
+            nodeRegisterType(info);
+        }
+    });
+}
+
+USTC_CG_NAMESPACE_CLOSE_SCOPE